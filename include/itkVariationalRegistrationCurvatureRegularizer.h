@@ -19,12 +19,12 @@
 #define itkVariationalRegistrationCurvatureRegularizer_h
 
 #include "itkVariationalRegistrationRegularizer.h"
+#include "itkVariationalRegistrationFFTUtilities.h"
 #include "itkMultiThreaderBase.h"
 
-#if defined(ITK_USE_FFTWD) || defined(ITK_USE_FFTWF)
-
-// other includes:
-#  include "itkFFTWCommon.h"
+#include <algorithm>
+#include <string>
+#include <vector>
 
 namespace itk
 {
@@ -47,6 +47,28 @@ namespace itk
  *  Please note that for given weight \f$\alpha'\f$ you have to set
  *  \f$\alpha=\tau\alpha'\f$ (see Eq.(2) in VariationalRegistrationFilter).
  *
+ *  The DCTs are computed by an exchangeable FFT backend (see SetFFTBackend()). By
+ *  default, FFTW is used if ITK is built with FFTW, otherwise the bundled
+ *  VariationalRegistrationMixedRadixFFTBackend, so this class is always available.
+ *
+ *  The FFTs are computed with the precision TRealTypeFFT (float or double). By
+ *  default, double precision is used (see
+ *  VariationalRegistrationFFTUtilities::DefaultRealType). For fields with float
+ *  values, float halves the memory of the buffers, but the results differ
+ *  slightly from the double precision results.
+ *
+ *  With UsePadding on, the DCT buffers are padded to sizes with small prime factors
+ *  (see VariationalRegistrationFFTUtilities::GetSmoothSize()).
+ *
+ *  With UseIncrementalUpdate on, the DCT of the regularized field and the field
+ *  itself are kept, so each call only transforms the increment of the input to
+ *  the last output, which is regularized as well before it is added to the kept
+ *  DCT (see RegularizeIncrement). Both need as much memory as the field. An
+ *  unregularized increment is transformed separately, which needs one more
+ *  forward DCT and the memory of one component. With UsePadding, the padding of
+ *  the kept field is not replaced by the boundary pixels of the input, so the
+ *  result differs slightly from the direct computation near the boundary.
+ *
  *  \sa VariationalRegistrationFilter
  *  \sa VariationalRegistrationRegularizer
  *
@@ -59,7 +81,9 @@ namespace itk
  *  \author Rene Werner
  *  \author Jan Ehrhardt
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField,
+          typename TRealTypeFFT = typename VariationalRegistrationFFTUtilities::DefaultRealType<
+            typename NumericTraits<typename TDisplacementField::PixelType>::ValueType>::Type>
 class VariationalRegistrationCurvatureRegularizer : public VariationalRegistrationRegularizer<TDisplacementField>
 {
 public:
@@ -88,20 +112,9 @@ public:
   using ValueType = typename Superclass::ValueType;
   typedef typename DisplacementFieldType::SizeType::SizeValueType OffsetValueType;
 
-  /** Types for FFTW proxy */
-
-#  if defined(ITK_USE_FFTWD)
-  // Prefer to use double precision
-  using RealTypeFFT = double;
-#  else
-#    if defined(ITK_USE_FFTWF)
-// Allow to use single precision
-#      warning "Using single precision for FFT computations!"
-  using RealTypeFFT = float;
-#    endif
-#  endif
-
-  using FFTWProxyType = typename fftw::Proxy<RealTypeFFT>;
+  /** Types of the FFT */
+  using RealTypeFFT = TRealTypeFFT;
+  using FFTBackendType = VariationalRegistrationFFTBackend<RealTypeFFT, ImageDimension>;
 
   /** Set the regularization weight alpha */
   itkSetMacro(Alpha, ValueType);
@@ -109,6 +122,76 @@ public:
   /** Get the regularization weight alpha */
   itkGetConstMacro(Alpha, ValueType);
 
+  /** Set/Get the FFT backend. The plans are created again if the backend or
+   * the number of work units changes. A backend must not be shared by
+   * regularizers that run concurrently. Default is
+   * VariationalRegistrationFFTUtilities::CreateDefaultBackend(). Unless
+   * UsePadding was set explicitly, it is set to the default of the backend
+   * (see FFTBackendType::GetDefaultUsePadding()). */
+  virtual void
+  SetFFTBackend(FFTBackendType * backend)
+  {
+    if (this->m_FFTBackend != backend)
+    {
+      this->m_FFTBackend = backend;
+      if (!this->m_UsePaddingIsSet && backend != nullptr)
+      {
+        this->m_UsePadding = backend->GetDefaultUsePadding();
+      }
+      this->Modified();
+    }
+  }
+  itkGetModifiableObjectMacro(FFTBackend, FFTBackendType);
+
+  /** Set/Get the planner flag of the FFT backend: FFTBackendType::PlanEstimate,
+   * PlanMeasure or PlanPatient (the flags FFTW_ESTIMATE, FFTW_MEASURE or
+   * FFTW_PATIENT of FFTW). It is used when the plans are created, i.e. when
+   * the size of the field changes. Default is PlanMeasure. */
+  itkSetMacro(PlanRigor, unsigned int);
+  itkGetConstMacro(PlanRigor, unsigned int);
+
+  /** Set/Get the wisdom file of the FFT backend (used by FFTW). If set, the
+   * wisdom is imported from the file before the plans are created for the
+   * first time and exported to the file after each planning, so plans for
+   * sizes measured in an earlier run are created at once. Default is empty
+   * (no wisdom file). */
+  itkSetStringMacro(WisdomFileName);
+  itkGetStringMacro(WisdomFileName);
+
+  /** Set/Get if the FFT buffers are padded to sizes whose prime factors are
+   * 2, 3, 5 and 7 only. The field is extended by replicating its boundary
+   * pixels and the result is cropped after the inverse transform, so the
+   * time of the FFT no longer depends on the prime factors of the field size.
+   * The padding changes the result slightly near the boundary. Default is
+   * the default of the FFT backend, i.e. off for FFTW and on for the bundled
+   * mixed radix backend (see FFTBackendType::GetDefaultUsePadding()). */
+  virtual void
+  SetUsePadding(bool usePadding)
+  {
+    this->m_UsePaddingIsSet = true;
+    if (this->m_UsePadding != usePadding)
+    {
+      this->m_UsePadding = usePadding;
+      this->Modified();
+    }
+  }
+  itkGetConstMacro(UsePadding, bool);
+  itkBooleanMacro(UsePadding);
+
+  /** The curvature regularizer supports UseIncrementalUpdate. */
+  bool
+  SupportsIncrementalUpdate() const override
+  {
+    return true;
+  }
+
+  /** Discard the kept DCT of the field. */
+  void
+  ResetIncrementalUpdate() override
+  {
+    m_FieldSpectrumIsValid = false;
+  }
+
 protected:
   VariationalRegistrationCurvatureRegularizer();
   ~VariationalRegistrationCurvatureRegularizer() override;
@@ -127,7 +210,7 @@ protected:
   void
   Initialize() override;
 
-  /** Initialize FFTW plans and multi-threading, allocate arrays for FFT */
+  /** Initialize FFT plans and multi-threading, allocate arrays for FFT */
   virtual bool
   InitializeCurvatureFFTPlans();
 
@@ -155,13 +238,35 @@ private:
   /** Weight of the regularization term. */
   ValueType m_Alpha;
 
+  /** FFT backend and the backend the plans were created with. */
+  typename FFTBackendType::Pointer m_FFTBackend;
+  const FFTBackendType *           m_PlannedFFTBackend;
+
+  /** Number of work units the plans were created for. */
+  unsigned int m_PlannedNumberOfWorkUnits;
+
+  /** Planner flag of the FFT backend. */
+  unsigned int m_PlanRigor;
+
+  /** Wisdom file of the FFT backend. */
+  std::string m_WisdomFileName;
+
+  /** Pad the FFT buffers to smooth sizes. */
+  bool m_UsePadding;
+
+  /** UsePadding was set explicitly and is kept if the backend changes. */
+  bool m_UsePaddingIsSet;
+
   /** The spacing of the displacement field. */
   typename DisplacementFieldType::SpacingType m_Spacing;
 
   /** The size of the displacement field. */
+  typename DisplacementFieldType::SizeType m_FieldSize;
+
+  /** The size of the FFT buffers; the field size or the padded size. */
   typename DisplacementFieldType::SizeType m_Size;
 
-  /** Number of pixels of the displacement field. */
+  /** Number of pixels of the FFT buffers. */
   OffsetValueType m_TotalSize;
 
   /** offset table needed to compute image index from array index */
@@ -170,13 +275,26 @@ private:
   /** diagonal matrix for solving LES after FFT */
   RealTypeFFT * m_DiagonalMatrix[ImageDimension];
 
-  /** FFT plans and buffers */
-  typename FFTWProxyType::PlanType m_PlanForward;  /** FFT forward plan  */
-  typename FFTWProxyType::PlanType m_PlanBackward; /** FFT backward plan */
-  typename FFTWProxyType::PixelType *
-    m_VectorFieldComponentBuffer; /** FFT memory space for input/output spatial data */
-  typename FFTWProxyType::PixelType *
-    m_DCTVectorFieldComponentBuffer; /** FFT memory space for output/input frequency data */
+  /** FFT buffers */
+  std::vector<RealTypeFFT> m_VectorFieldComponentBuffer;    /** FFT memory space for input/output spatial data */
+  std::vector<RealTypeFFT> m_DCTVectorFieldComponentBuffer; /** FFT memory space for output/input frequency data */
+
+  /** DCT of the last regularized field and the field itself (scaled like
+   * the output of the backward DCT) for UseIncrementalUpdate; the components
+   * are stored one after another. */
+  std::vector<RealTypeFFT> m_FieldSpectrum;
+  std::vector<RealTypeFFT> m_LastField;
+  bool                     m_FieldSpectrumIsValid;
+
+  /** Whether the current call adds the regularized DCT of the increment to
+   * the kept DCT. */
+  bool m_AddFieldSpectrum;
+
+  /** DCT of the increment of the current component if the unregularized
+   * increment is transformed separately (see
+   * VariationalRegistrationRegularizer::SetUnregularizedIncrement()). */
+  std::vector<RealTypeFFT> m_IncrementSpectrum;
+  bool                     m_SplitIncrement;
 
   struct CurvatureFFTThreadStruct
   {
@@ -191,9 +309,8 @@ private:
 
 } // namespace itk
 
-#  ifndef ITK_MANUAL_INSTANTIATION
-#    include "itkVariationalRegistrationCurvatureRegularizer.hxx"
-#  endif
-
+#ifndef ITK_MANUAL_INSTANTIATION
+#  include "itkVariationalRegistrationCurvatureRegularizer.hxx"
 #endif
+
 #endif
@@ -18,13 +18,12 @@
 #ifndef itkVariationalRegistrationCurvatureRegularizer_hxx
 #define itkVariationalRegistrationCurvatureRegularizer_hxx
 
-#if defined(ITK_USE_FFTWD) || defined(ITK_USE_FFTWF)
+#include "itkVariationalRegistrationCurvatureRegularizer.h"
 
-#  include "itkVariationalRegistrationCurvatureRegularizer.h"
-
-#  include "itkImageRegionConstIterator.h"
-#  include "itkImageRegionConstIteratorWithIndex.h"
-#  include "itkNeighborhoodAlgorithm.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageScanlineIterator.h"
+#include "itkNeighborhoodAlgorithm.h"
 
 namespace itk
 {
@@ -32,11 +31,13 @@ namespace itk
 /**
  * Default constructor
  */
-template <typename TDisplacementField>
-VariationalRegistrationCurvatureRegularizer<TDisplacementField>::VariationalRegistrationCurvatureRegularizer()
+template <typename TDisplacementField, typename TRealTypeFFT>
+VariationalRegistrationCurvatureRegularizer<TDisplacementField,
+                                            TRealTypeFFT>::VariationalRegistrationCurvatureRegularizer()
 {
   for (unsigned int i = 0; i < ImageDimension; ++i)
   {
+    m_FieldSize[i] = 0;
     m_Size[i] = 0;
     m_Spacing[i] = 1.0;
     m_OffsetTable[i] = 0;
@@ -46,36 +47,29 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::VariationalRegi
   // Initialize regularization weights
   m_Alpha = 1.0;
 
+  m_FFTBackend = VariationalRegistrationFFTUtilities::CreateDefaultBackend<RealTypeFFT, ImageDimension>();
+  m_PlannedFFTBackend = nullptr;
+  m_PlannedNumberOfWorkUnits = 0;
+  m_PlanRigor = FFTBackendType::PlanMeasure;
+  m_UsePadding = m_FFTBackend->GetDefaultUsePadding();
+  m_UsePaddingIsSet = false;
+  m_FieldSpectrumIsValid = false;
+  m_AddFieldSpectrum = false;
+  m_SplitIncrement = false;
+
   for (unsigned int i = 0; i < ImageDimension; ++i)
   {
     this->m_DiagonalMatrix[i] = nullptr;
   }
-
-  this->m_PlanForward = nullptr;
-  this->m_PlanBackward = nullptr;
-  this->m_VectorFieldComponentBuffer = nullptr;
-  this->m_DCTVectorFieldComponentBuffer = nullptr;
 }
 
 /**
  * Default destructor
  */
-template <typename TDisplacementField>
-VariationalRegistrationCurvatureRegularizer<TDisplacementField>::~VariationalRegistrationCurvatureRegularizer()
+template <typename TDisplacementField, typename TRealTypeFFT>
+VariationalRegistrationCurvatureRegularizer<TDisplacementField,
+                                            TRealTypeFFT>::~VariationalRegistrationCurvatureRegularizer()
 {
-  //
-  // Free old data, if already allocated
-  //
-  if (this->m_VectorFieldComponentBuffer != nullptr)
-    delete[] this->m_VectorFieldComponentBuffer;
-  if (this->m_DCTVectorFieldComponentBuffer != nullptr)
-    delete[] this->m_DCTVectorFieldComponentBuffer;
-
-  if (this->m_PlanForward != nullptr)
-    FFTWProxyType::DestroyPlan(this->m_PlanForward);
-  if (this->m_PlanBackward != nullptr)
-    FFTWProxyType::DestroyPlan(this->m_PlanBackward);
-
   //
   // Free old data, if already allocated
   //
@@ -89,9 +83,9 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::~VariationalReg
 /**
  * Generate data
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 void
-VariationalRegistrationCurvatureRegularizer<TDisplacementField>::GenerateData()
+VariationalRegistrationCurvatureRegularizer<TDisplacementField, TRealTypeFFT>::GenerateData()
 {
   // Allocate the output image
   this->AllocateOutputs();
@@ -106,19 +100,34 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::GenerateData()
 /*
  * Initialize flags
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 void
-VariationalRegistrationCurvatureRegularizer<TDisplacementField>::Initialize()
+VariationalRegistrationCurvatureRegularizer<TDisplacementField, TRealTypeFFT>::Initialize()
 {
   this->Superclass::Initialize();
   DisplacementFieldPointer DisplacementField = this->GetOutput();
 
+  if (this->m_FFTBackend.IsNull())
+  {
+    itkExceptionMacro(<< "FFT backend is not set!");
+  }
+
   this->m_Spacing = DisplacementField->GetSpacing();
 
-  typename DisplacementFieldType::SizeType size = DisplacementField->GetRequestedRegion().GetSize();
+  // The DCT size is the field size or, with padding, the next smooth size
+  this->m_FieldSize = DisplacementField->GetRequestedRegion().GetSize();
+  typename DisplacementFieldType::SizeType size = this->m_FieldSize;
+  if (this->m_UsePadding)
+  {
+    for (unsigned int i = 0; i < ImageDimension; ++i)
+    {
+      size[i] = VariationalRegistrationFFTUtilities::GetSmoothSize(size[i]);
+    }
+  }
 
   // Only reinitialize FFT plans if size has changed since last Initialize()
-  if (size != this->m_Size)
+  const bool sizeChanged = (size != this->m_Size);
+  if (sizeChanged)
   {
     // Set new image size and complex buffer size including total sizes.
     // According to the FFTW manual, the complex buffer has the size
@@ -135,12 +144,21 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::Initialize()
       this->m_TotalSize *= this->m_Size[j];
     }
 
-    // initialize matrix and FFTW plans
+    // initialize matrix
     if (!InitializeCurvatureDiagonalMatrix())
     {
       itkExceptionMacro(<< "Initializing Curvature Matrix failed!");
       return;
     }
+  }
+
+  // The FFT plans are created again if the size, the backend or the number
+  // of work units has changed
+  if (sizeChanged || this->m_FFTBackend.GetPointer() != this->m_PlannedFFTBackend ||
+      this->GetNumberOfWorkUnits() != this->m_PlannedNumberOfWorkUnits)
+  {
+    // The kept DCT belongs to the old size
+    this->m_FieldSpectrumIsValid = false;
 
     if (!InitializeCurvatureFFTPlans())
     {
@@ -153,76 +171,32 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::Initialize()
 /**
  * Initialize FFT plans
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 bool
-VariationalRegistrationCurvatureRegularizer<TDisplacementField>::InitializeCurvatureFFTPlans()
+VariationalRegistrationCurvatureRegularizer<TDisplacementField, TRealTypeFFT>::InitializeCurvatureFFTPlans()
 {
   itkDebugMacro(<< "Initializing curvature plans for FFT...");
 
-  //
-  // Free old data, if already allocated
-  //
-  if (this->m_VectorFieldComponentBuffer != nullptr)
-    delete[] this->m_VectorFieldComponentBuffer;
-  if (this->m_DCTVectorFieldComponentBuffer != nullptr)
-    delete[] this->m_DCTVectorFieldComponentBuffer;
-
-  if (this->m_PlanForward != nullptr)
-    FFTWProxyType::DestroyPlan(this->m_PlanForward);
-  if (this->m_PlanBackward != nullptr)
-    FFTWProxyType::DestroyPlan(this->m_PlanBackward);
-
   // Allocate input and output buffers for DCT
-  this->m_VectorFieldComponentBuffer = new FFTWProxyType::PixelType[this->m_TotalSize];
-  this->m_DCTVectorFieldComponentBuffer = new FFTWProxyType::PixelType[this->m_TotalSize];
+  this->m_VectorFieldComponentBuffer.resize(this->m_TotalSize);
+  this->m_DCTVectorFieldComponentBuffer.resize(this->m_TotalSize);
 
-  //
-  // different methods for the DCT are available in FFTW
-  // (look here: https://www.fftw.org/doc/Real_002dto_002dReal-Transforms.html)
-  //
-  // We use the FFTW_REDFT01 and FFTW_REDFT10 transform (fast), unsure what the correct choice is
-  //
-
-  fftw_r2r_kind fftForwardKind[ImageDimension];
-  fftw_r2r_kind fftBackwardKind[ImageDimension];
-  int           size[ImageDimension];
-  for (unsigned int i = 0; i < ImageDimension; ++i)
-  {
-    fftForwardKind[i] = FFTW_REDFT01;
-    fftBackwardKind[i] = FFTW_REDFT10;
-    // Get image size in reverse order for FFTW
-    size[(ImageDimension - 1) - i] = this->m_Size[i];
-  }
-
-  // Create the plan for the FFT
+  // Create the plans for the DCT
   // We need only one plan forward and backward because we reuse the input and output buffers
-  // fftw_plan_r2r transforms are not available in FFTWProxyType, so we have to call FFTW functions
-  // directly
-
-  // first set multi-threading
-  fftw_plan_with_nthreads(this->GetNumberOfWorkUnits());
-
-  this->m_PlanForward = fftw_plan_r2r(ImageDimension,
-                                      size,
-                                      this->m_VectorFieldComponentBuffer,
-                                      this->m_DCTVectorFieldComponentBuffer,
-                                      fftForwardKind,
-                                      FFTW_MEASURE | FFTW_DESTROY_INPUT);
-  if (this->m_PlanForward == nullptr)
-  {
-    return false;
-  }
-
-  this->m_PlanBackward = fftw_plan_r2r(ImageDimension,
-                                       size,
-                                       this->m_DCTVectorFieldComponentBuffer,
-                                       this->m_VectorFieldComponentBuffer,
-                                       fftBackwardKind,
-                                       FFTW_MEASURE | FFTW_DESTROY_INPUT);
-  if (this->m_PlanBackward == nullptr)
+  // The plans use the work units of this instance; the backend serializes the planning with
+  // other instances.
+  this->m_FFTBackend->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+  this->m_FFTBackend->SetPlanRigor(this->m_PlanRigor);
+  this->m_FFTBackend->SetWisdomFileName(this->m_WisdomFileName);
+
+  this->m_PlannedFFTBackend = nullptr;
+  if (!this->m_FFTBackend->PlanCosine(
+        this->m_Size, this->m_VectorFieldComponentBuffer.data(), this->m_DCTVectorFieldComponentBuffer.data()))
   {
     return false;
   }
+  this->m_PlannedFFTBackend = this->m_FFTBackend.GetPointer();
+  this->m_PlannedNumberOfWorkUnits = this->GetNumberOfWorkUnits();
 
   return true;
 }
@@ -230,9 +204,9 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::InitializeCurva
 /**
  * Initialize elastic matrix
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 bool
-VariationalRegistrationCurvatureRegularizer<TDisplacementField>::InitializeCurvatureDiagonalMatrix()
+VariationalRegistrationCurvatureRegularizer<TDisplacementField, TRealTypeFFT>::InitializeCurvatureDiagonalMatrix()
 {
   itkDebugMacro(<< "Initializing curvature matrix for FFT...");
 
@@ -274,9 +248,9 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::InitializeCurva
 /**
  * Execute regularization
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 void
-VariationalRegistrationCurvatureRegularizer<TDisplacementField>::Regularize()
+VariationalRegistrationCurvatureRegularizer<TDisplacementField, TRealTypeFFT>::Regularize()
 {
   DisplacementFieldConstPointer inputField = this->GetInput();
 
@@ -286,8 +260,8 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::Regularize()
     return;
   }
 
-  using ConstIteratorType = ImageRegionConstIterator<DisplacementFieldType>;
-  ConstIteratorType inputIt(inputField, inputField->GetLargestPossibleRegion());
+  using ConstIteratorType = ImageScanlineConstIterator<DisplacementFieldType>;
+  ConstIteratorType inputIt(inputField, inputField->GetRequestedRegion());
 
   DisplacementFieldPointer outField = this->GetOutput();
   if (!outField)
@@ -296,7 +270,7 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::Regularize()
     return;
   }
 
-  using IteratorType = ImageRegionIterator<DisplacementFieldType>;
+  using IteratorType = ImageScanlineIterator<DisplacementFieldType>;
   IteratorType outIt(outField, outField->GetRequestedRegion());
 
   //
@@ -314,20 +288,85 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::Regularize()
     normalizationFactor *= 0.5;
   }
 
-  unsigned int n;
+  // With incremental update, only the increment of the input to the last
+  // output is transformed and the kept DCT is added in the LES. The
+  // unregularized increment is transformed separately, as it is not
+  // regularized with the rest of the increment.
+  const bool keepFieldSpectrum = this->GetUseIncrementalUpdate();
+  m_AddFieldSpectrum = keepFieldSpectrum && m_FieldSpectrumIsValid;
+  m_FieldSpectrumIsValid = false;
+  if (keepFieldSpectrum)
+  {
+    m_FieldSpectrum.resize(ImageDimension * m_TotalSize);
+    m_LastField.resize(ImageDimension * m_TotalSize);
+  }
+  const DisplacementFieldType * unregularizedField = this->GetUnregularizedIncrement();
+  m_SplitIncrement = m_AddFieldSpectrum && this->GetRegularizeIncrement() && unregularizedField != nullptr;
+  if (m_SplitIncrement)
+  {
+    m_IncrementSpectrum.resize(m_TotalSize);
+  }
+  const RealTypeFFT unregularizedScale = this->GetUnregularizedIncrementScale();
+
+  SizeValueType line; // Counter for field copying
   for (unsigned int dim = 0; dim < ImageDimension; ++dim)
   {
-    // Copy vector component into input buffer for FFT
-    for (n = 0, inputIt.GoToBegin(); !inputIt.IsAtEnd(); ++n, ++inputIt)
+    RealTypeFFT * lastField = keepFieldSpectrum ? m_LastField.data() + dim * m_TotalSize : nullptr;
+
+    // Copy vector component into input buffer for FFT. The field is stored
+    // at the origin of the (padded) buffer.
+    for (line = 0, inputIt.GoToBegin(); !inputIt.IsAtEnd(); ++line)
     {
-      m_VectorFieldComponentBuffer[n] = inputIt.Get()[dim];
+      OffsetValueType n = VariationalRegistrationFFTUtilities::GetLineOffset(line, m_FieldSize, m_Size);
+      while (!inputIt.IsAtEndOfLine())
+      {
+        m_VectorFieldComponentBuffer[n] = inputIt.Get()[dim];
+        if (m_AddFieldSpectrum)
+        {
+          m_VectorFieldComponentBuffer[n] -= lastField[n] * normalizationFactor;
+        }
+        ++inputIt;
+        ++n;
+      }
+      inputIt.NextLine();
+    }
+
+    // Extend the field into the padding of the buffer
+    if (m_Size != m_FieldSize)
+    {
+      VariationalRegistrationFFTUtilities::PadBuffer(m_VectorFieldComponentBuffer.data(), m_FieldSize, m_Size);
     }
 
     // Perform Forward FFT for input field
     itkDebugMacro(<< "Performing Forward FFT of dimension " << dim << "...");
 
     // Execute FFT for component
-    FFTWProxyType::Execute(this->m_PlanForward);
+    this->m_FFTBackend->ExecuteForwardCosine();
+
+    // Keep the DCT of the increment and transform the unregularized increment
+    if (m_SplitIncrement)
+    {
+      std::copy(
+        m_DCTVectorFieldComponentBuffer.begin(), m_DCTVectorFieldComponentBuffer.end(), m_IncrementSpectrum.begin());
+
+      ConstIteratorType unregularizedIt(unregularizedField, inputField->GetRequestedRegion());
+      for (line = 0; !unregularizedIt.IsAtEnd(); ++line)
+      {
+        OffsetValueType n = VariationalRegistrationFFTUtilities::GetLineOffset(line, m_FieldSize, m_Size);
+        while (!unregularizedIt.IsAtEndOfLine())
+        {
+          m_VectorFieldComponentBuffer[n] = unregularizedScale * unregularizedIt.Get()[dim];
+          ++unregularizedIt;
+          ++n;
+        }
+        unregularizedIt.NextLine();
+      }
+      if (m_Size != m_FieldSize)
+      {
+        VariationalRegistrationFFTUtilities::PadBuffer(m_VectorFieldComponentBuffer.data(), m_FieldSize, m_Size);
+      }
+      this->m_FFTBackend->ExecuteForwardCosine();
+    }
 
     // Solve the LES in Fourier domain
     itkDebugMacro(<< "Solving Curvature LES in frequency space (dimension " << dim << ")...");
@@ -336,26 +375,43 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::Regularize()
     // Perform Backward FFT for the result in the complex domain
     itkDebugMacro(<< "Performing Backward FFT of dimension " << dim << "...");
     //  Execute FFT for component
-    FFTWProxyType::Execute(this->m_PlanBackward);
+    this->m_FFTBackend->ExecuteBackwardCosine();
 
-    // Copy buffer from inverse DCT to component of field
-    for (n = 0, outIt.GoToBegin(); !outIt.IsAtEnd(); ++n, ++outIt)
+    // Keep the result for the increment of the next call
+    if (keepFieldSpectrum)
     {
-      PixelType vec = outIt.Get();
-      vec[dim] = m_VectorFieldComponentBuffer[n] * normalizationFactor;
-      outIt.Set(vec);
+      std::copy(m_VectorFieldComponentBuffer.begin(), m_VectorFieldComponentBuffer.end(), lastField);
+    }
+
+    // Copy buffer from inverse DCT to component of field; the padding is
+    // cropped
+    for (line = 0, outIt.GoToBegin(); !outIt.IsAtEnd(); ++line)
+    {
+      OffsetValueType n = VariationalRegistrationFFTUtilities::GetLineOffset(line, m_FieldSize, m_Size);
+      while (!outIt.IsAtEndOfLine())
+      {
+        PixelType vec = outIt.Get();
+        vec[dim] = m_VectorFieldComponentBuffer[n] * normalizationFactor;
+        outIt.Set(vec);
+        ++outIt;
+        ++n;
+      }
+      outIt.NextLine();
     }
   }
 
+  m_FieldSpectrumIsValid = keepFieldSpectrum;
+
   outField->Modified();
 }
 
 /**
  * Solve elastic LES
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 void
-VariationalRegistrationCurvatureRegularizer<TDisplacementField>::SolveCurvatureLES(unsigned int currentDimension)
+VariationalRegistrationCurvatureRegularizer<TDisplacementField, TRealTypeFFT>::SolveCurvatureLES(
+  unsigned int currentDimension)
 {
   // Declare thread data struct and set filter
   CurvatureFFTThreadStruct curvatureThreadParameters;
@@ -374,9 +430,10 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::SolveCurvatureL
 /**
  * Solve elastic LES
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 ITK_THREAD_RETURN_TYPE
-VariationalRegistrationCurvatureRegularizer<TDisplacementField>::SolveCurvatureLESThreaderCallback(void * arg)
+VariationalRegistrationCurvatureRegularizer<TDisplacementField, TRealTypeFFT>::SolveCurvatureLESThreaderCallback(
+  void * arg)
 {
   // Get MultiThreader struct
   auto * threadStruct = (MultiThreaderBase::WorkUnitInfo *)arg;
@@ -400,9 +457,9 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::SolveCurvatureL
 /**
  * Solve elastic LES
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 void
-VariationalRegistrationCurvatureRegularizer<TDisplacementField>::ThreadedSolveCurvatureLES(
+VariationalRegistrationCurvatureRegularizer<TDisplacementField, TRealTypeFFT>::ThreadedSolveCurvatureLES(
   unsigned int    currentDimension,
   OffsetValueType from,
   OffsetValueType to)
@@ -431,6 +488,17 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::ThreadedSolveCu
   // compute weight including the spacing of this dimension
   const double weight = m_Alpha * meanSquaredSpacing / itk::Math::sqr(m_Spacing[currentDimension]);
 
+  // With incremental update, the (regularized) DCT of the increment is added
+  // to the kept DCT, which is replaced by the result. With a split increment,
+  // the buffer holds the DCT of the unregularized increment, which is not
+  // regularized before.
+  const bool    keepFieldSpectrum = this->GetUseIncrementalUpdate();
+  const bool    addFieldSpectrum = m_AddFieldSpectrum;
+  const bool    regularizeIncrement = this->GetRegularizeIncrement();
+  RealTypeFFT * fieldSpectrum = keepFieldSpectrum ? m_FieldSpectrum.data() + currentDimension * m_TotalSize : nullptr;
+
+  const RealTypeFFT * incrementSpectrum = m_SplitIncrement ? m_IncrementSpectrum.data() : nullptr;
+
   // Iterate over each pixel in thread range
   double                                    diagValue = 0;
   typename DisplacementFieldType::IndexType index;
@@ -452,16 +520,34 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::ThreadedSolveCu
     diagValue *= (diagValue * weight);
     diagValue += 1.0; // add identity matrix
     // multiply with inverse of the diagonal matrix
-    this->m_DCTVectorFieldComponentBuffer[i] /= diagValue;
+    double value = this->m_DCTVectorFieldComponentBuffer[i];
+    if (addFieldSpectrum)
+    {
+      if (incrementSpectrum)
+      {
+        value += (incrementSpectrum[i] - value) / diagValue;
+      }
+      else if (regularizeIncrement)
+      {
+        value /= diagValue;
+      }
+      value += fieldSpectrum[i];
+    }
+    this->m_DCTVectorFieldComponentBuffer[i] = static_cast<RealTypeFFT>(value / diagValue);
+    if (keepFieldSpectrum)
+    {
+      fieldSpectrum[i] = this->m_DCTVectorFieldComponentBuffer[i];
+    }
   }
 }
 
 /*
  * Calculate the index in the complex image for a given offset.
  */
-template <typename TDisplacementField>
-typename VariationalRegistrationCurvatureRegularizer<TDisplacementField>::DisplacementFieldType::IndexType
-VariationalRegistrationCurvatureRegularizer<TDisplacementField>::CalculateImageIndex(OffsetValueType offset)
+template <typename TDisplacementField, typename TRealTypeFFT>
+typename VariationalRegistrationCurvatureRegularizer<TDisplacementField, TRealTypeFFT>::DisplacementFieldType::IndexType
+VariationalRegistrationCurvatureRegularizer<TDisplacementField, TRealTypeFFT>::CalculateImageIndex(
+  OffsetValueType offset)
 {
   typename DisplacementFieldType::IndexType index;
   typename DisplacementFieldType::IndexType requestedRegionIndex = this->GetOutput()->GetRequestedRegion().GetIndex();
@@ -480,20 +566,31 @@ VariationalRegistrationCurvatureRegularizer<TDisplacementField>::CalculateImageI
 /*
  * Print status information
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 void
-VariationalRegistrationCurvatureRegularizer<TDisplacementField>::PrintSelf(std::ostream & os, Indent indent) const
+VariationalRegistrationCurvatureRegularizer<TDisplacementField, TRealTypeFFT>::PrintSelf(std::ostream & os,
+                                                                                         Indent         indent) const
 {
   Superclass::PrintSelf(os, indent);
 
+  os << indent << "FieldSize: ";
+  os << m_FieldSize << std::endl;
   os << indent << "Size: ";
   os << m_Size << std::endl;
   os << indent << "Spacing: ";
   os << m_Spacing << std::endl;
+  os << indent << "FFTBackend: ";
+  os << (m_FFTBackend.IsNull() ? "(none)" : m_FFTBackend->GetNameOfClass()) << std::endl;
+  os << indent << "PlanRigor: ";
+  os << m_PlanRigor << std::endl;
+  os << indent << "WisdomFileName: ";
+  os << m_WisdomFileName << std::endl;
+  os << indent << "UsePadding: ";
+  os << m_UsePadding << std::endl;
+  os << indent << "FieldSpectrumIsValid: ";
+  os << m_FieldSpectrumIsValid << std::endl;
 }
 
 } // end namespace itk
 
 #endif
-
-#endif
@@ -99,7 +99,13 @@ public:
   using NeighborhoodType = typename Superclass::NeighborhoodType;
   using FloatOffsetType = typename Superclass::FloatOffsetType;
 
-  /** Image gradient calculator type. */
+  /** Image gradient types. */
+  using GradientPixelType = typename Superclass::GradientPixelType;
+  using GradientImageType = typename Superclass::GradientImageType;
+
+  /** Gradient calculator type.
+   * \deprecated The functions read the dense gradient images of
+   * VariationalRegistrationFunction; kept for subclasses. */
   using GradientCalculatorType = CentralDifferenceImageFunction<FixedImageType>;
   using GradientCalculatorPointer = typename GradientCalculatorType::Pointer;
 
@@ -114,6 +120,19 @@ public:
                 void *                   globalData,
                 const FloatOffsetType &  offset = FloatOffsetType(0.0)) override;
 
+  /** The updates of this function can be computed line by line. */
+  bool
+  SupportsScanlineUpdate() const override
+  {
+    return true;
+  }
+
+  /** Compute the updates for a contiguous line of pixels along the first
+   * image dimension using raw pointers to the image and gradient buffers.
+   * \sa SetUseVectorizedForces() */
+  void
+  ComputeUpdateScanline(const IndexType & index, SizeValueType length, PixelType * update, void * globalData) override;
+
   /** Select that the fixed image gradient is used for computing the forces. */
   virtual void
   SetGradientTypeToFixedImage()
@@ -156,6 +175,15 @@ public:
     return m_IntensityDifferenceThreshold;
   }
 
+  /** Compute the forces with the single precision SIMD row kernels of
+   * VariationalRegistrationForceKernels if the CPU supports them, the image
+   * has two or three dimensions and the gradients and the displacement field
+   * have float components. Otherwise, or if switched off, the forces are
+   * computed in double precision. Default is on. */
+  itkSetMacro(UseVectorizedForces, bool);
+  itkGetConstMacro(UseVectorizedForces, bool);
+  itkBooleanMacro(UseVectorizedForces);
+
 protected:
   VariationalRegistrationDemonsFunction();
   ~VariationalRegistrationDemonsFunction() override = default;
@@ -175,12 +203,6 @@ protected:
   };
 
 private:
-  /** Function to compute derivatives of the fixed image. */
-  GradientCalculatorPointer m_FixedImageGradientCalculator;
-
-  /** Function to compute derivatives of the warped image. */
-  GradientCalculatorPointer m_WarpedImageGradientCalculator;
-
   /** Set if warped or fixed image gradient is used for force computation. */
   GradientType m_GradientType;
 
@@ -193,6 +215,9 @@ private:
   /** Precalculated normalizer for spacing consideration. */
   double m_Normalizer;
 
+  /** Use the SIMD row kernels if possible. */
+  bool m_UseVectorizedForces;
+
   /** Zero update return value (zero vector). */
   PixelType m_ZeroUpdateReturn;
 };
@@ -36,6 +36,13 @@ namespace itk
  *  Please note that \f$\alpha\f$ corresponds to \f$\tau\alpha\f$ in Eq.(2)
  *  in VariationalRegistrationFilter.
  *
+ *  All components of the field share the tridiagonal matrices of each
+ *  direction. They are solved together in one sweep per direction directly
+ *  on the field. The solutions of each direction are added to the output
+ *  while the sweep proceeds, so no images with intermediate results are
+ *  needed. Only if the filter runs in place, a copy of the input field is
+ *  kept.
+ *
  *  \sa VariationalRegistrationFilter
  *  \sa VariationalRegistrationRegularizer
  *
@@ -109,19 +116,6 @@ protected:
   virtual void
   InitLUMatrices(ValueType ** alpha, ValueType ** beta, ValueType ** gamma, int n, int dim);
 
-  /** Regularize a given component (dimension) of the deformation field. This
-   *  is called for each ImageDimension by GenerateData(). */
-  virtual void
-  RegularizeComponent(const int component);
-
-  /** A struct to store parameters for multithreaded function call. */
-  struct CalcBufferThreadStruct
-  {
-    VariationalRegistrationDiffusionRegularizer * Filter;
-    unsigned int                                  component; // The current dimension.
-    BufferImagePointer                            bPtr;      // Pointer to the image buffer.
-  };
-
   /** A struct to store parameters for multithreaded function call. */
   struct RegularizeThreadStruct
   {
@@ -130,29 +124,30 @@ protected:
     ValueType *                                   alpha;     // Pointer to matrix diagonal.
     ValueType *                                   beta;      // Pointer to matrix subdiagonal.
     ValueType *                                   gamma;     // Pointer to matrix superdiagonal.
-    BufferImagePointer                            bPtr;      // Pointer to force field image buffer.
-    BufferImagePointer                            vPtr;      // Pointer to temporal result image buffer.
+    DisplacementFieldConstPointer                 uPtr;      // Pointer to the field to regularize.
   };
 
-  /** A struct to store parameters for multithreaded function call. */
-  struct MergeDirectionsThreadStruct
-  {
-    VariationalRegistrationDiffusionRegularizer * Filter;
-    unsigned int                                  component; // The current dimension.
-    BufferImagePointer *                          vPtr;      // Pointer to temporal image buffers.
-  };
-
-  /** Method for multi-threaded calculation of the image buffer. */
-  static ITK_THREAD_RETURN_TYPE
-  CalcBufferCallback(void * arg);
-
-  /** Method for multi-threaded regularization of the image buffer. */
+  /** Method for multi-threaded regularization of the field. */
   static ITK_THREAD_RETURN_TYPE
   RegularizeDirectionCallback(void * arg);
 
-  /** Method for multi-threaded calculation of the final field. */
-  static ITK_THREAD_RETURN_TYPE
-  MergeDirectionsCallback(void * arg);
+  /** Number of pixel rows that are solved together in
+   * RegularizeDirectionCallback() for directions other than 0. */
+  static constexpr int LineBatchSize = 16;
+
+  /** Solve A v = f for a batch of rows with the factorized tridiagonal matrix
+   * A. The rows start at f and v and consecutive rows are one value apart.
+   * Consecutive values of a row are fOffset and vOffset values apart. */
+  static void
+  SolveTridiagonalLines(const ValueType * f,
+                        int               fOffset,
+                        ValueType *       v,
+                        int               vOffset,
+                        int               n,
+                        int               numberOfLines,
+                        const ValueType * alpha,
+                        const ValueType * beta,
+                        const ValueType * gamma);
 
   /** Split the boundary face orthogonal to "inDir" into "num" pieces, returning
    * region "i" as "splitRegion". This method is called "num" times. The
@@ -173,12 +168,8 @@ private:
   typename DisplacementFieldType::SpacingType m_Spacing;
 
   // Attributes for AOS calculation
-  /** Pointer to a temporal image for the regularization.  */
-  BufferImagePointer m_BufferImage;
-
-  /** Buffers for the regularized fields in each direction. Stored in separate
-   * images instead of a vector image for better memory management. */
-  BufferImagePointer m_V[ImageDimension];
+  /** Copy of the input field if the filter runs in place. */
+  DisplacementFieldPointer m_InputCopy;
 
   /** Array for the diagonals of the factorized matrices for each dimension */
   ValueType * m_MatrixAlpha[ImageDimension];
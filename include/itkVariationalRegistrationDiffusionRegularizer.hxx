@@ -19,10 +19,13 @@
 #define itkVariationalRegistrationDiffusionRegularizer_hxx
 #include "itkVariationalRegistrationDiffusionRegularizer.h"
 
-#include "itkImageRegionConstIterator.h"
-#include "itkImageRegionIteratorWithIndex.h"
+#include "itkImageAlgorithm.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
 #include "itkMultiThreaderBase.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace itk
 {
 
@@ -43,7 +46,7 @@ VariationalRegistrationDiffusionRegularizer<TDisplacementField>::VariationalRegi
 }
 
 /**
- * Generate data by regularizing each component of the field independently
+ * Generate data by regularizing all components of the field at once
  */
 template <typename TDisplacementField>
 void
@@ -55,10 +58,48 @@ VariationalRegistrationDiffusionRegularizer<TDisplacementField>::GenerateData()
   // Initialize and allocate data
   this->Initialize();
 
-  // Separately regularize each component of the vector field
-  for (unsigned int component = 0; component < ImageDimension; ++component)
+  // The directions are accumulated in the output. If the filter runs in
+  // place, the input field is overwritten and has to be copied before.
+  DisplacementFieldConstPointer field = this->GetInput();
+  if (field->GetBufferPointer() == this->GetOutput()->GetBufferPointer())
+  {
+    const typename DisplacementFieldType::RegionType region = field->GetBufferedRegion();
+    if (m_InputCopy.IsNull() || m_InputCopy->GetBufferedRegion() != region)
+    {
+      m_InputCopy = DisplacementFieldType::New();
+      m_InputCopy->CopyInformation(field);
+      m_InputCopy->SetRegions(region);
+      m_InputCopy->Allocate();
+    }
+    ImageAlgorithm::Copy(field.GetPointer(), m_InputCopy.GetPointer(), region, region);
+    field = m_InputCopy;
+  }
+  else
+  {
+    m_InputCopy = nullptr;
+  }
+
+  this->GetMultiThreader()->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+
+  // ==========================================
+  // Execute regularization in each direction. All components of the field
+  // share the matrices and are solved in the same sweep. The result of each
+  // direction is added to the output as soon as a batch of rows is solved.
+  RegularizeThreadStruct regularizeStr;
+  for (unsigned int direction = 0; direction < ImageDimension; ++direction)
   {
-    this->RegularizeComponent(component);
+    regularizeStr.Filter = this;
+    regularizeStr.direction = direction;
+    regularizeStr.alpha = m_MatrixAlpha[direction];
+    regularizeStr.beta = m_MatrixBeta[direction];
+    regularizeStr.gamma = m_MatrixGamma[direction];
+    regularizeStr.uPtr = field;
+
+    // Setup MultiThreader
+    this->GetMultiThreader()->SetSingleMethod(this->RegularizeDirectionCallback, &regularizeStr);
+
+    // Execute MultiThreader
+    this->GetMultiThreader()->SingleMethodExecute();
   }
 }
 
@@ -82,23 +123,9 @@ VariationalRegistrationDiffusionRegularizer<TDisplacementField>::Initialize()
     m_Size = size;
     m_Spacing = spacing;
 
-    // Allocate m_pBufferImage.
-    m_BufferImage = BufferImageType::New();
-    m_BufferImage->CopyInformation(DisplacementField);
-    m_BufferImage->SetRequestedRegion(DisplacementField->GetRequestedRegion());
-    m_BufferImage->SetBufferedRegion(DisplacementField->GetBufferedRegion());
-    m_BufferImage->Allocate();
-
     // Initialize Matrices for AOS scheme
     for (unsigned int dim = 0; dim < ImageDimension; ++dim)
     {
-      // Allocate all m_V.
-      m_V[dim] = BufferImageType::New();
-      m_V[dim]->CopyInformation(DisplacementField);
-      m_V[dim]->SetRequestedRegion(DisplacementField->GetRequestedRegion());
-      m_V[dim]->SetBufferedRegion(DisplacementField->GetBufferedRegion());
-      m_V[dim]->Allocate();
-
       this->InitLUMatrices(&m_MatrixAlpha[dim], &m_MatrixBeta[dim], &m_MatrixGamma[dim], m_Size[dim], dim);
     }
   }
@@ -163,112 +190,12 @@ VariationalRegistrationDiffusionRegularizer<TDisplacementField>::InitLUMatrices(
 }
 
 /**
- * Regularize one component of the field using AOS
- */
-template <typename TDisplacementField>
-void
-VariationalRegistrationDiffusionRegularizer<TDisplacementField>::RegularizeComponent(const int component)
-{
-  typename TDisplacementField::ConstPointer DisplacementField = this->GetOutput();
-
-  // ==========================================
-  // Calculate image to be smoothed from vector components.
-  CalcBufferThreadStruct calcBufferStr;
-
-  // Initializing thread parameters.
-  calcBufferStr.Filter = this;
-  calcBufferStr.component = component;
-  calcBufferStr.bPtr = m_BufferImage;
-
-  this->GetMultiThreader()->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
-  this->GetMultiThreader()->SetSingleMethod(this->CalcBufferCallback, &calcBufferStr);
-
-  // Multithread the execution
-  this->GetMultiThreader()->SingleMethodExecute();
-
-  // ==========================================
-  // Execute regularization in each direction.
-  RegularizeThreadStruct regularizeStr;
-  for (unsigned int direction = 0; direction < ImageDimension; ++direction)
-  {
-    regularizeStr.Filter = this;
-    regularizeStr.direction = direction;
-    regularizeStr.bPtr = m_BufferImage;
-    regularizeStr.alpha = m_MatrixAlpha[direction];
-    regularizeStr.beta = m_MatrixBeta[direction];
-    regularizeStr.gamma = m_MatrixGamma[direction];
-    regularizeStr.vPtr = m_V[direction];
-
-    // Setup MultiThreader
-    this->GetMultiThreader()->SetSingleMethod(this->RegularizeDirectionCallback, &regularizeStr);
-
-    // Execute MultiThreader
-    this->GetMultiThreader()->SingleMethodExecute();
-  }
-
-  // ==========================================
-  // Write result in deformation field.
-  MergeDirectionsThreadStruct mergeDirectionsStr;
-
-  // Initializing thread parameters.
-  mergeDirectionsStr.Filter = this;
-  mergeDirectionsStr.vPtr = m_V;
-  mergeDirectionsStr.component = component;
-
-  // Setup MultiThreader
-  this->GetMultiThreader()->SetSingleMethod(this->MergeDirectionsCallback, &mergeDirectionsStr);
-
-  // Execute MultiThreader
-  this->GetMultiThreader()->SingleMethodExecute();
-}
-
-/**
- * Callback function for threaded copying of one field component into the
- * image buffer as a preparation for AOS
- */
-template <typename TDisplacementField>
-ITK_THREAD_RETURN_TYPE
-VariationalRegistrationDiffusionRegularizer<TDisplacementField>::CalcBufferCallback(void * arg)
-{
-  // Get MultiThreader struct
-  auto * threadStruct = (MultiThreaderBase::WorkUnitInfo *)arg;
-  int    threadId = threadStruct->WorkUnitID;
-  int    threadCount = threadStruct->NumberOfWorkUnits;
-
-  // Get user struct
-  auto * userStruct = (CalcBufferThreadStruct *)threadStruct->UserData;
-
-  // Calculate region for current thread
-  typename BufferImageType::RegionType splitRegion;
-  int total = userStruct->Filter->SplitRequestedRegion(threadId, threadCount, splitRegion);
-
-  if (threadId < total)
-  {
-    // Get user data
-    unsigned int                  component = userStruct->component;
-    DisplacementFieldConstPointer uPtr = userStruct->Filter->GetInput();
-    BufferImagePointer            bPtr = userStruct->bPtr;
-
-    // Define iterator for current region
-    ImageRegionConstIterator<DisplacementFieldType> uIt =
-      ImageRegionConstIterator<DisplacementFieldType>(uPtr, splitRegion);
-    ImageRegionIterator<BufferImageType> bIt = ImageRegionIterator<BufferImageType>(bPtr, splitRegion);
-
-    // Copy value of vector component to buffer image
-    for (uIt.GoToBegin(), bIt.GoToBegin(); !uIt.IsAtEnd(); ++uIt, ++bIt)
-    {
-      bIt.Set(uIt.Get()[component]);
-    }
-  }
-
-  return ITK_THREAD_RETURN_DEFAULT_VALUE;
-}
-
-/**
- * Callback function for threaded regularization of the buffered image
- * in a given direction.
+ * Callback function for threaded regularization of the field in a given
+ * direction. The result is added to the output field.
  *
  * For efficiency reasons, this method operates directly on the image buffers.
+ * The components of a pixel are contiguous, so they are solved as rows of the
+ * same batch.
  */
 template <typename TDisplacementField>
 ITK_THREAD_RETURN_TYPE
@@ -295,13 +222,21 @@ VariationalRegistrationDiffusionRegularizer<TDisplacementField>::RegularizeDirec
     ValueType * beta = userStruct->beta;
     ValueType * gamma = userStruct->gamma;
 
-    ValueType * fStart = userStruct->bPtr->GetBufferPointer();
-    ValueType * vStart = userStruct->vPtr->GetBufferPointer();
+    DisplacementFieldConstPointer uPtr = userStruct->uPtr;
+    DisplacementFieldPointer      outPtr = userStruct->Filter->GetOutput();
+
+    const auto * fStart = reinterpret_cast<const ValueType *>(uPtr->GetBufferPointer());
+    auto *       outStart = reinterpret_cast<ValueType *>(outPtr->GetBufferPointer());
+
+    const bool isFirstDirection = (direction == 0);
+    const bool isLastDirection = (direction == static_cast<int>(ImageDimension) - 1);
 
     // Calc strides for buffer operations
-    typename BufferImageType::SizeType  imageSize = userStruct->bPtr->GetLargestPossibleRegion().GetSize();
-    typename BufferImageType::IndexType stride;
-    stride[0] = 1;
+    const int numberOfComponents = PixelType::Dimension;
+
+    typename DisplacementFieldType::SizeType  imageSize = uPtr->GetLargestPossibleRegion().GetSize();
+    typename DisplacementFieldType::IndexType stride;
+    stride[0] = numberOfComponents;
     for (unsigned int i = 1; i < ImageDimension; ++i)
     {
       stride[i] = stride[i - 1] * imageSize[i - 1];
@@ -311,11 +246,28 @@ VariationalRegistrationDiffusionRegularizer<TDisplacementField>::RegularizeDirec
     int offset = stride[direction]; // Stride for next voxel in row
     int n = imageSize[direction];   // Number of pixels in row
 
+    // Rows along direction 0 are solved pixel row by pixel row. For the
+    // other directions, the rows that start at adjacent pixels along
+    // dimension 0 are solved together in batches, such that the values of a
+    // batch at each position are contiguous in memory.
+    typename BufferImageType::RegionType batchRegion = splitRegion;
+    int                                  batchExtent = 1;
+    if (direction != 0)
+    {
+      batchExtent = splitRegion.GetSize(0);
+      batchRegion.SetSize(0, 1);
+    }
+
+    // Solution of the rows of one batch; consecutive values of a row are
+    // maxNumberOfLines values apart.
+    const int              maxNumberOfLines = (direction != 0 ? LineBatchSize : 1) * numberOfComponents;
+    std::vector<ValueType> v(static_cast<std::size_t>(maxNumberOfLines) * n);
+
     // Define iterator for current region
-    ImageRegionIteratorWithIndex<BufferImageType> regionIt =
-      ImageRegionIteratorWithIndex<BufferImageType>(userStruct->bPtr, splitRegion);
+    ImageRegionConstIteratorWithIndex<DisplacementFieldType> regionIt =
+      ImageRegionConstIteratorWithIndex<DisplacementFieldType>(uPtr, batchRegion);
 
-    // For each pixel on the current face, sample the corresponding row f and
+    // For each batch on the current face, sample the corresponding rows f and
     // solve A v = f with respect to v.
     for (regionIt.GoToBegin(); !regionIt.IsAtEnd(); ++regionIt)
     {
@@ -326,28 +278,31 @@ VariationalRegistrationDiffusionRegularizer<TDisplacementField>::RegularizeDirec
         startOffset += regionIt.GetIndex()[i] * stride[i];
       }
 
-      // Get buffer pointer for current row
-      ValueType * f = fStart + startOffset;
-      ValueType * v = vStart + startOffset;
-
-      // Set totalOffset to offset (first voxel in row)
-      int totalOffset = offset;
-
-      // Forward substitution (solve Lv=b).
-      *v = *f;
-      for (int i = 1; i < n; ++i)
+      for (int batchStart = 0; batchStart < batchExtent; batchStart += LineBatchSize)
       {
-        *(v + totalOffset) = *(f + totalOffset) - *(v + totalOffset - offset) * *(gamma + i - 1);
-        totalOffset += offset;
-      }
-      // Backward substitution (solve Rx=u, overwrite u with x).
-      totalOffset = (n - 1) * offset;
-      *(v + totalOffset) /= *(alpha + n - 1);
-
-      for (int i = n - 2; i >= 0; --i)
-      {
-        totalOffset -= offset;
-        *(v + totalOffset) = (*(v + totalOffset) - *(v + totalOffset + offset) * *(beta + i)) / (*(alpha + i));
+        const int numberOfPixels = std::min(batchExtent - batchStart, static_cast<int>(LineBatchSize));
+        const int numberOfLines = numberOfPixels * numberOfComponents;
+
+        const ValueType * f = fStart + startOffset + batchStart * numberOfComponents;
+        SolveTridiagonalLines(f, offset, v.data(), maxNumberOfLines, n, numberOfLines, alpha, beta, gamma);
+
+        // Add the solution to the sum of the previous directions and divide
+        // the sum by the number of directions after the last one.
+        ValueType * out = outStart + startOffset + batchStart * numberOfComponents;
+        for (int i = 0; i < n; ++i)
+        {
+          const ValueType * vi = v.data() + i * maxNumberOfLines;
+          ValueType *       outi = out + i * offset;
+          for (int l = 0; l < numberOfLines; ++l)
+          {
+            ValueType sum = isFirstDirection ? vi[l] : outi[l] + vi[l];
+            if (isLastDirection)
+            {
+              sum /= ImageDimension;
+            }
+            outi[l] = sum;
+          }
+        }
       }
     }
   }
@@ -355,56 +310,54 @@ VariationalRegistrationDiffusionRegularizer<TDisplacementField>::RegularizeDirec
 }
 
 /**
- * Callback function for the threaded adding of the regularization in
- * each spatial direction
+ * Solve a batch of tridiagonal systems with the same LU decomposition
  */
 template <typename TDisplacementField>
-ITK_THREAD_RETURN_TYPE
-VariationalRegistrationDiffusionRegularizer<TDisplacementField>::MergeDirectionsCallback(void * arg)
+void
+VariationalRegistrationDiffusionRegularizer<TDisplacementField>::SolveTridiagonalLines(const ValueType * f,
+                                                                                       int               fOffset,
+                                                                                       ValueType *       v,
+                                                                                       int               vOffset,
+                                                                                       int               n,
+                                                                                       int               numberOfLines,
+                                                                                       const ValueType * alpha,
+                                                                                       const ValueType * beta,
+                                                                                       const ValueType * gamma)
 {
-  // Get MultiThreader struct
-  auto * threadStruct = (MultiThreaderBase::WorkUnitInfo *)(arg);
-  int    threadId = threadStruct->WorkUnitID;
-  int    threadCount = threadStruct->NumberOfWorkUnits;
-
-  // Get user struct
-  auto * userStruct = (MergeDirectionsThreadStruct *)threadStruct->UserData;
-
-  // Calculate region for current thread
-  typename BufferImageType::RegionType splitRegion;
-  int total = userStruct->Filter->SplitRequestedRegion(threadId, threadCount, splitRegion);
-
-  if (threadId < total)
+  // Forward substitution (solve Lv=f).
+  for (int l = 0; l < numberOfLines; ++l)
   {
-    // Define iterator for current region
-    unsigned int             component = userStruct->component;
-    BufferImagePointer *     vPtr = userStruct->vPtr;
-    DisplacementFieldPointer outPtr = userStruct->Filter->GetOutput();
-
-    ImageRegionIteratorWithIndex<DisplacementFieldType> outIt =
-      ImageRegionIteratorWithIndex<DisplacementFieldType>(outPtr, splitRegion);
-
-    // For each pixel on the current face, sample the corresponding row f and
-    // solve A v = f with respect to v.
-    for (outIt.GoToBegin(); !outIt.IsAtEnd(); ++outIt)
+    v[l] = f[l];
+  }
+  for (int i = 1; i < n; ++i)
+  {
+    const ValueType   g = gamma[i - 1];
+    const ValueType * fi = f + i * fOffset;
+    const ValueType * vPrevious = v + (i - 1) * vOffset;
+    ValueType *       vi = v + i * vOffset;
+    for (int l = 0; l < numberOfLines; ++l)
     {
-      // Get current index and vector
-      PixelType                                 vector = outIt.Get();
-      typename DisplacementFieldType::IndexType index = outIt.GetIndex();
-
-      // Sum up values from each buffer image v.
-      ValueType sum = NumericTraits<ValueType>::Zero;
-      for (unsigned int dimDirection = 0; dimDirection < ImageDimension; ++dimDirection)
-      {
-        sum += vPtr[dimDirection]->GetPixel(index);
-      }
+      vi[l] = fi[l] - vPrevious[l] * g;
+    }
+  }
 
-      // Set value to field
-      vector[component] = sum / ImageDimension;
-      outIt.Set(vector);
+  // Backward substitution (solve Rx=v, overwrite v with x).
+  ValueType * vLast = v + (n - 1) * vOffset;
+  for (int l = 0; l < numberOfLines; ++l)
+  {
+    vLast[l] /= alpha[n - 1];
+  }
+  for (int i = n - 2; i >= 0; --i)
+  {
+    const ValueType   a = alpha[i];
+    const ValueType   b = beta[i];
+    const ValueType * vNext = v + (i + 1) * vOffset;
+    ValueType *       vi = v + i * vOffset;
+    for (int l = 0; l < numberOfLines; ++l)
+    {
+      vi[l] = (vi[l] - vNext[l] * b) / a;
     }
   }
-  return ITK_THREAD_RETURN_DEFAULT_VALUE;
 }
 
 /**
@@ -425,7 +378,7 @@ VariationalRegistrationDiffusionRegularizer<TDisplacementField>::SplitBoundaryFa
   typename BufferImageType::SizeType  splitSize;
 
   // Initialize the splitRegion to the output requested region
-  splitRegion = m_BufferImage->GetRequestedRegion();
+  splitRegion = this->GetOutput()->GetRequestedRegion();
   splitIndex = splitRegion.GetIndex();
   splitSize = splitRegion.GetSize();
 
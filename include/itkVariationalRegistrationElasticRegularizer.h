@@ -19,12 +19,11 @@
 #define itkVariationalRegistrationElasticRegularizer_h
 
 #include "itkVariationalRegistrationRegularizer.h"
+#include "itkVariationalRegistrationFFTUtilities.h"
 #include "itkMultiThreaderBase.h"
 
-#if defined(ITK_USE_FFTWD) || defined(ITK_USE_FFTWF)
-
-// other includes:
-#  include "itkFFTWCommon.h"
+#include <string>
+#include <vector>
 
 namespace itk
 {
@@ -42,6 +41,31 @@ namespace itk
  *  \f$\mu=\tau\mu'\f$ and \f$\lambda=\tau\lambda'\f$ (see Eq.(2)
  *  in VariationalRegistrationFilter).
  *
+ *  The FFTs are computed by an exchangeable FFT backend (see SetFFTBackend()). By
+ *  default, FFTW is used if ITK is built with FFTW, otherwise the bundled
+ *  VariationalRegistrationMixedRadixFFTBackend, so this class is always available.
+ *
+ *  The FFTs are computed with the precision TRealTypeFFT (float or double). By
+ *  default, double precision is used (see
+ *  VariationalRegistrationFFTUtilities::DefaultRealType). For fields with float
+ *  values, float halves the memory of the buffers, but the results differ
+ *  slightly from the double precision results.
+ *
+ *  With UsePadding on, the FFT buffers are padded to sizes with small prime factors
+ *  (see VariationalRegistrationFFTUtilities::GetSmoothSize()).
+ *
+ *  With UseIncrementalUpdate on, the spectrum of the regularized field is kept,
+ *  so each call only transforms the increment of the input to the last output,
+ *  which is regularized as well:
+ *  \f$\hat u^{out}=(Id - A)^{-1}[\hat u^{last} + (Id - A)^{-1}\widehat{\Delta u}]\f$.
+ *  With RegularizeIncrement off, the increment is added without the inner
+ *  \f$(Id - A)^{-1}\f$. An unregularized increment is transformed separately and
+ *  added without it. The spectrum needs as much memory as the complex FFT buffer,
+ *  and so does the spectrum of the increment if it is split. With UsePadding,
+ *  the padding of the kept field is not replaced by the boundary pixels of the
+ *  input, so the result differs slightly from the direct computation near the
+ *  boundary.
+ *
  *  \sa VariationalRegistrationFilter
  *  \sa VariationalRegistrationRegularizer
  *
@@ -55,7 +79,9 @@ namespace itk
  *  \author Rene Werner
  *  \author Jan Ehrhardt
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField,
+          typename TRealTypeFFT = typename VariationalRegistrationFFTUtilities::DefaultRealType<
+            typename NumericTraits<typename TDisplacementField::PixelType>::ValueType>::Type>
 class VariationalRegistrationElasticRegularizer : public VariationalRegistrationRegularizer<TDisplacementField>
 {
 public:
@@ -84,20 +110,10 @@ public:
   using ValueType = typename Superclass::ValueType;
   typedef typename DisplacementFieldType::SizeType::SizeValueType OffsetValueType;
 
-  /** Types for FFTW proxy */
-
-#  if defined(ITK_USE_FFTWD)
-  // Prefer to use double precision
-  using RealTypeFFT = double;
-#  else
-#    if defined(ITK_USE_FFTWF)
-// Allow to use single precision
-#      warning "Using single precision for FFT computations!"
-  using RealTypeFFT = float;
-#    endif
-#  endif
-
-  using FFTWProxyType = typename fftw::Proxy<RealTypeFFT>;
+  /** Types of the FFT */
+  using RealTypeFFT = TRealTypeFFT;
+  using FFTBackendType = VariationalRegistrationFFTBackend<RealTypeFFT, ImageDimension>;
+  using ComplexTypeFFT = typename FFTBackendType::ComplexType;
 
   /** Set the regularization weight lambda. */
   itkSetMacro(Lambda, ValueType);
@@ -111,6 +127,76 @@ public:
   /** Get the regularization weight mu. */
   itkGetConstMacro(Mu, ValueType);
 
+  /** Set/Get the FFT backend. The plans are created again if the backend or
+   * the number of work units changes. A backend must not be shared by
+   * regularizers that run concurrently. Default is
+   * VariationalRegistrationFFTUtilities::CreateDefaultBackend(). Unless
+   * UsePadding was set explicitly, it is set to the default of the backend
+   * (see FFTBackendType::GetDefaultUsePadding()). */
+  virtual void
+  SetFFTBackend(FFTBackendType * backend)
+  {
+    if (this->m_FFTBackend != backend)
+    {
+      this->m_FFTBackend = backend;
+      if (!this->m_UsePaddingIsSet && backend != nullptr)
+      {
+        this->m_UsePadding = backend->GetDefaultUsePadding();
+      }
+      this->Modified();
+    }
+  }
+  itkGetModifiableObjectMacro(FFTBackend, FFTBackendType);
+
+  /** Set/Get the planner flag of the FFT backend: FFTBackendType::PlanEstimate,
+   * PlanMeasure or PlanPatient (the flags FFTW_ESTIMATE, FFTW_MEASURE or
+   * FFTW_PATIENT of FFTW). It is used when the plans are created, i.e. when
+   * the size of the field changes. Default is PlanMeasure. */
+  itkSetMacro(PlanRigor, unsigned int);
+  itkGetConstMacro(PlanRigor, unsigned int);
+
+  /** Set/Get the wisdom file of the FFT backend (used by FFTW). If set, the
+   * wisdom is imported from the file before the plans are created for the
+   * first time and exported to the file after each planning, so plans for
+   * sizes measured in an earlier run are created at once. Default is empty
+   * (no wisdom file). */
+  itkSetStringMacro(WisdomFileName);
+  itkGetStringMacro(WisdomFileName);
+
+  /** Set/Get if the FFT buffers are padded to sizes whose prime factors are
+   * 2, 3, 5 and 7 only. The field is extended by replicating its boundary
+   * pixels and the result is cropped after the inverse transform, so the
+   * time of the FFT no longer depends on the prime factors of the field size.
+   * The padding changes the result slightly near the boundary. Default is
+   * the default of the FFT backend, i.e. off for FFTW and on for the bundled
+   * mixed radix backend (see FFTBackendType::GetDefaultUsePadding()). */
+  virtual void
+  SetUsePadding(bool usePadding)
+  {
+    this->m_UsePaddingIsSet = true;
+    if (this->m_UsePadding != usePadding)
+    {
+      this->m_UsePadding = usePadding;
+      this->Modified();
+    }
+  }
+  itkGetConstMacro(UsePadding, bool);
+  itkBooleanMacro(UsePadding);
+
+  /** The elastic regularizer supports UseIncrementalUpdate. */
+  bool
+  SupportsIncrementalUpdate() const override
+  {
+    return true;
+  }
+
+  /** Discard the kept spectrum of the field. */
+  void
+  ResetIncrementalUpdate() override
+  {
+    m_FieldSpectrumIsValid = false;
+  }
+
 protected:
   VariationalRegistrationElasticRegularizer();
   ~VariationalRegistrationElasticRegularizer() override = default;
@@ -129,7 +215,7 @@ protected:
   void
   Initialize() override;
 
-  /** Initialize FFTW plans and multi-threading, allocate arrays for FFT */
+  /** Initialize FFT plans and multi-threading, allocate arrays for FFT */
   virtual bool
   InitializeElasticFFTPlans();
 
@@ -137,7 +223,15 @@ protected:
   virtual bool
   InitializeElasticMatrix();
 
-  /** Delete all data allocated during Initialize() */
+  /** Precompute the inverse of the matrix of the LES for each frequency. */
+  virtual bool
+  InitializeInverseMatrix();
+
+  /** Compute the inverse of the matrix of the LES for one frequency. */
+  void
+  ComputeInverseMatrix(const typename DisplacementFieldType::IndexType & index, OffsetValueType offset);
+
+  /** Delete the matrices allocated during Initialize() */
   virtual void
   FreeData();
 
@@ -153,10 +247,6 @@ protected:
   virtual void
   ThreadedSolveElasticLES(OffsetValueType from, OffsetValueType to);
 
-  /** Calculate the index in the complex image for a given offset. */
-  typename DisplacementFieldType::IndexType
-  CalculateComplexImageIndex(OffsetValueType offset);
-
 private:
   /** Weight of the regularization term. */
   ValueType m_Lambda;
@@ -164,13 +254,35 @@ private:
   /** Weight of the regularization term. */
   ValueType m_Mu;
 
+  /** FFT backend and the backend the plans were created with. */
+  typename FFTBackendType::Pointer m_FFTBackend;
+  const FFTBackendType *           m_PlannedFFTBackend;
+
+  /** Number of work units the plans were created for. */
+  unsigned int m_PlannedNumberOfWorkUnits;
+
+  /** Planner flag of the FFT backend. */
+  unsigned int m_PlanRigor;
+
+  /** Wisdom file of the FFT backend. */
+  std::string m_WisdomFileName;
+
+  /** Pad the FFT buffers to smooth sizes. */
+  bool m_UsePadding;
+
+  /** UsePadding was set explicitly and is kept if the backend changes. */
+  bool m_UsePaddingIsSet;
+
   /** The spacing of the displacement field. */
   typename DisplacementFieldType::SpacingType m_Spacing;
 
   /** The size of the displacement field. */
+  typename DisplacementFieldType::SizeType m_FieldSize;
+
+  /** The size of the FFT buffers; the field size or the padded size. */
   typename DisplacementFieldType::SizeType m_Size;
 
-  /** Number of pixels of the displacement field. */
+  /** Number of pixels of the FFT buffers. */
   OffsetValueType m_TotalSize;
 
   /** The size of the complex buffer. */
@@ -179,19 +291,49 @@ private:
   /** Number of pixels of the complex buffer. */
   OffsetValueType m_TotalComplexSize;
 
-  OffsetValueType m_ComplexOffsetTable[ImageDimension];
-
   /** FFT matrix */
   double * m_MatrixCos[ImageDimension];
   double * m_MatrixSin[ImageDimension];
 
-  /** FFT plans and buffers */
-  typename FFTWProxyType::PlanType m_PlanForward[ImageDimension];  /** FFT forward plan  */
-  typename FFTWProxyType::PlanType m_PlanBackward[ImageDimension]; /** FFT backward plan */
-  typename FFTWProxyType::ComplexType *
-                                      m_ComplexBuffer[ImageDimension]; /** memory space for output of forward and input of backward FFT*/
-  typename FFTWProxyType::PixelType * m_InputBuffer;                   /** FFT memory space for input data */
-  typename FFTWProxyType::PixelType * m_OutputBuffer;                  /** FFT memory space for output data */
+  /** Number of unique entries of the symmetric inverse matrix. */
+  static constexpr unsigned int NumberOfMatrixEntries = ImageDimension * (ImageDimension + 1) / 2;
+
+  /** Unique entries of the inverse matrix of the LES for each frequency in
+   * the precision of the FFT. The upper triangle is stored row by row, one
+   * array per entry. */
+  std::vector<RealTypeFFT> m_InverseMatrix[NumberOfMatrixEntries];
+
+  /** Weights and spacing the inverse matrix was computed for. */
+  ValueType                                   m_InverseMatrixLambda;
+  ValueType                                   m_InverseMatrixMu;
+  typename DisplacementFieldType::SpacingType m_InverseMatrixSpacing;
+  bool                                        m_InverseMatrixUseImageSpacing;
+
+  /** FFT buffers. The components of the field are stored one after another,
+   * so each transform of the backend transforms all components at once. */
+
+  /** Memory space for output of forward and input of backward FFT and the
+   * start of each component in it. */
+  std::vector<ComplexTypeFFT> m_ComplexData;
+  ComplexTypeFFT *            m_ComplexBuffer[ImageDimension];
+
+  /** FFT memory space for input and output data */
+  std::vector<RealTypeFFT> m_RealBuffer;
+
+  /** Spectrum of the last regularized field for UseIncrementalUpdate, stored
+   * like m_ComplexData, and whether it belongs to the last output. */
+  std::vector<ComplexTypeFFT> m_FieldSpectrum;
+  bool                        m_FieldSpectrumIsValid;
+
+  /** Whether the current call adds the regularized spectrum of the increment
+   * to the kept spectrum. */
+  bool m_AddFieldSpectrum;
+
+  /** Spectrum of the increment, stored like m_ComplexData, if the
+   * unregularized increment is transformed separately (see
+   * VariationalRegistrationRegularizer::SetUnregularizedIncrement()). */
+  std::vector<ComplexTypeFFT> m_IncrementSpectrum;
+  bool                        m_SplitIncrement;
 
   struct ElasticFFTThreadStruct
   {
@@ -205,9 +347,8 @@ private:
 
 } // namespace itk
 
-#  ifndef ITK_MANUAL_INSTANTIATION
-#    include "itkVariationalRegistrationElasticRegularizer.hxx"
-#  endif
-
+#ifndef ITK_MANUAL_INSTANTIATION
+#  include "itkVariationalRegistrationElasticRegularizer.hxx"
 #endif
+
 #endif
@@ -18,13 +18,13 @@
 #ifndef itkVariationalRegistrationElasticRegularizer_hxx
 #define itkVariationalRegistrationElasticRegularizer_hxx
 
-#if defined(ITK_USE_FFTWD) || defined(ITK_USE_FFTWF)
+#include "itkVariationalRegistrationElasticRegularizer.h"
 
-#  include "itkVariationalRegistrationElasticRegularizer.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageScanlineIterator.h"
+#include "itkNeighborhoodAlgorithm.h"
 
-#  include "itkImageRegionConstIterator.h"
-#  include "itkImageRegionConstIteratorWithIndex.h"
-#  include "itkNeighborhoodAlgorithm.h"
 
 namespace itk
 {
@@ -32,15 +32,15 @@ namespace itk
 /**
  * Default constructor
  */
-template <typename TDisplacementField>
-VariationalRegistrationElasticRegularizer<TDisplacementField>::VariationalRegistrationElasticRegularizer()
+template <typename TDisplacementField, typename TRealTypeFFT>
+VariationalRegistrationElasticRegularizer<TDisplacementField, TRealTypeFFT>::VariationalRegistrationElasticRegularizer()
 {
   for (unsigned int i = 0; i < ImageDimension; ++i)
   {
+    m_FieldSize[i] = 0;
     m_Size[i] = 0;
     m_ComplexSize[i] = 0;
     m_Spacing[i] = 1.0;
-    m_ComplexOffsetTable[i] = 0;
   }
   m_TotalComplexSize = 0;
   m_TotalSize = 0;
@@ -49,24 +49,35 @@ VariationalRegistrationElasticRegularizer<TDisplacementField>::VariationalRegist
   m_Lambda = 1.0;
   m_Mu = 1.0;
 
+  m_FFTBackend = VariationalRegistrationFFTUtilities::CreateDefaultBackend<RealTypeFFT, ImageDimension>();
+  m_PlannedFFTBackend = nullptr;
+  m_PlannedNumberOfWorkUnits = 0;
+  m_PlanRigor = FFTBackendType::PlanMeasure;
+  m_UsePadding = m_FFTBackend->GetDefaultUsePadding();
+  m_UsePaddingIsSet = false;
+  m_FieldSpectrumIsValid = false;
+  m_AddFieldSpectrum = false;
+  m_SplitIncrement = false;
+
+  m_InverseMatrixLambda = 0.0;
+  m_InverseMatrixMu = 0.0;
+  m_InverseMatrixSpacing.Fill(0.0);
+  m_InverseMatrixUseImageSpacing = false;
+
   for (unsigned int i = 0; i < ImageDimension; ++i)
   {
     this->m_MatrixCos[i] = nullptr;
     this->m_MatrixSin[i] = nullptr;
     this->m_ComplexBuffer[i] = nullptr;
-    this->m_PlanForward[i] = nullptr;
-    this->m_PlanBackward[i] = nullptr;
   }
-  this->m_InputBuffer = nullptr;
-  this->m_OutputBuffer = nullptr;
 }
 
 /**
  * Generate data
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 void
-VariationalRegistrationElasticRegularizer<TDisplacementField>::GenerateData()
+VariationalRegistrationElasticRegularizer<TDisplacementField, TRealTypeFFT>::GenerateData()
 {
   // Allocate the output image
   this->AllocateOutputs();
@@ -81,19 +92,34 @@ VariationalRegistrationElasticRegularizer<TDisplacementField>::GenerateData()
 /*
  * Initialize flags
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 void
-VariationalRegistrationElasticRegularizer<TDisplacementField>::Initialize()
+VariationalRegistrationElasticRegularizer<TDisplacementField, TRealTypeFFT>::Initialize()
 {
   this->Superclass::Initialize();
   DisplacementFieldPointer DisplacementField = this->GetOutput();
 
+  if (this->m_FFTBackend.IsNull())
+  {
+    itkExceptionMacro(<< "FFT backend is not set!");
+  }
+
   this->m_Spacing = DisplacementField->GetSpacing();
 
-  typename DisplacementFieldType::SizeType size = DisplacementField->GetRequestedRegion().GetSize();
+  // The FFT size is the field size or, with padding, the next smooth size
+  this->m_FieldSize = DisplacementField->GetRequestedRegion().GetSize();
+  typename DisplacementFieldType::SizeType size = this->m_FieldSize;
+  if (this->m_UsePadding)
+  {
+    for (unsigned int i = 0; i < ImageDimension; ++i)
+    {
+      size[i] = VariationalRegistrationFFTUtilities::GetSmoothSize(size[i]);
+    }
+  }
 
   // Only reinitialize FFT plans if size has changed since last Initialize()
-  if (size != this->m_Size)
+  const bool sizeChanged = (size != this->m_Size);
+  if (sizeChanged)
   {
     // Set new image size and complex buffer size including total sizes.
     // According to the FFTW manual, the complex buffer has the size
@@ -105,13 +131,6 @@ VariationalRegistrationElasticRegularizer<TDisplacementField>::Initialize()
       this->m_ComplexSize[i] = size[i];
     }
 
-    // Calculate offset table for complex image
-    this->m_ComplexOffsetTable[0] = 1;
-    for (unsigned int j = 0; j + 1 < ImageDimension; j++)
-    {
-      this->m_ComplexOffsetTable[j + 1] = this->m_ComplexOffsetTable[j] * this->m_ComplexSize[j];
-    }
-
     // Compute total number of pixels
     this->m_TotalSize = 1;
     this->m_TotalComplexSize = 1;
@@ -124,12 +143,21 @@ VariationalRegistrationElasticRegularizer<TDisplacementField>::Initialize()
     // Reset old data
     FreeData();
 
-    // initialize matrix and FFTW plans
+    // initialize matrix
     if (!InitializeElasticMatrix())
     {
       itkExceptionMacro(<< "Initializing Elastic Matrix failed!");
       return;
     }
+  }
+
+  // The FFT plans are created again if the size, the backend or the number
+  // of work units has changed
+  if (sizeChanged || this->m_FFTBackend.GetPointer() != this->m_PlannedFFTBackend ||
+      this->GetNumberOfWorkUnits() != this->m_PlannedNumberOfWorkUnits)
+  {
+    // The kept spectrum and the real buffer are reallocated
+    this->m_FieldSpectrumIsValid = false;
 
     if (!InitializeElasticFFTPlans())
     {
@@ -137,14 +165,27 @@ VariationalRegistrationElasticRegularizer<TDisplacementField>::Initialize()
       return;
     }
   }
+
+  // The inverse matrix is fixed for a level, so it is only recomputed if the
+  // size, the spacing or the weights have changed
+  if (sizeChanged || this->m_Spacing != this->m_InverseMatrixSpacing || this->m_Mu != this->m_InverseMatrixMu ||
+      this->m_Lambda != this->m_InverseMatrixLambda ||
+      this->GetUseImageSpacing() != this->m_InverseMatrixUseImageSpacing)
+  {
+    if (!InitializeInverseMatrix())
+    {
+      itkExceptionMacro(<< "Initializing inverse Elastic Matrix failed!");
+      return;
+    }
+  }
 }
 
 /*
  * Reset data
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 void
-VariationalRegistrationElasticRegularizer<TDisplacementField>::FreeData()
+VariationalRegistrationElasticRegularizer<TDisplacementField, TRealTypeFFT>::FreeData()
 {
   for (unsigned int i = 0; i < ImageDimension; ++i)
   {
@@ -152,57 +193,41 @@ VariationalRegistrationElasticRegularizer<TDisplacementField>::FreeData()
       delete[] this->m_MatrixCos[i];
     if (this->m_MatrixSin[i] != nullptr)
       delete[] this->m_MatrixSin[i];
-
-    if (this->m_PlanForward[i] != nullptr)
-      FFTWProxyType::DestroyPlan(this->m_PlanForward[i]);
-    if (this->m_PlanBackward[i] != nullptr)
-      FFTWProxyType::DestroyPlan(this->m_PlanBackward[i]);
-
-    if (this->m_ComplexBuffer[i] != nullptr)
-      delete[] this->m_ComplexBuffer[i];
   }
-  if (this->m_InputBuffer != nullptr)
-    delete[] this->m_InputBuffer;
-  if (this->m_OutputBuffer != nullptr)
-    delete[] this->m_OutputBuffer;
 }
 
 /**
  * Initialize FFT plans
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 bool
-VariationalRegistrationElasticRegularizer<TDisplacementField>::InitializeElasticFFTPlans()
+VariationalRegistrationElasticRegularizer<TDisplacementField, TRealTypeFFT>::InitializeElasticFFTPlans()
 {
   itkDebugMacro(<< "Initializing elastic plans for FFT...");
 
-  // Get image size in reverse order for FFTW
-  auto * n = new int[ImageDimension];
+  // Allocate buffers for all components
+  this->m_RealBuffer.resize(ImageDimension * this->m_TotalSize);
+  this->m_ComplexData.resize(ImageDimension * this->m_TotalComplexSize);
   for (unsigned int i = 0; i < ImageDimension; ++i)
   {
-    n[(ImageDimension - 1) - i] = this->m_Size[i];
+    this->m_ComplexBuffer[i] = this->m_ComplexData.data() + i * this->m_TotalComplexSize;
   }
 
-  // Allocate buffers
-  this->m_InputBuffer = new FFTWProxyType::PixelType[this->m_TotalSize];
-  this->m_OutputBuffer = new FFTWProxyType::PixelType[this->m_TotalSize];
-  for (unsigned int i = 0; i < ImageDimension; ++i)
-  {
-    this->m_ComplexBuffer[i] = new typename FFTWProxyType::ComplexType[this->m_TotalComplexSize];
-  }
+  // Create the plans for the FFT of all components. The plans use the work
+  // units of this instance; the backend serializes the planning with other
+  // instances.
+  this->m_FFTBackend->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+  this->m_FFTBackend->SetPlanRigor(this->m_PlanRigor);
+  this->m_FFTBackend->SetWisdomFileName(this->m_WisdomFileName);
 
-  // Create the plans for the FFT
-  for (unsigned int i = 0; i < ImageDimension; ++i)
+  this->m_PlannedFFTBackend = nullptr;
+  if (!this->m_FFTBackend->PlanRealToComplex(
+        this->m_Size, ImageDimension, this->m_RealBuffer.data(), this->m_ComplexData.data()))
   {
-    this->m_PlanForward[i] = FFTWProxyType::Plan_dft_r2c(
-      ImageDimension, n, this->m_InputBuffer, this->m_ComplexBuffer[i], FFTW_MEASURE, this->GetNumberOfWorkUnits());
-
-    this->m_PlanBackward[i] = FFTWProxyType::Plan_dft_c2r(
-      ImageDimension, n, this->m_ComplexBuffer[i], this->m_OutputBuffer, FFTW_MEASURE, this->GetNumberOfWorkUnits());
+    return false;
   }
-
-  // delete n
-  delete[] n;
+  this->m_PlannedFFTBackend = this->m_FFTBackend.GetPointer();
+  this->m_PlannedNumberOfWorkUnits = this->GetNumberOfWorkUnits();
 
   return true;
 }
@@ -210,9 +235,9 @@ VariationalRegistrationElasticRegularizer<TDisplacementField>::InitializeElastic
 /**
  * Initialize elastic matrix
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 bool
-VariationalRegistrationElasticRegularizer<TDisplacementField>::InitializeElasticMatrix()
+VariationalRegistrationElasticRegularizer<TDisplacementField, TRealTypeFFT>::InitializeElasticMatrix()
 {
   itkDebugMacro(<< "Initializing elastic matrix for FFT...");
 
@@ -238,9 +263,9 @@ VariationalRegistrationElasticRegularizer<TDisplacementField>::InitializeElastic
 /**
  * Execute regularization
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 void
-VariationalRegistrationElasticRegularizer<TDisplacementField>::Regularize()
+VariationalRegistrationElasticRegularizer<TDisplacementField, TRealTypeFFT>::Regularize()
 {
   DisplacementFieldConstPointer inputField = this->GetInput();
 
@@ -250,47 +275,133 @@ VariationalRegistrationElasticRegularizer<TDisplacementField>::Regularize()
     return;
   }
 
+  // With incremental update, the real buffer still holds the last output
+  // (scaled by m_TotalSize) after the backward FFT, so only the increment of
+  // the input is transformed and the kept spectrum is added in the LES.
+  const bool keepFieldSpectrum = this->GetUseIncrementalUpdate();
+  this->m_AddFieldSpectrum = keepFieldSpectrum && this->m_FieldSpectrumIsValid;
+  this->m_FieldSpectrumIsValid = false;
+  if (keepFieldSpectrum)
+  {
+    this->m_FieldSpectrum.resize(this->m_ComplexData.size());
+  }
+  const bool        addFieldSpectrum = this->m_AddFieldSpectrum;
+  const RealTypeFFT lastOutputScale = 1.0 / static_cast<double>(this->m_TotalSize);
+
+  // The unregularized increment is transformed separately, as it is not
+  // regularized with the rest of the increment.
+  const DisplacementFieldType * unregularizedField = this->GetUnregularizedIncrement();
+  this->m_SplitIncrement = addFieldSpectrum && this->GetRegularizeIncrement() && unregularizedField != nullptr;
+  if (this->m_SplitIncrement)
+  {
+    this->m_IncrementSpectrum.resize(this->m_ComplexData.size());
+  }
+
   // Perform Forward FFT for input field
   itkDebugMacro(<< "Performing Forward FFT...");
-  using ConstIteratorType = ImageRegionConstIterator<DisplacementFieldType>;
+  using ConstIteratorType = ImageScanlineConstIterator<DisplacementFieldType>;
   ConstIteratorType inputIt(inputField, inputField->GetRequestedRegion());
 
-  unsigned int n; // Counter for field copying
-  for (unsigned int i = 0; i < ImageDimension; ++i)
+  // Copy the vector components into the input buffer for FFT in one pass.
+  // The field is stored at the origin of the (padded) buffer.
+  SizeValueType line = 0; // Counter for field copying
+  while (!inputIt.IsAtEnd())
+  {
+    OffsetValueType n = VariationalRegistrationFFTUtilities::GetLineOffset(line, this->m_FieldSize, this->m_Size);
+    while (!inputIt.IsAtEndOfLine())
+    {
+      const PixelType vec = inputIt.Get();
+      for (unsigned int i = 0; i < ImageDimension; ++i)
+      {
+        RealTypeFFT & value = m_RealBuffer[i * this->m_TotalSize + n];
+        value = addFieldSpectrum ? vec[i] - lastOutputScale * value : vec[i];
+      }
+      ++inputIt;
+      ++n;
+    }
+    inputIt.NextLine();
+    ++line;
+  }
+
+  // Extend the field into the padding of the buffer
+  if (this->m_Size != this->m_FieldSize)
   {
-    // Copy vector component into input buffer for FFT
-    for (n = 0, inputIt.GoToBegin(); !inputIt.IsAtEnd(); ++n, ++inputIt)
+    for (unsigned int i = 0; i < ImageDimension; ++i)
     {
-      m_InputBuffer[n] = inputIt.Get()[i];
+      VariationalRegistrationFFTUtilities::PadBuffer(
+        m_RealBuffer.data() + i * this->m_TotalSize, this->m_FieldSize, this->m_Size);
     }
+  }
+
+  // Execute FFT for all components
+  this->m_FFTBackend->ExecuteRealToComplex();
+
+  // Keep the spectrum of the increment and transform the unregularized
+  // increment
+  if (this->m_SplitIncrement)
+  {
+    std::copy(this->m_ComplexData.begin(), this->m_ComplexData.end(), this->m_IncrementSpectrum.begin());
 
-    // Execute FFT for component
-    FFTWProxyType::Execute(this->m_PlanForward[i]);
+    const RealTypeFFT unregularizedScale = this->GetUnregularizedIncrementScale();
+    ConstIteratorType unregularizedIt(unregularizedField, inputField->GetRequestedRegion());
+    for (line = 0; !unregularizedIt.IsAtEnd(); ++line)
+    {
+      OffsetValueType n = VariationalRegistrationFFTUtilities::GetLineOffset(line, this->m_FieldSize, this->m_Size);
+      while (!unregularizedIt.IsAtEndOfLine())
+      {
+        const PixelType vec = unregularizedIt.Get();
+        for (unsigned int i = 0; i < ImageDimension; ++i)
+        {
+          m_RealBuffer[i * this->m_TotalSize + n] = unregularizedScale * vec[i];
+        }
+        ++unregularizedIt;
+        ++n;
+      }
+      unregularizedIt.NextLine();
+    }
+    if (this->m_Size != this->m_FieldSize)
+    {
+      for (unsigned int i = 0; i < ImageDimension; ++i)
+      {
+        VariationalRegistrationFFTUtilities::PadBuffer(
+          m_RealBuffer.data() + i * this->m_TotalSize, this->m_FieldSize, this->m_Size);
+      }
+    }
+    this->m_FFTBackend->ExecuteRealToComplex();
   }
 
   // Solve the LES in Fourier domain
   itkDebugMacro(<< "Solving Elastic LES...");
   this->SolveElasticLES();
+  this->m_FieldSpectrumIsValid = keepFieldSpectrum;
 
   // Perform Backward FFT for the result in the complex domain
   itkDebugMacro(<< "Performing Backward FFT...");
   DisplacementFieldPointer outField = this->GetOutput();
 
-  using IteratorType = ImageRegionIterator<DisplacementFieldType>;
+  using IteratorType = ImageScanlineIterator<DisplacementFieldType>;
   IteratorType outIt(outField, outField->GetRequestedRegion());
 
-  for (unsigned int i = 0; i < ImageDimension; ++i)
-  {
-    //  Execute FFT for component
-    FFTWProxyType::Execute(this->m_PlanBackward[i]);
+  // Execute FFT for all components
+  this->m_FFTBackend->ExecuteComplexToReal();
 
-    // Copy complex buffer for component to component of field
-    for (n = 0, outIt.GoToBegin(); !outIt.IsAtEnd(); ++n, ++outIt)
+  // Copy the components of the result to the field in one pass; the padding
+  // is cropped
+  PixelType outVec;
+  for (line = 0; !outIt.IsAtEnd(); ++line)
+  {
+    OffsetValueType n = VariationalRegistrationFFTUtilities::GetLineOffset(line, this->m_FieldSize, this->m_Size);
+    while (!outIt.IsAtEndOfLine())
     {
-      PixelType vec = outIt.Get();
-      vec[i] = m_OutputBuffer[n] / static_cast<double>(this->m_TotalSize);
-      outIt.Set(vec);
+      for (unsigned int i = 0; i < ImageDimension; ++i)
+      {
+        outVec[i] = m_RealBuffer[i * this->m_TotalSize + n] / static_cast<double>(this->m_TotalSize);
+      }
+      outIt.Set(outVec);
+      ++outIt;
+      ++n;
     }
+    outIt.NextLine();
   }
 
   outField->Modified();
@@ -299,9 +410,9 @@ VariationalRegistrationElasticRegularizer<TDisplacementField>::Regularize()
 /**
  * Solve elastic LES
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 void
-VariationalRegistrationElasticRegularizer<TDisplacementField>::SolveElasticLES()
+VariationalRegistrationElasticRegularizer<TDisplacementField, TRealTypeFFT>::SolveElasticLES()
 {
   // Declare thread data struct and set filter
   ElasticFFTThreadStruct elasticLESStr;
@@ -319,9 +430,9 @@ VariationalRegistrationElasticRegularizer<TDisplacementField>::SolveElasticLES()
 /**
  * Solve elastic LES
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 ITK_THREAD_RETURN_TYPE
-VariationalRegistrationElasticRegularizer<TDisplacementField>::SolveElasticLESThreaderCallback(void * arg)
+VariationalRegistrationElasticRegularizer<TDisplacementField, TRealTypeFFT>::SolveElasticLESThreaderCallback(void * arg)
 {
   // Get MultiThreader struct
   auto * threadStruct = (MultiThreaderBase::WorkUnitInfo *)arg;
@@ -343,14 +454,75 @@ VariationalRegistrationElasticRegularizer<TDisplacementField>::SolveElasticLESTh
 }
 
 /**
- * Solve elastic LES
+ * Initialize inverse matrix
  */
-template <typename TDisplacementField>
-void
-VariationalRegistrationElasticRegularizer<TDisplacementField>::ThreadedSolveElasticLES(OffsetValueType from,
-                                                                                       OffsetValueType to)
+template <typename TDisplacementField, typename TRealTypeFFT>
+bool
+VariationalRegistrationElasticRegularizer<TDisplacementField, TRealTypeFFT>::InitializeInverseMatrix()
 {
+  itkDebugMacro(<< "Initializing inverse elastic matrix for FFT...");
+
   // Only implemented for Imagedimension 2 and 3 - throw exception otherwise
+  if (ImageDimension != 2 && ImageDimension != 3)
+  {
+    itkExceptionMacro(<< "Elastic regularizer implemented only for ImageDimension = 2 or 3!");
+  }
+
+  for (unsigned int e = 0; e < NumberOfMatrixEntries; ++e)
+  {
+    this->m_InverseMatrix[e].resize(this->m_TotalComplexSize);
+  }
+
+  // Each line along the first dimension of the complex buffer is processed
+  // by one work unit
+  const OffsetValueType lineLength = this->m_ComplexSize[0];
+  const OffsetValueType numberOfLines = this->m_TotalComplexSize / lineLength;
+
+  this->GetMultiThreader()->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+  this->GetMultiThreader()->ParallelizeArray(
+    0,
+    numberOfLines,
+    [this, lineLength](SizeValueType line) {
+      const OffsetValueType lineOffset = line * lineLength;
+
+      typename DisplacementFieldType::IndexType index;
+      index[0] = 0;
+      for (unsigned int d = 1; d < ImageDimension; ++d)
+      {
+        index[d] = static_cast<typename DisplacementFieldType::IndexValueType>(line % this->m_ComplexSize[d]);
+        line /= this->m_ComplexSize[d];
+      }
+      for (OffsetValueType x = 0; x < lineLength; ++x)
+      {
+        index[0] = static_cast<typename DisplacementFieldType::IndexValueType>(x);
+        this->ComputeInverseMatrix(index, lineOffset + x);
+      }
+    },
+    nullptr);
+
+  this->m_InverseMatrixMu = this->m_Mu;
+  this->m_InverseMatrixLambda = this->m_Lambda;
+  this->m_InverseMatrixSpacing = this->m_Spacing;
+  this->m_InverseMatrixUseImageSpacing = this->GetUseImageSpacing();
+
+  return true;
+}
+
+/**
+ * Compute the inverse matrix for one frequency
+ */
+template <typename TDisplacementField, typename TRealTypeFFT>
+void
+VariationalRegistrationElasticRegularizer<TDisplacementField, TRealTypeFFT>::ComputeInverseMatrix(
+  const typename DisplacementFieldType::IndexType & index,
+  OffsetValueType                                   offset)
+{
+  ValueType meanSquaredSpacing = 0.0;
+  for (unsigned int i = 0; i < ImageDimension; ++i)
+  {
+    meanSquaredSpacing += itk::Math::sqr(m_Spacing[i]);
+  }
+
   if (ImageDimension == 3)
   {
     // Get parameters from struct
@@ -365,120 +537,79 @@ VariationalRegistrationElasticRegularizer<TDisplacementField>::ThreadedSolveElas
     const double lp2m = m_Lambda + 2 * m_Mu;
     const double lpm = m_Lambda + m_Mu;
 
-    double fftInX[2];
-    double fftInY[2];
-    double fftInZ[2];
     double detD;
     double d11, d12, d13, d22, d23, d33;
-    double invD11, invD12, invD13, invD22, invD23, invD33;
-
-    const double mu_hx2 = m_Mu / itk::Math::sqr(m_Spacing[0]);
-    const double mu_hy2 = m_Mu / itk::Math::sqr(m_Spacing[1]);
-    const double mu_hz2 = m_Mu / itk::Math::sqr(m_Spacing[2]);
 
-    const double lambdaPlus2mu_hx2 = (m_Lambda + 2 * m_Mu) / itk::Math::sqr(m_Spacing[0]);
-    const double lambdaPlus2mu_hy2 = (m_Lambda + 2 * m_Mu) / itk::Math::sqr(m_Spacing[1]);
-    const double lambdaPlus2mu_hz2 = (m_Lambda + 2 * m_Mu) / itk::Math::sqr(m_Spacing[2]);
-
-    const double lambdaPlusmu_hxhy = (m_Lambda + m_Mu) / (m_Spacing[0] * m_Spacing[1]);
-    const double lambdaPlusmu_hxhz = (m_Lambda + m_Mu) / (m_Spacing[0] * m_Spacing[2]);
-    const double lambdaPlusmu_hyhz = (m_Lambda + m_Mu) / (m_Spacing[1] * m_Spacing[2]);
+    meanSquaredSpacing /= 3.0;
 
-    ValueType meanSquaredSpacing = 0.0;
-    for (unsigned int i = 0; i < ImageDimension; ++i)
+    // Calculate the matrix values for current pixel position using the
+    // precomputed sine and cosine values.
+    if (this->GetUseImageSpacing())
     {
-      meanSquaredSpacing += itk::Math::sqr(m_Spacing[i]);
+      const double mu_hx2 = m_Mu / itk::Math::sqr(m_Spacing[0]);
+      const double mu_hy2 = m_Mu / itk::Math::sqr(m_Spacing[1]);
+      const double mu_hz2 = m_Mu / itk::Math::sqr(m_Spacing[2]);
+
+      const double lambdaPlus2mu_hx2 = (m_Lambda + 2 * m_Mu) / itk::Math::sqr(m_Spacing[0]);
+      const double lambdaPlus2mu_hy2 = (m_Lambda + 2 * m_Mu) / itk::Math::sqr(m_Spacing[1]);
+      const double lambdaPlus2mu_hz2 = (m_Lambda + 2 * m_Mu) / itk::Math::sqr(m_Spacing[2]);
+
+      const double lambdaPlusmu_hxhy = (m_Lambda + m_Mu) / (m_Spacing[0] * m_Spacing[1]);
+      const double lambdaPlusmu_hxhz = (m_Lambda + m_Mu) / (m_Spacing[0] * m_Spacing[2]);
+      const double lambdaPlusmu_hyhz = (m_Lambda + m_Mu) / (m_Spacing[1] * m_Spacing[2]);
+
+      // Calculate matrix M
+      d11 = -2 * (lambdaPlus2mu_hx2 + mu_hy2 + mu_hz2) + lambdaPlus2mu_hx2 * Cosj[index[0]] + mu_hy2 * Cosk[index[1]] +
+            mu_hz2 * Cosl[index[2]];
+      d12 = -lambdaPlusmu_hxhy * Sinj[index[0]] * Sink[index[1]];
+      d13 = -lambdaPlusmu_hxhz * Sinj[index[0]] * Sinl[index[2]];
+      d22 = -2 * (lambdaPlus2mu_hy2 + mu_hx2 + mu_hz2) + lambdaPlus2mu_hy2 * Cosk[index[1]] + mu_hx2 * Cosj[index[0]] +
+            mu_hz2 * Cosl[index[2]];
+      d23 = -lambdaPlusmu_hyhz * Sink[index[1]] * Sinl[index[2]];
+      d33 = -2 * (lambdaPlus2mu_hz2 + mu_hx2 + mu_hy2) + lambdaPlus2mu_hz2 * Cosl[index[2]] + mu_hx2 * Cosj[index[0]] +
+            mu_hy2 * Cosk[index[1]];
+
+      // Calculate Id - h^2 * M.
+      d11 = 1 - meanSquaredSpacing * d11;
+      d12 = -meanSquaredSpacing * d12;
+      d13 = -meanSquaredSpacing * d13;
+      d22 = 1 - meanSquaredSpacing * d22;
+      d23 = -meanSquaredSpacing * d23;
+      d33 = 1 - meanSquaredSpacing * d33;
     }
-    meanSquaredSpacing /= 3.0;
-
-    // Iterate over each pixel in thread range
-    for (OffsetValueType i = from; i < to; ++i)
+    else
     {
-      // Get image index according to offset
-      typename DisplacementFieldType::IndexType index = this->CalculateComplexImageIndex(i);
-
-      // Save values of forward FFT X,Y,Z for this pixel
-      // to be able to overwrite the array
-      fftInX[0] = m_ComplexBuffer[0][i][0];
-      fftInX[1] = m_ComplexBuffer[0][i][1];
-      fftInY[0] = m_ComplexBuffer[1][i][0];
-      fftInY[1] = m_ComplexBuffer[1][i][1];
-      fftInZ[0] = m_ComplexBuffer[2][i][0];
-      fftInZ[1] = m_ComplexBuffer[2][i][1];
-
-      // Calculate the matrix values for current pixel position using the
-      // precomputed sine and cosine values.
-      if (this->GetUseImageSpacing())
-      {
-        // Calculate matrix M
-        d11 = -2 * (lambdaPlus2mu_hx2 + mu_hy2 + mu_hz2) + lambdaPlus2mu_hx2 * Cosj[index[0]] +
-              mu_hy2 * Cosk[index[1]] + mu_hz2 * Cosl[index[2]];
-        d12 = -lambdaPlusmu_hxhy * Sinj[index[0]] * Sink[index[1]];
-        d13 = -lambdaPlusmu_hxhz * Sinj[index[0]] * Sinl[index[2]];
-        d22 = -2 * (lambdaPlus2mu_hy2 + mu_hx2 + mu_hz2) + lambdaPlus2mu_hy2 * Cosk[index[1]] +
-              mu_hx2 * Cosj[index[0]] + mu_hz2 * Cosl[index[2]];
-        d23 = -lambdaPlusmu_hyhz * Sink[index[1]] * Sinl[index[2]];
-        d33 = -2 * (lambdaPlus2mu_hz2 + mu_hx2 + mu_hy2) + lambdaPlus2mu_hz2 * Cosl[index[2]] +
-              mu_hx2 * Cosj[index[0]] + mu_hy2 * Cosk[index[1]];
-
-        // Calculate Id - h^2 * M.
-        d11 = 1 - meanSquaredSpacing * d11;
-        d12 = -meanSquaredSpacing * d12;
-        d13 = -meanSquaredSpacing * d13;
-        d22 = 1 - meanSquaredSpacing * d22;
-        d23 = -meanSquaredSpacing * d23;
-        d33 = 1 - meanSquaredSpacing * d33;
-      }
-      else
-      {
-        // Calculate Id - h^2 * M.
-        d11 = 1 - m2lp4m - lp2m * Cosj[index[0]] - m_Mu * (Cosk[index[1]] + Cosl[index[2]]);
-        d12 = lpm * Sinj[index[0]] * Sink[index[1]];
-        d13 = lpm * Sinj[index[0]] * Sinl[index[2]];
-        d22 = 1 - m2lp4m - lp2m * Cosk[index[1]] - m_Mu * (Cosj[index[0]] + Cosl[index[2]]);
-        d23 = lpm * Sink[index[1]] * Sinl[index[2]];
-        d33 = 1 - m2lp4m - lp2m * Cosl[index[2]] - m_Mu * (Cosj[index[0]] + Cosk[index[1]]);
-      }
-
-      // Calculate determinant
-      detD = d11 * d22 * d33 - d11 * d23 * d23 - d12 * d12 * d33 + d12 * d13 * d23 + d12 * d13 * d23 - d13 * d13 * d22;
-
-      // Calculate the inverse values
-      if (fabs(detD) < 1e-15)
-      {
-        // If determinant is (close to) zero, inverse is zero
-        m_ComplexBuffer[0][i][0] = 0;
-        m_ComplexBuffer[0][i][1] = 0;
+      // Calculate Id - h^2 * M.
+      d11 = 1 - m2lp4m - lp2m * Cosj[index[0]] - m_Mu * (Cosk[index[1]] + Cosl[index[2]]);
+      d12 = lpm * Sinj[index[0]] * Sink[index[1]];
+      d13 = lpm * Sinj[index[0]] * Sinl[index[2]];
+      d22 = 1 - m2lp4m - lp2m * Cosk[index[1]] - m_Mu * (Cosj[index[0]] + Cosl[index[2]]);
+      d23 = lpm * Sink[index[1]] * Sinl[index[2]];
+      d33 = 1 - m2lp4m - lp2m * Cosl[index[2]] - m_Mu * (Cosj[index[0]] + Cosk[index[1]]);
+    }
 
-        m_ComplexBuffer[1][i][0] = 0;
-        m_ComplexBuffer[1][i][1] = 0;
+    // Calculate determinant
+    detD = d11 * d22 * d33 - d11 * d23 * d23 - d12 * d12 * d33 + d12 * d13 * d23 + d12 * d13 * d23 - d13 * d13 * d22;
 
-        m_ComplexBuffer[2][i][0] = 0;
-        m_ComplexBuffer[2][i][1] = 0;
-      }
-      else
+    // Calculate the inverse values
+    if (fabs(detD) < 1e-15)
+    {
+      // If determinant is (close to) zero, inverse is zero
+      for (unsigned int e = 0; e < NumberOfMatrixEntries; ++e)
       {
-        // Calculate inverse of the 3x3 matrix
-        invD11 = (d22 * d33 - d23 * d23) / detD;
-        invD12 = (d13 * d23 - d12 * d33) / detD;
-        invD13 = (d12 * d23 - d13 * d22) / detD;
-        invD22 = (d11 * d33 - d13 * d13) / detD;
-        invD23 = (d12 * d13 - d11 * d23) / detD;
-        invD33 = (d11 * d22 - d12 * d12) / detD;
-
-        // Calculate du1 = invD11.*fft3(in1) + invD12.*fft3(in2) + invD13.*fft3(in3)
-        m_ComplexBuffer[0][i][0] = invD11 * fftInX[0] + invD12 * fftInY[0] + invD13 * fftInZ[0];
-        m_ComplexBuffer[0][i][1] = invD11 * fftInX[1] + invD12 * fftInY[1] + invD13 * fftInZ[1];
-
-        // Calculate du2 = invD12.*fft3(in1) + invD22.*fft3(in2) + invD23.*fft3(in3)
-        m_ComplexBuffer[1][i][0] = invD12 * fftInX[0] + invD22 * fftInY[0] + invD23 * fftInZ[0];
-        m_ComplexBuffer[1][i][1] = invD12 * fftInX[1] + invD22 * fftInY[1] + invD23 * fftInZ[1];
-
-        // Calculate du3 = invD13.*fft3(in1) + invD23.*fft3(in2) + invD33.*fft3(in3)
-        m_ComplexBuffer[2][i][0] = invD13 * fftInX[0] + invD23 * fftInY[0] + invD33 * fftInZ[0];
-        m_ComplexBuffer[2][i][1] = invD13 * fftInX[1] + invD23 * fftInY[1] + invD33 * fftInZ[1];
+        m_InverseMatrix[e][offset] = 0.0f;
       }
     }
+    else
+    {
+      // Calculate inverse of the 3x3 matrix
+      m_InverseMatrix[0][offset] = static_cast<RealTypeFFT>((d22 * d33 - d23 * d23) / detD);
+      m_InverseMatrix[1][offset] = static_cast<RealTypeFFT>((d13 * d23 - d12 * d33) / detD);
+      m_InverseMatrix[2][offset] = static_cast<RealTypeFFT>((d12 * d23 - d13 * d22) / detD);
+      m_InverseMatrix[3][offset] = static_cast<RealTypeFFT>((d11 * d33 - d13 * d13) / detD);
+      m_InverseMatrix[4][offset] = static_cast<RealTypeFFT>((d12 * d13 - d11 * d23) / detD);
+      m_InverseMatrix[5][offset] = static_cast<RealTypeFFT>((d11 * d22 - d12 * d12) / detD);
+    }
   }
   else if (ImageDimension == 2)
   {
@@ -492,136 +623,201 @@ VariationalRegistrationElasticRegularizer<TDisplacementField>::ThreadedSolveElas
     const double lp2m = m_Lambda + 2 * m_Mu;
     const double lpm = m_Lambda + m_Mu;
 
-    double fftInX[2];
-    double fftInY[2];
     double detD;
     double d11, d12, d22;
-    double invD11, invD12, invD22;
 
-    const double mu_hx2 = m_Mu / itk::Math::sqr(m_Spacing[0]);
-    const double mu_hy2 = m_Mu / itk::Math::sqr(m_Spacing[1]);
+    meanSquaredSpacing /= ImageDimension;
 
-    const double lambdaPlus2mu_hx2 = (m_Lambda + 2 * m_Mu) / itk::Math::sqr(m_Spacing[0]);
-    const double lambdaPlus2mu_hy2 = (m_Lambda + 2 * m_Mu) / itk::Math::sqr(m_Spacing[1]);
+    // Calculate the matrix values for current pixel position using the
+    // precomputed sine and cosine values.
+    if (this->GetUseImageSpacing())
+    {
+      const double mu_hx2 = m_Mu / itk::Math::sqr(m_Spacing[0]);
+      const double mu_hy2 = m_Mu / itk::Math::sqr(m_Spacing[1]);
 
-    const double lambdaPlusmu_hxhy = (m_Lambda + m_Mu) / (m_Spacing[0] * m_Spacing[1]);
+      const double lambdaPlus2mu_hx2 = (m_Lambda + 2 * m_Mu) / itk::Math::sqr(m_Spacing[0]);
+      const double lambdaPlus2mu_hy2 = (m_Lambda + 2 * m_Mu) / itk::Math::sqr(m_Spacing[1]);
 
-    ValueType meanSquaredSpacing = 0.0;
-    for (unsigned int i = 0; i < ImageDimension; ++i)
-    {
-      meanSquaredSpacing += itk::Math::sqr(m_Spacing[i]);
-    }
-    meanSquaredSpacing /= ImageDimension;
+      const double lambdaPlusmu_hxhy = (m_Lambda + m_Mu) / (m_Spacing[0] * m_Spacing[1]);
 
-    // Iterate over each pixel in thread range
-    for (OffsetValueType i = from; i < to; ++i)
-    {
-      // Get image index according to offset
-      typename DisplacementFieldType::IndexType index = this->CalculateComplexImageIndex(i);
-
-      // Save values of forward FFT X,Y for this pixel
-      // to be able to overwrite the array
-      fftInX[0] = m_ComplexBuffer[0][i][0];
-      fftInX[1] = m_ComplexBuffer[0][i][1];
-      fftInY[0] = m_ComplexBuffer[1][i][0];
-      fftInY[1] = m_ComplexBuffer[1][i][1];
-
-      // Calculate the matrix values for current pixel position using the
-      // precomputed sine and cosine values.
-      if (this->GetUseImageSpacing())
-      {
-        // Calculate matrix M
-        d11 = -2 * (lambdaPlus2mu_hx2 + mu_hy2) + lambdaPlus2mu_hx2 * Cosj[index[0]] + mu_hy2 * Cosk[index[1]];
-        d12 = -lambdaPlusmu_hxhy * Sinj[index[0]] * Sink[index[1]];
-        d22 = -2 * (lambdaPlus2mu_hy2 + mu_hx2) + lambdaPlus2mu_hy2 * Cosk[index[1]] + mu_hx2 * Cosj[index[0]];
-
-        // Calculate Id - h^2 * M.
-        d11 = 1 - meanSquaredSpacing * d11;
-        d12 = -meanSquaredSpacing * d12;
-        d22 = 1 - meanSquaredSpacing * d22;
-      }
-      else
-      {
-        // Calculate Id - M.
-        d11 = 1 - m2lp3m - lp2m * Cosj[index[0]] - m_Mu * (Cosk[index[1]]);
-        d12 = lpm * Sinj[index[0]] * Sink[index[1]];
-        d22 = 1 - m2lp3m - lp2m * Cosk[index[1]] - m_Mu * (Cosj[index[0]]);
-      }
+      // Calculate matrix M
+      d11 = -2 * (lambdaPlus2mu_hx2 + mu_hy2) + lambdaPlus2mu_hx2 * Cosj[index[0]] + mu_hy2 * Cosk[index[1]];
+      d12 = -lambdaPlusmu_hxhy * Sinj[index[0]] * Sink[index[1]];
+      d22 = -2 * (lambdaPlus2mu_hy2 + mu_hx2) + lambdaPlus2mu_hy2 * Cosk[index[1]] + mu_hx2 * Cosj[index[0]];
 
-      // Calculate determinant
-      detD = d11 * d22 - d12 * d12;
+      // Calculate Id - h^2 * M.
+      d11 = 1 - meanSquaredSpacing * d11;
+      d12 = -meanSquaredSpacing * d12;
+      d22 = 1 - meanSquaredSpacing * d22;
+    }
+    else
+    {
+      // Calculate Id - M.
+      d11 = 1 - m2lp3m - lp2m * Cosj[index[0]] - m_Mu * (Cosk[index[1]]);
+      d12 = lpm * Sinj[index[0]] * Sink[index[1]];
+      d22 = 1 - m2lp3m - lp2m * Cosk[index[1]] - m_Mu * (Cosj[index[0]]);
+    }
 
-      // Calculate the inverse values
-      if (fabs(detD) < 1e-15)
-      {
-        // If determinant is (close to) zero, inverse is zero
-        m_ComplexBuffer[0][i][0] = 0;
-        m_ComplexBuffer[0][i][1] = 0;
+    // Calculate determinant
+    detD = d11 * d22 - d12 * d12;
 
-        m_ComplexBuffer[1][i][0] = 0;
-        m_ComplexBuffer[1][i][1] = 0;
-      }
-      else
+    // Calculate the inverse values
+    if (fabs(detD) < 1e-15)
+    {
+      // If determinant is (close to) zero, inverse is zero
+      for (unsigned int e = 0; e < NumberOfMatrixEntries; ++e)
       {
-        // Calculate inverse of the 2x2 matrix
-        invD11 = d22 / detD;
-        invD12 = -d12 / detD;
-        invD22 = d11 / detD;
-
-        // Calculate du1 = invD11.*fft2(in1) + invD12.*fft2(in2)
-        m_ComplexBuffer[0][i][0] = invD11 * fftInX[0] + invD12 * fftInY[0];
-        m_ComplexBuffer[0][i][1] = invD11 * fftInX[1] + invD12 * fftInY[1];
-
-        // Calculate du2 = invD12.*fft2(in1) + invD22.*fft2(in2)
-        m_ComplexBuffer[1][i][0] = invD12 * fftInX[0] + invD22 * fftInY[0];
-        m_ComplexBuffer[1][i][1] = invD12 * fftInX[1] + invD22 * fftInY[1];
+        m_InverseMatrix[e][offset] = 0.0f;
       }
     }
-  }
-  else
-  {
-    itkExceptionMacro(<< "Elastic regularizer implemented only for ImageDimension = 2 or 3!");
+    else
+    {
+      // Calculate inverse of the 2x2 matrix
+      m_InverseMatrix[0][offset] = static_cast<RealTypeFFT>(d22 / detD);
+      m_InverseMatrix[1][offset] = static_cast<RealTypeFFT>(-d12 / detD);
+      m_InverseMatrix[2][offset] = static_cast<RealTypeFFT>(d11 / detD);
+    }
   }
 }
 
-/*
- * Calculate the index in the complex image for a given offset.
+/**
+ * Solve elastic LES
  */
-template <typename TDisplacementField>
-typename VariationalRegistrationElasticRegularizer<TDisplacementField>::DisplacementFieldType::IndexType
-VariationalRegistrationElasticRegularizer<TDisplacementField>::CalculateComplexImageIndex(OffsetValueType offset)
+template <typename TDisplacementField, typename TRealTypeFFT>
+void
+VariationalRegistrationElasticRegularizer<TDisplacementField, TRealTypeFFT>::ThreadedSolveElasticLES(
+  OffsetValueType from,
+  OffsetValueType to)
 {
-  typename DisplacementFieldType::IndexType index;
-  typename DisplacementFieldType::IndexType requestedRegionIndex = this->GetOutput()->GetRequestedRegion().GetIndex();
+  // Multiply the spectrum of each frequency with the precomputed symmetric
+  // inverse matrix; entry (r, c) with r <= c is stored at
+  // r * ImageDimension - r * (r - 1) / 2 + (c - r).
+  const RealTypeFFT * inverseMatrix[ImageDimension][ImageDimension];
+  for (unsigned int r = 0; r < ImageDimension; ++r)
+  {
+    for (unsigned int c = r; c < ImageDimension; ++c)
+    {
+      inverseMatrix[r][c] = m_InverseMatrix[r * ImageDimension - r * (r - 1) / 2 + (c - r)].data();
+      inverseMatrix[c][r] = inverseMatrix[r][c];
+    }
+  }
 
-  for (int j = ImageDimension - 1; j > 0; j--)
+  ComplexTypeFFT * fft[ImageDimension];
+  for (unsigned int c = 0; c < ImageDimension; ++c)
   {
-    index[j] = static_cast<typename DisplacementFieldType::IndexValueType>(offset / this->m_ComplexOffsetTable[j]);
-    offset -= (index[j] * this->m_ComplexOffsetTable[j]);
-    index[j] += requestedRegionIndex[j];
+    fft[c] = m_ComplexBuffer[c];
   }
-  index[0] = requestedRegionIndex[0] + static_cast<typename DisplacementFieldType::IndexValueType>(offset);
 
-  return index;
+  // With incremental update, the (regularized) spectrum of the increment is
+  // added to the kept spectrum, which is replaced by the result. With a split
+  // increment, the buffer holds the spectrum of the unregularized increment,
+  // which is not regularized before.
+  const bool             keepFieldSpectrum = this->GetUseIncrementalUpdate();
+  const bool             addFieldSpectrum = m_AddFieldSpectrum;
+  const bool             regularizeIncrement = this->GetRegularizeIncrement();
+  const bool             splitIncrement = m_SplitIncrement;
+  ComplexTypeFFT *       fieldSpectrum[ImageDimension];
+  const ComplexTypeFFT * incrementSpectrum[ImageDimension];
+  for (unsigned int c = 0; c < ImageDimension; ++c)
+  {
+    fieldSpectrum[c] = keepFieldSpectrum ? m_FieldSpectrum.data() + c * m_TotalComplexSize : nullptr;
+    incrementSpectrum[c] = splitIncrement ? m_IncrementSpectrum.data() + c * m_TotalComplexSize : nullptr;
+  }
+
+  // Iterate over each pixel in thread range
+  for (OffsetValueType i = from; i < to; ++i)
+  {
+    // Save values of forward FFT for this pixel to be able to overwrite the
+    // array
+    double fftIn[ImageDimension][2];
+    for (unsigned int c = 0; c < ImageDimension; ++c)
+    {
+      fftIn[c][0] = fft[c][i].real();
+      fftIn[c][1] = fft[c][i].imag();
+    }
+
+    if (addFieldSpectrum)
+    {
+      // Part of the increment that is regularized before it is added
+      double regularized[ImageDimension][2];
+      double increment[ImageDimension][2];
+      for (unsigned int c = 0; c < ImageDimension; ++c)
+      {
+        regularized[c][0] = splitIncrement ? incrementSpectrum[c][i].real() - fftIn[c][0] : fftIn[c][0];
+        regularized[c][1] = splitIncrement ? incrementSpectrum[c][i].imag() - fftIn[c][1] : fftIn[c][1];
+        increment[c][0] = splitIncrement ? fftIn[c][0] : 0.0;
+        increment[c][1] = splitIncrement ? fftIn[c][1] : 0.0;
+      }
+      for (unsigned int r = 0; r < ImageDimension; ++r)
+      {
+        if (regularizeIncrement)
+        {
+          for (unsigned int c = 0; c < ImageDimension; ++c)
+          {
+            increment[r][0] += inverseMatrix[r][c][i] * regularized[c][0];
+            increment[r][1] += inverseMatrix[r][c][i] * regularized[c][1];
+          }
+        }
+        else
+        {
+          increment[r][0] += regularized[r][0];
+          increment[r][1] += regularized[r][1];
+        }
+      }
+      for (unsigned int c = 0; c < ImageDimension; ++c)
+      {
+        fftIn[c][0] = increment[c][0] + fieldSpectrum[c][i].real();
+        fftIn[c][1] = increment[c][1] + fieldSpectrum[c][i].imag();
+      }
+    }
+
+    // Calculate du_r = sum_c invD_rc .* fft(in_c)
+    for (unsigned int r = 0; r < ImageDimension; ++r)
+    {
+      double real = 0.0;
+      double imag = 0.0;
+      for (unsigned int c = 0; c < ImageDimension; ++c)
+      {
+        real += inverseMatrix[r][c][i] * fftIn[c][0];
+        imag += inverseMatrix[r][c][i] * fftIn[c][1];
+      }
+      fft[r][i] = ComplexTypeFFT(static_cast<RealTypeFFT>(real), static_cast<RealTypeFFT>(imag));
+      if (keepFieldSpectrum)
+      {
+        fieldSpectrum[r][i] = fft[r][i];
+      }
+    }
+  }
 }
 
 /*
  * Print status information
  */
-template <typename TDisplacementField>
+template <typename TDisplacementField, typename TRealTypeFFT>
 void
-VariationalRegistrationElasticRegularizer<TDisplacementField>::PrintSelf(std::ostream & os, Indent indent) const
+VariationalRegistrationElasticRegularizer<TDisplacementField, TRealTypeFFT>::PrintSelf(std::ostream & os,
+                                                                                       Indent         indent) const
 {
   Superclass::PrintSelf(os, indent);
 
+  os << indent << "FieldSize: ";
+  os << m_FieldSize << std::endl;
   os << indent << "Size: ";
   os << m_Size << std::endl;
   os << indent << "Spacing: ";
   os << m_Spacing << std::endl;
+  os << indent << "FFTBackend: ";
+  os << (m_FFTBackend.IsNull() ? "(none)" : m_FFTBackend->GetNameOfClass()) << std::endl;
+  os << indent << "PlanRigor: ";
+  os << m_PlanRigor << std::endl;
+  os << indent << "WisdomFileName: ";
+  os << m_WisdomFileName << std::endl;
+  os << indent << "UsePadding: ";
+  os << m_UsePadding << std::endl;
+  os << indent << "FieldSpectrumIsValid: ";
+  os << m_FieldSpectrumIsValid << std::endl;
 }
 
 } // end namespace itk
 
 #endif
-
-#endif
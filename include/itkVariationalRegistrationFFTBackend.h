@@ -0,0 +1,179 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationFFTBackend_h
+#define itkVariationalRegistrationFFTBackend_h
+
+#include "itkNumericTraits.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkSize.h"
+
+#include <complex>
+#include <string>
+
+namespace itk
+{
+
+/** \class itk::VariationalRegistrationFFTBackend
+ *
+ *  \brief Interface of the FFT implementations used by the spectral regularizers.
+ *
+ *  A backend plans transforms for a size and a pair of buffers once (Plan...())
+ *  and executes them on these buffers in each iteration (Execute...()). The
+ *  transforms are not normalized and follow the definitions of FFTW:
+ *  - ExecuteRealToComplex() computes the forward real-to-complex FFT of several
+ *    images stored one after another. The spectrum of each image has the size
+ *    [n_0/2+1, n_1, ..., n_d]. ExecuteComplexToReal() computes the inverse
+ *    transform (FFTW_FORWARD / FFTW_BACKWARD).
+ *  - ExecuteForwardCosine() computes the DCT-III (FFTW_REDFT01) of the spatial
+ *    buffer into the frequency buffer, ExecuteBackwardCosine() the DCT-II
+ *    (FFTW_REDFT10) of the frequency buffer into the spatial buffer.
+ *
+ *  Sizes are given in ITK order, i.e. dimension 0 varies fastest in memory.
+ *  The execution may overwrite the input buffer of a transform.
+ *
+ *  The planner effort and the wisdom file are hints for backends that measure
+ *  the speed of algorithms while planning; other backends ignore them.
+ *
+ *  Different backend instances can plan and execute concurrently, each with
+ *  its own number of work units, e.g. for several registrations in one
+ *  process. Backends with global state (FFTW) serialize their planning. A
+ *  single instance is not thread safe.
+ *
+ *  \sa VariationalRegistrationFFTWBackend
+ *  \sa VariationalRegistrationMixedRadixFFTBackend
+ *  \sa VariationalRegistrationElasticRegularizer
+ *  \sa VariationalRegistrationCurvatureRegularizer
+ *
+ *  \ingroup VariationalRegistration
+ */
+template <typename TReal, unsigned int VDimension>
+class VariationalRegistrationFFTBackend : public Object
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(VariationalRegistrationFFTBackend);
+
+  /** Standard class type alias */
+  using Self = VariationalRegistrationFFTBackend;
+  using Superclass = Object;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  /** Run-time type information (and related methods) */
+  itkTypeMacro(VariationalRegistrationFFTBackend, Object);
+
+  /** Dimension of the transforms. */
+  static constexpr unsigned int ImageDimension = VDimension;
+
+  /** Types of the buffers. */
+  using RealType = TReal;
+  using ComplexType = std::complex<TReal>;
+  using SizeType = Size<VDimension>;
+
+  /** Planner efforts; the values are the planner flags of FFTW. */
+  static constexpr unsigned int PlanEstimate = 1U << 6;
+  static constexpr unsigned int PlanMeasure = 0U;
+  static constexpr unsigned int PlanPatient = 1U << 5;
+
+  /** Set/Get the number of work units used for planning and execution. */
+  itkSetClampMacro(NumberOfWorkUnits, unsigned int, 1, NumericTraits<unsigned int>::max());
+  itkGetConstMacro(NumberOfWorkUnits, unsigned int);
+
+  /** Set/Get the planner effort: PlanEstimate, PlanMeasure or PlanPatient.
+   * Default is PlanMeasure. */
+  itkSetMacro(PlanRigor, unsigned int);
+  itkGetConstMacro(PlanRigor, unsigned int);
+
+  /** Set/Get the file the planner wisdom is imported from and exported to.
+   * Default is empty (no wisdom file). */
+  itkSetStringMacro(WisdomFileName);
+  itkGetStringMacro(WisdomFileName);
+
+  /** Returns if the regularizers pad the buffers to smooth sizes with this
+   * backend unless UsePadding is set explicitly. Backends whose costs grow
+   * quickly with large prime factors of the size return true. */
+  virtual bool
+  GetDefaultUsePadding() const
+  {
+    return false;
+  }
+
+  /** Plan the real-to-complex FFT and its inverse of numberOfImages images
+   * of the given size. The images are stored one after another in the real
+   * buffer, their spectra one after another in the complex buffer. Returns
+   * false if planning failed. */
+  virtual bool
+  PlanRealToComplex(const SizeType & size, unsigned int numberOfImages, RealType * real, ComplexType * complex) = 0;
+
+  /** Transform the real buffer into the complex buffer. */
+  virtual void
+  ExecuteRealToComplex() = 0;
+
+  /** Transform the complex buffer into the real buffer. */
+  virtual void
+  ExecuteComplexToReal() = 0;
+
+  /** Plan the DCTs of an image of the given size between the spatial and the
+   * frequency buffer. Returns false if planning failed. */
+  virtual bool
+  PlanCosine(const SizeType & size, RealType * spatial, RealType * frequency) = 0;
+
+  /** Transform the spatial buffer into the frequency buffer (DCT-III). */
+  virtual void
+  ExecuteForwardCosine() = 0;
+
+  /** Transform the frequency buffer into the spatial buffer (DCT-II). */
+  virtual void
+  ExecuteBackwardCosine() = 0;
+
+protected:
+  VariationalRegistrationFFTBackend()
+  {
+    m_NumberOfWorkUnits = 1;
+    m_PlanRigor = PlanMeasure;
+  }
+  ~VariationalRegistrationFFTBackend() override = default;
+
+  /** Print information about the backend. */
+  void
+  PrintSelf(std::ostream & os, Indent indent) const override
+  {
+    Superclass::PrintSelf(os, indent);
+
+    os << indent << "NumberOfWorkUnits: ";
+    os << m_NumberOfWorkUnits << std::endl;
+    os << indent << "PlanRigor: ";
+    os << m_PlanRigor << std::endl;
+    os << indent << "WisdomFileName: ";
+    os << m_WisdomFileName << std::endl;
+  }
+
+private:
+  /** Number of work units for planning and execution. */
+  unsigned int m_NumberOfWorkUnits;
+
+  /** Planner effort. */
+  unsigned int m_PlanRigor;
+
+  /** Wisdom file of the planner. */
+  std::string m_WisdomFileName;
+};
+
+} // namespace itk
+
+#endif
@@ -0,0 +1,212 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationFFTUtilities_h
+#define itkVariationalRegistrationFFTUtilities_h
+
+#include "itkVariationalRegistrationFFTBackend.h"
+#include "itkVariationalRegistrationFFTWBackend.h"
+#include "itkVariationalRegistrationMixedRadixFFTBackend.h"
+#include "itkSize.h"
+
+#include <type_traits>
+
+namespace itk
+{
+/**
+ * \namespace VariationalRegistrationFFTUtilities
+ *
+ * \brief Selection of the FFT backend and padding for the spectral regularizers.
+ *
+ * The backend is selected when the module is configured: FFTW
+ * (VariationalRegistrationFFTWBackend) is used if ITK is built with FFTW for
+ * the precision of the FFT, otherwise the bundled
+ * VariationalRegistrationMixedRadixFFTBackend. DefaultRealType selects the
+ * precision for the value type of a displacement field: double precision,
+ * unless ITK is built with FFTW for single precision only. Single precision
+ * for float fields has to be selected explicitly with the template parameter
+ * of the regularizers.
+ *
+ * FFTs are fastest for sizes whose prime factors are small; a large prime
+ * factor in one dimension can make the FFT several times slower than for
+ * the next larger smooth size. GetSmoothSize() computes this size,
+ * GetLineOffset() maps the lines of a field into a larger buffer and
+ * PadBuffer() fills the remaining pixels of the buffer.
+ *
+ * \sa VariationalRegistrationElasticRegularizer
+ * \sa VariationalRegistrationCurvatureRegularizer
+ *
+ * \ingroup VariationalRegistration
+ */
+namespace VariationalRegistrationFFTUtilities
+{
+
+/** Default precision of the FFT for fields with value type TValue. The
+ * precision does not depend on the value type, so the results of float and
+ * double fields agree. */
+template <typename TValue>
+struct DefaultRealType
+{
+#if defined(ITK_USE_FFTWF) && !defined(ITK_USE_FFTWD)
+  using Type = float;
+#else
+  using Type = double;
+#endif
+};
+
+/** True if ITK is built with FFTW for the precision TReal. */
+template <typename TReal>
+struct IsFFTWAvailable : std::false_type
+{};
+
+#if defined(ITK_USE_FFTWD)
+template <>
+struct IsFFTWAvailable<double> : std::true_type
+{};
+#endif
+
+#if defined(ITK_USE_FFTWF)
+template <>
+struct IsFFTWAvailable<float> : std::true_type
+{};
+#endif
+
+/** Default FFT backend for the precision TReal. */
+template <typename TReal, unsigned int VDimension>
+struct DefaultBackend
+{
+#if defined(ITK_USE_FFTWD) || defined(ITK_USE_FFTWF)
+  using Type = typename std::conditional<IsFFTWAvailable<TReal>::value,
+                                         VariationalRegistrationFFTWBackend<TReal, VDimension>,
+                                         VariationalRegistrationMixedRadixFFTBackend<TReal, VDimension>>::type;
+#else
+  using Type = VariationalRegistrationMixedRadixFFTBackend<TReal, VDimension>;
+#endif
+};
+
+/** Create an instance of the default FFT backend. */
+template <typename TReal, unsigned int VDimension>
+typename VariationalRegistrationFFTBackend<TReal, VDimension>::Pointer
+CreateDefaultBackend()
+{
+  return DefaultBackend<TReal, VDimension>::Type::New().GetPointer();
+}
+
+/** Smallest size that is at least size and has no prime factors other than
+ * 2, 3, 5 and 7. */
+inline SizeValueType
+GetSmoothSize(SizeValueType size)
+{
+  const SizeValueType factors[] = { 2, 3, 5, 7 };
+  for (SizeValueType candidate = (size > 0) ? size : 1;; ++candidate)
+  {
+    SizeValueType rest = candidate;
+    for (const SizeValueType factor : factors)
+    {
+      while (rest % factor == 0)
+      {
+        rest /= factor;
+      }
+    }
+    if (rest == 1)
+    {
+      return candidate;
+    }
+  }
+}
+
+/** Offset of the first pixel of a line along dimension 0 in a buffer of size
+ * bufferSize that holds a region of size size at its origin. The lines of
+ * the region are numbered in memory order. */
+template <unsigned int VDimension>
+OffsetValueType
+GetLineOffset(SizeValueType line, const Size<VDimension> & size, const Size<VDimension> & bufferSize)
+{
+  OffsetValueType offset = 0;
+  OffsetValueType stride = bufferSize[0];
+  for (unsigned int d = 1; d < VDimension; ++d)
+  {
+    offset += static_cast<OffsetValueType>(line % size[d]) * stride;
+    line /= size[d];
+    stride *= bufferSize[d];
+  }
+  return offset;
+}
+
+/** Fill the pixels of a buffer of size bufferSize outside of the region of
+ * size size at its origin by replicating the boundary pixels of the region.
+ * The padded field has zero derivatives across the boundary of the region,
+ * which is consistent with the Neumann boundary conditions of the DCT and
+ * avoids the artificial edges of zero padding for the periodic FFT. */
+template <typename TReal, unsigned int VDimension>
+void
+PadBuffer(TReal * buffer, const Size<VDimension> & size, const Size<VDimension> & bufferSize)
+{
+  OffsetValueType offsetTable[VDimension];
+  offsetTable[0] = 1;
+  for (unsigned int d = 1; d < VDimension; ++d)
+  {
+    offsetTable[d] = offsetTable[d - 1] * static_cast<OffsetValueType>(bufferSize[d - 1]);
+  }
+
+  // Pad one dimension after the other; the lines along dimension d are taken
+  // from the part of the buffer that is already filled
+  for (unsigned int d = 0; d < VDimension; ++d)
+  {
+    if (size[d] >= bufferSize[d])
+    {
+      continue;
+    }
+
+    SizeValueType extent[VDimension];
+    SizeValueType numberOfLines = 1;
+    for (unsigned int e = 0; e < VDimension; ++e)
+    {
+      extent[e] = (e < d) ? bufferSize[e] : size[e];
+      if (e != d)
+      {
+        numberOfLines *= extent[e];
+      }
+    }
+
+    for (SizeValueType line = 0; line < numberOfLines; ++line)
+    {
+      OffsetValueType offset = 0;
+      SizeValueType   rest = line;
+      for (unsigned int e = 0; e < VDimension; ++e)
+      {
+        if (e != d)
+        {
+          offset += static_cast<OffsetValueType>(rest % extent[e]) * offsetTable[e];
+          rest /= extent[e];
+        }
+      }
+
+      TReal *     lineStart = buffer + offset;
+      const TReal value = lineStart[(size[d] - 1) * offsetTable[d]];
+      for (SizeValueType i = size[d]; i < bufferSize[d]; ++i)
+      {
+        lineStart[i * offsetTable[d]] = value;
+      }
+    }
+  }
+}
+
+} // end namespace VariationalRegistrationFFTUtilities
+} // end namespace itk
+
+#endif
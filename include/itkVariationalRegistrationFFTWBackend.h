@@ -0,0 +1,136 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationFFTWBackend_h
+#define itkVariationalRegistrationFFTWBackend_h
+
+#include "itkVariationalRegistrationFFTBackend.h"
+
+#if defined(ITK_USE_FFTWD) || defined(ITK_USE_FFTWF)
+
+#  include "itkFFTWCommon.h"
+#  include "itkVariationalRegistrationFFTWUtilities.h"
+
+#  include <string>
+
+namespace itk
+{
+
+/** \class itk::VariationalRegistrationFFTWBackend
+ *
+ *  \brief FFT backend of the spectral regularizers based on FFTW.
+ *
+ *  The transforms are computed with FFTW plans of the advanced interface, so
+ *  all images of a real-to-complex transform are transformed by one plan. The
+ *  wisdom is imported from the wisdom file before the first planning and
+ *  exported after each planning.
+ *
+ *  This backend is only available if ITK is built with ITK_USE_FFTWD (TReal
+ *  double) or ITK_USE_FFTWF (TReal float).
+ *
+ *  \sa VariationalRegistrationFFTBackend
+ *  \sa VariationalRegistrationFFTWUtilities
+ *
+ *  \ingroup VariationalRegistration
+ */
+template <typename TReal, unsigned int VDimension>
+class VariationalRegistrationFFTWBackend : public VariationalRegistrationFFTBackend<TReal, VDimension>
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(VariationalRegistrationFFTWBackend);
+
+  /** Standard class type alias */
+  using Self = VariationalRegistrationFFTWBackend;
+  using Superclass = VariationalRegistrationFFTBackend<TReal, VDimension>;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods) */
+  itkTypeMacro(VariationalRegistrationFFTWBackend, VariationalRegistrationFFTBackend);
+
+  static constexpr unsigned int ImageDimension = VDimension;
+
+  using RealType = typename Superclass::RealType;
+  using ComplexType = typename Superclass::ComplexType;
+  using SizeType = typename Superclass::SizeType;
+
+  /** Types for FFTW proxy */
+  using FFTWProxyType = typename fftw::Proxy<TReal>;
+
+  bool
+  PlanRealToComplex(const SizeType & size,
+                    unsigned int     numberOfImages,
+                    RealType *       real,
+                    ComplexType *    complex) override;
+
+  void
+  ExecuteRealToComplex() override;
+
+  void
+  ExecuteComplexToReal() override;
+
+  bool
+  PlanCosine(const SizeType & size, RealType * spatial, RealType * frequency) override;
+
+  void
+  ExecuteForwardCosine() override;
+
+  void
+  ExecuteBackwardCosine() override;
+
+protected:
+  VariationalRegistrationFFTWBackend();
+  ~VariationalRegistrationFFTWBackend() override;
+
+  /** Import the wisdom if the wisdom file has changed. */
+  void
+  ImportWisdom();
+
+  /** Export the wisdom to the wisdom file. */
+  void
+  ExportWisdom();
+
+  /** Destroy a plan if it exists. fftw::Proxy::DestroyPlan() locks the
+   * global FFTW mutex of ITK. */
+  static void
+  DestroyPlan(typename FFTWProxyType::PlanType & plan);
+
+private:
+  /** Plans of the real-to-complex FFT and its inverse. */
+  typename FFTWProxyType::PlanType m_PlanRealToComplex;
+  typename FFTWProxyType::PlanType m_PlanComplexToReal;
+
+  /** Plans of the forward and the backward DCT. */
+  typename FFTWProxyType::PlanType m_PlanForwardCosine;
+  typename FFTWProxyType::PlanType m_PlanBackwardCosine;
+
+  /** The file the wisdom was imported from. */
+  std::string m_ImportedWisdomFileName;
+};
+
+} // namespace itk
+
+#  ifndef ITK_MANUAL_INSTANTIATION
+#    include "itkVariationalRegistrationFFTWBackend.hxx"
+#  endif
+
+#endif
+
+#endif
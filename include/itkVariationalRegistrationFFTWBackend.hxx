@@ -0,0 +1,269 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationFFTWBackend_hxx
+#define itkVariationalRegistrationFFTWBackend_hxx
+
+#if defined(ITK_USE_FFTWD) || defined(ITK_USE_FFTWF)
+
+#  include "itkVariationalRegistrationFFTWBackend.h"
+
+namespace itk
+{
+
+/**
+ * Default constructor
+ */
+template <typename TReal, unsigned int VDimension>
+VariationalRegistrationFFTWBackend<TReal, VDimension>::VariationalRegistrationFFTWBackend()
+{
+  static_assert(Superclass::PlanEstimate == FFTW_ESTIMATE && Superclass::PlanMeasure == FFTW_MEASURE &&
+                  Superclass::PlanPatient == FFTW_PATIENT,
+                "The planner efforts have to be the flags of FFTW");
+
+  m_PlanRealToComplex = nullptr;
+  m_PlanComplexToReal = nullptr;
+  m_PlanForwardCosine = nullptr;
+  m_PlanBackwardCosine = nullptr;
+}
+
+/**
+ * Default destructor
+ */
+template <typename TReal, unsigned int VDimension>
+VariationalRegistrationFFTWBackend<TReal, VDimension>::~VariationalRegistrationFFTWBackend()
+{
+  DestroyPlan(m_PlanRealToComplex);
+  DestroyPlan(m_PlanComplexToReal);
+  DestroyPlan(m_PlanForwardCosine);
+  DestroyPlan(m_PlanBackwardCosine);
+}
+
+/**
+ * Destroy a plan
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationFFTWBackend<TReal, VDimension>::DestroyPlan(typename FFTWProxyType::PlanType & plan)
+{
+  if (plan != nullptr)
+  {
+    FFTWProxyType::DestroyPlan(plan);
+    plan = nullptr;
+  }
+}
+
+/**
+ * Import the wisdom
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationFFTWBackend<TReal, VDimension>::ImportWisdom()
+{
+  // Import the wisdom before the first planning. A missing file is not an
+  // error, it is created when the wisdom is exported.
+  const std::string wisdomFileName = this->GetWisdomFileName();
+  if (!wisdomFileName.empty() && wisdomFileName != m_ImportedWisdomFileName)
+  {
+    if (!VariationalRegistrationFFTWUtilities::ImportWisdom<TReal>(wisdomFileName))
+    {
+      itkDebugMacro(<< "Could not import FFTW wisdom from " << wisdomFileName);
+    }
+    m_ImportedWisdomFileName = wisdomFileName;
+  }
+}
+
+/**
+ * Export the wisdom
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationFFTWBackend<TReal, VDimension>::ExportWisdom()
+{
+  // Save the wisdom of the new plans
+  const std::string wisdomFileName = this->GetWisdomFileName();
+  if (!wisdomFileName.empty() && !VariationalRegistrationFFTWUtilities::ExportWisdom<TReal>(wisdomFileName))
+  {
+    itkWarningMacro(<< "Could not export FFTW wisdom to " << wisdomFileName);
+  }
+}
+
+/**
+ * Plan the real-to-complex FFT
+ */
+template <typename TReal, unsigned int VDimension>
+bool
+VariationalRegistrationFFTWBackend<TReal, VDimension>::PlanRealToComplex(const SizeType & size,
+                                                                         unsigned int     numberOfImages,
+                                                                         RealType *       real,
+                                                                         ComplexType *    complex)
+{
+  DestroyPlan(m_PlanRealToComplex);
+  DestroyPlan(m_PlanComplexToReal);
+
+  // Get image size in reverse order for FFTW
+  int n[VDimension];
+  int totalSize = 1;
+  int totalComplexSize = 1;
+  for (unsigned int i = 0; i < VDimension; ++i)
+  {
+    n[(VDimension - 1) - i] = static_cast<int>(size[i]);
+    totalSize *= static_cast<int>(size[i]);
+    totalComplexSize *= (i == 0) ? static_cast<int>(size[0]) / 2 + 1 : static_cast<int>(size[i]);
+  }
+
+  // std::complex has the memory layout of the complex type of FFTW
+  auto * fftwComplex = reinterpret_cast<typename FFTWProxyType::ComplexType *>(complex);
+
+  this->ImportWisdom();
+
+  // fftw::Proxy only provides plans for single transforms, so the advanced
+  // interface is used to transform all images with one plan.
+  m_PlanRealToComplex = VariationalRegistrationFFTWUtilities::PlanManyForward(VDimension,
+                                                                              n,
+                                                                              static_cast<int>(numberOfImages),
+                                                                              real,
+                                                                              totalSize,
+                                                                              fftwComplex,
+                                                                              totalComplexSize,
+                                                                              this->GetPlanRigor(),
+                                                                              this->GetNumberOfWorkUnits());
+
+  m_PlanComplexToReal = VariationalRegistrationFFTWUtilities::PlanManyBackward(VDimension,
+                                                                               n,
+                                                                               static_cast<int>(numberOfImages),
+                                                                               fftwComplex,
+                                                                               totalComplexSize,
+                                                                               real,
+                                                                               totalSize,
+                                                                               this->GetPlanRigor(),
+                                                                               this->GetNumberOfWorkUnits());
+
+  if (m_PlanRealToComplex == nullptr || m_PlanComplexToReal == nullptr)
+  {
+    return false;
+  }
+
+  this->ExportWisdom();
+
+  return true;
+}
+
+/**
+ * Execute the real-to-complex FFT
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationFFTWBackend<TReal, VDimension>::ExecuteRealToComplex()
+{
+  FFTWProxyType::Execute(m_PlanRealToComplex);
+}
+
+/**
+ * Execute the complex-to-real FFT
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationFFTWBackend<TReal, VDimension>::ExecuteComplexToReal()
+{
+  FFTWProxyType::Execute(m_PlanComplexToReal);
+}
+
+/**
+ * Plan the DCTs
+ */
+template <typename TReal, unsigned int VDimension>
+bool
+VariationalRegistrationFFTWBackend<TReal, VDimension>::PlanCosine(const SizeType & size,
+                                                                  RealType *       spatial,
+                                                                  RealType *       frequency)
+{
+  DestroyPlan(m_PlanForwardCosine);
+  DestroyPlan(m_PlanBackwardCosine);
+
+  //
+  // different methods for the DCT are available in FFTW
+  // (look here: https://www.fftw.org/doc/Real_002dto_002dReal-Transforms.html)
+  //
+  // We use the FFTW_REDFT01 and FFTW_REDFT10 transform (fast), unsure what the correct choice is
+  //
+  fftw_r2r_kind forwardKind[VDimension];
+  fftw_r2r_kind backwardKind[VDimension];
+  int           n[VDimension];
+  for (unsigned int i = 0; i < VDimension; ++i)
+  {
+    forwardKind[i] = FFTW_REDFT01;
+    backwardKind[i] = FFTW_REDFT10;
+    // Get image size in reverse order for FFTW
+    n[(VDimension - 1) - i] = static_cast<int>(size[i]);
+  }
+
+  this->ImportWisdom();
+
+  // fftw_plan_r2r transforms are not available in FFTWProxyType, so we have
+  // to call FFTW functions directly
+  m_PlanForwardCosine = VariationalRegistrationFFTWUtilities::PlanRealToReal(VDimension,
+                                                                             n,
+                                                                             spatial,
+                                                                             frequency,
+                                                                             forwardKind,
+                                                                             this->GetPlanRigor() | FFTW_DESTROY_INPUT,
+                                                                             this->GetNumberOfWorkUnits());
+
+  m_PlanBackwardCosine = VariationalRegistrationFFTWUtilities::PlanRealToReal(VDimension,
+                                                                              n,
+                                                                              frequency,
+                                                                              spatial,
+                                                                              backwardKind,
+                                                                              this->GetPlanRigor() | FFTW_DESTROY_INPUT,
+                                                                              this->GetNumberOfWorkUnits());
+
+  if (m_PlanForwardCosine == nullptr || m_PlanBackwardCosine == nullptr)
+  {
+    return false;
+  }
+
+  this->ExportWisdom();
+
+  return true;
+}
+
+/**
+ * Execute the forward DCT
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationFFTWBackend<TReal, VDimension>::ExecuteForwardCosine()
+{
+  FFTWProxyType::Execute(m_PlanForwardCosine);
+}
+
+/**
+ * Execute the backward DCT
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationFFTWBackend<TReal, VDimension>::ExecuteBackwardCosine()
+{
+  FFTWProxyType::Execute(m_PlanBackwardCosine);
+}
+
+} // end namespace itk
+
+#endif
+
+#endif
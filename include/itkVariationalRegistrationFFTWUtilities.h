@@ -0,0 +1,230 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationFFTWUtilities_h
+#define itkVariationalRegistrationFFTWUtilities_h
+
+#if defined(ITK_USE_FFTWD) || defined(ITK_USE_FFTWF)
+
+#  include "itkFFTWCommon.h"
+
+#  include <mutex>
+#  include <string>
+
+namespace itk
+{
+/**
+ * \namespace VariationalRegistrationFFTWUtilities
+ *
+ * \brief Planning and wisdom handling of the FFTW backend of the spectral regularizers.
+ *
+ * The planning functions are overloaded for both precisions and create plans
+ * of the FFTW interfaces not provided by fftw::Proxy. The FFTW planner and
+ * the number of threads of new plans are global state, so the functions lock
+ * the global FFTW mutex of ITK (like fftw::Proxy) and set the number of
+ * threads of each plan under the lock. Plans with different numbers of
+ * threads can thus be created concurrently; the execution of plans is thread
+ * safe in FFTW.
+ *
+ * Planning with FFTW_MEASURE or FFTW_PATIENT measures several algorithms for
+ * each transform size, which takes seconds for large 3D fields. FFTW stores
+ * the results as wisdom. ImportWisdom() and ExportWisdom() load and save the
+ * wisdom of the given precision from and to a file, so plans for sizes that
+ * were measured before (e.g. in a previous run) are created at once. Both
+ * functions lock the global FFTW mutex of ITK as well.
+ *
+ * \sa VariationalRegistrationFFTWBackend
+ *
+ * \ingroup VariationalRegistration
+ */
+namespace VariationalRegistrationFFTWUtilities
+{
+
+/** Import the wisdom of precision TReal from a file. Returns false if the
+ * file could not be read. */
+template <typename TReal>
+bool
+ImportWisdom(const std::string & fileName);
+
+/** Export the wisdom of precision TReal to a file. Returns false if the file
+ * could not be written. */
+template <typename TReal>
+bool
+ExportWisdom(const std::string & fileName);
+
+#  if defined(ITK_USE_FFTWD)
+template <>
+inline bool
+ImportWisdom<double>(const std::string & fileName)
+{
+  const std::lock_guard<FFTWGlobalConfiguration::MutexType> lockGuard(FFTWGlobalConfiguration::GetLockMutex());
+  return fftw_import_wisdom_from_filename(fileName.c_str()) != 0;
+}
+
+template <>
+inline bool
+ExportWisdom<double>(const std::string & fileName)
+{
+  const std::lock_guard<FFTWGlobalConfiguration::MutexType> lockGuard(FFTWGlobalConfiguration::GetLockMutex());
+  return fftw_export_wisdom_to_filename(fileName.c_str()) != 0;
+}
+
+/** Create a plan for the real-to-complex FFT of howMany images stored one
+ * after another. The distances are the numbers of pixels between two
+ * images. */
+inline fftw_plan
+PlanManyForward(int            rank,
+                const int *    n,
+                int            howMany,
+                double *       in,
+                int            inDistance,
+                fftw_complex * out,
+                int            outDistance,
+                unsigned int   flags,
+                int            threads)
+{
+  const std::lock_guard<FFTWGlobalConfiguration::MutexType> lockGuard(FFTWGlobalConfiguration::GetLockMutex());
+  fftw_plan_with_nthreads(threads);
+  const fftw_plan plan =
+    fftw_plan_many_dft_r2c(rank, n, howMany, in, nullptr, 1, inDistance, out, nullptr, 1, outDistance, flags);
+  FFTWGlobalConfiguration::SetNewWisdomAvailable(true);
+  return plan;
+}
+
+/** Create a plan for the complex-to-real FFT of howMany images stored one
+ * after another. */
+inline fftw_plan
+PlanManyBackward(int            rank,
+                 const int *    n,
+                 int            howMany,
+                 fftw_complex * in,
+                 int            inDistance,
+                 double *       out,
+                 int            outDistance,
+                 unsigned int   flags,
+                 int            threads)
+{
+  const std::lock_guard<FFTWGlobalConfiguration::MutexType> lockGuard(FFTWGlobalConfiguration::GetLockMutex());
+  fftw_plan_with_nthreads(threads);
+  const fftw_plan plan =
+    fftw_plan_many_dft_c2r(rank, n, howMany, in, nullptr, 1, inDistance, out, nullptr, 1, outDistance, flags);
+  FFTWGlobalConfiguration::SetNewWisdomAvailable(true);
+  return plan;
+}
+
+/** Create a plan for a real-to-real transform (e.g. a DCT). */
+inline fftw_plan
+PlanRealToReal(int                   rank,
+               const int *           n,
+               double *              in,
+               double *              out,
+               const fftw_r2r_kind * kind,
+               unsigned int          flags,
+               int                   threads)
+{
+  const std::lock_guard<FFTWGlobalConfiguration::MutexType> lockGuard(FFTWGlobalConfiguration::GetLockMutex());
+  fftw_plan_with_nthreads(threads);
+  const fftw_plan plan = fftw_plan_r2r(rank, n, in, out, kind, flags);
+  FFTWGlobalConfiguration::SetNewWisdomAvailable(true);
+  return plan;
+}
+#  endif
+
+#  if defined(ITK_USE_FFTWF)
+template <>
+inline bool
+ImportWisdom<float>(const std::string & fileName)
+{
+  const std::lock_guard<FFTWGlobalConfiguration::MutexType> lockGuard(FFTWGlobalConfiguration::GetLockMutex());
+  return fftwf_import_wisdom_from_filename(fileName.c_str()) != 0;
+}
+
+template <>
+inline bool
+ExportWisdom<float>(const std::string & fileName)
+{
+  const std::lock_guard<FFTWGlobalConfiguration::MutexType> lockGuard(FFTWGlobalConfiguration::GetLockMutex());
+  return fftwf_export_wisdom_to_filename(fileName.c_str()) != 0;
+}
+
+/** Create a plan for the real-to-complex FFT of howMany images stored one
+ * after another. The distances are the numbers of pixels between two
+ * images. */
+inline fftwf_plan
+PlanManyForward(int             rank,
+                const int *     n,
+                int             howMany,
+                float *         in,
+                int             inDistance,
+                fftwf_complex * out,
+                int             outDistance,
+                unsigned int    flags,
+                int             threads)
+{
+  const std::lock_guard<FFTWGlobalConfiguration::MutexType> lockGuard(FFTWGlobalConfiguration::GetLockMutex());
+  fftwf_plan_with_nthreads(threads);
+  const fftwf_plan plan =
+    fftwf_plan_many_dft_r2c(rank, n, howMany, in, nullptr, 1, inDistance, out, nullptr, 1, outDistance, flags);
+  FFTWGlobalConfiguration::SetNewWisdomAvailable(true);
+  return plan;
+}
+
+/** Create a plan for the complex-to-real FFT of howMany images stored one
+ * after another. */
+inline fftwf_plan
+PlanManyBackward(int             rank,
+                 const int *     n,
+                 int             howMany,
+                 fftwf_complex * in,
+                 int             inDistance,
+                 float *         out,
+                 int             outDistance,
+                 unsigned int    flags,
+                 int             threads)
+{
+  const std::lock_guard<FFTWGlobalConfiguration::MutexType> lockGuard(FFTWGlobalConfiguration::GetLockMutex());
+  fftwf_plan_with_nthreads(threads);
+  const fftwf_plan plan =
+    fftwf_plan_many_dft_c2r(rank, n, howMany, in, nullptr, 1, inDistance, out, nullptr, 1, outDistance, flags);
+  FFTWGlobalConfiguration::SetNewWisdomAvailable(true);
+  return plan;
+}
+
+/** Create a plan for a real-to-real transform (e.g. a DCT). */
+inline fftwf_plan
+PlanRealToReal(int                    rank,
+               const int *            n,
+               float *                in,
+               float *                out,
+               const fftwf_r2r_kind * kind,
+               unsigned int           flags,
+               int                    threads)
+{
+  const std::lock_guard<FFTWGlobalConfiguration::MutexType> lockGuard(FFTWGlobalConfiguration::GetLockMutex());
+  fftwf_plan_with_nthreads(threads);
+  const fftwf_plan plan = fftwf_plan_r2r(rank, n, in, out, kind, flags);
+  FFTWGlobalConfiguration::SetNewWisdomAvailable(true);
+  return plan;
+}
+#  endif
+
+} // end namespace VariationalRegistrationFFTWUtilities
+} // end namespace itk
+
+#endif
+
+#endif
@@ -20,9 +20,10 @@
 
 #include "itkVariationalRegistrationNCCFunction.h"
 #include "itkCovariantVector.h"
+#include "itkImage.h"
+#include "itkVector.h"
 #include "itkInterpolateImageFunction.h"
 #include "itkLinearInterpolateImageFunction.h"
-#include "itkCentralDifferenceImageFunction.h"
 
 namespace itk
 {
@@ -49,6 +50,18 @@ namespace itk
  *  Alternative, the classical gradient \f$\nabla M(x+u(x))\f$ can be replaced by \f$\nabla F(x)\f$
  *  or \f$\frac{\nabla F(x) + \nabla M(x+u(x))}{2}\f$.
  *
+ *  In contrast to VariationalRegistrationNCCFunction, the local sums of m, m*m and f*m are
+ *  computed for the whole image in InitializeIteration() by separable running box sums
+ *  (one multithreaded pass per image dimension). The costs per pixel are therefore independent
+ *  of the radius, and the forces are evaluated from the precomputed sums and the cached fixed
+ *  image statistics in ComputeUpdate() and ComputeUpdateScanline(). The sums need three
+ *  additional double values per pixel.
+ *
+ *  By default, neighborhoods at the image boundary are restricted to the image region. With
+ *  SetBoundaryConditionToMirror() or SetBoundaryConditionToClamp(), each line is padded with
+ *  mirrored or clamped ghost cells in the box sum passes instead, such that all neighborhoods
+ *  have the same size and the running sums need no boundary checks.
+ *
  *  \sa VariationalRegistrationFilter
  *  \sa VariationalRegistrationFunction
  *
@@ -110,9 +123,17 @@ public:
   using NeighborhoodType = typename Superclass::NeighborhoodType;
   using FloatOffsetType = typename Superclass::FloatOffsetType;
 
-  /** Gradient calculator type. */
+  /** Image gradient types. */
+  using GradientPixelType = typename Superclass::GradientPixelType;
+  using GradientImageType = typename Superclass::GradientImageType;
+
+  /** Gradient calculator type (deprecated, see superclass). */
   using GradientCalculatorType = typename Superclass::GradientCalculatorType;
-  using GradientCalculatorPointer = typename GradientCalculatorType::Pointer;
+  using GradientCalculatorPointer = typename Superclass::GradientCalculatorPointer;
+
+  /** Set the object's state before each iteration. Computes the local sums. */
+  void
+  InitializeIteration() override;
 
   /** This method is called by a finite difference solver image filter at
    * each pixel that does not lie on a data set boundary */
@@ -121,14 +142,31 @@ public:
                 void *                   globalData,
                 const FloatOffsetType &  offset = FloatOffsetType(0.0)) override;
 
-  /** Return a pointer to a global data structure that is passed to
-   * this object from the solver at each calculation.  */
-  void *
-  GetGlobalDataPointer() const override;
-
-  /** Release memory for global data structure. */
+  /** Compute the updates for a contiguous line of pixels along the first
+   * image dimension from the precomputed local sums. */
   void
-  ReleaseGlobalDataPointer(void * GlobalData) const override;
+  ComputeUpdateScanline(const IndexType & index, SizeValueType length, PixelType * update, void * globalData) override;
+
+  /** Restrict neighborhoods at the image boundary to the image region (default). */
+  virtual void
+  SetBoundaryConditionToCrop()
+  {
+    this->m_BoundaryCondition = Superclass::BOUNDARY_CONDITION_CROP;
+  }
+
+  /** Pad the images by mirroring at the boundary pixels. All neighborhoods are complete. */
+  virtual void
+  SetBoundaryConditionToMirror()
+  {
+    this->m_BoundaryCondition = Superclass::BOUNDARY_CONDITION_MIRROR;
+  }
+
+  /** Pad the images by repeating the boundary pixels. All neighborhoods are complete. */
+  virtual void
+  SetBoundaryConditionToClamp()
+  {
+    this->m_BoundaryCondition = Superclass::BOUNDARY_CONDITION_CLAMP;
+  }
 
 protected:
   VariationalRegistrationFastNCCFunction();
@@ -140,27 +178,56 @@ protected:
 
   using GlobalDataStruct = typename Superclass::GlobalDataStruct;
 
-  /** A global data type for this class of equation. Used to store
-   * information for computing the metric. */
-  struct NCCGlobalDataStruct
+  /** Local fixed image statistics type. */
+  using FixedStatisticsPixelType = typename Superclass::FixedStatisticsPixelType;
+  using FixedStatisticsImageType = typename Superclass::FixedStatisticsImageType;
+
+  /** Image type of the local sums of m, m*m and f*m (in this order). The
+   * sums are stored in double precision: the moving image is not centered at
+   * the fixed intensity range in multimodal registrations, so single
+   * precision sums of m*m would lose the local variance to cancellation.
+   * f and m are shifted by GetFixedIntensityCenter() to keep the sums small;
+   * GetMovingSums() converts them back. */
+  using LocalSumsValueType = double;
+  using LocalSumsPixelType = Vector<LocalSumsValueType, 3>;
+  using LocalSumsImageType = Image<LocalSumsPixelType, ImageDimension>;
+  using LocalSumsImagePointer = typename LocalSumsImageType::Pointer;
+
+  /** Compute the local sums of the warped image and of f*m. */
+  virtual void
+  ComputeLocalSums();
+
+  /** Convert the shifted local sums of a pixel into the sums of m, m*m and
+   * f*m as required by ComputeLocalUpdate(). */
+  void
+  GetMovingSums(const LocalSumsPixelType &       sums,
+                const FixedStatisticsPixelType & fixedStatistics,
+                double                           pixelCounter,
+                double *                         movingSums) const
+  {
+    // With f' = f - c and m' = m - c:
+    // Sum_i m = Sum_i m' + N*c
+    // Sum_i m*m = Sum_i m'*m' + 2*c*Sum_i m' + N*c*c
+    // Sum_i f*m = Sum_i f'*m' + c*Sum_i m' + c*Sum_i f' + N*c*c   (as Sum_i f' = N*meanF - N*c)
+    const double center = this->GetFixedIntensityCenter();
+    const double sm = sums[0];
+    const double sf = pixelCounter * (fixedStatistics[0] - center);
+    movingSums[0] = sm + pixelCounter * center;
+    movingSums[1] = sums[1] + 2.0 * center * sm + pixelCounter * center * center;
+    movingSums[2] = sums[2] + center * sm + center * sf + pixelCounter * center * center;
+  }
+
+  /** Replace each pixel of the image of m, m*m and f*m by the sum over its
+   * neighborhood. The default implementation computes box sums. */
+  virtual void
+  ComputeNeighborhoodSums(LocalSumsImageType * sums) const
   {
-    double              m_SumOfMetricValues;
-    SizeValueType       m_NumberOfPixelsProcessed;
-    double              m_SumOfSquaredChange;
-    IndexType           m_LastIndex;
-    bool                bValuesAreValid;
-    unsigned int        lastSliceIndex;
-    std::vector<double> sfSliceValueList;
-    std::vector<double> smSliceValueList;
-    std::vector<double> sffSliceValueList;
-    std::vector<double> smmSliceValueList;
-    std::vector<double> sfmSliceValueList;
-    double              sfLastValue;
-    double              smLastValue;
-    double              sffLastValue;
-    double              smmLastValue;
-    double              sfmLastValue;
-  };
+    this->BoxSumImage(sums);
+  }
+
+private:
+  /** Local sums of the current iteration. */
+  LocalSumsImagePointer m_LocalSums;
 };
 
 
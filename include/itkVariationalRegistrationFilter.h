@@ -138,6 +138,7 @@ public:
 
   /** Types inherited from the superclass */
   using OutputImageType = typename Superclass::OutputImageType;
+  using UpdateBufferType = typename Superclass::UpdateBufferType;
 
   /** The value type of a time step.  Inherited from the superclass. */
   using TimeStepType = typename Superclass::TimeStepType;
@@ -237,6 +238,20 @@ public:
    * on, then the update field is smoothed using the VariationalRegistrationRegularizer. */
   itkBooleanMacro(SmoothUpdateField);
 
+  /** Set/Get whether the deformation field is regularized incrementally. If
+   * on and the regularizer supports it (see
+   * VariationalRegistrationRegularizer::SupportsIncrementalUpdate()), the
+   * regularizer keeps the regularized field of the last iteration (the
+   * spectrum for FFT based regularizers) and only transforms the increment
+   * of each iteration. With SmoothUpdateField, the update is smoothed in the
+   * same call, which saves one forward and one backward transform per
+   * iteration; the result equals the direct regularization up to rounding
+   * errors. Only used if SmoothDisplacementField is on; otherwise a warning
+   * is issued and the field is regularized directly. Default is off. */
+  itkSetMacro(UseIncrementalRegularization, bool);
+  itkGetConstMacro(UseIncrementalRegularization, bool);
+  itkBooleanMacro(UseIncrementalRegularization);
+
   /** Get the metric value. The metric value is the mean square difference
    * in intensity between the fixed image and transforming moving image
    * computed over the the overlapping region between the two images.
@@ -293,6 +308,28 @@ protected:
   void
   ApplyUpdate(const TimeStepType & dt) override;
 
+  /** Get the part of the increment of the output in ApplyUpdate() that is
+   * not smoothed with SmoothUpdateField, and its factor. The incremental
+   * regularization only regularizes it with the field. Default is none, as
+   * the increment is the update field times the time step. */
+  virtual const UpdateBufferType *
+  GetUnsmoothedIncrement(const TimeStepType & itkNotUsed(dt), double & scale)
+  {
+    scale = 0.0;
+    return nullptr;
+  }
+
+  /** The type of region used for multithreading */
+  using ThreadRegionType = typename UpdateBufferType::RegionType;
+
+  /** Compute the update field for a region line by line. If the registration
+   * function supports scanline updates, the update buffer is filled with raw
+   * buffer access. Otherwise the update of each pixel is computed with a
+   * neighborhood iterator. The metric sums of each line are stored in the
+   * function such that the metric does not depend on the number of threads. */
+  TimeStepType
+  ThreadedCalculateChange(const ThreadRegionType & regionToProcess, ThreadIdType threadId) override;
+
   /** Override VerifyInputInformation() since this filter's inputs do
    * not need to occupy the same physical space.
    *
@@ -328,6 +365,7 @@ private:
   /** Modes to control smoothing of the update and deformation fields */
   bool m_SmoothDisplacementField;
   bool m_SmoothUpdateField;
+  bool m_UseIncrementalRegularization;
 };
 
 } // end namespace itk
@@ -21,6 +21,8 @@
 
 #include "itkImageRegionConstIterator.h"
 #include "itkImageRegionIterator.h"
+#include "itkImageScanlineIterator.h"
+#include "itkNeighborhoodAlgorithm.h"
 
 namespace itk
 {
@@ -41,6 +43,7 @@ VariationalRegistrationFilter<TFixedImage, TMovingImage, TDisplacementField>::Va
   m_StopRegistrationFlag = false;
   m_SmoothDisplacementField = true;
   m_SmoothUpdateField = false;
+  m_UseIncrementalRegularization = false;
 
   // Initialize with default regularizer.
   m_Regularizer = DefaultRegularizerType::New();
@@ -317,6 +320,10 @@ VariationalRegistrationFilter<TFixedImage, TMovingImage, TDisplacementField>::In
   rfp->SetMovingImage(movingPtr);
   rfp->SetDisplacementField(this->GetDisplacementField());
 
+  // The image passes of the function use the work units of the filter.
+  this->GetMultiThreader()->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+  rfp->SetMultiThreader(this->GetMultiThreader());
+
   if (maskImage)
   {
     rfp->SetMaskImage(maskImage);
@@ -333,9 +340,30 @@ template <typename TFixedImage, typename TMovingImage, typename TDisplacementFie
 void
 VariationalRegistrationFilter<TFixedImage, TMovingImage, TDisplacementField>::ApplyUpdate(const TimeStepType & dt)
 {
-  // If fluid-like registration is performed, smooth the update field.
-  if (this->GetSmoothUpdateField())
+  // With incremental regularization, the regularizer keeps the field of the
+  // last iteration, so the output only differs from it by the increment.
+  // With SmoothUpdateField, the update is smoothed in the same call; a part
+  // of the increment that is not smoothed in the direct computation is only
+  // regularized with the field. The kept field is discarded in the first
+  // iteration of each run.
+  if (m_UseIncrementalRegularization && !this->GetSmoothDisplacementField() && this->GetElapsedIterations() == 0)
+  {
+    itkWarningMacro(<< "UseIncrementalRegularization requires SmoothDisplacementField; "
+                    << "the field is regularized directly.");
+  }
+  const bool incremental = m_UseIncrementalRegularization && this->GetSmoothDisplacementField() &&
+                           m_Regularizer->SupportsIncrementalUpdate();
+  if (incremental && this->GetElapsedIterations() == 0)
+  {
+    m_Regularizer->ResetIncrementalUpdate();
+  }
+  const bool regularizeIncrement = incremental && this->GetSmoothUpdateField() && this->GetElapsedIterations() > 0;
+
+  // If fluid-like registration is performed, smooth the update field. With
+  // incremental regularization, this is done together with the field.
+  if (this->GetSmoothUpdateField() && !regularizeIncrement)
   {
+    m_Regularizer->SetUseIncrementalUpdate(false);
     m_Regularizer->SetInput(this->GetUpdateBuffer());
     m_Regularizer->GetOutput()->SetRequestedRegion(this->GetOutput()->GetRequestedRegion());
     m_Regularizer->Update();
@@ -350,6 +378,11 @@ VariationalRegistrationFilter<TFixedImage, TMovingImage, TDisplacementField>::Ap
   // (= deformation field).
   if (this->GetSmoothDisplacementField())
   {
+    double unsmoothedScale = 0.0;
+    m_Regularizer->SetUseIncrementalUpdate(incremental);
+    m_Regularizer->SetRegularizeIncrement(this->GetSmoothUpdateField());
+    m_Regularizer->SetUnregularizedIncrement(this->GetUnsmoothedIncrement(dt, unsmoothedScale));
+    m_Regularizer->SetUnregularizedIncrementScale(unsmoothedScale);
     m_Regularizer->SetInput(this->GetOutput());
     m_Regularizer->GetOutput()->SetRequestedRegion(this->GetOutput()->GetRequestedRegion());
     m_Regularizer->Update();
@@ -362,6 +395,86 @@ VariationalRegistrationFilter<TFixedImage, TMovingImage, TDisplacementField>::Ap
   this->SetRMSChange(rfp->GetRMSChange());
 }
 
+/*
+ * Compute the update field line by line
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+typename VariationalRegistrationFilter<TFixedImage, TMovingImage, TDisplacementField>::TimeStepType
+VariationalRegistrationFilter<TFixedImage, TMovingImage, TDisplacementField>::ThreadedCalculateChange(
+  const ThreadRegionType & regionToProcess,
+  ThreadIdType             itkNotUsed(threadId))
+{
+  RegistrationFunctionType * rfp = this->DownCastDifferenceFunctionType();
+
+  // Ask the function object for a pointer to a data structure it
+  // will use to manage any global values it needs.
+  void * globalData = rfp->GetGlobalDataPointer();
+
+  UpdateBufferType *                     updateBuffer = this->GetUpdateBuffer();
+  typename UpdateBufferType::PixelType * updateBufferPointer = updateBuffer->GetBufferPointer();
+  const SizeValueType                    lineLength = regionToProcess.GetSize(0);
+
+  // The metric sums of each line are handed over to the function after the
+  // line is processed.
+  ImageScanlineIterator<UpdateBufferType> updateIt(updateBuffer, regionToProcess);
+  if (rfp->SupportsScanlineUpdate())
+  {
+    while (!updateIt.IsAtEnd())
+    {
+      const typename UpdateBufferType::IndexType lineIndex = updateIt.GetIndex();
+      rfp->ComputeUpdateScanline(
+        lineIndex, lineLength, updateBufferPointer + updateBuffer->ComputeOffset(lineIndex), globalData);
+      rfp->StoreScanlineGlobalData(lineIndex, globalData);
+      updateIt.NextLine();
+    }
+  }
+  else
+  {
+    // As in DenseFiniteDifferenceImageFilter, the region without boundary
+    // conditions is processed first, then the boundary faces. The sums are
+    // handed over after each line of a face; the faces only depend on the
+    // distance to the image boundary, so each line is split into the same
+    // segments for any number of work units.
+    using NeighborhoodIteratorType = typename RegistrationFunctionType::NeighborhoodType;
+    using FaceCalculatorType = NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<OutputImageType>;
+
+    OutputImageType *                               output = this->GetOutput();
+    const typename OutputImageType::SizeType        radius = rfp->GetRadius();
+    FaceCalculatorType                              faceCalculator;
+    const typename FaceCalculatorType::FaceListType faceList = faceCalculator(output, regionToProcess, radius);
+
+    for (const ThreadRegionType & face : faceList)
+    {
+      if (face.GetNumberOfPixels() == 0)
+      {
+        continue;
+      }
+
+      NeighborhoodIteratorType                outputIt(radius, output, face);
+      ImageScanlineIterator<UpdateBufferType> faceIt(updateBuffer, face);
+      while (!faceIt.IsAtEnd())
+      {
+        const typename UpdateBufferType::IndexType lineIndex = faceIt.GetIndex();
+        while (!faceIt.IsAtEndOfLine())
+        {
+          faceIt.Set(rfp->ComputeUpdate(outputIt, globalData));
+          ++faceIt;
+          ++outputIt;
+        }
+        rfp->StoreScanlineGlobalData(lineIndex, globalData);
+        faceIt.NextLine();
+      }
+    }
+  }
+
+  // Ask the finite difference function to compute the time step for
+  // this iteration and free the global data memory.
+  const TimeStepType timeStep = rfp->ComputeGlobalTimeStep(globalData);
+  rfp->ReleaseGlobalDataPointer(globalData);
+
+  return timeStep;
+}
+
 /*
  * Print status information
  */
@@ -382,6 +495,8 @@ VariationalRegistrationFilter<TFixedImage, TMovingImage, TDisplacementField>::Pr
   os << m_SmoothDisplacementField << std::endl;
   os << indent << "SmoothUpdateField: ";
   os << m_SmoothUpdateField << std::endl;
+  os << indent << "UseIncrementalRegularization: ";
+  os << m_UseIncrementalRegularization << std::endl;
 }
 
 } // end namespace itk
@@ -0,0 +1,974 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationForceKernels_h
+#define itkVariationalRegistrationForceKernels_h
+
+#include "itkIntTypes.h"
+
+#include <cmath>
+
+#if !defined(ITK_VARIATIONALREGISTRATION_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) &&                     \
+  (defined(__x86_64__) || defined(__i386__))
+#  define ITK_VARIATIONALREGISTRATION_X86_DISPATCH
+#  include <immintrin.h>
+#endif
+
+namespace itk
+{
+/**
+ * \namespace VariationalRegistrationForceKernels
+ *
+ * \brief Single precision row kernels computing Demons and SSD forces.
+ *
+ * The kernels work directly on one image row: \c fixed and \c warped hold the
+ * intensities, \c gradient (and the optional \c secondGradient, which is
+ * added) the interleaved gradient components of the pixels and \c update
+ * receives the interleaved update components. \c inside is a non-zero flag
+ * for the pixels inside the segmentation mask or a null pointer if all
+ * pixels are inside. Pixels outside the mask and pixels rejected by the
+ * intensity difference (or denominator) threshold get a zero update. The
+ * squared speed values of the pixels inside the mask and the squared update
+ * norms are added to \c sumOfMetricValues and \c sumOfSquaredChange in
+ * double precision.
+ *
+ * The AVX2 and AVX-512 kernels process 8 and 16 pixels per step. The
+ * interleaved gradient and update components of these pixels are two or
+ * three contiguous vectors, which are deinterleaved and interleaved again
+ * with register permutations; there is no gather or scatter. The mask and
+ * the thresholds are evaluated as lane masks. The remaining pixels of a row
+ * are computed by the scalar kernel. Vector kernels exist for two and three
+ * dimensions on x86 with GCC or Clang and are selected at runtime by
+ * GetDemonsKernel() and GetSSDKernel(), so the same binary runs on all x86
+ * machines. Defining ITK_VARIATIONALREGISTRATION_NO_SIMD disables them.
+ *
+ * As the forces are computed in single precision, the kernels are only used
+ * for float gradients and displacement fields. Their updates differ from the
+ * double precision computation of the registration functions by rounding
+ * errors, except for pixels lying on one of the thresholds.
+ *
+ * \sa VariationalRegistrationDemonsFunction
+ * \sa VariationalRegistrationSSDFunction
+ *
+ * \ingroup VariationalRegistration
+ */
+namespace VariationalRegistrationForceKernels
+{
+
+/** Signature of the Demons kernels. */
+template <unsigned int VDimension>
+using DemonsKernelType = void (*)(SizeValueType         length,
+                                  const float *         fixed,
+                                  const float *         warped,
+                                  const float *         gradient,
+                                  const float *         secondGradient,
+                                  const unsigned char * inside,
+                                  float *               update,
+                                  double                normalizer,
+                                  double                intensityDifferenceThreshold,
+                                  double                denominatorThreshold,
+                                  double &              sumOfMetricValues,
+                                  double &              sumOfSquaredChange);
+
+/** Signature of the SSD kernels. */
+template <unsigned int VDimension>
+using SSDKernelType = void (*)(SizeValueType         length,
+                               const float *         fixed,
+                               const float *         warped,
+                               const float *         gradient,
+                               const float *         secondGradient,
+                               const unsigned char * inside,
+                               float *               update,
+                               double                intensityDifferenceThreshold,
+                               double &              sumOfMetricValues,
+                               double &              sumOfSquaredChange);
+
+/** Length of the row chunks whose intensities are converted to float by the
+ * callers. */
+constexpr SizeValueType ChunkLength = 256;
+
+/** Return a row of intensities as float values; other pixel types are
+ * converted into the buffer. */
+template <typename TPixel>
+inline const float *
+GetFloatRow(const TPixel * row, SizeValueType length, float * buffer)
+{
+  for (SizeValueType i = 0; i < length; i++)
+  {
+    buffer[i] = static_cast<float>(row[i]);
+  }
+  return buffer;
+}
+
+inline const float *
+GetFloatRow(const float * row, SizeValueType, float *)
+{
+  return row;
+}
+
+/** Set the inside flags of a row of mask pixels and return the number of
+ * pixels inside the mask. */
+template <typename TMaskPixel>
+inline SizeValueType
+GetInsideFlags(const TMaskPixel * maskRow, TMaskPixel maskThreshold, SizeValueType length, unsigned char * inside)
+{
+  SizeValueType numberOfInsidePixels = 0;
+  for (SizeValueType i = 0; i < length; i++)
+  {
+    inside[i] = maskRow[i] > maskThreshold;
+    numberOfInsidePixels += inside[i];
+  }
+  return numberOfInsidePixels;
+}
+
+/** Demons force, scalar version; also computes the row tails of the vector
+ * kernels. */
+template <unsigned int VDimension>
+inline void
+DemonsKernelScalar(SizeValueType         length,
+                   const float *         fixed,
+                   const float *         warped,
+                   const float *         gradient,
+                   const float *         secondGradient,
+                   const unsigned char * inside,
+                   float *               update,
+                   double                normalizer,
+                   double                intensityDifferenceThreshold,
+                   double                denominatorThreshold,
+                   double &              sumOfMetricValues,
+                   double &              sumOfSquaredChange)
+{
+  const float inverseNormalizer = static_cast<float>(1.0 / normalizer);
+  const float intensityThreshold = static_cast<float>(intensityDifferenceThreshold);
+  const float denominatorThresholdFloat = static_cast<float>(denominatorThreshold);
+
+  for (SizeValueType p = 0; p < length; p++)
+  {
+    float * u = update + p * VDimension;
+    if (inside && !inside[p])
+    {
+      for (unsigned int j = 0; j < VDimension; j++)
+      {
+        u[j] = 0.0f;
+      }
+      continue;
+    }
+
+    const float speedValue = fixed[p] - warped[p];
+    float       g[VDimension];
+    float       gradientSquaredMagnitude = 0.0f;
+    for (unsigned int j = 0; j < VDimension; j++)
+    {
+      g[j] = gradient[p * VDimension + j];
+      if (secondGradient)
+      {
+        g[j] += secondGradient[p * VDimension + j];
+      }
+      gradientSquaredMagnitude += g[j] * g[j];
+    }
+    const float speedSquared = speedValue * speedValue;
+    const float denominator = speedSquared * inverseNormalizer + gradientSquaredMagnitude;
+
+    float squaredChange = 0.0f;
+    if (std::abs(speedValue) < intensityThreshold || denominator < denominatorThresholdFloat)
+    {
+      for (unsigned int j = 0; j < VDimension; j++)
+      {
+        u[j] = 0.0f;
+      }
+    }
+    else
+    {
+      const float factor = speedValue / denominator;
+      for (unsigned int j = 0; j < VDimension; j++)
+      {
+        u[j] = g[j] * factor;
+        squaredChange += u[j] * u[j];
+      }
+    }
+
+    sumOfMetricValues += speedSquared;
+    sumOfSquaredChange += squaredChange;
+  }
+}
+
+/** SSD force, scalar version; also computes the row tails of the vector
+ * kernels. */
+template <unsigned int VDimension>
+inline void
+SSDKernelScalar(SizeValueType         length,
+                const float *         fixed,
+                const float *         warped,
+                const float *         gradient,
+                const float *         secondGradient,
+                const unsigned char * inside,
+                float *               update,
+                double                intensityDifferenceThreshold,
+                double &              sumOfMetricValues,
+                double &              sumOfSquaredChange)
+{
+  const float intensityThreshold = static_cast<float>(intensityDifferenceThreshold);
+
+  for (SizeValueType p = 0; p < length; p++)
+  {
+    float * u = update + p * VDimension;
+    if (inside && !inside[p])
+    {
+      for (unsigned int j = 0; j < VDimension; j++)
+      {
+        u[j] = 0.0f;
+      }
+      continue;
+    }
+
+    const float speedValue = fixed[p] - warped[p];
+    const bool  active = !(std::abs(speedValue) < intensityThreshold);
+
+    float squaredChange = 0.0f;
+    for (unsigned int j = 0; j < VDimension; j++)
+    {
+      float g = gradient[p * VDimension + j];
+      if (secondGradient)
+      {
+        g += secondGradient[p * VDimension + j];
+      }
+      u[j] = active ? g * speedValue : 0.0f;
+      squaredChange += u[j] * u[j];
+    }
+
+    sumOfMetricValues += speedValue * speedValue;
+    sumOfSquaredChange += squaredChange;
+  }
+}
+
+#if defined(ITK_VARIATIONALREGISTRATION_X86_DISPATCH)
+
+/** Vector operations of the AVX2 kernels (8 float lanes). */
+struct AVX2Traits
+{
+  using VectorType = __m256;
+  using MaskType = __m256;
+  struct AccumulatorType
+  {
+    __m256d m_Low;
+    __m256d m_High;
+  };
+  static constexpr unsigned int Width = 8;
+
+#  define ITK_VARIATIONALREGISTRATION_AVX2 __attribute__((target("avx2"))) static inline
+  ITK_VARIATIONALREGISTRATION_AVX2 VectorType
+  Load(const float * p)
+  {
+    return _mm256_loadu_ps(p);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 void
+  Store(float * p, VectorType v)
+  {
+    _mm256_storeu_ps(p, v);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 VectorType
+  Set1(float value)
+  {
+    return _mm256_set1_ps(value);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 VectorType
+  Add(VectorType a, VectorType b)
+  {
+    return _mm256_add_ps(a, b);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 VectorType
+  Sub(VectorType a, VectorType b)
+  {
+    return _mm256_sub_ps(a, b);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 VectorType
+  Mul(VectorType a, VectorType b)
+  {
+    return _mm256_mul_ps(a, b);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 VectorType
+  Div(VectorType a, VectorType b)
+  {
+    return _mm256_div_ps(a, b);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 VectorType
+  Abs(VectorType a)
+  {
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+  }
+  /** Lanes with !(a < b), like the scalar threshold tests. */
+  ITK_VARIATIONALREGISTRATION_AVX2 MaskType
+  NotLess(VectorType a, VectorType b)
+  {
+    return _mm256_cmp_ps(a, b, _CMP_NLT_UQ);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 MaskType
+  And(MaskType a, MaskType b)
+  {
+    return _mm256_and_ps(a, b);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 MaskType
+  AllLanes()
+  {
+    return _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 MaskType
+  InsideMask(const unsigned char * inside)
+  {
+    const __m256i flags = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(inside)));
+    return _mm256_castsi256_ps(
+      _mm256_xor_si256(_mm256_cmpeq_epi32(flags, _mm256_setzero_si256()), _mm256_set1_epi32(-1)));
+  }
+  /** The lanes of v selected by the mask, zero otherwise. */
+  ITK_VARIATIONALREGISTRATION_AVX2 VectorType
+  Select(VectorType v, MaskType mask)
+  {
+    return _mm256_and_ps(v, mask);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 AccumulatorType
+  ZeroAccumulator()
+  {
+    return { _mm256_setzero_pd(), _mm256_setzero_pd() };
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 void
+  Accumulate(AccumulatorType & sum, VectorType v)
+  {
+    sum.m_Low = _mm256_add_pd(sum.m_Low, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+    sum.m_High = _mm256_add_pd(sum.m_High, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 double
+  Sum(const AccumulatorType & sum)
+  {
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(sum.m_Low, sum.m_High));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  }
+
+  /** [x0 y0 x1 y1 ...] -> [x0 x1 ...], [y0 y1 ...] */
+  ITK_VARIATIONALREGISTRATION_AVX2 void
+  Deinterleave(const VectorType (&in)[2], VectorType (&out)[2])
+  {
+    const __m256 even = _mm256_shuffle_ps(in[0], in[1], _MM_SHUFFLE(2, 0, 2, 0));
+    const __m256 odd = _mm256_shuffle_ps(in[0], in[1], _MM_SHUFFLE(3, 1, 3, 1));
+    out[0] = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(even), _MM_SHUFFLE(3, 1, 2, 0)));
+    out[1] = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(odd), _MM_SHUFFLE(3, 1, 2, 0)));
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 void
+  Interleave(const VectorType (&in)[2], VectorType (&out)[2])
+  {
+    const __m256 x = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(in[0]), _MM_SHUFFLE(3, 1, 2, 0)));
+    const __m256 y = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(in[1]), _MM_SHUFFLE(3, 1, 2, 0)));
+    out[0] = _mm256_unpacklo_ps(x, y);
+    out[1] = _mm256_unpackhi_ps(x, y);
+  }
+  /** [x0 y0 z0 x1 ...] -> [x0 x1 ...], [y0 y1 ...], [z0 z1 ...]. Each
+   * component occupies disjoint lanes of the three input vectors, so two
+   * blends and one permutation yield it. */
+  ITK_VARIATIONALREGISTRATION_AVX2 void
+  Deinterleave(const VectorType (&in)[3], VectorType (&out)[3])
+  {
+    const __m256 x = _mm256_blend_ps(_mm256_blend_ps(in[0], in[1], 0x92), in[2], 0x24);
+    const __m256 y = _mm256_blend_ps(_mm256_blend_ps(in[0], in[1], 0x24), in[2], 0x49);
+    const __m256 z = _mm256_blend_ps(_mm256_blend_ps(in[0], in[1], 0x49), in[2], 0x92);
+    out[0] = _mm256_permutevar8x32_ps(x, _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5));
+    out[1] = _mm256_permutevar8x32_ps(y, _mm256_setr_epi32(1, 4, 7, 2, 5, 0, 3, 6));
+    out[2] = _mm256_permutevar8x32_ps(z, _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7));
+  }
+  ITK_VARIATIONALREGISTRATION_AVX2 void
+  Interleave(const VectorType (&in)[3], VectorType (&out)[3])
+  {
+    const __m256 x = _mm256_permutevar8x32_ps(in[0], _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5));
+    const __m256 y = _mm256_permutevar8x32_ps(in[1], _mm256_setr_epi32(5, 0, 3, 6, 1, 4, 7, 2));
+    const __m256 z = _mm256_permutevar8x32_ps(in[2], _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7));
+    out[0] = _mm256_blend_ps(_mm256_blend_ps(x, y, 0x92), z, 0x24);
+    out[1] = _mm256_blend_ps(_mm256_blend_ps(x, y, 0x24), z, 0x49);
+    out[2] = _mm256_blend_ps(_mm256_blend_ps(x, y, 0x49), z, 0x92);
+  }
+#  undef ITK_VARIATIONALREGISTRATION_AVX2
+};
+
+/** Vector operations of the AVX-512 kernels (16 float lanes). */
+struct AVX512Traits
+{
+  using VectorType = __m512;
+  using MaskType = __mmask16;
+  struct AccumulatorType
+  {
+    __m512d m_Low;
+    __m512d m_High;
+  };
+  static constexpr unsigned int Width = 16;
+
+  // The zero-masked forms of some intrinsics avoid spurious uninitialized
+  // value warnings of GCC 12
+
+#  define ITK_VARIATIONALREGISTRATION_AVX512 __attribute__((target("avx512f"))) static inline
+  ITK_VARIATIONALREGISTRATION_AVX512 VectorType
+  Load(const float * p)
+  {
+    return _mm512_loadu_ps(p);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX512 void
+  Store(float * p, VectorType v)
+  {
+    _mm512_storeu_ps(p, v);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX512 VectorType
+  Set1(float value)
+  {
+    return _mm512_set1_ps(value);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX512 VectorType
+  Add(VectorType a, VectorType b)
+  {
+    return _mm512_add_ps(a, b);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX512 VectorType
+  Sub(VectorType a, VectorType b)
+  {
+    return _mm512_sub_ps(a, b);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX512 VectorType
+  Mul(VectorType a, VectorType b)
+  {
+    return _mm512_mul_ps(a, b);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX512 VectorType
+  Div(VectorType a, VectorType b)
+  {
+    return _mm512_div_ps(a, b);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX512 VectorType
+  Abs(VectorType a)
+  {
+    return _mm512_abs_ps(a);
+  }
+  /** Lanes with !(a < b), like the scalar threshold tests. */
+  ITK_VARIATIONALREGISTRATION_AVX512 MaskType
+  NotLess(VectorType a, VectorType b)
+  {
+    return _mm512_cmp_ps_mask(a, b, _CMP_NLT_UQ);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX512 MaskType
+  And(MaskType a, MaskType b)
+  {
+    return static_cast<MaskType>(a & b);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX512 MaskType
+  AllLanes()
+  {
+    return static_cast<MaskType>(0xFFFF);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX512 MaskType
+  InsideMask(const unsigned char * inside)
+  {
+    const __m512i flags =
+      _mm512_maskz_cvtepu8_epi32(0xFFFF, _mm_loadu_si128(reinterpret_cast<const __m128i *>(inside)));
+    return _mm512_test_epi32_mask(flags, flags);
+  }
+  /** The lanes of v selected by the mask, zero otherwise. */
+  ITK_VARIATIONALREGISTRATION_AVX512 VectorType
+  Select(VectorType v, MaskType mask)
+  {
+    return _mm512_maskz_mov_ps(mask, v);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX512 AccumulatorType
+  ZeroAccumulator()
+  {
+    return { _mm512_setzero_pd(), _mm512_setzero_pd() };
+  }
+  ITK_VARIATIONALREGISTRATION_AVX512 void
+  Accumulate(AccumulatorType & sum, VectorType v)
+  {
+    const __m256 low = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, _mm512_castps_pd(v), 0));
+    const __m256 high = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, _mm512_castps_pd(v), 1));
+    sum.m_Low = _mm512_add_pd(sum.m_Low, _mm512_maskz_cvtps_pd(0xFF, low));
+    sum.m_High = _mm512_add_pd(sum.m_High, _mm512_maskz_cvtps_pd(0xFF, high));
+  }
+  ITK_VARIATIONALREGISTRATION_AVX512 double
+  Sum(const AccumulatorType & sum)
+  {
+    double lanes[8];
+    _mm512_storeu_pd(lanes, _mm512_add_pd(sum.m_Low, sum.m_High));
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+  }
+
+  /** [x0 y0 x1 y1 ...] -> [x0 x1 ...], [y0 y1 ...] */
+  ITK_VARIATIONALREGISTRATION_AVX512 void
+  Deinterleave(const VectorType (&in)[2], VectorType (&out)[2])
+  {
+    const __m512i even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    const __m512i odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+    out[0] = _mm512_permutex2var_ps(in[0], even, in[1]);
+    out[1] = _mm512_permutex2var_ps(in[0], odd, in[1]);
+  }
+  ITK_VARIATIONALREGISTRATION_AVX512 void
+  Interleave(const VectorType (&in)[2], VectorType (&out)[2])
+  {
+    const __m512i low = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+    const __m512i high = _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+    out[0] = _mm512_permutex2var_ps(in[0], low, in[1]);
+    out[1] = _mm512_permutex2var_ps(in[0], high, in[1]);
+  }
+  /** [x0 y0 z0 x1 ...] -> [x0 x1 ...], [y0 y1 ...], [z0 z1 ...]. The first
+   * permutation collects the components from the first two input vectors,
+   * the second one inserts those from the third input vector. */
+  ITK_VARIATIONALREGISTRATION_AVX512 void
+  Deinterleave(const VectorType (&in)[3], VectorType (&out)[3])
+  {
+    const __m512 x = _mm512_permutex2var_ps(
+      in[0], _mm512_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30, 0, 0, 0, 0, 0), in[1]);
+    const __m512 y = _mm512_permutex2var_ps(
+      in[0], _mm512_setr_epi32(1, 4, 7, 10, 13, 16, 19, 22, 25, 28, 31, 0, 0, 0, 0, 0), in[1]);
+    const __m512 z = _mm512_permutex2var_ps(
+      in[0], _mm512_setr_epi32(2, 5, 8, 11, 14, 17, 20, 23, 26, 29, 0, 0, 0, 0, 0, 0), in[1]);
+    out[0] =
+      _mm512_permutex2var_ps(x, _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 17, 20, 23, 26, 29), in[2]);
+    out[1] =
+      _mm512_permutex2var_ps(y, _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 18, 21, 24, 27, 30), in[2]);
+    out[2] =
+      _mm512_permutex2var_ps(z, _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 16, 19, 22, 25, 28, 31), in[2]);
+  }
+  /** The first permutation places the x and y components of each output
+   * vector, the second one inserts the z components. */
+  ITK_VARIATIONALREGISTRATION_AVX512 void
+  Interleave(const VectorType (&in)[3], VectorType (&out)[3])
+  {
+    const __m512 xy0 = _mm512_permutex2var_ps(
+      in[0], _mm512_setr_epi32(0, 16, 0, 1, 17, 0, 2, 18, 0, 3, 19, 0, 4, 20, 0, 5), in[1]);
+    const __m512 xy1 = _mm512_permutex2var_ps(
+      in[0], _mm512_setr_epi32(21, 0, 6, 22, 0, 7, 23, 0, 8, 24, 0, 9, 25, 0, 10, 26), in[1]);
+    const __m512 xy2 = _mm512_permutex2var_ps(
+      in[0], _mm512_setr_epi32(0, 11, 27, 0, 12, 28, 0, 13, 29, 0, 14, 30, 0, 15, 31, 0), in[1]);
+    out[0] =
+      _mm512_permutex2var_ps(xy0, _mm512_setr_epi32(0, 1, 16, 3, 4, 17, 6, 7, 18, 9, 10, 19, 12, 13, 20, 15), in[2]);
+    out[1] =
+      _mm512_permutex2var_ps(xy1, _mm512_setr_epi32(0, 21, 2, 3, 22, 5, 6, 23, 8, 9, 24, 11, 12, 25, 14, 15), in[2]);
+    out[2] =
+      _mm512_permutex2var_ps(xy2, _mm512_setr_epi32(26, 1, 2, 27, 4, 5, 28, 7, 8, 29, 10, 11, 30, 13, 14, 31), in[2]);
+  }
+#  undef ITK_VARIATIONALREGISTRATION_AVX512
+};
+
+// The generic vector kernels are always inlined into the target specific
+// kernels below, so the vector calling convention of the default target
+// does not matter
+#  if defined(__GNUC__) && !defined(__clang__)
+#    pragma GCC diagnostic push
+#    pragma GCC diagnostic ignored "-Wpsabi"
+#  endif
+
+/** Demons force for the pixels of full vectors; the row tail is computed by
+ * the scalar kernel. Always inlined into the target specific kernels. */
+template <typename TTraits, unsigned int VDimension>
+__attribute__((always_inline)) inline void
+DemonsKernelVector(SizeValueType         length,
+                   const float *         fixed,
+                   const float *         warped,
+                   const float *         gradient,
+                   const float *         secondGradient,
+                   const unsigned char * inside,
+                   float *               update,
+                   double                normalizer,
+                   double                intensityDifferenceThreshold,
+                   double                denominatorThreshold,
+                   double &              sumOfMetricValues,
+                   double &              sumOfSquaredChange)
+{
+  using VectorType = typename TTraits::VectorType;
+  using MaskType = typename TTraits::MaskType;
+  constexpr unsigned int Width = TTraits::Width;
+
+  const VectorType inverseNormalizer = TTraits::Set1(static_cast<float>(1.0 / normalizer));
+  const VectorType intensityThreshold = TTraits::Set1(static_cast<float>(intensityDifferenceThreshold));
+  const VectorType denominatorThresholdVector = TTraits::Set1(static_cast<float>(denominatorThreshold));
+
+  typename TTraits::AccumulatorType metricSum = TTraits::ZeroAccumulator();
+  typename TTraits::AccumulatorType changeSum = TTraits::ZeroAccumulator();
+
+  SizeValueType p = 0;
+  for (; p + Width <= length; p += Width)
+  {
+    // The gradients of the Width pixels are VDimension contiguous vectors
+    VectorType rows[VDimension];
+    for (unsigned int j = 0; j < VDimension; j++)
+    {
+      rows[j] = TTraits::Load(gradient + p * VDimension + j * Width);
+      if (secondGradient)
+      {
+        rows[j] = TTraits::Add(rows[j], TTraits::Load(secondGradient + p * VDimension + j * Width));
+      }
+    }
+    VectorType g[VDimension];
+    TTraits::Deinterleave(rows, g);
+
+    const VectorType speedValue = TTraits::Sub(TTraits::Load(fixed + p), TTraits::Load(warped + p));
+    VectorType       gradientSquaredMagnitude = TTraits::Mul(g[0], g[0]);
+    for (unsigned int j = 1; j < VDimension; j++)
+    {
+      gradientSquaredMagnitude = TTraits::Add(gradientSquaredMagnitude, TTraits::Mul(g[j], g[j]));
+    }
+    const VectorType speedSquared = TTraits::Mul(speedValue, speedValue);
+    const VectorType denominator =
+      TTraits::Add(TTraits::Mul(speedSquared, inverseNormalizer), gradientSquaredMagnitude);
+
+    const MaskType insideMask = inside ? TTraits::InsideMask(inside + p) : TTraits::AllLanes();
+    const MaskType active =
+      TTraits::And(insideMask,
+                   TTraits::And(TTraits::NotLess(TTraits::Abs(speedValue), intensityThreshold),
+                                TTraits::NotLess(denominator, denominatorThresholdVector)));
+
+    // Lanes with a vanishing denominator are discarded by the mask
+    const VectorType factor = TTraits::Div(speedValue, denominator);
+    VectorType       u[VDimension];
+    for (unsigned int j = 0; j < VDimension; j++)
+    {
+      u[j] = TTraits::Select(TTraits::Mul(g[j], factor), active);
+    }
+    VectorType squaredChange = TTraits::Mul(u[0], u[0]);
+    for (unsigned int j = 1; j < VDimension; j++)
+    {
+      squaredChange = TTraits::Add(squaredChange, TTraits::Mul(u[j], u[j]));
+    }
+
+    TTraits::Interleave(u, rows);
+    for (unsigned int j = 0; j < VDimension; j++)
+    {
+      TTraits::Store(update + p * VDimension + j * Width, rows[j]);
+    }
+
+    TTraits::Accumulate(metricSum, TTraits::Select(speedSquared, insideMask));
+    TTraits::Accumulate(changeSum, squaredChange);
+  }
+  sumOfMetricValues += TTraits::Sum(metricSum);
+  sumOfSquaredChange += TTraits::Sum(changeSum);
+
+  DemonsKernelScalar<VDimension>(length - p,
+                                 fixed + p,
+                                 warped + p,
+                                 gradient + p * VDimension,
+                                 secondGradient ? secondGradient + p * VDimension : nullptr,
+                                 inside ? inside + p : nullptr,
+                                 update + p * VDimension,
+                                 normalizer,
+                                 intensityDifferenceThreshold,
+                                 denominatorThreshold,
+                                 sumOfMetricValues,
+                                 sumOfSquaredChange);
+}
+
+/** SSD force for the pixels of full vectors; the row tail is computed by the
+ * scalar kernel. Always inlined into the target specific kernels. */
+template <typename TTraits, unsigned int VDimension>
+__attribute__((always_inline)) inline void
+SSDKernelVector(SizeValueType         length,
+                const float *         fixed,
+                const float *         warped,
+                const float *         gradient,
+                const float *         secondGradient,
+                const unsigned char * inside,
+                float *               update,
+                double                intensityDifferenceThreshold,
+                double &              sumOfMetricValues,
+                double &              sumOfSquaredChange)
+{
+  using VectorType = typename TTraits::VectorType;
+  using MaskType = typename TTraits::MaskType;
+  constexpr unsigned int Width = TTraits::Width;
+
+  const VectorType intensityThreshold = TTraits::Set1(static_cast<float>(intensityDifferenceThreshold));
+
+  typename TTraits::AccumulatorType metricSum = TTraits::ZeroAccumulator();
+  typename TTraits::AccumulatorType changeSum = TTraits::ZeroAccumulator();
+
+  SizeValueType p = 0;
+  for (; p + Width <= length; p += Width)
+  {
+    // The gradients of the Width pixels are VDimension contiguous vectors
+    VectorType rows[VDimension];
+    for (unsigned int j = 0; j < VDimension; j++)
+    {
+      rows[j] = TTraits::Load(gradient + p * VDimension + j * Width);
+      if (secondGradient)
+      {
+        rows[j] = TTraits::Add(rows[j], TTraits::Load(secondGradient + p * VDimension + j * Width));
+      }
+    }
+    VectorType g[VDimension];
+    TTraits::Deinterleave(rows, g);
+
+    const VectorType speedValue = TTraits::Sub(TTraits::Load(fixed + p), TTraits::Load(warped + p));
+    const MaskType   insideMask = inside ? TTraits::InsideMask(inside + p) : TTraits::AllLanes();
+    const MaskType   active = TTraits::And(insideMask, TTraits::NotLess(TTraits::Abs(speedValue), intensityThreshold));
+
+    VectorType u[VDimension];
+    for (unsigned int j = 0; j < VDimension; j++)
+    {
+      u[j] = TTraits::Select(TTraits::Mul(g[j], speedValue), active);
+    }
+    VectorType squaredChange = TTraits::Mul(u[0], u[0]);
+    for (unsigned int j = 1; j < VDimension; j++)
+    {
+      squaredChange = TTraits::Add(squaredChange, TTraits::Mul(u[j], u[j]));
+    }
+
+    TTraits::Interleave(u, rows);
+    for (unsigned int j = 0; j < VDimension; j++)
+    {
+      TTraits::Store(update + p * VDimension + j * Width, rows[j]);
+    }
+
+    TTraits::Accumulate(metricSum, TTraits::Select(TTraits::Mul(speedValue, speedValue), insideMask));
+    TTraits::Accumulate(changeSum, squaredChange);
+  }
+  sumOfMetricValues += TTraits::Sum(metricSum);
+  sumOfSquaredChange += TTraits::Sum(changeSum);
+
+  SSDKernelScalar<VDimension>(length - p,
+                              fixed + p,
+                              warped + p,
+                              gradient + p * VDimension,
+                              secondGradient ? secondGradient + p * VDimension : nullptr,
+                              inside ? inside + p : nullptr,
+                              update + p * VDimension,
+                              intensityDifferenceThreshold,
+                              sumOfMetricValues,
+                              sumOfSquaredChange);
+}
+
+#  if defined(__GNUC__) && !defined(__clang__)
+#    pragma GCC diagnostic pop
+#  endif
+
+/** Demons force, AVX2 version. */
+template <unsigned int VDimension>
+__attribute__((target("avx2"), flatten)) void
+DemonsKernelAVX2(SizeValueType         length,
+                 const float *         fixed,
+                 const float *         warped,
+                 const float *         gradient,
+                 const float *         secondGradient,
+                 const unsigned char * inside,
+                 float *               update,
+                 double                normalizer,
+                 double                intensityDifferenceThreshold,
+                 double                denominatorThreshold,
+                 double &              sumOfMetricValues,
+                 double &              sumOfSquaredChange)
+{
+  DemonsKernelVector<AVX2Traits, VDimension>(length,
+                                             fixed,
+                                             warped,
+                                             gradient,
+                                             secondGradient,
+                                             inside,
+                                             update,
+                                             normalizer,
+                                             intensityDifferenceThreshold,
+                                             denominatorThreshold,
+                                             sumOfMetricValues,
+                                             sumOfSquaredChange);
+}
+
+/** Demons force, AVX-512 version. */
+template <unsigned int VDimension>
+__attribute__((target("avx512f"), flatten)) void
+DemonsKernelAVX512(SizeValueType         length,
+                   const float *         fixed,
+                   const float *         warped,
+                   const float *         gradient,
+                   const float *         secondGradient,
+                   const unsigned char * inside,
+                   float *               update,
+                   double                normalizer,
+                   double                intensityDifferenceThreshold,
+                   double                denominatorThreshold,
+                   double &              sumOfMetricValues,
+                   double &              sumOfSquaredChange)
+{
+  DemonsKernelVector<AVX512Traits, VDimension>(length,
+                                               fixed,
+                                               warped,
+                                               gradient,
+                                               secondGradient,
+                                               inside,
+                                               update,
+                                               normalizer,
+                                               intensityDifferenceThreshold,
+                                               denominatorThreshold,
+                                               sumOfMetricValues,
+                                               sumOfSquaredChange);
+}
+
+/** SSD force, AVX2 version. */
+template <unsigned int VDimension>
+__attribute__((target("avx2"), flatten)) void
+SSDKernelAVX2(SizeValueType         length,
+              const float *         fixed,
+              const float *         warped,
+              const float *         gradient,
+              const float *         secondGradient,
+              const unsigned char * inside,
+              float *               update,
+              double                intensityDifferenceThreshold,
+              double &              sumOfMetricValues,
+              double &              sumOfSquaredChange)
+{
+  SSDKernelVector<AVX2Traits, VDimension>(length,
+                                          fixed,
+                                          warped,
+                                          gradient,
+                                          secondGradient,
+                                          inside,
+                                          update,
+                                          intensityDifferenceThreshold,
+                                          sumOfMetricValues,
+                                          sumOfSquaredChange);
+}
+
+/** SSD force, AVX-512 version. */
+template <unsigned int VDimension>
+__attribute__((target("avx512f"), flatten)) void
+SSDKernelAVX512(SizeValueType         length,
+                const float *         fixed,
+                const float *         warped,
+                const float *         gradient,
+                const float *         secondGradient,
+                const unsigned char * inside,
+                float *               update,
+                double                intensityDifferenceThreshold,
+                double &              sumOfMetricValues,
+                double &              sumOfSquaredChange)
+{
+  SSDKernelVector<AVX512Traits, VDimension>(length,
+                                            fixed,
+                                            warped,
+                                            gradient,
+                                            secondGradient,
+                                            inside,
+                                            update,
+                                            intensityDifferenceThreshold,
+                                            sumOfMetricValues,
+                                            sumOfSquaredChange);
+}
+
+#endif
+
+/** Widest instruction set supported by the CPU. */
+enum class InstructionSetType
+{
+  Scalar = 0,
+  AVX2 = 1,
+  AVX512 = 2
+};
+
+/** Detect the instruction set once; the result is cached. */
+inline InstructionSetType
+GetInstructionSet()
+{
+  static const InstructionSetType instructionSet = []() {
+#if defined(ITK_VARIATIONALREGISTRATION_X86_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+      return InstructionSetType::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+      return InstructionSetType::AVX2;
+    }
+#endif
+    return InstructionSetType::Scalar;
+  }();
+  return instructionSet;
+}
+
+/** Vector kernels for an instruction set; there are none for dimensions
+ * other than two and three. */
+template <unsigned int VDimension, bool VHasVectorKernels = (VDimension == 2 || VDimension == 3)>
+struct VectorKernels
+{
+  static DemonsKernelType<VDimension>
+  Demons(InstructionSetType)
+  {
+    return nullptr;
+  }
+  static SSDKernelType<VDimension>
+  SSD(InstructionSetType)
+  {
+    return nullptr;
+  }
+};
+
+template <unsigned int VDimension>
+struct VectorKernels<VDimension, true>
+{
+  static DemonsKernelType<VDimension>
+  Demons(InstructionSetType instructionSet)
+  {
+    switch (instructionSet)
+    {
+#if defined(ITK_VARIATIONALREGISTRATION_X86_DISPATCH)
+      case InstructionSetType::AVX512:
+        return DemonsKernelAVX512<VDimension>;
+      case InstructionSetType::AVX2:
+        return DemonsKernelAVX2<VDimension>;
+#endif
+      default:
+        return nullptr;
+    }
+  }
+  static SSDKernelType<VDimension>
+  SSD(InstructionSetType instructionSet)
+  {
+    switch (instructionSet)
+    {
+#if defined(ITK_VARIATIONALREGISTRATION_X86_DISPATCH)
+      case InstructionSetType::AVX512:
+        return SSDKernelAVX512<VDimension>;
+      case InstructionSetType::AVX2:
+        return SSDKernelAVX2<VDimension>;
+#endif
+      default:
+        return nullptr;
+    }
+  }
+};
+
+/** Return the Demons vector kernel of an instruction set (by default the one
+ * of the CPU) or a null pointer if there is none; the callers then use their
+ * scalar double precision code. */
+template <unsigned int VDimension>
+inline DemonsKernelType<VDimension>
+GetDemonsKernel(InstructionSetType instructionSet = GetInstructionSet())
+{
+  return VectorKernels<VDimension>::Demons(instructionSet);
+}
+
+/** Return the SSD vector kernel of an instruction set (by default the one of
+ * the CPU) or a null pointer if there is none. */
+template <unsigned int VDimension>
+inline SSDKernelType<VDimension>
+GetSSDKernel(InstructionSetType instructionSet = GetInstructionSet())
+{
+  return VectorKernels<VDimension>::SSD(instructionSet);
+}
+
+} // end namespace VariationalRegistrationForceKernels
+} // end namespace itk
+
+#endif
@@ -21,7 +21,12 @@
 #include "itkFiniteDifferenceFunction.h"
 //#include "itkWarpImageFilter.h"
 #include "itkContinuousBorderWarpImageFilter.h"
+#include "itkCovariantVector.h"
+#include "itkMultiThreaderBase.h"
+#include "itkNumericTraits.h"
+#include <atomic>
 #include <mutex>
+#include <vector>
 
 namespace itk
 {
@@ -36,6 +41,14 @@ namespace itk
  *
  *  Implement a concrete force type in a subclass; overwrite the methods
  *  InitializeIteration() and ComputeUpdate().
+ *  To speed up the computation, a subclass can also overwrite
+ *  SupportsScanlineUpdate() and ComputeUpdateScanline(). The update field is
+ *  then computed line by line on the raw image buffers by
+ *  VariationalRegistrationFilter.
+ *
+ *  The metric sums of each image line are stored in a separate slot and
+ *  added up pairwise in a fixed order when the metric is requested. Metric
+ *  value and RMS change are therefore reproducible for any number of threads.
  *
  *  \sa VariationalRegistrationFilter
  *
@@ -84,6 +97,10 @@ public:
   using DisplacementFieldType = TDisplacementField;
   using DisplacementFieldTypePointer = typename DisplacementFieldType::ConstPointer;
 
+  /** Various type definitions. */
+  using PixelType = typename Superclass::PixelType;
+  using IndexType = typename FixedImageType::IndexType;
+
   /** MovingImage image type. */
   using MaskImagePixelType = unsigned char;
   using MaskImageType = Image<MaskImagePixelType, ImageDimension>;
@@ -96,6 +113,30 @@ public:
     itk::ContinuousBorderWarpImageFilter<FixedImageType, WarpedImageType, DisplacementFieldType>;
   using MovingImageWarperPointer = typename MovingImageWarperType::Pointer;
 
+  /** Image gradient types. Gradients are stored in dense images that are
+   *  computed once and then read by the force computation. The components
+   *  have the floating point type of the fixed image pixels, i.e. float for
+   *  integer and float images and double for double images. */
+  using GradientValueType = typename NumericTraits<typename FixedImageType::PixelType>::FloatType;
+  using GradientPixelType = CovariantVector<GradientValueType, ImageDimension>;
+  using GradientImageType = Image<GradientPixelType, ImageDimension>;
+  using GradientImagePointer = typename GradientImageType::Pointer;
+
+  /** Set the multithreader used for the image passes of the function, e.g.
+   * the gradient computation. VariationalRegistrationFilter passes its own
+   * multithreader, so the passes use the work units of the filter. */
+  virtual void
+  SetMultiThreader(MultiThreaderBase * multiThreader)
+  {
+    m_MultiThreader = multiThreader;
+  }
+
+  /** Get the multithreader used for the image passes of the function. */
+  virtual MultiThreaderBase *
+  GetMultiThreader() const
+  {
+    return m_MultiThreader;
+  }
 
   /** Set the Moving image.  */
   virtual void
@@ -210,8 +251,25 @@ public:
     return m_TimeStep;
   }
 
+  /** Returns true if the function implements ComputeUpdateScanline(). In
+   * this case, VariationalRegistrationFilter computes the update field line
+   * by line instead of calling ComputeUpdate() for each pixel. */
+  virtual bool
+  SupportsScanlineUpdate() const
+  {
+    return false;
+  }
+
+  /** Compute the updates for a contiguous line of pixels along the first
+   * image dimension starting at index. The updates are written to the raw
+   * buffer update, which holds length pixels. The result is the same as
+   * calling ComputeUpdate() for each pixel of the line. */
+  virtual void
+  ComputeUpdateScanline(const IndexType & index, SizeValueType length, PixelType * update, void * globalData);
+
   /** Return a pointer to a global data structure that is passed to
-   * this object from the solver at each calculation.  */
+   * this object from the solver at each calculation. The structures are
+   * taken from a pool that is reused in each iteration. */
   void *
   GetGlobalDataPointer() const override;
 
@@ -219,6 +277,15 @@ public:
   void
   ReleaseGlobalDataPointer(void * GlobalData) const override;
 
+  /** Add the metric sums that were accumulated in the global data for the
+   * image line (or line segment) starting at index to the slot of this line.
+   * Each line of the requested region of the displacement field, i.e. the
+   * region the filter computes, has its own slot, so no lock is required.
+   * Called by VariationalRegistrationFilter after the updates of a line are
+   * computed. */
+  void
+  StoreScanlineGlobalData(const IndexType & index, void * globalData) const;
+
   //
   // Metric accessor methods
   /** Get the metric value. The metric value is the mean square difference
@@ -227,6 +294,7 @@ public:
   virtual double
   GetMetric() const
   {
+    this->ReduceMetricSums();
     return m_Metric;
   }
 
@@ -234,6 +302,7 @@ public:
   virtual double
   GetRMSChange() const
   {
+    this->ReduceMetricSums();
     return m_RMSChange;
   }
 
@@ -254,6 +323,46 @@ protected:
   virtual const WarpedImagePointer
   GetWarpedImage() const;
 
+  /** Compute the gradient of the fixed image and store it in a dense image.
+   * The gradient image is only recomputed if the fixed image has changed,
+   * i.e. it is computed once per resolution level. */
+  virtual void
+  UpdateFixedImageGradient();
+
+  /** Get the cached fixed image gradient. UpdateFixedImageGradient() has to
+   * be called before. */
+  const GradientImageType *
+  GetFixedImageGradient() const
+  {
+    return m_FixedImageGradient;
+  }
+
+  /** Compute the gradient of the warped image. Has to be called after
+   * WarpMovingImage() in each iteration. */
+  virtual void
+  ComputeWarpedImageGradient();
+
+  /** Get the warped image gradient. ComputeWarpedImageGradient() has to be
+   * called before. */
+  const GradientImageType *
+  GetWarpedImageGradient() const
+  {
+    return m_WarpedImageGradient;
+  }
+
+  /** Compute the central difference gradient of an image in a single
+   * multi-threaded pass over the raw image buffer. The gradient is zero at the
+   * image boundary and oriented by the image direction, as computed by
+   * CentralDifferenceImageFunction. The gradient image has to be allocated
+   * with the buffered region of the image. */
+  void
+  ComputeImageGradient(const FixedImageType * image, GradientImageType * gradientImage) const;
+
+  /** Allocate a gradient image with the geometry of the given image. The
+   * buffer is only reallocated if the region has changed. */
+  void
+  AllocateGradientImage(const FixedImageType * image, GradientImagePointer & gradientImage) const;
+
   /** A global data type for this class of equation. Used to store
    * information for computing the metric. */
   struct GlobalDataStruct
@@ -263,6 +372,22 @@ protected:
     double        m_SumOfSquaredChange;
   };
 
+  /** Entry of the global data pool. The padding of a cache line (64 bytes)
+   * keeps the sums of neighboring entries, which are used by different
+   * threads, on different cache lines without relying on over-aligned
+   * allocation. Structures that are allocated when the pool is exhausted are
+   * not pooled and deleted in ReleaseGlobalDataPointer(). */
+  struct GlobalDataPoolEntry : GlobalDataStruct
+  {
+    bool m_IsPooled{ true };
+    char m_Padding[64];
+  };
+
+  /** Add up the metric sums of all lines pairwise in a fixed order and
+   * compute metric value and RMS change. Only done once per iteration. */
+  void
+  ReduceMetricSums() const;
+
 private:
   /** The Moving image. */
   MovingImagePointer m_MovingImage;
@@ -279,6 +404,18 @@ private:
   /** A class to warp the moving image into the domain of the fixed image. */
   MovingImageWarperPointer m_MovingImageWarper;
 
+  /** The multithreader of the image passes. */
+  MultiThreaderBase::Pointer m_MultiThreader;
+
+  /** The cached fixed image gradient and the fixed image it was computed
+   * from, identified by its address and modification time. */
+  GradientImagePointer   m_FixedImageGradient;
+  const FixedImageType * m_FixedImageGradientSource;
+  ModifiedTimeType       m_FixedImageGradientSourceTime;
+
+  /** The gradient of the warped image of the current iteration. */
+  GradientImagePointer m_WarpedImageGradient;
+
   /** The global timestep. */
   TimeStepType m_TimeStep;
 
@@ -294,7 +431,22 @@ private:
   mutable double        m_RMSChange;
   mutable double        m_SumOfSquaredChange;
 
-  /** Mutex lock to protect modification to metric. */
+  /** Metric sums of each line of the requested region of the displacement
+   * field of the current iteration and whether they have already been
+   * reduced. */
+  mutable std::vector<GlobalDataStruct> m_LineMetricSums;
+  typename FixedImageType::RegionType   m_LineMetricRegion;
+  mutable bool                          m_LineMetricSumsReduced;
+
+  /** Pool of global data structures and the number of structures that were
+   * requested in the current iteration. InitializeIteration() provides one
+   * structure for each work unit of the multithreader, or more if more
+   * structures were requested before. */
+  mutable std::vector<GlobalDataPoolEntry> m_GlobalDataPool;
+  mutable std::atomic<SizeValueType>       m_GlobalDataPoolRequests;
+
+  /** Mutex lock to protect modification to metric. Only needed for global
+   * data with sums that were not stored per line. */
   mutable std::mutex m_MetricCalculationLock;
 };
 
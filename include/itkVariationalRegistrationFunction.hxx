@@ -19,6 +19,10 @@
 #define itkVariationalRegistrationFunction_hxx
 
 #include "itkVariationalRegistrationFunction.h"
+#include "itkImageScanlineConstIterator.h"
+#include "itkMultiThreaderBase.h"
+
+#include <algorithm>
 
 namespace itk
 {
@@ -44,8 +48,16 @@ VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>::
   m_NumberOfPixelsProcessed = 0L;
   m_RMSChange = NumericTraits<double>::max();
   m_SumOfSquaredChange = 0.0;
+  m_LineMetricSumsReduced = true;
+  m_GlobalDataPoolRequests = 0;
 
   m_MovingImageWarper = MovingImageWarperType::New();
+  m_MultiThreader = MultiThreaderBase::New();
+
+  m_FixedImageGradient = nullptr;
+  m_FixedImageGradientSource = nullptr;
+  m_FixedImageGradientSourceTime = 0;
+  m_WarpedImageGradient = nullptr;
 }
 
 /**
@@ -66,6 +78,30 @@ VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>::
   m_SumOfMetricValues = 0.0;
   m_NumberOfPixelsProcessed = 0L;
   m_SumOfSquaredChange = 0.0;
+
+  // one slot for the metric sums of each line of the computed region, i.e.
+  // the requested region of the displacement field (the filter output)
+  m_LineMetricRegion = this->GetDisplacementField()->GetRequestedRegion();
+  const SizeValueType lineLength = m_LineMetricRegion.GetSize(0);
+  const SizeValueType numberOfLines = lineLength ? m_LineMetricRegion.GetNumberOfPixels() / lineLength : 0;
+  if (m_LineMetricSums.size() != numberOfLines)
+  {
+    m_LineMetricSums.assign(numberOfLines, GlobalDataStruct{ 0.0, 0L, 0.0 });
+  }
+  else
+  {
+    std::fill(m_LineMetricSums.begin(), m_LineMetricSums.end(), GlobalDataStruct{ 0.0, 0L, 0.0 });
+  }
+  m_LineMetricSumsReduced = false;
+
+  // provide a global data structure for each work unit, so the first
+  // iteration does not allocate, or for each request of the last iteration
+  const SizeValueType poolSize = std::max<SizeValueType>(m_GlobalDataPoolRequests.exchange(0),
+                                                         m_MultiThreader->GetNumberOfWorkUnits());
+  if (poolSize > m_GlobalDataPool.size())
+  {
+    m_GlobalDataPool.resize(poolSize);
+  }
 }
 
 /**
@@ -103,6 +139,200 @@ VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>::
   }
 }
 
+/**
+ * Compute the fixed image gradient if the fixed image has changed.
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>::UpdateFixedImageGradient()
+{
+  const FixedImageType * fixedImage = this->GetFixedImage();
+  if (!fixedImage)
+  {
+    itkExceptionMacro(<< "FixedImage not set");
+  }
+
+  // The fixed image is constant within a resolution level. A new level (or
+  // the swapped images of a symmetric registration) is detected by a changed
+  // image address or modification time.
+  const ModifiedTimeType fixedImageTime = std::max(fixedImage->GetMTime(), fixedImage->GetUpdateMTime());
+  if (m_FixedImageGradient && m_FixedImageGradientSource == fixedImage &&
+      m_FixedImageGradientSourceTime == fixedImageTime)
+  {
+    return;
+  }
+
+  this->AllocateGradientImage(fixedImage, m_FixedImageGradient);
+  this->ComputeImageGradient(fixedImage, m_FixedImageGradient);
+
+  m_FixedImageGradientSource = fixedImage;
+  m_FixedImageGradientSourceTime = fixedImageTime;
+}
+
+/**
+ * Compute the gradient of the warped image.
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>::ComputeWarpedImageGradient()
+{
+  const WarpedImageType * warpedImage = m_MovingImageWarper->GetOutput();
+
+  this->AllocateGradientImage(warpedImage, m_WarpedImageGradient);
+  this->ComputeImageGradient(warpedImage, m_WarpedImageGradient);
+}
+
+/**
+ * Allocate a gradient image for the given image.
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>::AllocateGradientImage(
+  const FixedImageType * image,
+  GradientImagePointer & gradientImage) const
+{
+  if (!gradientImage || gradientImage->GetBufferedRegion() != image->GetBufferedRegion())
+  {
+    gradientImage = GradientImageType::New();
+    gradientImage->CopyInformation(image);
+    gradientImage->SetRequestedRegion(image->GetBufferedRegion());
+    gradientImage->SetBufferedRegion(image->GetBufferedRegion());
+    gradientImage->Allocate();
+  }
+  else
+  {
+    gradientImage->CopyInformation(image);
+  }
+}
+
+/**
+ * Compute central differences on the raw image buffer.
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>::ComputeImageGradient(
+  const FixedImageType * image,
+  GradientImageType *    gradientImage) const
+{
+  using RegionType = typename FixedImageType::RegionType;
+  using IndexType = typename FixedImageType::IndexType;
+  using SizeType = typename FixedImageType::SizeType;
+  using ImagePixelType = typename FixedImageType::PixelType;
+
+  const RegionType        bufferedRegion = image->GetBufferedRegion();
+  const SizeType          size = bufferedRegion.GetSize();
+  const IndexType         start = bufferedRegion.GetIndex();
+  const OffsetValueType * offsetTable = image->GetOffsetTable();
+
+  // Precompute the central difference weights.
+  double scale[ImageDimension];
+  for (unsigned int d = 0; d < ImageDimension; d++)
+  {
+    scale[d] = 0.5 / image->GetSpacing()[d];
+  }
+
+  // The gradient is only transformed into physical space if the image
+  // direction is not the identity.
+  const typename FixedImageType::DirectionType direction = image->GetDirection();
+  bool                                         useDirection = false;
+  for (unsigned int i = 0; i < ImageDimension; i++)
+  {
+    for (unsigned int j = 0; j < ImageDimension; j++)
+    {
+      if (direction[i][j] != (i == j ? 1.0 : 0.0))
+      {
+        useDirection = true;
+      }
+    }
+  }
+
+  const ImagePixelType * imageBuffer = image->GetBufferPointer();
+  GradientPixelType *    gradientBuffer = gradientImage->GetBufferPointer();
+
+  // Each work unit processes complete lines along the first dimension.
+  m_MultiThreader->ParallelizeImageRegionRestrictDirection<ImageDimension>(
+    0,
+    bufferedRegion,
+    [&](const RegionType & region) {
+      const SizeValueType lineLength = size[0];
+
+      ImageScanlineConstIterator<FixedImageType> lineIt(image, region);
+      while (!lineIt.IsAtEnd())
+      {
+        const IndexType        lineIndex = lineIt.GetIndex();
+        const OffsetValueType  lineOffset = image->ComputeOffset(lineIndex);
+        const ImagePixelType * in = imageBuffer + lineOffset;
+        GradientPixelType *    out = gradientBuffer + lineOffset;
+
+        // Derivative along the line; zero at the first and last pixel.
+        out[0][0] = 0.0;
+        out[lineLength - 1][0] = 0.0;
+        for (SizeValueType x = 1; x + 1 < lineLength; x++)
+        {
+          const double difference = static_cast<double>(in[x + 1]) - static_cast<double>(in[x - 1]);
+          out[x][0] = static_cast<GradientValueType>(difference * scale[0]);
+        }
+
+        // Derivatives across the line; zero if the line lies on the boundary.
+        for (unsigned int d = 1; d < ImageDimension; d++)
+        {
+          const IndexValueType position = lineIndex[d] - start[d];
+          if (position < 1 || position + 2 > static_cast<IndexValueType>(size[d]))
+          {
+            for (SizeValueType x = 0; x < lineLength; x++)
+            {
+              out[x][d] = 0.0;
+            }
+          }
+          else
+          {
+            const ImagePixelType * next = in + offsetTable[d];
+            const ImagePixelType * prev = in - offsetTable[d];
+            for (SizeValueType x = 0; x < lineLength; x++)
+            {
+              const double difference = static_cast<double>(next[x]) - static_cast<double>(prev[x]);
+              out[x][d] = static_cast<GradientValueType>(difference * scale[d]);
+            }
+          }
+        }
+
+        if (useDirection)
+        {
+          for (SizeValueType x = 0; x < lineLength; x++)
+          {
+            const GradientPixelType localGradient = out[x];
+            for (unsigned int i = 0; i < ImageDimension; i++)
+            {
+              double sum = 0.0;
+              for (unsigned int j = 0; j < ImageDimension; j++)
+              {
+                sum += direction[i][j] * localGradient[j];
+              }
+              out[x][i] = static_cast<GradientValueType>(sum);
+            }
+          }
+        }
+
+        lineIt.NextLine();
+      }
+    },
+    nullptr);
+}
+
+/**
+ * Compute the updates for a line of pixels.
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>::ComputeUpdateScanline(
+  const IndexType & itkNotUsed(index),
+  SizeValueType     itkNotUsed(length),
+  PixelType *       itkNotUsed(update),
+  void *            itkNotUsed(globalData))
+{
+  itkExceptionMacro(<< "ComputeUpdateScanline() is not implemented by " << this->GetNameOfClass());
+}
+
 /**
  * Returns an empty struct that is used by the threads to include the
  * required update information for each thread.
@@ -111,17 +341,29 @@ template <typename TFixedImage, typename TMovingImage, typename TDisplacementFie
 void *
 VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>::GetGlobalDataPointer() const
 {
-  auto * global = new GlobalDataStruct();
+  // Take the next structure of the pool; only if the pool is exhausted, a
+  // new structure is allocated.
+  const SizeValueType   request = m_GlobalDataPoolRequests++;
+  GlobalDataPoolEntry * global = nullptr;
+  if (request < m_GlobalDataPool.size())
+  {
+    global = &m_GlobalDataPool[request];
+  }
+  else
+  {
+    global = new GlobalDataPoolEntry();
+    global->m_IsPooled = false;
+  }
 
   global->m_SumOfMetricValues = 0.0;
   global->m_NumberOfPixelsProcessed = 0L;
   global->m_SumOfSquaredChange = 0;
 
-  return global;
+  return static_cast<GlobalDataStruct *>(global);
 }
 
 /**
- * Update the metric and release the per-thread-global data.
+ * Release the per-thread-global data.
  */
 template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
 void
@@ -130,19 +372,113 @@ VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>::
 {
   auto * globalData = (GlobalDataStruct *)gd;
 
-  std::lock_guard<std::mutex> mutexHolder(m_MetricCalculationLock);
+  // The sums are usually stored per line by StoreScanlineGlobalData(). Sums
+  // that are left (e.g. if ComputeUpdate() is called by another solver) are
+  // added up in arrival order.
+  if (globalData->m_NumberOfPixelsProcessed)
+  {
+    std::lock_guard<std::mutex> mutexHolder(m_MetricCalculationLock);
 
-  m_SumOfMetricValues += globalData->m_SumOfMetricValues;
-  m_NumberOfPixelsProcessed += globalData->m_NumberOfPixelsProcessed;
-  m_SumOfSquaredChange += globalData->m_SumOfSquaredChange;
+    m_SumOfMetricValues += globalData->m_SumOfMetricValues;
+    m_NumberOfPixelsProcessed += globalData->m_NumberOfPixelsProcessed;
+    m_SumOfSquaredChange += globalData->m_SumOfSquaredChange;
+    m_LineMetricSumsReduced = false;
+  }
 
-  if (m_NumberOfPixelsProcessed)
+  // Structures of the pool are reset in GetGlobalDataPointer()
+  auto * entry = static_cast<GlobalDataPoolEntry *>(globalData);
+  if (!entry->m_IsPooled)
   {
-    m_Metric = m_SumOfMetricValues / static_cast<double>(m_NumberOfPixelsProcessed);
-    m_RMSChange = std::sqrt(m_SumOfSquaredChange / static_cast<double>(m_NumberOfPixelsProcessed));
+    delete entry;
   }
+}
+
+/**
+ * Move the metric sums of a line into the slot of the line.
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>::StoreScanlineGlobalData(
+  const IndexType & index,
+  void *            gd) const
+{
+  auto * globalData = (GlobalDataStruct *)gd;
 
-  delete globalData;
+  // Number of the line in the requested region of the displacement field
+  SizeValueType line = 0;
+  SizeValueType stride = 1;
+  for (unsigned int d = 1; d < ImageDimension; d++)
+  {
+    line += static_cast<SizeValueType>(index[d] - m_LineMetricRegion.GetIndex(d)) * stride;
+    stride *= m_LineMetricRegion.GetSize(d);
+  }
+  if (!m_LineMetricRegion.IsInside(index) || line >= m_LineMetricSums.size())
+  {
+    itkExceptionMacro(<< "Line " << index
+                      << " is not inside the requested region of the displacement field of the current iteration");
+  }
+
+  GlobalDataStruct & lineSums = m_LineMetricSums[line];
+  lineSums.m_SumOfMetricValues += globalData->m_SumOfMetricValues;
+  lineSums.m_NumberOfPixelsProcessed += globalData->m_NumberOfPixelsProcessed;
+  lineSums.m_SumOfSquaredChange += globalData->m_SumOfSquaredChange;
+
+  globalData->m_SumOfMetricValues = 0.0;
+  globalData->m_NumberOfPixelsProcessed = 0L;
+  globalData->m_SumOfSquaredChange = 0.0;
+}
+
+/**
+ * Add up the metric sums of all lines and compute metric and RMS change.
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>::ReduceMetricSums() const
+{
+  if (m_LineMetricSumsReduced)
+  {
+    return;
+  }
+
+  // Pairwise summation in a fixed order; the result does not depend on the
+  // order in which the lines were processed.
+  const SizeValueType numberOfLines = m_LineMetricSums.size();
+  for (SizeValueType stride = 1; stride < numberOfLines; stride *= 2)
+  {
+    for (SizeValueType i = 0; i + stride < numberOfLines; i += 2 * stride)
+    {
+      GlobalDataStruct & sums = m_LineMetricSums[i];
+      GlobalDataStruct & other = m_LineMetricSums[i + stride];
+      sums.m_SumOfMetricValues += other.m_SumOfMetricValues;
+      sums.m_NumberOfPixelsProcessed += other.m_NumberOfPixelsProcessed;
+      sums.m_SumOfSquaredChange += other.m_SumOfSquaredChange;
+      other = GlobalDataStruct{ 0.0, 0L, 0.0 };
+    }
+  }
+
+  GlobalDataStruct total{ m_SumOfMetricValues, m_NumberOfPixelsProcessed, m_SumOfSquaredChange };
+  if (numberOfLines)
+  {
+    total.m_SumOfMetricValues += m_LineMetricSums[0].m_SumOfMetricValues;
+    total.m_NumberOfPixelsProcessed += m_LineMetricSums[0].m_NumberOfPixelsProcessed;
+    total.m_SumOfSquaredChange += m_LineMetricSums[0].m_SumOfSquaredChange;
+
+    // The other slots have been cleared during the summation; keep the
+    // total in the first slot such that a later reduction does not count
+    // any line twice.
+    m_LineMetricSums[0] = total;
+  }
+
+  m_SumOfMetricValues = 0.0;
+  m_NumberOfPixelsProcessed = 0L;
+  m_SumOfSquaredChange = 0.0;
+  m_LineMetricSumsReduced = true;
+
+  if (total.m_NumberOfPixelsProcessed)
+  {
+    m_Metric = total.m_SumOfMetricValues / static_cast<double>(total.m_NumberOfPixelsProcessed);
+    m_RMSChange = std::sqrt(total.m_SumOfSquaredChange / static_cast<double>(total.m_NumberOfPixelsProcessed));
+  }
 }
 
 /**
@@ -163,6 +499,12 @@ VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>::
   os << m_DisplacementField.GetPointer() << std::endl;
   os << indent << "MovingImageWarper: ";
   os << m_MovingImageWarper.GetPointer() << std::endl;
+  os << indent << "MultiThreader: ";
+  os << m_MultiThreader.GetPointer() << std::endl;
+  os << indent << "FixedImageGradient: ";
+  os << m_FixedImageGradient.GetPointer() << std::endl;
+  os << indent << "WarpedImageGradient: ";
+  os << m_WarpedImageGradient.GetPointer() << std::endl;
 
   os << indent << "TimeStep: ";
   os << m_TimeStep << std::endl;
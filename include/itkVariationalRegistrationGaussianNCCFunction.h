@@ -0,0 +1,159 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationGaussianNCCFunction_h
+#define itkVariationalRegistrationGaussianNCCFunction_h
+
+#include "itkVariationalRegistrationFastNCCFunction.h"
+#include "itkVariationalRegistrationLineFilters.h"
+#include "itkFixedArray.h"
+#include "itkMath.h"
+
+#include <cmath>
+
+namespace itk
+{
+
+/** \class VariationalRegistrationGaussianNCCFunction
+ *
+ *  \brief This class computes NCC forces with Gaussian windows in the variational registration framework.
+ *
+ *  The forces are the NCC forces of VariationalRegistrationNCCFunction, but the local means and
+ *  sums are weighted with a Gaussian window
+ *  \f$w(y)=\exp\left(-\sum_d \frac{(y_d-x_d)^2}{2\sigma_d^2}\right)\f$ instead of the box window
+ *  given by the radius. The local sums of f, f*f (once per level) and of m, m*m and f*m (in each
+ *  iteration) are computed by recursive Gaussian filtering in place on the sums images (see
+ *  VariationalRegistrationLineFilters). The costs per pixel are therefore independent of the
+ *  window size, no neighborhood is iterated and no intermediate images are allocated.
+ *
+ *  Use SetStandardDeviations() to set the standard deviations of the window in pixel units.
+ *  The weights of the window sum up to \f$N=\prod_d\sqrt{2\pi}\sigma_d\f$, which is used as
+ *  number of pixels in the force computation. The forces are therefore comparable to the forces
+ *  of VariationalRegistrationFastNCCFunction with \f$2r+1\approx\sqrt{2\pi}\sigma\f$, i.e.
+ *  \f$\sigma\approx0.8r\f$. The radius and the boundary condition are not used; at the
+ *  image boundary, the recursive filters extend the image with the boundary values.
+ *  The standard deviations have to be at least 0.5.
+ *
+ *  \sa VariationalRegistrationFastNCCFunction
+ *  \sa VariationalRegistrationFilter
+ *  \sa VariationalRegistrationFunction
+ *
+ *  \ingroup FiniteDifferenceFunctions
+ *  \ingroup VariationalRegistration
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+class VariationalRegistrationGaussianNCCFunction
+  : public VariationalRegistrationFastNCCFunction<TFixedImage, TMovingImage, TDisplacementField>
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(VariationalRegistrationGaussianNCCFunction);
+
+  /** Standard class type alias. */
+  using Self = VariationalRegistrationGaussianNCCFunction;
+  using Superclass = VariationalRegistrationFastNCCFunction<TFixedImage, TMovingImage, TDisplacementField>;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(VariationalRegistrationGaussianNCCFunction, VariationalRegistrationFastNCCFunction);
+
+  /** Get image dimension. */
+  static constexpr unsigned int ImageDimension = Superclass::ImageDimension;
+
+  /** FixedImage image type. */
+  using FixedImageType = typename Superclass::FixedImageType;
+  using FixedImagePointer = typename Superclass::FixedImagePointer;
+
+  /** Standard deviation type. */
+  using StandardDeviationsType = FixedArray<double, ImageDimension>;
+
+  /** Set/Get the standard deviations of the Gaussian window in pixel units. */
+  itkSetMacro(StandardDeviations, StandardDeviationsType);
+  virtual void
+  SetStandardDeviations(double value);
+  itkGetConstReferenceMacro(StandardDeviations, StandardDeviationsType);
+
+protected:
+  VariationalRegistrationGaussianNCCFunction();
+  ~VariationalRegistrationGaussianNCCFunction() override = default;
+
+  /** Print information about the filter. */
+  void
+  PrintSelf(std::ostream & os, Indent indent) const override;
+
+  /** Local sums image types. */
+  using FixedSumsImageType = typename Superclass::FixedSumsImageType;
+  using LocalSumsImageType = typename Superclass::LocalSumsImageType;
+
+  /** Scratch buffer types of the line filters. */
+  using FixedSumsScratchType =
+    VariationalRegistrationLineFilters::LineScratchType<typename FixedSumsImageType::PixelType>;
+  using LocalSumsScratchType =
+    VariationalRegistrationLineFilters::LineScratchType<typename LocalSumsImageType::PixelType>;
+
+  /** Compute the Gaussian weighted sums of f and f*f. */
+  void
+  ComputeFixedNeighborhoodSums(FixedSumsImageType * sums) const override
+  {
+    this->GaussianSumImage(sums, m_FixedSumsScratch);
+  }
+
+  /** Compute the Gaussian weighted sums of m, m*m and f*m. */
+  void
+  ComputeNeighborhoodSums(LocalSumsImageType * sums) const override
+  {
+    this->GaussianSumImage(sums, m_LocalSumsScratch);
+  }
+
+  /** Sum of the weights of the Gaussian window along one dimension. */
+  double
+  GetWindowSize(IndexValueType itkNotUsed(position),
+                IndexValueType itkNotUsed(regionStart),
+                SizeValueType  itkNotUsed(regionSize),
+                unsigned int   dimension) const override
+  {
+    return std::sqrt(2.0 * Math::pi) * m_StandardDeviations[dimension];
+  }
+
+  /** Replace each pixel of the image by the Gaussian weighted sum over the
+   * image. The image is smoothed in place with a recursive Gaussian filter
+   * along each dimension and scaled by the sum of the weights. */
+  template <typename TImage>
+  void
+  GaussianSumImage(TImage *                                                                          image,
+                   VariationalRegistrationLineFilters::LineScratchType<typename TImage::PixelType> & scratch) const;
+
+private:
+  /** Standard deviations of the Gaussian window in pixel units. */
+  StandardDeviationsType m_StandardDeviations;
+
+  /** Scratch buffers of the work units for the line filters, kept between
+   * iterations. */
+  mutable FixedSumsScratchType m_FixedSumsScratch;
+  mutable LocalSumsScratchType m_LocalSumsScratch;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#  include "itkVariationalRegistrationGaussianNCCFunction.hxx"
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationGaussianNCCFunction_hxx
+#define itkVariationalRegistrationGaussianNCCFunction_hxx
+
+#include "itkVariationalRegistrationGaussianNCCFunction.h"
+#include "itkMacro.h"
+
+namespace itk
+{
+
+/**
+ * Default constructor
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+VariationalRegistrationGaussianNCCFunction<TFixedImage, TMovingImage, TDisplacementField>::
+  VariationalRegistrationGaussianNCCFunction()
+{
+  // The neighborhood of the finite difference solver is not used
+  typename Superclass::RadiusType r;
+  r.Fill(0);
+  this->SetRadius(r);
+
+  m_StandardDeviations.Fill(2.0);
+}
+
+/**
+ * Set the standard deviations.
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationGaussianNCCFunction<TFixedImage, TMovingImage, TDisplacementField>::SetStandardDeviations(
+  double value)
+{
+  StandardDeviationsType sigma;
+  sigma.Fill(value);
+
+  this->SetStandardDeviations(sigma);
+}
+
+/*
+ * Standard "PrintSelf" method.
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationGaussianNCCFunction<TFixedImage, TMovingImage, TDisplacementField>::PrintSelf(
+  std::ostream & os,
+  Indent         indent) const
+{
+  Superclass::PrintSelf(os, indent);
+
+  os << indent << "StandardDeviations: ";
+  os << m_StandardDeviations << std::endl;
+}
+
+/*
+ * Gaussian weighted sums with recursive Gaussian filters along each dimension
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+template <typename TImage>
+void
+VariationalRegistrationGaussianNCCFunction<TFixedImage, TMovingImage, TDisplacementField>::GaussianSumImage(
+  TImage *                                                                          image,
+  VariationalRegistrationLineFilters::LineScratchType<typename TImage::PixelType> & scratch) const
+{
+  using ImagePixelType = typename TImage::PixelType;
+
+  for (unsigned int d = 0; d < ImageDimension; d++)
+  {
+    if (m_StandardDeviations[d] < 0.5)
+    {
+      itkExceptionMacro(<< "StandardDeviations must be at least 0.5");
+    }
+  }
+
+  // The image is filtered in place along each dimension. The filter computes
+  // the normalized Gaussian convolution (weights sum up to one), so each line
+  // is scaled with the sum of the weights along the dimension.
+  const typename TImage::RegionType region = image->GetBufferedRegion();
+  for (unsigned int d = 0; d < ImageDimension; d++)
+  {
+    const VariationalRegistrationLineFilters::RecursiveGaussianCoefficientsType coefficients =
+      VariationalRegistrationLineFilters::ComputeRecursiveGaussianCoefficients(m_StandardDeviations[d]);
+    const double sumOfWeights = this->GetWindowSize(0, 0, 0, d);
+    const bool   filterLines = region.GetSize(d) > 1;
+
+    const auto lineFilter = [&](ImagePixelType * line, ImagePixelType *, SizeValueType length) {
+      if (filterLines)
+      {
+        VariationalRegistrationLineFilters::RecursiveGaussianLine(line, length, coefficients);
+      }
+      for (SizeValueType i = 0; i < length; i++)
+      {
+        line[i] *= sumOfWeights;
+      }
+    };
+    VariationalRegistrationLineFilters::FilterLines(this->GetMultiThreader(), image, d, lineFilter, scratch);
+  }
+}
+
+} // end namespace itk
+
+#endif
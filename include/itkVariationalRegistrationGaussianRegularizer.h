@@ -19,6 +19,9 @@
 #define itkVariationalRegistrationGaussianRegularizer_h
 
 #include "itkVariationalRegistrationRegularizer.h"
+#include "itkVariationalRegistrationLineFilters.h"
+
+#include <vector>
 
 namespace itk
 {
@@ -31,6 +34,15 @@ namespace itk
  *  \f$K_{\sigma}\f$ the Gaussian kernel. This regularizer can be used
  *  to implement Demons registration within the variational framework.
  *
+ *  By default, the field is convolved with truncated Gaussian kernels (see
+ *  GaussianOperator), whose costs grow with the standard deviation. With
+ *  UseRecursiveGaussianOn(), recursive Gaussian filters are used instead,
+ *  which have constant costs per pixel. The field is filtered in place
+ *  along each dimension. Lines that are not contiguous in memory are
+ *  processed in blocks, which are transposed into a scratch buffer of the
+ *  work unit, so each dimension reads and writes the field once without
+ *  intermediate images. The scratch buffers are kept between calls.
+ *
  *  \sa VariationalRegistrationFilter
  *  \sa VariationalRegistrationRegularizer
  *  \sa VariationalRegistrationDemonsFunction
@@ -107,6 +119,15 @@ public:
    * \sa GaussianOperator. */
   itkGetConstMacro(MaximumKernelWidth, unsigned int);
 
+  /** Set/Get if the field is smoothed with a recursive Gaussian filter
+   * instead of a truncated Gaussian kernel. The recursive filter of
+   * Young and van Vliet has the same costs for each standard deviation.
+   * Standard deviations have to be zero or at least 0.5. MaximumError and MaximumKernelWidth are not used.
+   * Default is off. */
+  itkSetMacro(UseRecursiveGaussian, bool);
+  itkGetConstMacro(UseRecursiveGaussian, bool);
+  itkBooleanMacro(UseRecursiveGaussian);
+
 protected:
   VariationalRegistrationGaussianRegularizer();
   ~VariationalRegistrationGaussianRegularizer() override = default;
@@ -125,6 +146,22 @@ protected:
   void
   Initialize() override;
 
+  /** Convolve one contiguous line of the field in place with a kernel. The
+   * work line has the same length and is overwritten. */
+  static void
+  ConvolveLine(PixelType * line, PixelType * work, SizeValueType length, const std::vector<double> & kernel);
+
+  /** Apply a line filter to all lines of the output along a dimension
+   * (see VariationalRegistrationLineFilters::FilterLines()). */
+  template <typename TLineFilter>
+  void
+  FilterLines(unsigned int dimension, const TLineFilter & lineFilter)
+  {
+    this->GetMultiThreader()->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+    VariationalRegistrationLineFilters::FilterLines(
+      this->GetMultiThreader(), this->GetOutput(), dimension, lineFilter, m_LineScratch);
+  }
+
 private:
   /** Standard deviation for Gaussian smoothing */
   StandardDeviationsType m_StandardDeviations;
@@ -134,6 +171,12 @@ private:
 
   /** Limits of Gaussian kernel width. */
   unsigned int m_MaximumKernelWidth;
+
+  /** Use recursive Gaussian filters. */
+  bool m_UseRecursiveGaussian;
+
+  /** Scratch buffers of the work units for FilterLines(). */
+  VariationalRegistrationLineFilters::LineScratchType<PixelType> m_LineScratch;
 };
 
 } // namespace itk
@@ -19,11 +19,16 @@
 #define itkVariationalRegistrationGaussianRegularizer_hxx
 #include "itkVariationalRegistrationGaussianRegularizer.h"
 
+#include "itkImageAlgorithm.h"
 #include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
 #include "itkImageRegionIteratorWithIndex.h"
 
 #include "itkGaussianOperator.h"
-#include "itkVectorNeighborhoodOperatorImageFilter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 namespace itk
 {
@@ -41,6 +46,7 @@ VariationalRegistrationGaussianRegularizer<TDisplacementField>::VariationalRegis
 
   m_MaximumError = 0.1;
   m_MaximumKernelWidth = 30;
+  m_UseRecursiveGaussian = false;
 }
 
 /**
@@ -70,60 +76,115 @@ VariationalRegistrationGaussianRegularizer<TDisplacementField>::GenerateData()
   // Initialize and allocate data
   this->Initialize();
 
-  DisplacementFieldConstPointer field = this->GetInput();
+  DisplacementFieldConstPointer input = this->GetInput();
+  DisplacementFieldPointer      output = this->GetOutput();
+
+  const typename DisplacementFieldType::RegionType region = output->GetBufferedRegion();
 
-  using VectorType = typename DisplacementFieldType::PixelType;
-  using ScalarType = typename VectorType::ValueType;
-  using OperatorType = GaussianOperator<ScalarType, ImageDimension>;
-  using SmootherType = VectorNeighborhoodOperatorImageFilter<DisplacementFieldType, DisplacementFieldType>;
+  // The field is smoothed in place, so the output has to hold the input field
+  if (input->GetBufferPointer() != output->GetBufferPointer())
+  {
+    ImageAlgorithm::Copy(input.GetPointer(), output.GetPointer(), region, region);
+  }
 
-  OperatorType                   opers[ImageDimension];
-  typename SmootherType::Pointer smoothers[ImageDimension];
+  if (this->GetUseImageSpacing())
+  {
+    // TODO Considering image spacing in a multi resolution setting leads to
+    // very small sigmas and therefore insufficient regularization. Think of
+    // a better way?
+    itkWarningMacro("Image spacing is not considered during Gaussian "
+                    "regularization!");
+
+    // if( this->GetInput()->GetSpacing()[j] == 0.0 )
+    //   {
+    //   itkExceptionMacro(<< "Pixel spacing cannot be zero");
+    //   }
+    // // convert the variance from physical units to pixels
+    // const double s = this->GetInput()->GetSpacing()[j];
+    // opers[j].SetVariance( variance / itk::Math::sqr(s) );
+  }
 
+  // smooth along each dimension
   for (unsigned int j = 0; j < ImageDimension; j++)
   {
-    // smooth along this dimension
-    opers[j].SetDirection(j);
-    typename StandardDeviationsType::ValueType variance = itk::Math::sqr(this->GetStandardDeviations()[j]);
-    if (this->GetUseImageSpacing())
+    if (region.GetSize(j) < 2)
     {
-      // TODO Considering image spacing in a multi resolution setting leads to
-      // very small sigmas and therefore insufficient regularization. Think of
-      // a better way?
-      itkWarningMacro("Image spacing is not considered during Gaussian "
-                      "regularization!");
-      opers[j].SetVariance(variance);
-
-      // if( this->GetInput()->GetSpacing()[j] == 0.0 )
-      //   {
-      //   itkExceptionMacro(<< "Pixel spacing cannot be zero");
-      //   }
-      // // convert the variance from physical units to pixels
-      // const double s = this->GetInput()->GetSpacing()[j];
-      // opers[j].SetVariance( variance / itk::Math::sqr(s) );
+      continue;
+    }
+
+    if (m_UseRecursiveGaussian)
+    {
+      const double sigma = m_StandardDeviations[j];
+      if (sigma == 0.0)
+      {
+        continue;
+      }
+      if (sigma < 0.5)
+      {
+        itkExceptionMacro(<< "Recursive Gaussian smoothing requires standard deviations of zero or at least 0.5");
+      }
+
+      const VariationalRegistrationLineFilters::RecursiveGaussianCoefficientsType coefficients =
+        VariationalRegistrationLineFilters::ComputeRecursiveGaussianCoefficients(sigma);
+      this->FilterLines(j, [&coefficients](PixelType * line, PixelType *, SizeValueType length) {
+        VariationalRegistrationLineFilters::RecursiveGaussianLine(line, length, coefficients);
+      });
     }
     else
     {
-      opers[j].SetVariance(variance);
+      using OperatorType = GaussianOperator<double, ImageDimension>;
+
+      OperatorType oper;
+      oper.SetDirection(j);
+      oper.SetVariance(itk::Math::sqr(this->GetStandardDeviations()[j]));
+      oper.SetMaximumError(this->GetMaximumError());
+      oper.SetMaximumKernelWidth(this->GetMaximumKernelWidth());
+      oper.CreateDirectional();
+
+      const std::vector<double> kernel(oper.Begin(), oper.End());
+      this->FilterLines(j, [&kernel](PixelType * line, PixelType * work, SizeValueType length) {
+        Self::ConvolveLine(line, work, length, kernel);
+      });
     }
-    opers[j].SetMaximumError(this->GetMaximumError());
-    opers[j].SetMaximumKernelWidth(this->GetMaximumKernelWidth());
-    opers[j].CreateDirectional();
+  }
+}
 
-    smoothers[j] = SmootherType::New();
-    smoothers[j]->SetOperator(opers[j]);
-    smoothers[j]->ReleaseDataFlagOn();
+/*
+ * Convolve one line with a Gaussian kernel
+ */
+template <typename TDisplacementField>
+void
+VariationalRegistrationGaussianRegularizer<TDisplacementField>::ConvolveLine(PixelType *                 line,
+                                                                             PixelType *                 work,
+                                                                             SizeValueType               length,
+                                                                             const std::vector<double> & kernel)
+{
+  constexpr unsigned int NumberOfComponents = PixelType::Dimension;
+
+  const auto radius = static_cast<OffsetValueType>(kernel.size() / 2);
+  const auto last = static_cast<OffsetValueType>(length) - 1;
 
-    if (j > 0)
+  std::copy(line, line + length, work);
+
+  // Pixels outside of the line have the value of the nearest boundary pixel
+  // (see ZeroFluxNeumannBoundaryCondition)
+  for (OffsetValueType i = 0; i <= last; i++)
+  {
+    double sum[NumberOfComponents] = {};
+    for (OffsetValueType k = -radius; k <= radius; k++)
     {
-      smoothers[j]->SetInput(smoothers[j - 1]->GetOutput());
+      const PixelType & value = work[std::min(std::max(i + k, OffsetValueType{ 0 }), last)];
+      const double      weight = kernel[k + radius];
+      for (unsigned int c = 0; c < NumberOfComponents; c++)
+      {
+        sum[c] += weight * value[c];
+      }
+    }
+    for (unsigned int c = 0; c < NumberOfComponents; c++)
+    {
+      line[i][c] = static_cast<ValueType>(sum[c]);
     }
   }
-  smoothers[0]->SetInput(field);
-  smoothers[ImageDimension - 1]->GetOutput()->SetRequestedRegion(field->GetBufferedRegion());
-  smoothers[ImageDimension - 1]->Update();
-
-  this->GraftOutput(smoothers[ImageDimension - 1]->GetOutput());
 }
 
 /*
@@ -156,6 +217,8 @@ VariationalRegistrationGaussianRegularizer<TDisplacementField>::PrintSelf(std::o
   os << m_MaximumError << std::endl;
   os << indent << "MaximumKernelWidth: ";
   os << m_MaximumKernelWidth << std::endl;
+  os << indent << "UseRecursiveGaussian: ";
+  os << m_UseRecursiveGaussian << std::endl;
 }
 
 } // end namespace itk
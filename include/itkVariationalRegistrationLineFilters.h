@@ -0,0 +1,320 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationLineFilters_h
+#define itkVariationalRegistrationLineFilters_h
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionSplitterDirection.h"
+#include "itkMultiThreaderBase.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace itk
+{
+/**
+ * \namespace VariationalRegistrationLineFilters
+ *
+ * \brief Separable line filters for vector images.
+ *
+ * FilterLines() applies a line filter in place to all lines of an image
+ * along one dimension. Lines that are not contiguous in memory are processed
+ * in blocks, which are transposed into a scratch buffer of the work unit, so
+ * each dimension reads and writes the image once without intermediate images.
+ *
+ * RecursiveGaussianLine() is the third order recursive Gaussian filter of
+ * Young and van Vliet, whose costs per pixel do not depend on the standard
+ * deviation. The filter has unit gain, i.e. it computes the normalized
+ * Gaussian convolution.
+ *
+ * \sa VariationalRegistrationGaussianRegularizer
+ * \sa VariationalRegistrationGaussianNCCFunction
+ *
+ * \ingroup VariationalRegistration
+ */
+namespace VariationalRegistrationLineFilters
+{
+
+/** Coefficients of the recursive Gaussian filter. m_A are the feedback
+ * coefficients, m_B the gain and m_M the matrix of Triggs and Sdika for the
+ * initialization of the anticausal pass. */
+struct RecursiveGaussianCoefficientsType
+{
+  double m_B;
+  double m_A[3];
+  double m_M[3][3];
+};
+
+/** Feedback coefficients of the recursive Gaussian filter for the scale
+ * parameter q (see Young and van Vliet, "Recursive implementation of the
+ * Gaussian filter", Signal Processing 44(2), 1995, eq. 8c). */
+inline void
+ComputeRecursiveGaussianFeedback(double q, double * a)
+{
+  const double q2 = q * q;
+  const double q3 = q2 * q;
+  const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+
+  a[0] = (2.44413 * q + 2.85619 * q2 + 1.26661 * q3) / b0;
+  a[1] = -(1.4281 * q2 + 1.26661 * q3) / b0;
+  a[2] = 0.422205 * q3 / b0;
+}
+
+/** Variance of the impulse response of the recursive Gaussian filter with
+ * the feedback coefficients a, i.e. twice the variance of the causal pass. */
+inline double
+ComputeRecursiveGaussianVariance(const double * a)
+{
+  const double denominator = 1.0 - a[0] - a[1] - a[2];
+  const double mean = (a[0] + 2.0 * a[1] + 3.0 * a[2]) / denominator;
+  return 2.0 * (mean * mean + mean + (2.0 * a[1] + 6.0 * a[2]) / denominator);
+}
+
+/** Compute the filter coefficients for a standard deviation in pixel units.
+ * The standard deviation has to be at least 0.5.
+ *
+ * The closed form for q of Young and van Vliet (eq. 11b) yields impulse
+ * responses whose standard deviation is 10 to 20 percent too large. Instead,
+ * q is chosen such that the variance of the impulse response equals sigma^2,
+ * as proposed by Young, van Vliet and van Ginkel, "Recursive Gabor
+ * filtering", IEEE TSP 50(11), 2002. The variance increases monotonically
+ * with q and exceeds q^2, so q is found by bisection in [0, sigma]. */
+inline RecursiveGaussianCoefficientsType
+ComputeRecursiveGaussianCoefficients(double sigma)
+{
+  RecursiveGaussianCoefficientsType coefficients;
+
+  double lower = 0.0;
+  double upper = sigma;
+  for (unsigned int i = 0; i < 64; i++)
+  {
+    const double q = 0.5 * (lower + upper);
+    ComputeRecursiveGaussianFeedback(q, coefficients.m_A);
+    if (ComputeRecursiveGaussianVariance(coefficients.m_A) < sigma * sigma)
+    {
+      lower = q;
+    }
+    else
+    {
+      upper = q;
+    }
+  }
+  ComputeRecursiveGaussianFeedback(0.5 * (lower + upper), coefficients.m_A);
+
+  const double a1 = coefficients.m_A[0];
+  const double a2 = coefficients.m_A[1];
+  const double a3 = coefficients.m_A[2];
+  coefficients.m_B = 1.0 - (a1 + a2 + a3);
+
+  // Triggs and Sdika, eq. 15, scaled with the gain of the anticausal pass
+  const double scale = coefficients.m_B / ((1.0 + a1 - a2 + a3) * (1.0 - a1 - a2 - a3) * (1.0 + a2 + (a1 - a3) * a3));
+
+  coefficients.m_M[0][0] = scale * (-a3 * a1 + 1.0 - a3 * a3 - a2);
+  coefficients.m_M[0][1] = scale * (a3 + a1) * (a2 + a3 * a1);
+  coefficients.m_M[0][2] = scale * a3 * (a1 + a3 * a2);
+  coefficients.m_M[1][0] = scale * (a1 + a3 * a2);
+  coefficients.m_M[1][1] = -scale * (a2 - 1.0) * (a2 + a3 * a1);
+  coefficients.m_M[1][2] = -scale * a3 * (a3 * a1 + a3 * a3 + a2 - 1.0);
+  coefficients.m_M[2][0] = scale * (a3 * a1 + a2 + a1 * a1 - a2 * a2);
+  coefficients.m_M[2][1] = scale * (a1 * a2 + a3 * a2 * a2 - a1 * a3 * a3 - a3 * a3 * a3 - a3 * a2 + a3);
+  coefficients.m_M[2][2] = scale * a3 * (a1 + a3 * a2);
+
+  return coefficients;
+}
+
+/** Filter one contiguous line of vectors in place with the recursive
+ * Gaussian filter. The line is extended with its boundary values (see Triggs
+ * and Sdika, "Boundary conditions for Young-van Vliet recursive filtering",
+ * IEEE TSP 54(6), 2006). */
+template <typename TPixel>
+void
+RecursiveGaussianLine(TPixel * line, SizeValueType length, const RecursiveGaussianCoefficientsType & coefficients)
+{
+  using ValueType = typename TPixel::ValueType;
+  constexpr unsigned int NumberOfComponents = TPixel::Dimension;
+
+  const double   b = coefficients.m_B;
+  const double * a = coefficients.m_A;
+
+  for (unsigned int c = 0; c < NumberOfComponents; c++)
+  {
+    // Causal pass; the line is extended with the first value, which is the
+    // steady state of the filter.
+    const double first = line[0][c];
+    const double last = line[length - 1][c];
+    double       w1 = first;
+    double       w2 = first;
+    double       w3 = first;
+    for (SizeValueType i = 0; i < length; i++)
+    {
+      ValueType &  value = line[i][c];
+      const double w = b * value + a[0] * w1 + a[1] * w2 + a[2] * w3;
+      value = static_cast<ValueType>(w);
+      w3 = w2;
+      w2 = w1;
+      w1 = w;
+    }
+
+    // Initialize the anticausal pass with the response to the line being
+    // extended with the last value
+    double u[3];
+    for (unsigned int k = 0; k < 3; k++)
+    {
+      const SizeValueType i = (length > k) ? length - 1 - k : 0;
+      u[k] = line[i][c] - last;
+    }
+    double v[3];
+    for (unsigned int k = 0; k < 3; k++)
+    {
+      v[k] = coefficients.m_M[k][0] * u[0] + coefficients.m_M[k][1] * u[1] + coefficients.m_M[k][2] * u[2] + last;
+    }
+
+    // Anticausal pass
+    line[length - 1][c] = static_cast<ValueType>(v[0]);
+    double y1 = v[0];
+    double y2 = v[1];
+    double y3 = v[2];
+    for (SizeValueType i = length - 1; i > 0; i--)
+    {
+      ValueType &  value = line[i - 1][c];
+      const double y = b * value + a[0] * y1 + a[1] * y2 + a[2] * y3;
+      value = static_cast<ValueType>(y);
+      y3 = y2;
+      y2 = y1;
+      y1 = y;
+    }
+  }
+}
+
+/** Number of lines that are filtered together along the dimensions
+ * with non-contiguous lines. */
+constexpr SizeValueType LineBlockSize = 16;
+
+/** Scratch buffers of FilterLines(), one per work unit. The buffers are kept
+ * by the caller between calls and only enlarged if needed. */
+template <typename TPixel>
+using LineScratchType = std::vector<std::vector<TPixel>>;
+
+/** Apply a line filter in place to all lines of the buffered region of an
+ * image along a dimension with lineFilter(line, work, length); the work line
+ * has the same length as the line and can be overwritten. Lines along
+ * dimension 0 are filtered directly in the image, the lines along the other
+ * dimensions are copied into the scratch buffer of the work unit and written
+ * back. The lines are distributed over the work units of the multithreader. */
+template <typename TImage, typename TLineFilter>
+void
+FilterLines(MultiThreaderBase *                           multiThreader,
+            TImage *                                      image,
+            unsigned int                                  dimension,
+            const TLineFilter &                           lineFilter,
+            LineScratchType<typename TImage::PixelType> & scratch)
+{
+  using RegionType = typename TImage::RegionType;
+  using PixelType = typename TImage::PixelType;
+
+  const RegionType      region = image->GetBufferedRegion();
+  const OffsetValueType stride = image->GetOffsetTable()[dimension];
+  const SizeValueType   length = region.GetSize(dimension);
+  PixelType *           buffer = image->GetBufferPointer();
+
+  // For the dimensions other than 0, blocks of lines that are adjacent along
+  // dimension 0 are transposed into the scratch buffer; each position of the
+  // lines is then read and written as one contiguous block. The scratch
+  // buffer holds one line per block plus the work line.
+  const SizeValueType blockSize = (dimension == 0) ? 0 : LineBlockSize;
+  const SizeValueType scratchSize = (blockSize + 1) * length;
+
+  // Each work unit processes one chunk with whole lines along the dimension
+  auto splitter = ImageRegionSplitterDirection::New();
+  splitter->SetDirection(dimension);
+  const unsigned int numberOfChunks = splitter->GetNumberOfSplits(region, multiThreader->GetNumberOfWorkUnits());
+  if (scratch.size() < numberOfChunks)
+  {
+    scratch.resize(numberOfChunks);
+  }
+
+  multiThreader->ParallelizeArray(
+    0,
+    numberOfChunks,
+    [&](SizeValueType chunkNumber) {
+      RegionType chunk = region;
+      splitter->GetSplit(static_cast<unsigned int>(chunkNumber), numberOfChunks, chunk);
+
+      std::vector<PixelType> & lines = scratch[chunkNumber];
+      if (lines.size() < scratchSize)
+      {
+        lines.resize(scratchSize);
+      }
+      PixelType * work = lines.data() + blockSize * length;
+
+      RegionType face = chunk;
+      face.SetSize(dimension, 1);
+      const IndexValueType blockStart = face.GetIndex(0);
+      const SizeValueType  blockExtent = face.GetSize(0);
+
+      RegionType rows = face;
+      rows.SetSize(0, 1);
+
+      for (ImageRegionConstIteratorWithIndex<TImage> it(image, rows); !it.IsAtEnd(); ++it)
+      {
+        typename TImage::IndexType index = it.GetIndex();
+        if (dimension == 0)
+        {
+          lineFilter(buffer + image->ComputeOffset(index), work, length);
+          continue;
+        }
+
+        for (SizeValueType x = 0; x < blockExtent; x += blockSize)
+        {
+          index[0] = blockStart + static_cast<IndexValueType>(x);
+          const SizeValueType numberOfLines = std::min(blockSize, blockExtent - x);
+          PixelType *         block = buffer + image->ComputeOffset(index);
+
+          for (SizeValueType i = 0; i < length; i++)
+          {
+            const PixelType * in = block + i * stride;
+            for (SizeValueType l = 0; l < numberOfLines; l++)
+            {
+              lines[l * length + i] = in[l];
+            }
+          }
+
+          for (SizeValueType l = 0; l < numberOfLines; l++)
+          {
+            lineFilter(lines.data() + l * length, work, length);
+          }
+
+          for (SizeValueType i = 0; i < length; i++)
+          {
+            PixelType * out = block + i * stride;
+            for (SizeValueType l = 0; l < numberOfLines; l++)
+            {
+              out[l] = lines[l * length + i];
+            }
+          }
+        }
+      }
+    },
+    nullptr);
+}
+
+} // end namespace VariationalRegistrationLineFilters
+} // end namespace itk
+
+#endif
@@ -0,0 +1,294 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationMIFunction_h
+#define itkVariationalRegistrationMIFunction_h
+
+#include "itkVariationalRegistrationFunction.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace itk
+{
+
+/** \class itk::VariationalRegistrationMIFunction
+ *
+ *  \brief This class computes mutual information forces in the variational registration framework.
+ *
+ *  This class implements dense MI forces as given in <em>Hermosillo, Chefd'Hotel, and Faugeras.
+ *  "Variational methods for multimodal image matching." IJCV 50(3), 2002: 329-343</em> with the
+ *  joint histogram of <em>Mattes et al. "PET-CT image registration in the chest using free-form
+ *  deformations." IEEE TMI 22(1), 2003: 120-128</em>: the fixed image intensities are binned with
+ *  a zero order and the warped image intensities with a cubic B-spline Parzen window. With the
+ *  joint probabilities \f$p(i,j)\f$ and the marginal probabilities \f$p_M(j)\f$ of the warped
+ *  image, the forces are
+ *  \f[
+ *    f^{MI}(x)=-\frac{\tau\kappa}{\Delta b}\sum_j\beta'\left(j-t(M(x+u(x)))\right)
+ *    \log\frac{p(i(F(x)),j)}{p_M(j)}\nabla M(x+u(x))
+ *  \f]
+ *  \f$\tau\f$ is the step size, \f$\kappa\f$ is the mean squared spacing, \f$\Delta b\f$ is
+ *  the width of a bin of the warped image, \f$t\f$ maps an intensity to its continuous bin
+ *  position and \f$\beta'\f$ is the derivative of the cubic B-spline. The forces are the
+ *  derivative of the mutual information multiplied by the number of pixels.
+ *  Alternative, the classical gradient \f$\nabla M(x+u(x))\f$ can be replaced by \f$\nabla F(x)\f$
+ *  or \f$\frac{\nabla F(x) + \nabla M(x+u(x))}{2}\f$.
+ *
+ *  In InitializeIteration(), the joint histogram is built in a single pass over the images with
+ *  the multithreader of the function. Each work unit fills its own histogram, which is kept
+ *  between iterations; the histograms are then added up in a fixed order, so the result does
+ *  not depend on the scheduling. The logarithmic terms are
+ *  stored in tables, such that the force of a pixel only needs four table lookups.
+ *  The metric value is the negative pointwise mutual information averaged over all pixels.
+ *
+ *  \sa VariationalRegistrationFilter
+ *  \sa VariationalRegistrationFunction
+ *
+ *  \ingroup FiniteDifferenceFunctions
+ *  \ingroup VariationalRegistration
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+class VariationalRegistrationMIFunction
+  : public VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(VariationalRegistrationMIFunction);
+
+  /** Standard class type alias. */
+  using Self = VariationalRegistrationMIFunction;
+  using Superclass = VariationalRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(VariationalRegistrationMIFunction, VariationalRegistrationFunction);
+
+  /** Get image dimension. */
+  static constexpr unsigned int ImageDimension = Superclass::ImageDimension;
+
+  /** MovingImage image type. */
+  using MovingImageType = typename Superclass::MovingImageType;
+  using MovingImagePointer = typename Superclass::MovingImagePointer;
+
+  /** FixedImage image type. */
+  using FixedImageType = typename Superclass::FixedImageType;
+  using FixedImagePointer = typename Superclass::FixedImagePointer;
+
+  /** MaskImage image type. */
+  using MaskImageType = typename Superclass::MaskImageType;
+  using MaskImagePointer = typename Superclass::MaskImagePointer;
+
+  /** Image parameter types. */
+  using IndexType = typename FixedImageType::IndexType;
+  using SizeType = typename FixedImageType::SizeType;
+  using SpacingType = typename FixedImageType::SpacingType;
+
+  /** Deformation field type. */
+  using DisplacementFieldType = typename Superclass::DisplacementFieldType;
+  using DisplacementFieldTypePointer = typename Superclass::DisplacementFieldTypePointer;
+
+  /** Various type definitions. */
+  using PixelType = typename Superclass::PixelType;
+  using RadiusType = typename Superclass::RadiusType;
+  using NeighborhoodType = typename Superclass::NeighborhoodType;
+  using FloatOffsetType = typename Superclass::FloatOffsetType;
+
+  /** Image gradient types. */
+  using GradientPixelType = typename Superclass::GradientPixelType;
+  using GradientImageType = typename Superclass::GradientImageType;
+
+  /** Set the object's state before each iteration. Computes the joint
+   * histogram and the force tables. */
+  void
+  InitializeIteration() override;
+
+  /** This method is called by a finite difference solver image filter at
+   * each pixel that does not lie on a data set boundary */
+  PixelType
+  ComputeUpdate(const NeighborhoodType & neighborhood,
+                void *                   globalData,
+                const FloatOffsetType &  offset = FloatOffsetType(0.0)) override;
+
+  /** The updates of this function can be computed line by line. */
+  bool
+  SupportsScanlineUpdate() const override
+  {
+    return true;
+  }
+
+  /** Compute the updates for a contiguous line of pixels along the first
+   * image dimension using raw pointers to the image and gradient buffers. */
+  void
+  ComputeUpdateScanline(const IndexType & index, SizeValueType length, PixelType * update, void * globalData) override;
+
+  /** Select that the fixed image gradient is used for computing the forces. */
+  virtual void
+  SetGradientTypeToFixedImage()
+  {
+    m_GradientType = GRADIENT_TYPE_FIXED;
+  }
+
+  /** Select that the warped image gradient is used for computing the forces. */
+  virtual void
+  SetGradientTypeToWarpedMovingImage()
+  {
+    m_GradientType = GRADIENT_TYPE_WARPED;
+  }
+
+  /** Select that fixed and warped image gradients are used for computing the
+   *  forces. */
+  virtual void
+  SetGradientTypeToSymmetric()
+  {
+    m_GradientType = GRADIENT_TYPE_SYMMETRIC;
+  }
+
+  /** Set/Get the number of histogram bins for each image (including the two
+   * padding bins at each end). Default is 32. */
+  itkSetClampMacro(NumberOfHistogramBins, unsigned int, 5, NumericTraits<unsigned int>::max());
+  itkGetConstMacro(NumberOfHistogramBins, unsigned int);
+
+  /** Computes the time step for an update.
+   * Returns the constant time step scaled with the mean squared spacing.
+   * \sa SetTimeStep() */
+  typename Superclass::TimeStepType
+  ComputeGlobalTimeStep(void * itkNotUsed(GlobalData)) const override
+  {
+    return this->GetTimeStep() * m_Normalizer;
+  }
+
+protected:
+  VariationalRegistrationMIFunction();
+  ~VariationalRegistrationMIFunction() override = default;
+
+  using GlobalDataStruct = typename Superclass::GlobalDataStruct;
+
+  /** Print information about the filter. */
+  void
+  PrintSelf(std::ostream & os, Indent indent) const override;
+
+  /** Type of available image forces */
+  enum GradientType
+  {
+    GRADIENT_TYPE_WARPED = 0,
+    GRADIENT_TYPE_FIXED = 1,
+    GRADIENT_TYPE_SYMMETRIC = 2
+  };
+
+  /** Number of padding bins at each end of the histogram axes. */
+  static constexpr unsigned int HistogramPadding = 2;
+
+  /** Intensity range and bin width of an image in the histogram. */
+  struct HistogramAxisType
+  {
+    double m_Minimum;
+    double m_BinWidth;
+  };
+
+  /** Compute the intensity range of the images if an image has changed. */
+  virtual void
+  UpdateHistogramAxes();
+
+  /** Compute the intensity range of an image and the bin width. */
+  template <typename TImage>
+  HistogramAxisType
+  ComputeHistogramAxis(const TImage * image) const;
+
+  /** Build the joint histogram of the fixed and the warped image and compute
+   * the force and metric tables. */
+  virtual void
+  ComputeJointHistogram();
+
+  /** Continuous bin position of an intensity. */
+  double
+  GetBinPosition(const HistogramAxisType & axis, double value) const
+  {
+    const double position = (value - axis.m_Minimum) / axis.m_BinWidth + static_cast<double>(HistogramPadding);
+    const auto   lastPosition = static_cast<double>(m_NumberOfHistogramBins - HistogramPadding);
+    return std::min(std::max(position, static_cast<double>(HistogramPadding)), lastPosition);
+  }
+
+  /** Bin of a fixed image intensity (zero order Parzen window). */
+  unsigned int
+  GetFixedImageBin(double value) const
+  {
+    const auto bin = static_cast<unsigned int>(this->GetBinPosition(m_FixedAxis, value));
+    return std::min(bin, m_NumberOfHistogramBins - HistogramPadding - 1);
+  }
+
+  /** First of the four bins of the Parzen window at a bin position. */
+  unsigned int
+  GetParzenWindowStart(double position) const
+  {
+    const auto bin = std::min(static_cast<unsigned int>(position), m_NumberOfHistogramBins - HistogramPadding - 1);
+    return bin - 1;
+  }
+
+  /** Cubic B-spline and its derivative. */
+  static double
+  CubicBSpline(double x);
+  static double
+  CubicBSplineDerivative(double x);
+
+  /** Compute the update of one pixel from the force tables. The gradient has
+   * to be combined and scaled according to the gradient type. Returns the
+   * metric value of the pixel. */
+  double
+  ComputeLocalUpdate(double fixedValue, double warpedValue, const double * gradient, PixelType & update) const;
+
+private:
+  /** Set if warped or fixed image gradient is used for force computation. */
+  GradientType m_GradientType;
+
+  /** Number of histogram bins of each image. */
+  unsigned int m_NumberOfHistogramBins;
+
+  /** Histogram axes and the images they were computed for. */
+  HistogramAxisType       m_FixedAxis;
+  HistogramAxisType       m_MovingAxis;
+  const FixedImageType *  m_FixedAxisSource;
+  ModifiedTimeType        m_FixedAxisSourceTime;
+  const MovingImageType * m_MovingAxisSource;
+  ModifiedTimeType        m_MovingAxisSourceTime;
+  unsigned int            m_HistogramAxesNumberOfBins;
+
+  /** Histograms of the chunks of the image, one per work unit; kept between
+   * iterations to avoid reallocation. */
+  std::vector<double> m_ChunkHistograms;
+
+  /** Joint probabilities (fixed bin major) of the current iteration. */
+  std::vector<double> m_JointPDF;
+
+  /** log(p(i,j)/p_M(j)) for the forces and log(p(i,j)/(p_F(i)p_M(j))) for
+   * the metric value. */
+  std::vector<double> m_ForceTable;
+  std::vector<double> m_MetricTable;
+
+  /** Precalculated normalizer for spacing consideration. */
+  double m_Normalizer;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#  include "itkVariationalRegistrationMIFunction.hxx"
+#endif
+
+#endif
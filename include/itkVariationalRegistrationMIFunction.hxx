@@ -0,0 +1,542 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationMIFunction_hxx
+#define itkVariationalRegistrationMIFunction_hxx
+
+#include "itkVariationalRegistrationMIFunction.h"
+#include "itkImageRegionSplitterSlowDimension.h"
+#include "itkImageScanlineConstIterator.h"
+#include "itkMacro.h"
+#include "itkMath.h"
+#include "itkMinimumMaximumImageCalculator.h"
+#include "itkMultiThreaderBase.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+
+/**
+ * Default constructor
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+VariationalRegistrationMIFunction<TFixedImage, TMovingImage, TDisplacementField>::VariationalRegistrationMIFunction()
+{
+  RadiusType r;
+  for (unsigned int j = 0; j < ImageDimension; j++)
+  {
+    r[j] = 0;
+  }
+  this->SetRadius(r);
+
+  m_NumberOfHistogramBins = 32;
+
+  m_Normalizer = 1.0;
+
+  m_GradientType = GRADIENT_TYPE_WARPED;
+
+  m_FixedAxis.m_Minimum = 0.0;
+  m_FixedAxis.m_BinWidth = 1.0;
+  m_MovingAxis.m_Minimum = 0.0;
+  m_MovingAxis.m_BinWidth = 1.0;
+  m_FixedAxisSource = nullptr;
+  m_FixedAxisSourceTime = 0;
+  m_MovingAxisSource = nullptr;
+  m_MovingAxisSourceTime = 0;
+  m_HistogramAxesNumberOfBins = 0;
+}
+
+/**
+ * Set the function state values before each iteration
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationMIFunction<TFixedImage, TMovingImage, TDisplacementField>::InitializeIteration()
+{
+  // Call superclass method
+  Superclass::InitializeIteration();
+
+  // cache fixed image information
+  SpacingType fixedImageSpacing = this->GetFixedImage()->GetSpacing();
+
+  // compute the normalizer
+  m_Normalizer = 0.0;
+  for (unsigned int k = 0; k < ImageDimension; k++)
+  {
+    m_Normalizer += fixedImageSpacing[k] * fixedImageSpacing[k];
+  }
+  m_Normalizer /= static_cast<double>(ImageDimension);
+
+  // compute warped image gradient
+  if (m_GradientType != GRADIENT_TYPE_FIXED)
+  {
+    this->ComputeWarpedImageGradient();
+  }
+
+  // update fixed image gradient; this is only computed once per level
+  if (m_GradientType != GRADIENT_TYPE_WARPED)
+  {
+    this->UpdateFixedImageGradient();
+  }
+
+  // update the intensity ranges; also only computed once per level
+  this->UpdateHistogramAxes();
+
+  this->ComputeJointHistogram();
+}
+
+/**
+ * Compute the intensity ranges of the images if an image has changed
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationMIFunction<TFixedImage, TMovingImage, TDisplacementField>::UpdateHistogramAxes()
+{
+  const FixedImageType *  fixedImage = this->GetFixedImage();
+  const MovingImageType * movingImage = this->GetMovingImage();
+
+  // See UpdateFixedImageGradient() for the detection of a new level
+  const ModifiedTimeType fixedImageTime = std::max(fixedImage->GetMTime(), fixedImage->GetUpdateMTime());
+  const ModifiedTimeType movingImageTime = std::max(movingImage->GetMTime(), movingImage->GetUpdateMTime());
+  if (m_FixedAxisSource == fixedImage && m_FixedAxisSourceTime == fixedImageTime &&
+      m_MovingAxisSource == movingImage && m_MovingAxisSourceTime == movingImageTime &&
+      m_HistogramAxesNumberOfBins == m_NumberOfHistogramBins)
+  {
+    return;
+  }
+
+  m_FixedAxis = this->ComputeHistogramAxis(fixedImage);
+  m_MovingAxis = this->ComputeHistogramAxis(movingImage);
+
+  m_FixedAxisSource = fixedImage;
+  m_FixedAxisSourceTime = fixedImageTime;
+  m_MovingAxisSource = movingImage;
+  m_MovingAxisSourceTime = movingImageTime;
+  m_HistogramAxesNumberOfBins = m_NumberOfHistogramBins;
+}
+
+/**
+ * Compute the intensity range of an image
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+template <typename TImage>
+typename VariationalRegistrationMIFunction<TFixedImage, TMovingImage, TDisplacementField>::HistogramAxisType
+VariationalRegistrationMIFunction<TFixedImage, TMovingImage, TDisplacementField>::ComputeHistogramAxis(
+  const TImage * image) const
+{
+  using CalculatorType = MinimumMaximumImageCalculator<TImage>;
+
+  auto calculator = CalculatorType::New();
+  calculator->SetImage(image);
+  calculator->SetRegion(image->GetBufferedRegion());
+  calculator->Compute();
+
+  // The intensity range is mapped to the bins between the padding bins
+  const auto        minimum = static_cast<double>(calculator->GetMinimum());
+  const auto        maximum = static_cast<double>(calculator->GetMaximum());
+  HistogramAxisType axis;
+  axis.m_Minimum = minimum;
+  axis.m_BinWidth = 1.0;
+  if (maximum > minimum)
+  {
+    axis.m_BinWidth = (maximum - minimum) / static_cast<double>(m_NumberOfHistogramBins - 2 * HistogramPadding);
+  }
+  return axis;
+}
+
+/**
+ * Build the joint histogram and the force tables
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationMIFunction<TFixedImage, TMovingImage, TDisplacementField>::ComputeJointHistogram()
+{
+  using RegionType = typename FixedImageType::RegionType;
+  using FixedPixelType = typename FixedImageType::PixelType;
+  using MaskPixelType = typename MaskImageType::PixelType;
+
+  // VariationalRegistrationFunction::WarpMovingImage() has to be called before
+  const FixedImageType * fixedImage = this->GetFixedImage();
+  const FixedImageType * warpedImage = this->GetWarpedImage();
+  const MaskImageType *  mask = this->GetMaskImage();
+  const MaskPixelType    maskThreshold = this->GetMaskBackgroundThreshold();
+  const RegionType       region = fixedImage->GetBufferedRegion();
+
+  const unsigned int  numberOfBins = m_NumberOfHistogramBins;
+  const SizeValueType histogramSize = numberOfBins * numberOfBins;
+
+  // Each chunk of the image is processed by one work unit, which adds the
+  // Parzen window weights of its pixels to its own histogram. The histograms
+  // are only reallocated if the number of chunks or bins has changed.
+  MultiThreaderBase * multiThreader = this->GetMultiThreader();
+  auto                splitter = ImageRegionSplitterSlowDimension::New();
+  const unsigned int  numberOfChunks = splitter->GetNumberOfSplits(region, multiThreader->GetNumberOfWorkUnits());
+
+  if (m_ChunkHistograms.size() != numberOfChunks * histogramSize)
+  {
+    m_ChunkHistograms.assign(numberOfChunks * histogramSize, 0.0);
+  }
+  else
+  {
+    std::fill(m_ChunkHistograms.begin(), m_ChunkHistograms.end(), 0.0);
+  }
+  multiThreader->ParallelizeArray(
+    0,
+    numberOfChunks,
+    [&](SizeValueType chunk) {
+      RegionType chunkRegion = region;
+      splitter->GetSplit(static_cast<unsigned int>(chunk), numberOfChunks, chunkRegion);
+      double * histogram = m_ChunkHistograms.data() + chunk * histogramSize;
+
+      ImageScanlineConstIterator<FixedImageType> lineIt(fixedImage, chunkRegion);
+      while (!lineIt.IsAtEnd())
+      {
+        const IndexType        lineIndex = lineIt.GetIndex();
+        const FixedPixelType * fixedLine = fixedImage->GetBufferPointer() + fixedImage->ComputeOffset(lineIndex);
+        const FixedPixelType * warpedLine = warpedImage->GetBufferPointer() + warpedImage->ComputeOffset(lineIndex);
+        const MaskPixelType *  maskLine = mask ? mask->GetBufferPointer() + mask->ComputeOffset(lineIndex) : nullptr;
+
+        for (SizeValueType x = 0; x < chunkRegion.GetSize(0); x++)
+        {
+          if (maskLine && maskLine[x] <= maskThreshold)
+          {
+            continue;
+          }
+
+          const unsigned int fixedBin = this->GetFixedImageBin(static_cast<double>(fixedLine[x]));
+          const double       warpedPosition = this->GetBinPosition(m_MovingAxis, static_cast<double>(warpedLine[x]));
+          const unsigned int windowStart = this->GetParzenWindowStart(warpedPosition);
+
+          double * row = histogram + fixedBin * numberOfBins;
+          for (unsigned int j = windowStart; j < windowStart + 4; j++)
+          {
+            row[j] += CubicBSpline(static_cast<double>(j) - warpedPosition);
+          }
+        }
+        lineIt.NextLine();
+      }
+    },
+    nullptr);
+
+  // Add up the histograms of all chunks in a fixed order
+  m_JointPDF.assign(histogramSize, 0.0);
+  for (unsigned int chunk = 0; chunk < numberOfChunks; chunk++)
+  {
+    const double * histogram = m_ChunkHistograms.data() + chunk * histogramSize;
+    for (SizeValueType k = 0; k < histogramSize; k++)
+    {
+      m_JointPDF[k] += histogram[k];
+    }
+  }
+
+  // Normalize to joint probabilities and compute the marginal probabilities
+  double totalWeight = 0.0;
+  for (SizeValueType k = 0; k < histogramSize; k++)
+  {
+    totalWeight += m_JointPDF[k];
+  }
+
+  std::vector<double> fixedPDF(numberOfBins, 0.0);
+  std::vector<double> movingPDF(numberOfBins, 0.0);
+  if (totalWeight > 0.0)
+  {
+    for (unsigned int i = 0; i < numberOfBins; i++)
+    {
+      for (unsigned int j = 0; j < numberOfBins; j++)
+      {
+        const double p = m_JointPDF[i * numberOfBins + j] / totalWeight;
+        m_JointPDF[i * numberOfBins + j] = p;
+        fixedPDF[i] += p;
+        movingPDF[j] += p;
+      }
+    }
+  }
+
+  // Tabulate the logarithmic terms of the force and of the metric value
+  m_ForceTable.assign(histogramSize, 0.0);
+  m_MetricTable.assign(histogramSize, 0.0);
+  for (unsigned int i = 0; i < numberOfBins; i++)
+  {
+    for (unsigned int j = 0; j < numberOfBins; j++)
+    {
+      const double p = m_JointPDF[i * numberOfBins + j];
+      if (p > 0.0)
+      {
+        m_ForceTable[i * numberOfBins + j] = std::log(p / movingPDF[j]);
+        m_MetricTable[i * numberOfBins + j] = std::log(p / (fixedPDF[i] * movingPDF[j]));
+      }
+    }
+  }
+}
+
+/**
+ * Cubic B-spline
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+double
+VariationalRegistrationMIFunction<TFixedImage, TMovingImage, TDisplacementField>::CubicBSpline(double x)
+{
+  const double absX = std::abs(x);
+  if (absX < 1.0)
+  {
+    return (4.0 - 6.0 * absX * absX + 3.0 * absX * absX * absX) / 6.0;
+  }
+  if (absX < 2.0)
+  {
+    const double t = 2.0 - absX;
+    return t * t * t / 6.0;
+  }
+  return 0.0;
+}
+
+/**
+ * Derivative of the cubic B-spline
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+double
+VariationalRegistrationMIFunction<TFixedImage, TMovingImage, TDisplacementField>::CubicBSplineDerivative(double x)
+{
+  const double absX = std::abs(x);
+  if (absX < 1.0)
+  {
+    return x * (1.5 * absX - 2.0);
+  }
+  if (absX < 2.0)
+  {
+    const double t = 2.0 - absX;
+    return (x < 0.0) ? 0.5 * t * t : -0.5 * t * t;
+  }
+  return 0.0;
+}
+
+/**
+ * Compute the update of one pixel from the force tables
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+double
+VariationalRegistrationMIFunction<TFixedImage, TMovingImage, TDisplacementField>::ComputeLocalUpdate(
+  double         fixedValue,
+  double         warpedValue,
+  const double * gradient,
+  PixelType &    update) const
+{
+  const unsigned int numberOfBins = m_NumberOfHistogramBins;
+  const unsigned int fixedBin = this->GetFixedImageBin(fixedValue);
+  const double       warpedPosition = this->GetBinPosition(m_MovingAxis, warpedValue);
+  const unsigned int windowStart = this->GetParzenWindowStart(warpedPosition);
+
+  const double * forceRow = m_ForceTable.data() + fixedBin * numberOfBins;
+  const double * metricRow = m_MetricTable.data() + fixedBin * numberOfBins;
+
+  // Derivative of the mutual information with respect to the warped image
+  // intensity and pointwise mutual information at the Parzen window position
+  double derivative = 0.0;
+  double pointwiseMI = 0.0;
+  for (unsigned int j = windowStart; j < windowStart + 4; j++)
+  {
+    const double x = static_cast<double>(j) - warpedPosition;
+    derivative -= CubicBSplineDerivative(x) * forceRow[j];
+    pointwiseMI += CubicBSpline(x) * metricRow[j];
+  }
+  derivative /= m_MovingAxis.m_BinWidth;
+
+  for (unsigned int dim = 0; dim < ImageDimension; dim++)
+  {
+    update[dim] = derivative * gradient[dim];
+  }
+
+  // use the negative MI to get a decreasing metric value
+  return -pointwiseMI;
+}
+
+/**
+ * Compute update at a specific neighborhood
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+typename VariationalRegistrationMIFunction<TFixedImage, TMovingImage, TDisplacementField>::PixelType
+VariationalRegistrationMIFunction<TFixedImage, TMovingImage, TDisplacementField>::ComputeUpdate(
+  const NeighborhoodType & it,
+  void *                   gd,
+  const FloatOffsetType &  itkNotUsed(offset))
+{
+  // initialize update value to compute with zero
+  PixelType update;
+  update.Fill(0.0);
+
+  // Get the index at current location
+  const IndexType index = it.GetIndex();
+
+  // Check if index lies inside mask
+  const MaskImageType * mask = this->GetMaskImage();
+  if (mask && (mask->GetPixel(index) <= this->GetMaskBackgroundThreshold()))
+  {
+    return update;
+  }
+
+  // Compute the gradient of either fixed or warped moving image or as the mean of both (symmetric)
+  CovariantVector<double, ImageDimension> gradient;
+  if (m_GradientType == GRADIENT_TYPE_WARPED)
+  {
+    gradient = this->GetWarpedImageGradient()->GetPixel(index);
+  }
+  else if (m_GradientType == GRADIENT_TYPE_FIXED)
+  {
+    gradient = this->GetFixedImageGradient()->GetPixel(index);
+  }
+  else if (m_GradientType == GRADIENT_TYPE_SYMMETRIC)
+  {
+    gradient = this->GetFixedImageGradient()->GetPixel(index);
+    gradient += this->GetWarpedImageGradient()->GetPixel(index);
+    gradient *= 0.5;
+  }
+  else
+  {
+    itkExceptionMacro(<< "Unknown gradient type!");
+  }
+
+  const double metricValue = this->ComputeLocalUpdate(static_cast<double>(this->GetFixedImage()->GetPixel(index)),
+                                                      static_cast<double>(this->GetWarpedImage()->GetPixel(index)),
+                                                      gradient.GetDataPointer(),
+                                                      update);
+
+  // Update the global data (metric etc.)
+  auto * globalData = (GlobalDataStruct *)gd;
+  if (globalData)
+  {
+    globalData->m_NumberOfPixelsProcessed += 1;
+    globalData->m_SumOfMetricValues += metricValue;
+    globalData->m_SumOfSquaredChange += update.GetSquaredNorm();
+  }
+
+  return update;
+}
+
+/**
+ * Compute updates for a line of pixels
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationMIFunction<TFixedImage, TMovingImage, TDisplacementField>::ComputeUpdateScanline(
+  const IndexType & index,
+  SizeValueType     length,
+  PixelType *       update,
+  void *            gd)
+{
+  using FixedPixelType = typename FixedImageType::PixelType;
+  using MaskPixelType = typename MaskImageType::PixelType;
+
+  // VariationalRegistrationFunction::WarpMovingImage() has to be called before
+  const FixedImageType * fixedImage = this->GetFixedImage();
+  const FixedImageType * warpedImage = this->GetWarpedImage();
+  const MaskImageType *  mask = this->GetMaskImage();
+
+  // Get raw pointers to the current line of all buffers
+  const FixedPixelType * fixedLine = fixedImage->GetBufferPointer() + fixedImage->ComputeOffset(index);
+  const FixedPixelType * warpedLine = warpedImage->GetBufferPointer() + warpedImage->ComputeOffset(index);
+  const MaskPixelType *  maskLine = mask ? mask->GetBufferPointer() + mask->ComputeOffset(index) : nullptr;
+  const MaskPixelType    maskThreshold = this->GetMaskBackgroundThreshold();
+
+  // Select the gradient; the symmetric gradient is the mean of both gradients.
+  const GradientImageType * gradientImage = nullptr;
+  const GradientImageType * secondGradientImage = nullptr;
+  double                    gradientScale = 1.0;
+  if (m_GradientType == GRADIENT_TYPE_WARPED)
+  {
+    gradientImage = this->GetWarpedImageGradient();
+  }
+  else if (m_GradientType == GRADIENT_TYPE_FIXED)
+  {
+    gradientImage = this->GetFixedImageGradient();
+  }
+  else if (m_GradientType == GRADIENT_TYPE_SYMMETRIC)
+  {
+    gradientImage = this->GetFixedImageGradient();
+    secondGradientImage = this->GetWarpedImageGradient();
+    gradientScale = 0.5;
+  }
+  else
+  {
+    itkExceptionMacro(<< "Unknown gradient type!");
+  }
+  const GradientPixelType * gradientLine = gradientImage->GetBufferPointer() + gradientImage->ComputeOffset(index);
+  const GradientPixelType * secondGradientLine =
+    secondGradientImage ? secondGradientImage->GetBufferPointer() + secondGradientImage->ComputeOffset(index)
+                        : nullptr;
+
+  double        sumOfMetricValues = 0.0;
+  SizeValueType numberOfPixelsProcessed = 0;
+  double        sumOfSquaredChange = 0.0;
+
+  for (SizeValueType i = 0; i < length; i++)
+  {
+    // Check if pixel lies inside mask
+    if (maskLine && maskLine[i] <= maskThreshold)
+    {
+      update[i].Fill(0.0);
+      continue;
+    }
+
+    double gradient[ImageDimension];
+    for (unsigned int dim = 0; dim < ImageDimension; dim++)
+    {
+      gradient[dim] = gradientLine[i][dim];
+      if (secondGradientLine)
+      {
+        gradient[dim] += secondGradientLine[i][dim];
+      }
+      gradient[dim] *= gradientScale;
+    }
+
+    sumOfMetricValues += this->ComputeLocalUpdate(
+      static_cast<double>(fixedLine[i]), static_cast<double>(warpedLine[i]), gradient, update[i]);
+    numberOfPixelsProcessed++;
+    sumOfSquaredChange += update[i].GetSquaredNorm();
+  }
+
+  // Update the global data (metric etc.)
+  auto * globalData = (GlobalDataStruct *)gd;
+  if (globalData)
+  {
+    globalData->m_NumberOfPixelsProcessed += numberOfPixelsProcessed;
+    globalData->m_SumOfMetricValues += sumOfMetricValues;
+    globalData->m_SumOfSquaredChange += sumOfSquaredChange;
+  }
+}
+
+/**
+ * Standard "PrintSelf" method.
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationMIFunction<TFixedImage, TMovingImage, TDisplacementField>::PrintSelf(std::ostream & os,
+                                                                                            Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+
+  os << indent << "GradientType: ";
+  os << m_GradientType << std::endl;
+  os << indent << "NumberOfHistogramBins: ";
+  os << m_NumberOfHistogramBins << std::endl;
+  os << indent << "Normalizer: ";
+  os << m_Normalizer << std::endl;
+}
+
+} // end namespace itk
+
+#endif
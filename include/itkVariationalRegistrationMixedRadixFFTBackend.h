@@ -0,0 +1,210 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationMixedRadixFFTBackend_h
+#define itkVariationalRegistrationMixedRadixFFTBackend_h
+
+#include "itkVariationalRegistrationFFTBackend.h"
+#include "itkMultiThreaderBase.h"
+
+#include <vector>
+
+namespace itk
+{
+
+/** \class itk::VariationalRegistrationMixedRadixFFTBackend
+ *
+ *  \brief Bundled FFT backend of the spectral regularizers without external dependencies.
+ *
+ *  The multidimensional transforms are computed as one-dimensional transforms
+ *  along the lines of each dimension, which are distributed over the work
+ *  units. The one-dimensional complex FFTs are self-sorting (Stockham) mixed
+ *  radix FFTs with specialized passes for the factors 2 and 4; other factors
+ *  are handled by a generic pass whose costs grow with the square of the
+ *  factor, so sizes with large prime factors should be avoided. The
+ *  regularizers therefore pad the buffers to smooth sizes by default with this
+ *  backend (see GetDefaultUsePadding() and UsePadding of the regularizers).
+ *
+ *  Real lines are transformed in pairs with one complex FFT. The DCTs are
+ *  computed with one complex FFT of the same length after reordering the
+ *  input (Makhoul, 1980).
+ *
+ *  This backend is always available and is used if ITK is built without
+ *  FFTW or without FFTW for the precision TReal.
+ *
+ *  \sa VariationalRegistrationFFTBackend
+ *  \sa VariationalRegistrationFFTWBackend
+ *
+ *  \ingroup VariationalRegistration
+ */
+template <typename TReal, unsigned int VDimension>
+class VariationalRegistrationMixedRadixFFTBackend : public VariationalRegistrationFFTBackend<TReal, VDimension>
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(VariationalRegistrationMixedRadixFFTBackend);
+
+  /** Standard class type alias */
+  using Self = VariationalRegistrationMixedRadixFFTBackend;
+  using Superclass = VariationalRegistrationFFTBackend<TReal, VDimension>;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods) */
+  itkTypeMacro(VariationalRegistrationMixedRadixFFTBackend, VariationalRegistrationFFTBackend);
+
+  static constexpr unsigned int ImageDimension = VDimension;
+
+  using RealType = typename Superclass::RealType;
+  using ComplexType = typename Superclass::ComplexType;
+  using SizeType = typename Superclass::SizeType;
+
+  /** The generic passes for large prime factors are slow, so the buffers
+   * are padded by default. */
+  bool
+  GetDefaultUsePadding() const override
+  {
+    return true;
+  }
+
+  bool
+  PlanRealToComplex(const SizeType & size,
+                    unsigned int     numberOfImages,
+                    RealType *       real,
+                    ComplexType *    complex) override;
+
+  void
+  ExecuteRealToComplex() override;
+
+  void
+  ExecuteComplexToReal() override;
+
+  bool
+  PlanCosine(const SizeType & size, RealType * spatial, RealType * frequency) override;
+
+  void
+  ExecuteForwardCosine() override;
+
+  void
+  ExecuteBackwardCosine() override;
+
+protected:
+  VariationalRegistrationMixedRadixFFTBackend();
+  ~VariationalRegistrationMixedRadixFFTBackend() override = default;
+
+  /** Plan of the complex FFT of one length. */
+  class LinePlan
+  {
+  public:
+    /** Factorize the length and precompute the twiddle factors. */
+    void
+    Initialize(SizeValueType length);
+
+    SizeValueType
+    GetLength() const
+    {
+      return m_Length;
+    }
+
+    /** Transform a line in place. The scratch buffer holds as many values as
+     * the line. The backward transform uses the positive exponent. */
+    void
+    Transform(ComplexType * data, ComplexType * scratch, bool backward) const;
+
+  private:
+    /** One pass of the FFT: numberOfBlocks * factor transforms of length
+     * blockLength are combined with DFTs of length factor. */
+    struct StageType
+    {
+      unsigned int             m_Factor;
+      SizeValueType            m_NumberOfBlocks;
+      SizeValueType            m_BlockLength;
+      std::vector<ComplexType> m_Twiddles;
+      std::vector<ComplexType> m_Roots;
+    };
+
+    SizeValueType          m_Length{ 0 };
+    std::vector<StageType> m_Stages;
+  };
+
+  /** Product of two complex values without the special handling of
+   * infinities of std::complex. */
+  static ComplexType
+  Multiply(const ComplexType & a, const ComplexType & b)
+  {
+    return ComplexType(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+  }
+
+  /** Offset of the first value of a line along a dimension, where stride is
+   * the distance of two values of the line and length their number. */
+  static SizeValueType
+  ComputeLineStart(SizeValueType line, SizeValueType stride, SizeValueType length)
+  {
+    return line % stride + (line / stride) * stride * length;
+  }
+
+  /** Apply a function to ranges [begin, end) of numberOfLines lines in
+   * parallel; each work unit processes one range. */
+  template <typename TFunction>
+  void
+  ParallelizeLines(SizeValueType numberOfLines, const TFunction & function);
+
+  /** Transform all lines along a dimension of the complex buffer in place. */
+  void
+  TransformComplexLines(unsigned int dimension, bool backward);
+
+  /** Compute the DCT-III (backward false) or the DCT-II (backward true) of all
+   * lines along a dimension. The lines are read from input and written to
+   * output, which may be the same buffer. */
+  void
+  TransformCosineLines(unsigned int dimension, const RealType * input, RealType * output, bool backward);
+
+private:
+  /** Multithreader for the execution of the transforms. */
+  MultiThreaderBase::Pointer m_MultiThreader;
+
+  /** Size, number of images and buffers of the real-to-complex FFT. */
+  SizeType      m_RealToComplexSize;
+  unsigned int  m_NumberOfImages;
+  RealType *    m_Real;
+  ComplexType * m_Complex;
+
+  /** Size of the spectrum of each image. */
+  SizeType m_ComplexSize;
+
+  /** Plans of the real-to-complex FFT for each dimension. */
+  LinePlan m_RealToComplexPlans[VDimension];
+
+  /** Size and buffers of the DCTs. */
+  SizeType   m_CosineSize;
+  RealType * m_Spatial;
+  RealType * m_Frequency;
+
+  /** Plans of the DCTs and the factors exp(-i pi k / (2 n)) for each dimension. */
+  LinePlan                 m_CosinePlans[VDimension];
+  std::vector<ComplexType> m_CosineTwiddles[VDimension];
+};
+
+} // namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#  include "itkVariationalRegistrationMixedRadixFFTBackend.hxx"
+#endif
+
+#endif
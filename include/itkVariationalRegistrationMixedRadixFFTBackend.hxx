@@ -0,0 +1,609 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationMixedRadixFFTBackend_hxx
+#define itkVariationalRegistrationMixedRadixFFTBackend_hxx
+
+#include "itkVariationalRegistrationMixedRadixFFTBackend.h"
+#include "itkMath.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+
+/**
+ * Default constructor
+ */
+template <typename TReal, unsigned int VDimension>
+VariationalRegistrationMixedRadixFFTBackend<TReal, VDimension>::VariationalRegistrationMixedRadixFFTBackend()
+{
+  m_MultiThreader = MultiThreaderBase::New();
+
+  m_RealToComplexSize.Fill(0);
+  m_ComplexSize.Fill(0);
+  m_NumberOfImages = 0;
+  m_Real = nullptr;
+  m_Complex = nullptr;
+
+  m_CosineSize.Fill(0);
+  m_Spatial = nullptr;
+  m_Frequency = nullptr;
+}
+
+/**
+ * Factorize the length and precompute the twiddle factors
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationMixedRadixFFTBackend<TReal, VDimension>::LinePlan::Initialize(SizeValueType length)
+{
+  m_Length = length;
+  m_Stages.clear();
+
+  // Factors 4 and 2 first, then the odd prime factors in increasing order
+  std::vector<SizeValueType> factors;
+  SizeValueType              rest = length;
+  while (rest % 4 == 0)
+  {
+    factors.push_back(4);
+    rest /= 4;
+  }
+  while (rest % 2 == 0)
+  {
+    factors.push_back(2);
+    rest /= 2;
+  }
+  for (SizeValueType factor = 3; factor * factor <= rest; factor += 2)
+  {
+    while (rest % factor == 0)
+    {
+      factors.push_back(factor);
+      rest /= factor;
+    }
+  }
+  if (rest > 1)
+  {
+    factors.push_back(rest);
+  }
+
+  // Stage s combines numberOfBlocks = f_1 * ... * f_{s-1} groups of factor
+  // sequences of blockLength values (decimation in frequency). The output of
+  // each DFT of length factor is multiplied with exp(-2 pi i r a / (factor * blockLength)).
+  SizeValueType numberOfBlocks = 1;
+  for (const SizeValueType factor : factors)
+  {
+    StageType stage;
+    stage.m_Factor = static_cast<unsigned int>(factor);
+    stage.m_NumberOfBlocks = numberOfBlocks;
+    stage.m_BlockLength = length / (numberOfBlocks * factor);
+
+    const SizeValueType subLength = stage.m_BlockLength * factor;
+    stage.m_Twiddles.resize((factor - 1) * stage.m_BlockLength);
+    for (SizeValueType r = 1; r < factor; ++r)
+    {
+      for (SizeValueType a = 0; a < stage.m_BlockLength; ++a)
+      {
+        const double angle = -2.0 * itk::Math::pi * static_cast<double>((r * a) % subLength) / subLength;
+        stage.m_Twiddles[(r - 1) * stage.m_BlockLength + a] =
+          ComplexType(static_cast<TReal>(std::cos(angle)), static_cast<TReal>(std::sin(angle)));
+      }
+    }
+
+    stage.m_Roots.resize(factor);
+    for (SizeValueType j = 0; j < factor; ++j)
+    {
+      const double angle = -2.0 * itk::Math::pi * static_cast<double>(j) / factor;
+      stage.m_Roots[j] = ComplexType(static_cast<TReal>(std::cos(angle)), static_cast<TReal>(std::sin(angle)));
+    }
+
+    m_Stages.push_back(stage);
+    numberOfBlocks *= factor;
+  }
+}
+
+/**
+ * Transform a line in place
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationMixedRadixFFTBackend<TReal, VDimension>::LinePlan::Transform(ComplexType * data,
+                                                                                    ComplexType * scratch,
+                                                                                    bool          backward) const
+{
+  // The backward transform uses the conjugate roots and twiddle factors
+  const auto twiddle = [backward](const ComplexType & w) { return backward ? std::conj(w) : w; };
+
+  ComplexType * in = data;
+  ComplexType * out = scratch;
+  for (const StageType & stage : m_Stages)
+  {
+    const unsigned int  factor = stage.m_Factor;
+    const SizeValueType numberOfBlocks = stage.m_NumberOfBlocks;
+    const SizeValueType blockLength = stage.m_BlockLength;
+    const ComplexType * twiddles = stage.m_Twiddles.data();
+
+    for (SizeValueType c = 0; c < numberOfBlocks; ++c)
+    {
+      // Input j of the DFT is cc[a + j * blockLength], output r is written
+      // to out[a + blockLength * (c + numberOfBlocks * r)]
+      const ComplexType * cc = in + blockLength * factor * c;
+      ComplexType *       ch = out + blockLength * c;
+      const SizeValueType outStride = blockLength * numberOfBlocks;
+
+      if (factor == 2)
+      {
+        for (SizeValueType a = 0; a < blockLength; ++a)
+        {
+          const ComplexType t0 = cc[a];
+          const ComplexType t1 = cc[a + blockLength];
+          ch[a] = t0 + t1;
+          ch[a + outStride] = Multiply(t0 - t1, twiddle(twiddles[a]));
+        }
+      }
+      else if (factor == 4)
+      {
+        for (SizeValueType a = 0; a < blockLength; ++a)
+        {
+          const ComplexType t0 = cc[a];
+          const ComplexType t1 = cc[a + blockLength];
+          const ComplexType t2 = cc[a + 2 * blockLength];
+          const ComplexType t3 = cc[a + 3 * blockLength];
+          const ComplexType sum02 = t0 + t2;
+          const ComplexType diff02 = t0 - t2;
+          const ComplexType sum13 = t1 + t3;
+          const ComplexType diff13 = t1 - t3;
+
+          // Multiply diff13 with the fourth root of unity (-i or i)
+          const ComplexType rotated13 = backward ? ComplexType(-diff13.imag(), diff13.real())
+                                                 : ComplexType(diff13.imag(), -diff13.real());
+
+          ch[a] = sum02 + sum13;
+          ch[a + outStride] = Multiply(diff02 + rotated13, twiddle(twiddles[a]));
+          ch[a + 2 * outStride] = Multiply(sum02 - sum13, twiddle(twiddles[blockLength + a]));
+          ch[a + 3 * outStride] = Multiply(diff02 - rotated13, twiddle(twiddles[2 * blockLength + a]));
+        }
+      }
+      else
+      {
+        const ComplexType * roots = stage.m_Roots.data();
+        for (SizeValueType a = 0; a < blockLength; ++a)
+        {
+          for (unsigned int r = 0; r < factor; ++r)
+          {
+            ComplexType sum(0, 0);
+            for (unsigned int j = 0; j < factor; ++j)
+            {
+              sum += Multiply(cc[a + j * blockLength], twiddle(roots[(j * r) % factor]));
+            }
+            ch[a + r * outStride] = (r == 0) ? sum : Multiply(sum, twiddle(twiddles[(r - 1) * blockLength + a]));
+          }
+        }
+      }
+    }
+    std::swap(in, out);
+  }
+
+  if (in != data)
+  {
+    std::copy(in, in + m_Length, data);
+  }
+}
+
+/**
+ * Execute a function for ranges of lines in parallel
+ */
+template <typename TReal, unsigned int VDimension>
+template <typename TFunction>
+void
+VariationalRegistrationMixedRadixFFTBackend<TReal, VDimension>::ParallelizeLines(SizeValueType     numberOfLines,
+                                                                                 const TFunction & function)
+{
+  if (numberOfLines == 0)
+  {
+    return;
+  }
+
+  const SizeValueType numberOfRanges = std::min<SizeValueType>(numberOfLines, this->GetNumberOfWorkUnits());
+
+  m_MultiThreader->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+  m_MultiThreader->ParallelizeArray(
+    0,
+    numberOfRanges,
+    [&](SizeValueType range) {
+      function(range * numberOfLines / numberOfRanges, (range + 1) * numberOfLines / numberOfRanges);
+    },
+    nullptr);
+}
+
+/**
+ * Plan the real-to-complex FFT
+ */
+template <typename TReal, unsigned int VDimension>
+bool
+VariationalRegistrationMixedRadixFFTBackend<TReal, VDimension>::PlanRealToComplex(const SizeType & size,
+                                                                                  unsigned int     numberOfImages,
+                                                                                  RealType *       real,
+                                                                                  ComplexType *    complex)
+{
+  for (unsigned int i = 0; i < VDimension; ++i)
+  {
+    if (size[i] == 0)
+    {
+      return false;
+    }
+    m_RealToComplexPlans[i].Initialize(size[i]);
+  }
+
+  m_RealToComplexSize = size;
+  m_ComplexSize = size;
+  m_ComplexSize[0] = size[0] / 2 + 1;
+  m_NumberOfImages = numberOfImages;
+  m_Real = real;
+  m_Complex = complex;
+
+  return true;
+}
+
+/**
+ * Transform all lines along a dimension of the complex buffer
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationMixedRadixFFTBackend<TReal, VDimension>::TransformComplexLines(unsigned int dimension,
+                                                                                      bool         backward)
+{
+  const LinePlan &    plan = m_RealToComplexPlans[dimension];
+  const SizeValueType length = plan.GetLength();
+
+  SizeValueType stride = 1;
+  SizeValueType totalSize = 1;
+  for (unsigned int i = 0; i < VDimension; ++i)
+  {
+    if (i < dimension)
+    {
+      stride *= m_ComplexSize[i];
+    }
+    totalSize *= m_ComplexSize[i];
+  }
+  const SizeValueType numberOfLines = m_NumberOfImages * (totalSize / length);
+
+  this->ParallelizeLines(numberOfLines, [&](SizeValueType begin, SizeValueType end) {
+    std::vector<ComplexType> line(length);
+    std::vector<ComplexType> scratch(length);
+    for (SizeValueType l = begin; l < end; ++l)
+    {
+      ComplexType * start = m_Complex + ComputeLineStart(l, stride, length);
+      for (SizeValueType j = 0; j < length; ++j)
+      {
+        line[j] = start[j * stride];
+      }
+      plan.Transform(line.data(), scratch.data(), backward);
+      for (SizeValueType j = 0; j < length; ++j)
+      {
+        start[j * stride] = line[j];
+      }
+    }
+  });
+}
+
+/**
+ * Execute the real-to-complex FFT
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationMixedRadixFFTBackend<TReal, VDimension>::ExecuteRealToComplex()
+{
+  // Transform pairs of real lines along dimension 0 with one complex FFT:
+  // for z = a + i b, A_k = (Z_k + conj(Z_{n-k})) / 2 and
+  // B_k = (Z_k - conj(Z_{n-k})) / (2 i).
+  const LinePlan &    plan = m_RealToComplexPlans[0];
+  const SizeValueType length = plan.GetLength();
+  const SizeValueType complexLength = m_ComplexSize[0];
+
+  SizeValueType totalSize = 1;
+  for (unsigned int i = 0; i < VDimension; ++i)
+  {
+    totalSize *= m_RealToComplexSize[i];
+  }
+  const SizeValueType numberOfLines = m_NumberOfImages * (totalSize / length);
+  const auto          half = static_cast<TReal>(0.5);
+
+  this->ParallelizeLines((numberOfLines + 1) / 2, [&](SizeValueType begin, SizeValueType end) {
+    std::vector<ComplexType> line(length);
+    std::vector<ComplexType> scratch(length);
+    for (SizeValueType pair = begin; pair < end; ++pair)
+    {
+      const bool       hasSecond = (2 * pair + 1 < numberOfLines);
+      const RealType * a = m_Real + 2 * pair * length;
+      const RealType * b = a + length;
+      ComplexType *    spectrumA = m_Complex + 2 * pair * complexLength;
+      ComplexType *    spectrumB = spectrumA + complexLength;
+
+      for (SizeValueType j = 0; j < length; ++j)
+      {
+        line[j] = ComplexType(a[j], hasSecond ? b[j] : 0);
+      }
+      plan.Transform(line.data(), scratch.data(), false);
+      for (SizeValueType k = 0; k < complexLength; ++k)
+      {
+        const ComplexType z = line[k];
+        const ComplexType zMirror = std::conj(line[(length - k) % length]);
+        spectrumA[k] = half * (z + zMirror);
+        if (hasSecond)
+        {
+          const ComplexType difference = z - zMirror;
+          spectrumB[k] = ComplexType(half * difference.imag(), -half * difference.real());
+        }
+      }
+    }
+  });
+
+  for (unsigned int i = 1; i < VDimension; ++i)
+  {
+    this->TransformComplexLines(i, false);
+  }
+}
+
+/**
+ * Execute the complex-to-real FFT
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationMixedRadixFFTBackend<TReal, VDimension>::ExecuteComplexToReal()
+{
+  for (unsigned int i = VDimension - 1; i > 0; --i)
+  {
+    this->TransformComplexLines(i, true);
+  }
+
+  // Transform pairs of Hermitian spectra along dimension 0 with one complex
+  // FFT of z = a + i b. The imaginary parts of the values at frequency 0 and
+  // n/2 are ignored like in FFTW.
+  const LinePlan &    plan = m_RealToComplexPlans[0];
+  const SizeValueType length = plan.GetLength();
+  const SizeValueType complexLength = m_ComplexSize[0];
+
+  SizeValueType totalSize = 1;
+  for (unsigned int i = 0; i < VDimension; ++i)
+  {
+    totalSize *= m_RealToComplexSize[i];
+  }
+  const SizeValueType numberOfLines = m_NumberOfImages * (totalSize / length);
+
+  this->ParallelizeLines((numberOfLines + 1) / 2, [&](SizeValueType begin, SizeValueType end) {
+    std::vector<ComplexType> line(length);
+    std::vector<ComplexType> scratch(length);
+    for (SizeValueType pair = begin; pair < end; ++pair)
+    {
+      const bool          hasSecond = (2 * pair + 1 < numberOfLines);
+      RealType *          a = m_Real + 2 * pair * length;
+      RealType *          b = a + length;
+      const ComplexType * spectrumA = m_Complex + 2 * pair * complexLength;
+      const ComplexType * spectrumB = spectrumA + complexLength;
+
+      for (SizeValueType k = 0; k < length; ++k)
+      {
+        ComplexType valueA;
+        ComplexType valueB(0, 0);
+        if (2 * k <= length)
+        {
+          valueA = spectrumA[k];
+          if (hasSecond)
+          {
+            valueB = spectrumB[k];
+          }
+        }
+        else
+        {
+          valueA = std::conj(spectrumA[length - k]);
+          if (hasSecond)
+          {
+            valueB = std::conj(spectrumB[length - k]);
+          }
+        }
+        if (k == 0 || 2 * k == length)
+        {
+          valueA = ComplexType(valueA.real(), 0);
+          valueB = ComplexType(valueB.real(), 0);
+        }
+        line[k] = ComplexType(valueA.real() - valueB.imag(), valueA.imag() + valueB.real());
+      }
+      plan.Transform(line.data(), scratch.data(), true);
+      for (SizeValueType j = 0; j < length; ++j)
+      {
+        a[j] = line[j].real();
+        if (hasSecond)
+        {
+          b[j] = line[j].imag();
+        }
+      }
+    }
+  });
+}
+
+/**
+ * Plan the DCTs
+ */
+template <typename TReal, unsigned int VDimension>
+bool
+VariationalRegistrationMixedRadixFFTBackend<TReal, VDimension>::PlanCosine(const SizeType & size,
+                                                                           RealType *       spatial,
+                                                                           RealType *       frequency)
+{
+  for (unsigned int i = 0; i < VDimension; ++i)
+  {
+    if (size[i] == 0)
+    {
+      return false;
+    }
+    m_CosinePlans[i].Initialize(size[i]);
+
+    m_CosineTwiddles[i].resize(size[i]);
+    for (SizeValueType k = 0; k < size[i]; ++k)
+    {
+      const double angle = -itk::Math::pi * static_cast<double>(k) / (2.0 * size[i]);
+      m_CosineTwiddles[i][k] = ComplexType(static_cast<TReal>(std::cos(angle)), static_cast<TReal>(std::sin(angle)));
+    }
+  }
+
+  m_CosineSize = size;
+  m_Spatial = spatial;
+  m_Frequency = frequency;
+
+  return true;
+}
+
+/**
+ * Compute the DCTs of all lines along a dimension
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationMixedRadixFFTBackend<TReal, VDimension>::TransformCosineLines(unsigned int     dimension,
+                                                                                     const RealType * input,
+                                                                                     RealType *       output,
+                                                                                     bool             backward)
+{
+  const LinePlan &    plan = m_CosinePlans[dimension];
+  const ComplexType * twiddles = m_CosineTwiddles[dimension].data();
+  const SizeValueType length = plan.GetLength();
+
+  SizeValueType stride = 1;
+  SizeValueType totalSize = 1;
+  for (unsigned int i = 0; i < VDimension; ++i)
+  {
+    if (i < dimension)
+    {
+      stride *= m_CosineSize[i];
+    }
+    totalSize *= m_CosineSize[i];
+  }
+  const SizeValueType numberOfLines = totalSize / length;
+  const auto          half = static_cast<TReal>(0.5);
+
+  // Two lines a and b are transformed with one complex FFT of z = a + i b
+  this->ParallelizeLines((numberOfLines + 1) / 2, [&](SizeValueType begin, SizeValueType end) {
+    std::vector<ComplexType> line(length);
+    std::vector<ComplexType> scratch(length);
+    for (SizeValueType pair = begin; pair < end; ++pair)
+    {
+      const bool          hasSecond = (2 * pair + 1 < numberOfLines);
+      const SizeValueType startA = ComputeLineStart(2 * pair, stride, length);
+      const SizeValueType startB = hasSecond ? ComputeLineStart(2 * pair + 1, stride, length) : startA;
+      const RealType *    inA = input + startA;
+      const RealType *    inB = input + startB;
+      RealType *          outA = output + startA;
+      RealType *          outB = output + startB;
+
+      if (backward)
+      {
+        // DCT-II: FFT of v = (x_0, x_2, x_4, ..., x_5, x_3, x_1) and
+        // y_k = 2 Re(exp(-i pi k / (2 n)) V_k)
+        for (SizeValueType j = 0; 2 * j < length; ++j)
+        {
+          line[j] = ComplexType(inA[2 * j * stride], hasSecond ? inB[2 * j * stride] : 0);
+        }
+        for (SizeValueType j = 0; 2 * j + 1 < length; ++j)
+        {
+          line[length - 1 - j] = ComplexType(inA[(2 * j + 1) * stride], hasSecond ? inB[(2 * j + 1) * stride] : 0);
+        }
+        plan.Transform(line.data(), scratch.data(), false);
+        for (SizeValueType k = 0; k < length; ++k)
+        {
+          const ComplexType z = line[k];
+          const ComplexType zMirror = std::conj(line[(length - k) % length]);
+          const ComplexType valueA = half * (z + zMirror);
+          outA[k * stride] = 2 * Multiply(twiddles[k], valueA).real();
+          if (hasSecond)
+          {
+            const ComplexType difference = z - zMirror;
+            const ComplexType valueB(half * difference.imag(), -half * difference.real());
+            outB[k * stride] = 2 * Multiply(twiddles[k], valueB).real();
+          }
+        }
+      }
+      else
+      {
+        // DCT-III: inverse FFT of V_k = exp(i pi k / (2 n)) (x_k - i x_{n-k})
+        // and reordering of the result
+        for (SizeValueType k = 0; k < length; ++k)
+        {
+          const ComplexType twiddle = std::conj(twiddles[k]);
+          const RealType    mirrorA = (k == 0) ? 0 : inA[(length - k) * stride];
+          const ComplexType valueA = Multiply(twiddle, ComplexType(inA[k * stride], -mirrorA));
+          ComplexType       valueB(0, 0);
+          if (hasSecond)
+          {
+            const RealType mirrorB = (k == 0) ? 0 : inB[(length - k) * stride];
+            valueB = Multiply(twiddle, ComplexType(inB[k * stride], -mirrorB));
+          }
+          line[k] = ComplexType(valueA.real() - valueB.imag(), valueA.imag() + valueB.real());
+        }
+        plan.Transform(line.data(), scratch.data(), true);
+        for (SizeValueType j = 0; 2 * j < length; ++j)
+        {
+          outA[2 * j * stride] = line[j].real();
+          if (hasSecond)
+          {
+            outB[2 * j * stride] = line[j].imag();
+          }
+        }
+        for (SizeValueType j = 0; 2 * j + 1 < length; ++j)
+        {
+          outA[(2 * j + 1) * stride] = line[length - 1 - j].real();
+          if (hasSecond)
+          {
+            outB[(2 * j + 1) * stride] = line[length - 1 - j].imag();
+          }
+        }
+      }
+    }
+  });
+}
+
+/**
+ * Execute the forward DCT
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationMixedRadixFFTBackend<TReal, VDimension>::ExecuteForwardCosine()
+{
+  this->TransformCosineLines(0, m_Spatial, m_Frequency, false);
+  for (unsigned int i = 1; i < VDimension; ++i)
+  {
+    this->TransformCosineLines(i, m_Frequency, m_Frequency, false);
+  }
+}
+
+/**
+ * Execute the backward DCT
+ */
+template <typename TReal, unsigned int VDimension>
+void
+VariationalRegistrationMixedRadixFFTBackend<TReal, VDimension>::ExecuteBackwardCosine()
+{
+  this->TransformCosineLines(0, m_Frequency, m_Spatial, true);
+  for (unsigned int i = 1; i < VDimension; ++i)
+  {
+    this->TransformCosineLines(i, m_Spatial, m_Spatial, true);
+  }
+}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,325 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationMultigridRegularizer_h
+#define itkVariationalRegistrationMultigridRegularizer_h
+
+#include "itkVariationalRegistrationRegularizer.h"
+
+#include <vector>
+
+namespace itk
+{
+
+/** \class itk::VariationalRegistrationMultigridRegularizer
+ *
+ *  \brief This class performs diffusive, elastic or curvature regularization of a vector field with multigrid.
+ *
+ *  We compute \f$u^{out}=(Id - A)^{-1}[u^{in}]\f$ by solving the linear system
+ *  \f$(Id - A)u^{out}=u^{in}\f$ with a geometric multigrid method. The operator \f$A\f$ is one of
+ *  - \f$A[u]=\alpha\Delta u\f$ (diffusive, see VariationalRegistrationDiffusionRegularizer),
+ *  - \f$A[u]=\mu\Delta u + (\mu+\lambda)\nabla(\nabla\cdot u)\f$ (elastic, see
+ *    VariationalRegistrationElasticRegularizer),
+ *  - \f$A[u]=-\alpha\Delta^2 u\f$ (curvature, see VariationalRegistrationCurvatureRegularizer).
+ *
+ *  The operators are discretized with finite differences and Neumann boundary conditions.
+ *  In contrast to the diffusion regularizer, the system is solved without operator splitting,
+ *  and in contrast to the elastic and curvature regularizers, no FFTW is needed and the costs
+ *  are linear in the number of pixels for each image size.
+ *
+ *  The system is solved with V-cycles on a hierarchy of cell-centered grids, which are
+ *  coarsened by a factor of two along each dimension. Residuals are restricted by averaging
+ *  and corrections are prolongated by linear interpolation. The smoother is a multithreaded
+ *  red-black Gauss-Seidel relaxation. The curvature system is solved in the mixed form
+ *  \f$u+\alpha\Delta v=u^{in}\f$, \f$v-\Delta u=0\f$ with a collective relaxation of
+ *  \f$(u,v)\f$ at each pixel, so all stencils have the five (seven) point form. The mixed
+ *  derivatives of the elastic operator couple diagonal neighbors, so the elastic system is
+ *  relaxed with four (eight) colors instead of two.
+ *
+ *  V-cycles are performed until the norm of the residual is below a tolerance relative to the
+ *  norm of the input field (see SetTolerance()), but at most SetMaximumNumberOfCycles() cycles.
+ *  The solution of the previous call with the same input field is used as initial value
+ *  (warm start) if the size of the field has not changed, because the field only changes
+ *  slightly between two iterations of the registration. The solutions of the two most recent
+ *  input fields are kept, so the warm start also applies if the registration filter smooths
+ *  both the update field and the displacement field, which alternate as input.
+ *
+ *  Please note that \f$\alpha\f$, \f$\mu\f$ and \f$\lambda\f$ correspond to the weights
+ *  multiplied with \f$\tau\f$ (see Eq.(2) in VariationalRegistrationFilter).
+ *
+ *  \sa VariationalRegistrationFilter
+ *  \sa VariationalRegistrationRegularizer
+ *  \sa VariationalRegistrationDiffusionRegularizer
+ *  \sa VariationalRegistrationElasticRegularizer
+ *  \sa VariationalRegistrationCurvatureRegularizer
+ *
+ *  \ingroup VariationalRegistration
+ */
+template <typename TDisplacementField>
+class VariationalRegistrationMultigridRegularizer : public VariationalRegistrationRegularizer<TDisplacementField>
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(VariationalRegistrationMultigridRegularizer);
+
+  /** Standard class type alias */
+  using Self = VariationalRegistrationMultigridRegularizer;
+  using Superclass = VariationalRegistrationRegularizer<TDisplacementField>;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods) */
+  itkTypeMacro(VariationalRegistrationMultigridRegularizer, VariationalRegistrationRegularizer);
+
+  /** Dimensionality of input and output data is assumed to be the same. */
+  static constexpr unsigned int ImageDimension = TDisplacementField::ImageDimension;
+
+  /** Deformation field types, inherited from Superclass. */
+  using DisplacementFieldType = typename Superclass::DisplacementFieldType;
+  using DisplacementFieldPointer = typename Superclass::DisplacementFieldPointer;
+  using DisplacementFieldConstPointer = typename Superclass::DisplacementFieldConstPointer;
+  using PixelType = typename Superclass::PixelType;
+  using ValueType = typename Superclass::ValueType;
+  using SizeType = typename DisplacementFieldType::SizeType;
+  using IndexType = typename DisplacementFieldType::IndexType;
+  using SpacingType = typename DisplacementFieldType::SpacingType;
+
+  /** Select the diffusive operator. */
+  virtual void
+  SetOperatorToDiffusion()
+  {
+    m_OperatorType = OPERATOR_DIFFUSION;
+    this->Modified();
+  }
+
+  /** Select the linear elastic operator. */
+  virtual void
+  SetOperatorToElastic()
+  {
+    m_OperatorType = OPERATOR_ELASTIC;
+    this->Modified();
+  }
+
+  /** Select the curvature operator. */
+  virtual void
+  SetOperatorToCurvature()
+  {
+    m_OperatorType = OPERATOR_CURVATURE;
+    this->Modified();
+  }
+
+  /** Set/Get the regularization weight alpha of the diffusive and the
+   * curvature operator. */
+  itkSetMacro(Alpha, ValueType);
+  itkGetConstMacro(Alpha, ValueType);
+
+  /** Set/Get the regularization weight mu of the elastic operator. */
+  itkSetMacro(Mu, ValueType);
+  itkGetConstMacro(Mu, ValueType);
+
+  /** Set/Get the regularization weight lambda of the elastic operator. */
+  itkSetMacro(Lambda, ValueType);
+  itkGetConstMacro(Lambda, ValueType);
+
+  /** Set/Get the maximum number of V-cycles in each call. Default is 10. */
+  itkSetClampMacro(MaximumNumberOfCycles, unsigned int, 1, NumericTraits<unsigned int>::max());
+  itkGetConstMacro(MaximumNumberOfCycles, unsigned int);
+
+  /** Set/Get the tolerance of the residual norm relative to the norm of the
+   * input field. No more V-cycles are performed once the residual is below
+   * the tolerance. Default is 1e-3. */
+  itkSetClampMacro(Tolerance, double, 0.0, NumericTraits<double>::max());
+  itkGetConstMacro(Tolerance, double);
+
+  /** Set/Get the number of relaxations before and after the coarse grid
+   * correction on each level. Default is 2. */
+  itkSetClampMacro(NumberOfSmoothingIterations, unsigned int, 1, NumericTraits<unsigned int>::max());
+  itkGetConstMacro(NumberOfSmoothingIterations, unsigned int);
+
+  /** Set/Get the number of relaxations that solve the system of the
+   * coarsest level. Default is 50. */
+  itkSetClampMacro(NumberOfCoarsestLevelIterations, unsigned int, 1, NumericTraits<unsigned int>::max());
+  itkGetConstMacro(NumberOfCoarsestLevelIterations, unsigned int);
+
+  /** Get the number of V-cycles performed in the last call. */
+  itkGetConstMacro(ElapsedCycles, unsigned int);
+
+  /** Set/Get if the solution of the previous call with the same input field
+   * is the initial value. Default is on. */
+  itkSetMacro(UseWarmStart, bool);
+  itkGetConstMacro(UseWarmStart, bool);
+  itkBooleanMacro(UseWarmStart);
+
+protected:
+  VariationalRegistrationMultigridRegularizer();
+  ~VariationalRegistrationMultigridRegularizer() override = default;
+
+  /** Print information about the filter. */
+  void
+  PrintSelf(std::ostream & os, Indent indent) const override;
+
+  /** Execute regularization. This method is multi-threaded but does not
+   * use ThreadedGenerateData(). */
+  void
+  GenerateData() override;
+
+  /** Method for initialization. The grid hierarchy is built in this method
+   * if the size or the spacing of the field has changed. */
+  void
+  Initialize() override;
+
+  /** Type of available operators */
+  enum OperatorType
+  {
+    OPERATOR_DIFFUSION = 0,
+    OPERATOR_ELASTIC = 1,
+    OPERATOR_CURVATURE = 2
+  };
+
+  /** Grid of one level. The unknowns of a pixel are stored contiguously in
+   * the value type of the field; for the curvature operator these are u
+   * followed by v. */
+  struct LevelType
+  {
+    /** Size of the grid and offsets between neighbors in pixels. */
+    SizeType        m_Size;
+    OffsetValueType m_OffsetTable[ImageDimension];
+    SizeValueType   m_NumberOfPixels;
+
+    /** Mean spacing divided by the spacing of each dimension. */
+    double m_Scales[ImageDimension];
+
+    std::vector<ValueType> m_Solution;
+    std::vector<ValueType> m_RightHandSide;
+    std::vector<ValueType> m_Residual;
+  };
+
+  /** Number of unknowns of each pixel. */
+  unsigned int
+  GetNumberOfUnknowns() const
+  {
+    return (m_OperatorType == OPERATOR_CURVATURE) ? 2 * ImageDimension : ImageDimension;
+  }
+
+  /** Perform one V-cycle on the given level and all coarser levels. */
+  virtual void
+  VCycle(unsigned int levelNumber);
+
+  /** Relax the system of a level with red-black (or multicolor)
+   * Gauss-Seidel. */
+  virtual void
+  Smooth(LevelType & level, unsigned int iterations);
+
+  /** Compute the residual of the system of a level and return its squared
+   * norm. */
+  virtual double
+  ComputeResidual(LevelType & level);
+
+  /** Restrict the residual of a level to the right hand side of the next
+   * coarser level. */
+  virtual void
+  RestrictResidual(const LevelType & fine, LevelType & coarse);
+
+  /** Interpolate the solution of a coarse level and add it to the solution of
+   * the next finer level. */
+  virtual void
+  ProlongateCorrection(const LevelType & coarse, LevelType & fine);
+
+  /** Evaluate the stencil of the operator at a pixel. For the diffusive and
+   * the elastic operator, the system reads diagonal[e] * u[e] - sums[e] = f[e]
+   * for each unknown e. For the curvature operator, diagonal[0] holds the
+   * weighted number of neighbors k and sums holds the weighted sums of the
+   * neighbors of u and v; the system reads u + alpha * (sums_v - k * v) = f_u
+   * and v + k * u - sums_u = f_v. */
+  void
+  EvaluateStencil(const LevelType & level,
+                  const IndexType & index,
+                  OffsetValueType   offset,
+                  double *          diagonal,
+                  double *          sums) const;
+
+  /** Apply a function to each line of a level along dimension 0 in parallel.
+   * The function is called with the index and the offset of the first pixel
+   * of the line. */
+  template <typename TFunction>
+  void
+  ParallelizeLines(const LevelType & level, const TFunction & function);
+
+  /** Apply a function to each line of a level along dimension 0 in parallel
+   * whose index has the parity of bit d of the color in each dimension d > 0.
+   * The function is called as in ParallelizeLines(). */
+  template <typename TFunction>
+  void
+  ParallelizeLinesOfColor(const LevelType & level, unsigned int color, const TFunction & function);
+
+  /** Add up the sums of the lines of a level, which are stored in the line
+   * sums by the function of ParallelizeLines(). */
+  double
+  SumLineSums(const LevelType & level) const;
+
+private:
+  /** Selected operator. */
+  OperatorType m_OperatorType;
+
+  /** Regularization weights. */
+  ValueType m_Alpha;
+  ValueType m_Mu;
+  ValueType m_Lambda;
+
+  /** Parameters of the solver. */
+  unsigned int m_MaximumNumberOfCycles;
+  double       m_Tolerance;
+  unsigned int m_NumberOfSmoothingIterations;
+  unsigned int m_NumberOfCoarsestLevelIterations;
+  bool         m_UseWarmStart;
+  unsigned int m_ElapsedCycles;
+
+  /** Grid hierarchy; level 0 has the size of the field. */
+  std::vector<LevelType> m_Levels;
+
+  /** Sums of each line of a level for the norms. */
+  std::vector<double> m_LineSums;
+
+  /** Size, spacing and operator the hierarchy belongs to. */
+  SizeType     m_Size;
+  SpacingType  m_Spacing;
+  bool         m_UsedImageSpacing;
+  OperatorType m_LevelsOperatorType;
+
+  /** Solution of the finest level and the input field it belongs to. */
+  struct WarmStartType
+  {
+    const DisplacementFieldType * m_Input;
+    std::vector<ValueType>        m_Solution;
+  };
+
+  /** Solutions for the warm start, the most recently used last. */
+  std::vector<WarmStartType> m_WarmStarts;
+
+  /** Number of input fields with a solution for the warm start. */
+  static constexpr unsigned int NumberOfWarmStarts = 2;
+};
+
+} // namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#  include "itkVariationalRegistrationMultigridRegularizer.hxx"
+#endif
+
+#endif
@@ -0,0 +1,766 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkVariationalRegistrationMultigridRegularizer_hxx
+#define itkVariationalRegistrationMultigridRegularizer_hxx
+#include "itkVariationalRegistrationMultigridRegularizer.h"
+
+#include "itkMath.h"
+#include "itkMultiThreaderBase.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+
+/**
+ * Default constructor
+ */
+template <typename TDisplacementField>
+VariationalRegistrationMultigridRegularizer<TDisplacementField>::VariationalRegistrationMultigridRegularizer()
+{
+  m_OperatorType = OPERATOR_DIFFUSION;
+
+  // Initialize regularization weights
+  m_Alpha = 1.0;
+  m_Mu = 1.0;
+  m_Lambda = 1.0;
+
+  m_MaximumNumberOfCycles = 10;
+  m_Tolerance = 1e-3;
+  m_NumberOfSmoothingIterations = 2;
+  m_NumberOfCoarsestLevelIterations = 50;
+  m_UseWarmStart = true;
+  m_ElapsedCycles = 0;
+
+  m_Size.Fill(0);
+  m_Spacing.Fill(1.0);
+  m_UsedImageSpacing = false;
+  m_LevelsOperatorType = OPERATOR_DIFFUSION;
+}
+
+/**
+ * Generate data
+ */
+template <typename TDisplacementField>
+void
+VariationalRegistrationMultigridRegularizer<TDisplacementField>::GenerateData()
+{
+  // Allocate the output image
+  this->AllocateOutputs();
+
+  // Initialize and allocate data
+  this->Initialize();
+
+  this->GetMultiThreader()->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+
+  // Find the solution of a previous call with the same input field
+  const DisplacementFieldType * input = this->GetInput();
+  auto                          warmStart = std::find_if(
+    m_WarmStarts.begin(), m_WarmStarts.end(), [input](const WarmStartType & entry) { return entry.m_Input == input; });
+
+  // The field is the right hand side on the finest level. Without a solution
+  // of a previous call, it is also the initial value.
+  LevelType &         finest = m_Levels[0];
+  const unsigned int  numberOfUnknowns = this->GetNumberOfUnknowns();
+  const SizeValueType lineLength = finest.m_Size[0];
+  const PixelType *   in = input->GetBufferPointer();
+  const ValueType *   previous = (warmStart != m_WarmStarts.end()) ? warmStart->m_Solution.data() : nullptr;
+  ValueType *         f = finest.m_RightHandSide.data();
+  ValueType *         u = finest.m_Solution.data();
+
+  this->ParallelizeLines(finest, [&](const IndexType &, OffsetValueType lineOffset) {
+    const auto lineStart = static_cast<SizeValueType>(lineOffset);
+    double     sumOfSquares = 0.0;
+    for (SizeValueType i = lineStart; i < lineStart + lineLength; ++i)
+    {
+      for (unsigned int e = 0; e < numberOfUnknowns; ++e)
+      {
+        const ValueType value = (e < ImageDimension) ? in[i][e] : ValueType{ 0 };
+        f[i * numberOfUnknowns + e] = value;
+        u[i * numberOfUnknowns + e] = previous ? previous[i * numberOfUnknowns + e] : value;
+        sumOfSquares += itk::Math::sqr(static_cast<double>(value));
+      }
+    }
+    m_LineSums[lineStart / lineLength] = sumOfSquares;
+  });
+  const double rightHandSideNorm = std::sqrt(this->SumLineSums(finest));
+
+  // Perform V-cycles until the norm of the residual is below the tolerance
+  // relative to the norm of the right hand side.
+  m_ElapsedCycles = 0;
+  while (m_ElapsedCycles < m_MaximumNumberOfCycles)
+  {
+    const double residualNorm = std::sqrt(this->ComputeResidual(finest));
+    if (residualNorm <= m_Tolerance * rightHandSideNorm)
+    {
+      break;
+    }
+    this->VCycle(0);
+    ++m_ElapsedCycles;
+  }
+
+  // Keep the solution for the next call with the same input field; the
+  // least recently used solution is replaced.
+  if (m_UseWarmStart)
+  {
+    WarmStartType entry;
+    if (warmStart != m_WarmStarts.end())
+    {
+      entry = std::move(*warmStart);
+      m_WarmStarts.erase(warmStart);
+    }
+    else if (m_WarmStarts.size() >= NumberOfWarmStarts)
+    {
+      entry = std::move(m_WarmStarts.front());
+      m_WarmStarts.erase(m_WarmStarts.begin());
+    }
+    entry.m_Input = input;
+    entry.m_Solution.assign(finest.m_Solution.begin(), finest.m_Solution.end());
+    m_WarmStarts.push_back(std::move(entry));
+  }
+
+  // Write the solution to the output field
+  PixelType * out = this->GetOutput()->GetBufferPointer();
+  this->GetMultiThreader()->ParallelizeArray(
+    0,
+    finest.m_NumberOfPixels,
+    [&](SizeValueType i) {
+      for (unsigned int c = 0; c < ImageDimension; ++c)
+      {
+        out[i][c] = u[i * numberOfUnknowns + c];
+      }
+    },
+    nullptr);
+}
+
+/*
+ * Initialize flags and build the grid hierarchy
+ */
+template <typename TDisplacementField>
+void
+VariationalRegistrationMultigridRegularizer<TDisplacementField>::Initialize()
+{
+  this->Superclass::Initialize();
+
+  DisplacementFieldPointer DisplacementField = this->GetOutput();
+
+  const SizeType    size = DisplacementField->GetRequestedRegion().GetSize();
+  const SpacingType spacing = DisplacementField->GetSpacing();
+  const bool        useImageSpacing = this->GetUseImageSpacing();
+
+  if (!m_UseWarmStart)
+  {
+    m_WarmStarts.clear();
+  }
+
+  // Only rebuild the hierarchy if the grid or the operator have changed
+  if (size == m_Size && spacing == m_Spacing && useImageSpacing == m_UsedImageSpacing &&
+      m_OperatorType == m_LevelsOperatorType)
+  {
+    return;
+  }
+  m_Size = size;
+  m_Spacing = spacing;
+  m_UsedImageSpacing = useImageSpacing;
+  m_LevelsOperatorType = m_OperatorType;
+
+  // The kept solutions belong to the old grid or operator
+  m_WarmStarts.clear();
+
+  // Derivatives are weighted relative to the mean squared spacing as in the
+  // other regularizers.
+  double scales[ImageDimension];
+  double meanSquaredSpacing = 0.0;
+  for (unsigned int d = 0; d < ImageDimension; ++d)
+  {
+    meanSquaredSpacing += itk::Math::sqr(spacing[d]);
+  }
+  meanSquaredSpacing /= ImageDimension;
+  for (unsigned int d = 0; d < ImageDimension; ++d)
+  {
+    scales[d] = useImageSpacing ? std::sqrt(meanSquaredSpacing) / spacing[d] : 1.0;
+  }
+
+  // Halve each dimension with at least four pixels until no dimension can be
+  // coarsened anymore.
+  const unsigned int numberOfUnknowns = this->GetNumberOfUnknowns();
+  SizeType           levelSize = size;
+  bool               coarsened = true;
+
+  m_Levels.clear();
+  while (coarsened)
+  {
+    LevelType level;
+    level.m_Size = levelSize;
+    level.m_NumberOfPixels = 1;
+    for (unsigned int d = 0; d < ImageDimension; ++d)
+    {
+      level.m_OffsetTable[d] = static_cast<OffsetValueType>(level.m_NumberOfPixels);
+      level.m_NumberOfPixels *= levelSize[d];
+      level.m_Scales[d] = scales[d];
+    }
+    level.m_Solution.assign(level.m_NumberOfPixels * numberOfUnknowns, ValueType{ 0 });
+    level.m_RightHandSide.assign(level.m_NumberOfPixels * numberOfUnknowns, ValueType{ 0 });
+    level.m_Residual.assign(level.m_NumberOfPixels * numberOfUnknowns, ValueType{ 0 });
+    m_Levels.push_back(std::move(level));
+
+    coarsened = false;
+    for (unsigned int d = 0; d < ImageDimension; ++d)
+    {
+      if (levelSize[d] >= 4)
+      {
+        levelSize[d] = (levelSize[d] + 1) / 2;
+        scales[d] /= 2.0;
+        coarsened = true;
+      }
+    }
+  }
+
+  // One sum for each line of the finest level
+  m_LineSums.assign(m_Levels[0].m_NumberOfPixels / size[0], 0.0);
+}
+
+/**
+ * Perform one V-cycle
+ */
+template <typename TDisplacementField>
+void
+VariationalRegistrationMultigridRegularizer<TDisplacementField>::VCycle(unsigned int levelNumber)
+{
+  LevelType & level = m_Levels[levelNumber];
+
+  // The coarsest level has at most three pixels along each dimension and is
+  // solved by relaxation.
+  if (levelNumber + 1 == m_Levels.size())
+  {
+    this->Smooth(level, m_NumberOfCoarsestLevelIterations);
+    return;
+  }
+
+  this->Smooth(level, m_NumberOfSmoothingIterations);
+
+  // Coarse grid correction
+  LevelType & coarse = m_Levels[levelNumber + 1];
+  this->ComputeResidual(level);
+  this->RestrictResidual(level, coarse);
+  std::fill(coarse.m_Solution.begin(), coarse.m_Solution.end(), ValueType{ 0 });
+  this->VCycle(levelNumber + 1);
+  this->ProlongateCorrection(coarse, level);
+
+  this->Smooth(level, m_NumberOfSmoothingIterations);
+}
+
+/**
+ * Red-black (or multicolor) Gauss-Seidel relaxation
+ */
+template <typename TDisplacementField>
+void
+VariationalRegistrationMultigridRegularizer<TDisplacementField>::Smooth(LevelType & level, unsigned int iterations)
+{
+  const unsigned int numberOfUnknowns = this->GetNumberOfUnknowns();
+  const bool         multicolor = (m_OperatorType == OPERATOR_ELASTIC);
+  const unsigned int numberOfColors = multicolor ? (1u << ImageDimension) : 2u;
+  const double       alpha = m_Alpha;
+
+  ValueType *       u = level.m_Solution.data();
+  const ValueType * f = level.m_RightHandSide.data();
+
+  for (unsigned int iteration = 0; iteration < iterations; ++iteration)
+  {
+    for (unsigned int color = 0; color < numberOfColors; ++color)
+    {
+      // Pixels of one color have no neighbors of the same color, so they can
+      // be relaxed in any order.
+      const auto relaxLine = [&](const IndexType & lineIndex, OffsetValueType lineOffset) {
+        IndexValueType start = color & 1u;
+        if (!multicolor)
+        {
+          // The color is the parity of the sum of the index
+          for (unsigned int d = 1; d < ImageDimension; ++d)
+          {
+            start += lineIndex[d];
+          }
+          start &= 1;
+        }
+
+        double    diagonal[2 * ImageDimension];
+        double    sums[2 * ImageDimension];
+        IndexType index = lineIndex;
+        for (index[0] = start; index[0] < static_cast<IndexValueType>(level.m_Size[0]); index[0] += 2)
+        {
+          const OffsetValueType offset = lineOffset + index[0];
+          this->EvaluateStencil(level, index, offset, diagonal, sums);
+
+          ValueType *       ui = u + offset * numberOfUnknowns;
+          const ValueType * fi = f + offset * numberOfUnknowns;
+          if (m_OperatorType == OPERATOR_CURVATURE)
+          {
+            // Solve the 2x2 system of u and v of each component
+            const double k = diagonal[0];
+            for (unsigned int c = 0; c < ImageDimension; ++c)
+            {
+              const double fu = fi[c] - alpha * sums[ImageDimension + c];
+              const double fv = fi[ImageDimension + c] + sums[c];
+              const double uc = (fu + alpha * k * fv) / (1.0 + alpha * k * k);
+              ui[c] = static_cast<ValueType>(uc);
+              ui[ImageDimension + c] = static_cast<ValueType>(fv - k * uc);
+            }
+          }
+          else
+          {
+            for (unsigned int e = 0; e < numberOfUnknowns; ++e)
+            {
+              ui[e] = static_cast<ValueType>((fi[e] + sums[e]) / diagonal[e]);
+            }
+          }
+        }
+      };
+
+      // With multiple colors, the color is the parity of the index in each
+      // dimension, so only the lines of the color are visited.
+      if (multicolor)
+      {
+        this->ParallelizeLinesOfColor(level, color, relaxLine);
+      }
+      else
+      {
+        this->ParallelizeLines(level, relaxLine);
+      }
+    }
+  }
+}
+
+/**
+ * Compute the residual
+ */
+template <typename TDisplacementField>
+double
+VariationalRegistrationMultigridRegularizer<TDisplacementField>::ComputeResidual(LevelType & level)
+{
+  const unsigned int numberOfUnknowns = this->GetNumberOfUnknowns();
+  const double       alpha = m_Alpha;
+
+  const ValueType * u = level.m_Solution.data();
+  const ValueType * f = level.m_RightHandSide.data();
+  ValueType *       r = level.m_Residual.data();
+
+  this->ParallelizeLines(level, [&](const IndexType & lineIndex, OffsetValueType lineOffset) {
+    double    diagonal[2 * ImageDimension];
+    double    sums[2 * ImageDimension];
+    double    residual[2 * ImageDimension];
+    double    sumOfSquares = 0.0;
+    IndexType index = lineIndex;
+    for (index[0] = 0; index[0] < static_cast<IndexValueType>(level.m_Size[0]); ++index[0])
+    {
+      const OffsetValueType offset = lineOffset + index[0];
+      this->EvaluateStencil(level, index, offset, diagonal, sums);
+
+      const ValueType * ui = u + offset * numberOfUnknowns;
+      const ValueType * fi = f + offset * numberOfUnknowns;
+      ValueType *       ri = r + offset * numberOfUnknowns;
+      if (m_OperatorType == OPERATOR_CURVATURE)
+      {
+        const double k = diagonal[0];
+        for (unsigned int c = 0; c < ImageDimension; ++c)
+        {
+          const double uc = ui[c];
+          const double vc = ui[ImageDimension + c];
+          residual[c] = fi[c] - (uc + alpha * (sums[ImageDimension + c] - k * vc));
+          residual[ImageDimension + c] = fi[ImageDimension + c] - (vc + k * uc - sums[c]);
+        }
+      }
+      else
+      {
+        for (unsigned int e = 0; e < numberOfUnknowns; ++e)
+        {
+          residual[e] = fi[e] - (diagonal[e] * ui[e] - sums[e]);
+        }
+      }
+
+      for (unsigned int e = 0; e < numberOfUnknowns; ++e)
+      {
+        ri[e] = static_cast<ValueType>(residual[e]);
+        sumOfSquares += residual[e] * residual[e];
+      }
+    }
+    m_LineSums[lineOffset / level.m_Size[0]] = sumOfSquares;
+  });
+
+  return this->SumLineSums(level);
+}
+
+/**
+ * Add up the sums of the lines of a level
+ */
+template <typename TDisplacementField>
+double
+VariationalRegistrationMultigridRegularizer<TDisplacementField>::SumLineSums(const LevelType & level) const
+{
+  // The lines are added up in a fixed order, so the result does not depend
+  // on the scheduling.
+  const SizeValueType numberOfLines = level.m_NumberOfPixels / level.m_Size[0];
+  double              sum = 0.0;
+  for (SizeValueType line = 0; line < numberOfLines; ++line)
+  {
+    sum += m_LineSums[line];
+  }
+  return sum;
+}
+
+/**
+ * Restrict the residual by averaging the fine pixels of each coarse pixel
+ */
+template <typename TDisplacementField>
+void
+VariationalRegistrationMultigridRegularizer<TDisplacementField>::RestrictResidual(const LevelType & fine,
+                                                                                  LevelType &       coarse)
+{
+  const unsigned int numberOfUnknowns = this->GetNumberOfUnknowns();
+
+  const ValueType * r = fine.m_Residual.data();
+  ValueType *       f = coarse.m_RightHandSide.data();
+
+  this->ParallelizeLines(coarse, [&](const IndexType & lineIndex, OffsetValueType lineOffset) {
+    double    sum[2 * ImageDimension];
+    IndexType index = lineIndex;
+    for (index[0] = 0; index[0] < static_cast<IndexValueType>(coarse.m_Size[0]); ++index[0])
+    {
+      std::fill(sum, sum + numberOfUnknowns, 0.0);
+      unsigned int numberOfChildren = 0;
+
+      // Each coarsened dimension contributes up to two fine pixels
+      for (unsigned int child = 0; child < (1u << ImageDimension); ++child)
+      {
+        OffsetValueType fineOffset = 0;
+        bool            isValid = true;
+        for (unsigned int d = 0; d < ImageDimension && isValid; ++d)
+        {
+          const IndexValueType bit = (child >> d) & 1u;
+          IndexValueType       fineIndex = index[d] + bit;
+          if (fine.m_Size[d] != coarse.m_Size[d])
+          {
+            fineIndex = 2 * index[d] + bit;
+          }
+          isValid = (fine.m_Size[d] != coarse.m_Size[d] || bit == 0) &&
+                    fineIndex < static_cast<IndexValueType>(fine.m_Size[d]);
+          fineOffset += fineIndex * fine.m_OffsetTable[d];
+        }
+        if (isValid)
+        {
+          for (unsigned int e = 0; e < numberOfUnknowns; ++e)
+          {
+            sum[e] += r[fineOffset * numberOfUnknowns + e];
+          }
+          ++numberOfChildren;
+        }
+      }
+
+      ValueType * fi = f + (lineOffset + index[0]) * numberOfUnknowns;
+      for (unsigned int e = 0; e < numberOfUnknowns; ++e)
+      {
+        fi[e] = static_cast<ValueType>(sum[e] / numberOfChildren);
+      }
+    }
+  });
+}
+
+/**
+ * Add the linearly interpolated coarse solution to the fine solution
+ */
+template <typename TDisplacementField>
+void
+VariationalRegistrationMultigridRegularizer<TDisplacementField>::ProlongateCorrection(const LevelType & coarse,
+                                                                                      LevelType &       fine)
+{
+  const unsigned int numberOfUnknowns = this->GetNumberOfUnknowns();
+
+  const ValueType * e = coarse.m_Solution.data();
+  ValueType *       u = fine.m_Solution.data();
+
+  this->ParallelizeLines(fine, [&](const IndexType & lineIndex, OffsetValueType lineOffset) {
+    double    correction[2 * ImageDimension];
+    IndexType index = lineIndex;
+    for (index[0] = 0; index[0] < static_cast<IndexValueType>(fine.m_Size[0]); ++index[0])
+    {
+      std::fill(correction, correction + numberOfUnknowns, 0.0);
+
+      // A fine pixel lies between its coarse pixel (weight 3/4) and the
+      // next coarse pixel in the direction of the fine pixel (weight 1/4)
+      // along each coarsened dimension. At the boundary, the coarse pixel
+      // gets both weights.
+      for (unsigned int neighbor = 0; neighbor < (1u << ImageDimension); ++neighbor)
+      {
+        OffsetValueType coarseOffset = 0;
+        double          weight = 1.0;
+        for (unsigned int d = 0; d < ImageDimension && weight > 0.0; ++d)
+        {
+          const bool     isNext = ((neighbor >> d) & 1u) != 0;
+          IndexValueType coarseIndex = index[d];
+          if (fine.m_Size[d] != coarse.m_Size[d])
+          {
+            coarseIndex = index[d] / 2;
+            if (isNext)
+            {
+              coarseIndex += (index[d] % 2 == 0) ? -1 : 1;
+              coarseIndex =
+                std::min(std::max(coarseIndex, IndexValueType{ 0 }), static_cast<IndexValueType>(coarse.m_Size[d]) - 1);
+            }
+            weight *= isNext ? 0.25 : 0.75;
+          }
+          else if (isNext)
+          {
+            weight = 0.0;
+          }
+          coarseOffset += coarseIndex * coarse.m_OffsetTable[d];
+        }
+        if (weight > 0.0)
+        {
+          for (unsigned int k = 0; k < numberOfUnknowns; ++k)
+          {
+            correction[k] += weight * e[coarseOffset * numberOfUnknowns + k];
+          }
+        }
+      }
+
+      ValueType * ui = u + (lineOffset + index[0]) * numberOfUnknowns;
+      for (unsigned int k = 0; k < numberOfUnknowns; ++k)
+      {
+        ui[k] = static_cast<ValueType>(ui[k] + correction[k]);
+      }
+    }
+  });
+}
+
+/**
+ * Evaluate the stencil of the operator at a pixel
+ */
+template <typename TDisplacementField>
+void
+VariationalRegistrationMultigridRegularizer<TDisplacementField>::EvaluateStencil(const LevelType & level,
+                                                                                 const IndexType & index,
+                                                                                 OffsetValueType   offset,
+                                                                                 double *          diagonal,
+                                                                                 double *          sums) const
+{
+  const unsigned int numberOfUnknowns = this->GetNumberOfUnknowns();
+  const ValueType *  u = level.m_Solution.data();
+
+  // Missing neighbors at the boundary are replaced by the pixel itself
+  // (Neumann boundary conditions), so they do not contribute to the stencil.
+  if (m_OperatorType == OPERATOR_ELASTIC)
+  {
+    const double mu = m_Mu;
+    const double lambdaPlusMu = m_Lambda + m_Mu;
+
+    for (unsigned int c = 0; c < ImageDimension; ++c)
+    {
+      diagonal[c] = 1.0;
+      sums[c] = 0.0;
+    }
+
+    // mu * Laplacian(u_c) + (lambda + mu) * d^2 u_c / dx_c^2
+    for (unsigned int d = 0; d < ImageDimension; ++d)
+    {
+      const double w = itk::Math::sqr(level.m_Scales[d]);
+      for (int direction = -1; direction <= 1; direction += 2)
+      {
+        const IndexValueType neighborIndex = index[d] + direction;
+        if (neighborIndex < 0 || neighborIndex >= static_cast<IndexValueType>(level.m_Size[d]))
+        {
+          continue;
+        }
+        const ValueType * neighbor = u + (offset + direction * level.m_OffsetTable[d]) * numberOfUnknowns;
+        for (unsigned int c = 0; c < ImageDimension; ++c)
+        {
+          const double weight = (c == d) ? (mu + lambdaPlusMu) * w : mu * w;
+          sums[c] += weight * neighbor[c];
+          diagonal[c] += weight;
+        }
+      }
+    }
+
+    // (lambda + mu) * d^2 u_d / (dx_c dx_d) with central differences
+    for (unsigned int c = 0; c < ImageDimension; ++c)
+    {
+      for (unsigned int d = 0; d < ImageDimension; ++d)
+      {
+        if (d == c)
+        {
+          continue;
+        }
+        OffsetValueType step[2][2];
+        for (unsigned int j = 0; j < 2; ++j)
+        {
+          const unsigned int dim = (j == 0) ? c : d;
+          const bool         hasPrevious = index[dim] > 0;
+          const bool         hasNext = index[dim] + 1 < static_cast<IndexValueType>(level.m_Size[dim]);
+          step[j][0] = hasPrevious ? -level.m_OffsetTable[dim] : 0;
+          step[j][1] = hasNext ? level.m_OffsetTable[dim] : 0;
+        }
+        const double mixed = static_cast<double>(u[(offset + step[0][1] + step[1][1]) * numberOfUnknowns + d]) -
+                             u[(offset + step[0][1] + step[1][0]) * numberOfUnknowns + d] -
+                             u[(offset + step[0][0] + step[1][1]) * numberOfUnknowns + d] +
+                             u[(offset + step[0][0] + step[1][0]) * numberOfUnknowns + d];
+        sums[c] += 0.25 * lambdaPlusMu * level.m_Scales[c] * level.m_Scales[d] * mixed;
+      }
+    }
+    return;
+  }
+
+  // Laplacian of all unknowns. The diffusive operator is weighted with alpha,
+  // the curvature operator applies alpha in the relaxation.
+  const double factor = (m_OperatorType == OPERATOR_DIFFUSION) ? static_cast<double>(m_Alpha) : 1.0;
+  double       numberOfNeighbors = 0.0;
+  std::fill(sums, sums + numberOfUnknowns, 0.0);
+  for (unsigned int d = 0; d < ImageDimension; ++d)
+  {
+    const double w = factor * itk::Math::sqr(level.m_Scales[d]);
+    for (int direction = -1; direction <= 1; direction += 2)
+    {
+      const IndexValueType neighborIndex = index[d] + direction;
+      if (neighborIndex < 0 || neighborIndex >= static_cast<IndexValueType>(level.m_Size[d]))
+      {
+        continue;
+      }
+      const ValueType * neighbor = u + (offset + direction * level.m_OffsetTable[d]) * numberOfUnknowns;
+      for (unsigned int e = 0; e < numberOfUnknowns; ++e)
+      {
+        sums[e] += w * neighbor[e];
+      }
+      numberOfNeighbors += w;
+    }
+  }
+
+  if (m_OperatorType == OPERATOR_DIFFUSION)
+  {
+    for (unsigned int e = 0; e < numberOfUnknowns; ++e)
+    {
+      diagonal[e] = 1.0 + numberOfNeighbors;
+    }
+  }
+  else
+  {
+    diagonal[0] = numberOfNeighbors;
+  }
+}
+
+/**
+ * Apply a function to each line of a level in parallel
+ */
+template <typename TDisplacementField>
+template <typename TFunction>
+void
+VariationalRegistrationMultigridRegularizer<TDisplacementField>::ParallelizeLines(const LevelType & level,
+                                                                                  const TFunction & function)
+{
+  const SizeValueType numberOfLines = level.m_NumberOfPixels / level.m_Size[0];
+
+  this->GetMultiThreader()->ParallelizeArray(
+    0,
+    numberOfLines,
+    [&](SizeValueType line) {
+      IndexType       index;
+      OffsetValueType offset = 0;
+      index[0] = 0;
+      for (unsigned int d = 1; d < ImageDimension; ++d)
+      {
+        index[d] = static_cast<IndexValueType>(line % level.m_Size[d]);
+        line /= level.m_Size[d];
+        offset += index[d] * level.m_OffsetTable[d];
+      }
+      function(index, offset);
+    },
+    nullptr);
+}
+
+/**
+ * Apply a function to each line of a level with the parity of a color
+ */
+template <typename TDisplacementField>
+template <typename TFunction>
+void
+VariationalRegistrationMultigridRegularizer<TDisplacementField>::ParallelizeLinesOfColor(const LevelType & level,
+                                                                                         unsigned int      color,
+                                                                                         const TFunction & function)
+{
+  // Number of indices with the parity of the color along each dimension
+  SizeValueType numberOfIndices[ImageDimension];
+  SizeValueType numberOfLines = 1;
+  for (unsigned int d = 1; d < ImageDimension; ++d)
+  {
+    numberOfIndices[d] = (level.m_Size[d] + 1 - ((color >> d) & 1u)) / 2;
+    numberOfLines *= numberOfIndices[d];
+  }
+
+  this->GetMultiThreader()->ParallelizeArray(
+    0,
+    numberOfLines,
+    [&](SizeValueType line) {
+      IndexType       index;
+      OffsetValueType offset = 0;
+      index[0] = 0;
+      for (unsigned int d = 1; d < ImageDimension; ++d)
+      {
+        index[d] = static_cast<IndexValueType>(2 * (line % numberOfIndices[d]) + ((color >> d) & 1u));
+        line /= numberOfIndices[d];
+        offset += index[d] * level.m_OffsetTable[d];
+      }
+      function(index, offset);
+    },
+    nullptr);
+}
+
+/*
+ * Print status information
+ */
+template <typename TDisplacementField>
+void
+VariationalRegistrationMultigridRegularizer<TDisplacementField>::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+
+  os << indent << "OperatorType: ";
+  os << m_OperatorType << std::endl;
+  os << indent << "Alpha: ";
+  os << m_Alpha << std::endl;
+  os << indent << "Mu: ";
+  os << m_Mu << std::endl;
+  os << indent << "Lambda: ";
+  os << m_Lambda << std::endl;
+  os << indent << "MaximumNumberOfCycles: ";
+  os << m_MaximumNumberOfCycles << std::endl;
+  os << indent << "Tolerance: ";
+  os << m_Tolerance << std::endl;
+  os << indent << "NumberOfSmoothingIterations: ";
+  os << m_NumberOfSmoothingIterations << std::endl;
+  os << indent << "NumberOfCoarsestLevelIterations: ";
+  os << m_NumberOfCoarsestLevelIterations << std::endl;
+  os << indent << "UseWarmStart: ";
+  os << m_UseWarmStart << std::endl;
+  os << indent << "NumberOfWarmStartSolutions: ";
+  os << m_WarmStarts.size() << std::endl;
+  os << indent << "ElapsedCycles: ";
+  os << m_ElapsedCycles << std::endl;
+  os << indent << "NumberOfLevels: ";
+  os << m_Levels.size() << std::endl;
+}
+
+} // end namespace itk
+
+#endif
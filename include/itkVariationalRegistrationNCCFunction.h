@@ -19,10 +19,14 @@
 #define itkVariationalRegistrationNCCFunction_h
 
 #include "itkVariationalRegistrationFunction.h"
+#include "itkCentralDifferenceImageFunction.h"
 #include "itkCovariantVector.h"
+#include "itkImage.h"
 #include "itkInterpolateImageFunction.h"
 #include "itkLinearInterpolateImageFunction.h"
-#include "itkCentralDifferenceImageFunction.h"
+#include "itkVector.h"
+
+#include <algorithm>
 
 namespace itk
 {
@@ -49,6 +53,11 @@ namespace itk
  *  Alternative, the classical gradient \f$\nabla M(x+u(x))\f$ can be replaced by \f$\nabla F(x)\f$
  *  or \f$\frac{\nabla F(x) + \nabla M(x+u(x))}{2}\f$.
  *
+ *  The fixed image is constant within a resolution level. Therefore, the local mean
+ *  \f$\bar{F}\f$ and the centred sum of squares \f$\sum_w (F-\bar{F})^2\f$ are computed
+ *  only once per level and stored in a double image. In each iteration, only the sums of
+ *  M, M*M and F*M are computed.
+ *
  *  \sa VariationalRegistrationFilter
  *  \sa VariationalRegistrationFunction
  *
@@ -109,7 +118,13 @@ public:
   using NeighborhoodType = typename Superclass::NeighborhoodType;
   using FloatOffsetType = typename Superclass::FloatOffsetType;
 
-  /** Gradient calculator type. */
+  /** Image gradient types. */
+  using GradientPixelType = typename Superclass::GradientPixelType;
+  using GradientImageType = typename Superclass::GradientImageType;
+
+  /** Gradient calculator type.
+   * \deprecated The functions read the dense gradient images of
+   * VariationalRegistrationFunction; kept for subclasses. */
   using GradientCalculatorType = CentralDifferenceImageFunction<FixedImageType>;
   using GradientCalculatorPointer = typename GradientCalculatorType::Pointer;
 
@@ -124,6 +139,18 @@ public:
                 void *                   globalData,
                 const FloatOffsetType &  offset = FloatOffsetType(0.0)) override;
 
+  /** The updates of this function can be computed line by line. */
+  bool
+  SupportsScanlineUpdate() const override
+  {
+    return true;
+  }
+
+  /** Compute the updates for a contiguous line of pixels along the first
+   * image dimension using raw pointers to the image and gradient buffers. */
+  void
+  ComputeUpdateScanline(const IndexType & index, SizeValueType length, PixelType * update, void * globalData) override;
+
   /** Select that the fixed image gradient is used for computing the forces. */
   virtual void
   SetGradientTypeToFixedImage()
@@ -176,17 +203,125 @@ protected:
     GRADIENT_TYPE_SYMMETRIC = 2
   };
 
-  /** Function to compute derivatives of the fixed image. */
+#if !defined(ITK_LEGACY_REMOVE)
+  /** Function to compute derivatives of the fixed image.
+   * \deprecated Use GetFixedImageGradient(); the calculator is no longer
+   * used by the function itself but still set to the fixed image. */
   GradientCalculatorPointer m_FixedImageGradientCalculator;
 
-  /** Function to compute derivatives of the warped image. */
+  /** Function to compute derivatives of the warped image.
+   * \deprecated Use GetWarpedImageGradient(); the calculator is no longer
+   * used by the function itself but still set to the warped image. */
   GradientCalculatorPointer m_WarpedImageGradientCalculator;
+#endif
+
+  /** Image type of the local fixed image statistics: mean and centred sum of
+   * squares Sum_i (f-meanF)^2 (in this order). Both are stored in double
+   * precision, as the mean is subtracted from the sums of the moving image
+   * in each iteration. */
+  using FixedStatisticsPixelType = Vector<double, 2>;
+  using FixedStatisticsImageType = Image<FixedStatisticsPixelType, ImageDimension>;
+  using FixedStatisticsImagePointer = typename FixedStatisticsImageType::Pointer;
+
+  /** Compute the local fixed image statistics if the fixed image, the
+   * radius or a parameter of the function has changed. */
+  virtual void
+  UpdateFixedStatistics();
+
+  /** Get the local fixed image statistics. */
+  const FixedStatisticsImageType *
+  GetFixedStatistics() const
+  {
+    return m_FixedStatistics.GetPointer();
+  }
+
+  /** Get the center of the intensity range of the fixed image, computed
+   * together with the local fixed image statistics. Subclasses can shift the
+   * intensities by this value to keep the local sums small. */
+  double
+  GetFixedIntensityCenter() const
+  {
+    return m_FixedIntensityCenter;
+  }
+
+  /** Replace each pixel of the image by the sum over its neighborhood (see
+   * SetRadius()). Depending on the boundary condition, the neighborhood is
+   * restricted to the buffered region or the image is padded with mirrored
+   * or clamped ghost cells. */
+  template <typename TImage>
+  void
+  BoxSumImage(TImage * image) const;
+
+  /** Image type of the local sums of f and f*f (in this order). */
+  using FixedSumsPixelType = Vector<double, 2>;
+  using FixedSumsImageType = Image<FixedSumsPixelType, ImageDimension>;
+
+  /** Replace each pixel of the image of f and f*f by the sum over its
+   * neighborhood. The default implementation computes box sums. */
+  virtual void
+  ComputeFixedNeighborhoodSums(FixedSumsImageType * sums) const
+  {
+    this->BoxSumImage(sums);
+  }
+
+  /** Number of pixels in the neighborhood of a position along one dimension. */
+  virtual double
+  GetWindowSize(IndexValueType position,
+                IndexValueType regionStart,
+                SizeValueType  regionSize,
+                unsigned int   dimension) const
+  {
+    const auto radius = static_cast<IndexValueType>(this->GetRadius()[dimension]);
+    if (m_BoundaryCondition != BOUNDARY_CONDITION_CROP)
+    {
+      return static_cast<double>(2 * radius + 1);
+    }
+    const IndexValueType lower = std::max(position - radius, regionStart);
+    const IndexValueType upper = std::min(position + radius, regionStart + static_cast<IndexValueType>(regionSize) - 1);
+    return static_cast<double>(upper - lower + 1);
+  }
+
+  /** Compute the update of one pixel from the local fixed image statistics
+   * and the local sums of m, m*m and f*m (in this order). The gradient has to
+   * be combined and scaled according to the gradient type. Returns the
+   * metric value 1 - CC of the pixel. */
+  double
+  ComputeLocalUpdate(const FixedStatisticsPixelType & fixedStatistics,
+                     const double *                   movingSums,
+                     double                           pixelCounter,
+                     double                           fixedValue,
+                     double                           warpedValue,
+                     const double *                   gradient,
+                     PixelType &                      update) const;
+
+  /** Handling of neighborhoods at the image boundary */
+  enum BoundaryConditionType
+  {
+    BOUNDARY_CONDITION_CROP = 0,
+    BOUNDARY_CONDITION_MIRROR = 1,
+    BOUNDARY_CONDITION_CLAMP = 2
+  };
 
   /** Set if warped or fixed image gradient is used for force computation. */
   GradientType m_GradientType;
 
+  /** Boundary condition of the local sums. Only the box sums support padded
+   * boundary conditions; ComputeUpdate() and ComputeUpdateScanline() of this
+   * class require BOUNDARY_CONDITION_CROP. */
+  BoundaryConditionType m_BoundaryCondition;
+
   /** Precalculated normalizer for spacing consideration. */
   double m_Normalizer;
+
+private:
+  /** Local fixed image statistics and the state they were computed for. */
+  FixedStatisticsImagePointer m_FixedStatistics;
+  double                      m_FixedIntensityCenter;
+  const FixedImageType *      m_FixedStatisticsSource;
+  ModifiedTimeType            m_FixedStatisticsSourceTime;
+  RadiusType                  m_FixedStatisticsRadius;
+  BoundaryConditionType       m_FixedStatisticsBoundaryCondition;
+  ModifiedTimeType            m_FixedStatisticsFunctionTime;
 };
 
 
@@ -19,8 +19,17 @@
 #define itkVariationalRegistrationNCCFunction_hxx
 
 #include "itkVariationalRegistrationNCCFunction.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageScanlineConstIterator.h"
 #include "itkMacro.h"
 #include "itkMath.h"
+#include "itkMultiThreaderBase.h"
+#include "itkNumericTraits.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
 
 namespace itk
 {
@@ -41,9 +50,21 @@ VariationalRegistrationNCCFunction<TFixedImage, TMovingImage, TDisplacementField
 
   m_Normalizer = 1.0;
 
+  m_GradientType = GRADIENT_TYPE_FIXED;
+
+  m_BoundaryCondition = BOUNDARY_CONDITION_CROP;
+
+  m_FixedIntensityCenter = 0.0;
+  m_FixedStatisticsSource = nullptr;
+  m_FixedStatisticsSourceTime = 0;
+  m_FixedStatisticsRadius.Fill(0);
+  m_FixedStatisticsBoundaryCondition = BOUNDARY_CONDITION_CROP;
+  m_FixedStatisticsFunctionTime = 0;
+
+#if !defined(ITK_LEGACY_REMOVE)
   m_FixedImageGradientCalculator = GradientCalculatorType::New();
   m_WarpedImageGradientCalculator = GradientCalculatorType::New();
-  m_GradientType = GRADIENT_TYPE_FIXED;
+#endif
 }
 
 /*
@@ -61,10 +82,16 @@ VariationalRegistrationNCCFunction<TFixedImage, TMovingImage, TDisplacementField
   os << m_Normalizer << std::endl;
   os << indent << "GradientType: ";
   os << m_GradientType << std::endl;
+  os << indent << "BoundaryCondition: ";
+  os << m_BoundaryCondition << std::endl;
+  os << indent << "FixedStatistics: ";
+  os << m_FixedStatistics.GetPointer() << std::endl;
+#if !defined(ITK_LEGACY_REMOVE)
   os << indent << "FixedImageGradientCalculator: ";
   os << m_FixedImageGradientCalculator.GetPointer() << std::endl;
   os << indent << "WarpedImageGradientCalculator: ";
   os << m_WarpedImageGradientCalculator.GetPointer() << std::endl;
+#endif
 }
 
 /*
@@ -92,9 +119,294 @@ VariationalRegistrationNCCFunction<TFixedImage, TMovingImage, TDisplacementField
   }
   m_Normalizer /= static_cast<double>(ImageDimension);
 
-  // setup gradient calculator
+  // compute warped image gradient
+  if (m_GradientType != GRADIENT_TYPE_FIXED)
+  {
+    this->ComputeWarpedImageGradient();
+  }
+
+  // update fixed image gradient; this is only computed once per level
+  if (m_GradientType != GRADIENT_TYPE_WARPED)
+  {
+    this->UpdateFixedImageGradient();
+  }
+
+  // update local fixed image statistics; also only computed once per level
+  this->UpdateFixedStatistics();
+
+#if !defined(ITK_LEGACY_REMOVE)
+  // keep the deprecated gradient calculators usable for subclasses
   m_FixedImageGradientCalculator->SetInputImage(this->GetFixedImage());
   m_WarpedImageGradientCalculator->SetInputImage(this->GetWarpedImage());
+#endif
+}
+
+/*
+ * Compute the local fixed image statistics if the fixed image has changed
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationNCCFunction<TFixedImage, TMovingImage, TDisplacementField>::UpdateFixedStatistics()
+{
+  using RegionType = typename FixedImageType::RegionType;
+  using FixedPixelType = typename FixedImageType::PixelType;
+
+  const FixedImageType * fixedImage = this->GetFixedImage();
+  if (!fixedImage)
+  {
+    itkExceptionMacro(<< "FixedImage not set");
+  }
+
+  // See UpdateFixedImageGradient() for the detection of a new level
+  const ModifiedTimeType fixedImageTime = std::max(fixedImage->GetMTime(), fixedImage->GetUpdateMTime());
+  const RadiusType       radius = this->GetRadius();
+  const ModifiedTimeType functionTime = this->GetMTime();
+  if (m_FixedStatistics && m_FixedStatisticsSource == fixedImage && m_FixedStatisticsSourceTime == fixedImageTime &&
+      m_FixedStatisticsRadius == radius && m_FixedStatisticsBoundaryCondition == m_BoundaryCondition &&
+      m_FixedStatisticsFunctionTime == functionTime)
+  {
+    return;
+  }
+
+  const RegionType region = fixedImage->GetBufferedRegion();
+
+  // Sum up f and f*f in all neighborhoods
+  auto sums = FixedSumsImageType::New();
+  sums->CopyInformation(fixedImage);
+  sums->SetRequestedRegion(region);
+  sums->SetBufferedRegion(region);
+  sums->Allocate();
+
+  // The intensity range is reduced with min and max, so the result does not
+  // depend on the order of the work units.
+  double     fixedMinimum = NumericTraits<double>::max();
+  double     fixedMaximum = NumericTraits<double>::NonpositiveMin();
+  std::mutex rangeLock;
+
+  this->GetMultiThreader()->template ParallelizeImageRegion<ImageDimension>(
+    region,
+    [&](const RegionType & subRegion) {
+      double subRegionMinimum = NumericTraits<double>::max();
+      double subRegionMaximum = NumericTraits<double>::NonpositiveMin();
+
+      ImageScanlineConstIterator<FixedImageType> lineIt(fixedImage, subRegion);
+      while (!lineIt.IsAtEnd())
+      {
+        const IndexType        lineIndex = lineIt.GetIndex();
+        const FixedPixelType * fixedLine = fixedImage->GetBufferPointer() + fixedImage->ComputeOffset(lineIndex);
+        FixedSumsPixelType *   sumsLine = sums->GetBufferPointer() + sums->ComputeOffset(lineIndex);
+        for (SizeValueType x = 0; x < subRegion.GetSize(0); x++)
+        {
+          const auto fixedValue = static_cast<double>(fixedLine[x]);
+          sumsLine[x][0] = fixedValue;
+          sumsLine[x][1] = fixedValue * fixedValue;
+          subRegionMinimum = std::min(subRegionMinimum, fixedValue);
+          subRegionMaximum = std::max(subRegionMaximum, fixedValue);
+        }
+        lineIt.NextLine();
+      }
+
+      std::lock_guard<std::mutex> lock(rangeLock);
+      fixedMinimum = std::min(fixedMinimum, subRegionMinimum);
+      fixedMaximum = std::max(fixedMaximum, subRegionMaximum);
+    },
+    nullptr);
+  m_FixedIntensityCenter = (region.GetNumberOfPixels() > 0) ? 0.5 * (fixedMinimum + fixedMaximum) : 0.0;
+
+  this->ComputeFixedNeighborhoodSums(sums.GetPointer());
+
+  // Compute mean and centred sum of squares
+  if (!m_FixedStatistics || m_FixedStatistics->GetBufferedRegion() != region)
+  {
+    m_FixedStatistics = FixedStatisticsImageType::New();
+    m_FixedStatistics->SetRequestedRegion(region);
+    m_FixedStatistics->SetBufferedRegion(region);
+    m_FixedStatistics->Allocate();
+  }
+  m_FixedStatistics->CopyInformation(fixedImage);
+
+  this->GetMultiThreader()->template ParallelizeImageRegion<ImageDimension>(
+    region,
+    [&](const RegionType & subRegion) {
+      ImageScanlineConstIterator<FixedImageType> lineIt(fixedImage, subRegion);
+      while (!lineIt.IsAtEnd())
+      {
+        const IndexType lineIndex = lineIt.GetIndex();
+
+        // Number of neighborhood pixels across the line is constant
+        double linePixelCounter = 1.0;
+        for (unsigned int d = 1; d < ImageDimension; d++)
+        {
+          linePixelCounter *= this->GetWindowSize(lineIndex[d], region.GetIndex(d), region.GetSize(d), d);
+        }
+
+        const FixedSumsPixelType *      sumsLine = sums->GetBufferPointer() + sums->ComputeOffset(lineIndex);
+        FixedStatisticsPixelType * statisticsLine =
+          m_FixedStatistics->GetBufferPointer() + m_FixedStatistics->ComputeOffset(lineIndex);
+        for (SizeValueType x = 0; x < subRegion.GetSize(0); x++)
+        {
+          const IndexValueType position = lineIndex[0] + static_cast<IndexValueType>(x);
+          const double         pixelCounter =
+            linePixelCounter * this->GetWindowSize(position, region.GetIndex(0), region.GetSize(0), 0);
+          const double sf = sumsLine[x][0];
+          const double sff = sumsLine[x][1];
+
+          // Sum_i (f-meanF)^2 = Sum_i f*f - 2* meanF*Sum_i f + Sum_i meanF*meanF
+          const double fixedMean = sf / pixelCounter;
+          statisticsLine[x][0] = fixedMean;
+          statisticsLine[x][1] = sff - 2 * fixedMean * sf + pixelCounter * fixedMean * fixedMean;
+        }
+        lineIt.NextLine();
+      }
+    },
+    nullptr);
+
+  m_FixedStatisticsSource = fixedImage;
+  m_FixedStatisticsSourceTime = fixedImageTime;
+  m_FixedStatisticsRadius = radius;
+  m_FixedStatisticsBoundaryCondition = m_BoundaryCondition;
+  m_FixedStatisticsFunctionTime = functionTime;
+}
+
+/*
+ * Separable box sum with running sums along each dimension
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+template <typename TImage>
+void
+VariationalRegistrationNCCFunction<TFixedImage, TMovingImage, TDisplacementField>::BoxSumImage(TImage * image) const
+{
+  using RegionType = typename TImage::RegionType;
+  using ImagePixelType = typename TImage::PixelType;
+  using SumPixelType = typename NumericTraits<ImagePixelType>::RealType;
+
+  const RegionType        region = image->GetBufferedRegion();
+  const OffsetValueType * offsetTable = image->GetOffsetTable();
+  const RadiusType        radius = this->GetRadius();
+
+  for (unsigned int d = 0; d < ImageDimension; d++)
+  {
+    const SizeValueType lineLength = region.GetSize(d);
+    const auto          lineRadius = static_cast<SizeValueType>(radius[d]);
+    if (lineRadius == 0)
+    {
+      continue;
+    }
+    const OffsetValueType stride = offsetTable[d];
+
+    // For padded boundary conditions, lineRadius ghost cells are added on both
+    // sides of each line (plus one zero row that keeps the sliding window
+    // update free of branches).
+    const SizeValueType padding = (m_BoundaryCondition == BOUNDARY_CONDITION_CROP) ? 0 : lineRadius;
+    const SizeValueType paddedLength = lineLength + 2 * padding;
+    const auto          sourcePosition = [&](SizeValueType k) -> SizeValueType {
+      const auto position = static_cast<IndexValueType>(k) - static_cast<IndexValueType>(padding);
+      const auto last = static_cast<IndexValueType>(lineLength) - 1;
+      if (m_BoundaryCondition == BOUNDARY_CONDITION_MIRROR && last > 0)
+      {
+        // Reflect at the boundary pixels: ... 2 1 | 0 1 2 ... n-1 | n-2 n-3 ...
+        IndexValueType reflected = std::abs(position) % (2 * last);
+        if (reflected > last)
+        {
+          reflected = 2 * last - reflected;
+        }
+        return static_cast<SizeValueType>(reflected);
+      }
+      return static_cast<SizeValueType>(std::min(std::max(position, IndexValueType{ 0 }), last));
+    };
+
+    // Each work unit processes complete lines along dimension d. For d > 0,
+    // the lines of a row along dimension 0 are processed together such that
+    // all memory accesses are contiguous.
+    this->GetMultiThreader()->template ParallelizeImageRegionRestrictDirection<ImageDimension>(
+      d,
+      region,
+      [&](const RegionType & subRegion) {
+        const SizeValueType bundleWidth = (d == 0) ? 1 : subRegion.GetSize(0);
+
+        std::vector<ImagePixelType> lines((paddedLength + 1) * bundleWidth, NumericTraits<ImagePixelType>::ZeroValue());
+        std::vector<SumPixelType>   sums(bundleWidth);
+
+        RegionType bundleStarts = subRegion;
+        bundleStarts.SetSize(0, 1);
+        bundleStarts.SetSize(d, 1);
+
+        ImageRegionConstIteratorWithIndex<TImage> startIt(image, bundleStarts);
+        for (; !startIt.IsAtEnd(); ++startIt)
+        {
+          ImagePixelType * base = image->GetBufferPointer() + image->ComputeOffset(startIt.GetIndex());
+
+          for (SizeValueType k = 0; k < paddedLength; k++)
+          {
+            const ImagePixelType * in = base + sourcePosition(k) * stride;
+            ImagePixelType *       copy = lines.data() + k * bundleWidth;
+            for (SizeValueType w = 0; w < bundleWidth; w++)
+            {
+              copy[w] = in[w];
+            }
+          }
+
+          // Initial window of the first pixel
+          const SizeValueType initialWindow = std::min(lineRadius + padding + 1, paddedLength);
+          std::fill(sums.begin(), sums.end(), NumericTraits<SumPixelType>::ZeroValue());
+          for (SizeValueType k = 0; k < initialWindow; k++)
+          {
+            const ImagePixelType * copy = lines.data() + k * bundleWidth;
+            for (SizeValueType w = 0; w < bundleWidth; w++)
+            {
+              sums[w] += copy[w];
+            }
+          }
+
+          if (padding == 0)
+          {
+            // Slide the window along the line, restricted to the line
+            for (SizeValueType k = 0; k < lineLength; k++)
+            {
+              ImagePixelType * out = base + k * stride;
+              for (SizeValueType w = 0; w < bundleWidth; w++)
+              {
+                out[w] = static_cast<ImagePixelType>(sums[w]);
+              }
+
+              if (k + lineRadius + 1 < lineLength)
+              {
+                const ImagePixelType * entering = lines.data() + (k + lineRadius + 1) * bundleWidth;
+                for (SizeValueType w = 0; w < bundleWidth; w++)
+                {
+                  sums[w] += entering[w];
+                }
+              }
+              if (k >= lineRadius)
+              {
+                const ImagePixelType * leaving = lines.data() + (k - lineRadius) * bundleWidth;
+                for (SizeValueType w = 0; w < bundleWidth; w++)
+                {
+                  sums[w] -= leaving[w];
+                }
+              }
+            }
+          }
+          else
+          {
+            // Slide the window along the padded line; all windows are complete
+            for (SizeValueType k = 0; k < lineLength; k++)
+            {
+              ImagePixelType *       out = base + k * stride;
+              const ImagePixelType * entering = lines.data() + (k + 2 * lineRadius + 1) * bundleWidth;
+              const ImagePixelType * leaving = lines.data() + k * bundleWidth;
+              for (SizeValueType w = 0; w < bundleWidth; w++)
+              {
+                out[w] = static_cast<ImagePixelType>(sums[w]);
+                sums[w] += entering[w];
+                sums[w] -= leaving[w];
+              }
+            }
+          }
+        }
+      },
+      nullptr);
+  }
 }
 
 /*
@@ -127,118 +439,313 @@ VariationalRegistrationNCCFunction<TFixedImage, TMovingImage, TDisplacementField
   FixedImagePointer fixedImage = this->GetFixedImage();
   FixedImagePointer warpedImage = this->GetWarpedImage();
 
-  //
-  // Get fixed image information and neighborhood radius
-  //
-
-  // Compute sums and mean in local neighborhood
-  // of current position index
+  // Compute sums in local neighborhood of current position index.
+  // Mean and Sum_i (f-meanF)^2 of the fixed image are precomputed.
   // Iterate in current neighborhood to compute the following values:
-  // mean of fixed (f) and warped moving (m) image
-  // Sum f*f, Sum m*m, Sum m*f
-  double             sf = 0.0;
-  double             sm = 0.0;
-  double             sff = 0.0;
-  double             smm = 0.0;
-  double             sfm = 0.0;
+  // Sum m, Sum m*m, Sum m*f
+  double             movingSums[3] = { 0.0, 0.0, 0.0 };
   unsigned int       pixelCounter = 0;
   const unsigned int hoodSize = it.Size();
   for (unsigned int indct = 0; indct < hoodSize; indct++)
   {
     const IndexType neighIndex = it.GetIndex(indct);
-    if (fixedImage->GetLargestPossibleRegion().IsInside(neighIndex))
+    if (fixedImage->GetBufferedRegion().IsInside(neighIndex))
     {
       const auto fixedNeighValue = static_cast<double>(fixedImage->GetPixel(neighIndex));
       const auto movingNeighValue = static_cast<double>(warpedImage->GetPixel(neighIndex));
 
-      sf += fixedNeighValue;
-      sm += movingNeighValue;
-      sff += fixedNeighValue * fixedNeighValue;
-      smm += movingNeighValue * movingNeighValue;
-      sfm += fixedNeighValue * movingNeighValue;
+      movingSums[0] += movingNeighValue;
+      movingSums[1] += movingNeighValue * movingNeighValue;
+      movingSums[2] += fixedNeighValue * movingNeighValue;
       pixelCounter++;
     }
   }
-  const double fixedMean = sf / static_cast<double>(pixelCounter);
-  const double movingMean = sm / static_cast<double>(pixelCounter);
 
-  // Compute Sum_i (f-meanF)^2 , Sum_i (m-meanM)^2, Sum_i (f-meanF)(m-meanM)
-  // Sum_i (f-meanF)^2 = Sum_i f*f - 2* meanF*Sum_i f + Sum_i meanF*meanF
-  // Sum_i (f-meanF)(m-meanM) = Sum_i f*m - meanF*Sum_i m - meanM*Sum_i f + Sum_i meanF*meanM
-  const double SumFF = sff - 2 * fixedMean * sf + pixelCounter * fixedMean * fixedMean;
+  // Compute the gradient of either fixed or warped moving image or as the mean of both (symmetric)
+  CovariantVector<double, ImageDimension> gradient;
+  if (m_GradientType == GRADIENT_TYPE_WARPED)
+  {
+    gradient = this->GetWarpedImageGradient()->GetPixel(index);
+  }
+  else if (m_GradientType == GRADIENT_TYPE_FIXED)
+  {
+    gradient = this->GetFixedImageGradient()->GetPixel(index);
+  }
+  else if (m_GradientType == GRADIENT_TYPE_SYMMETRIC)
+  {
+    gradient = this->GetFixedImageGradient()->GetPixel(index);
+    gradient += this->GetWarpedImageGradient()->GetPixel(index);
+    gradient *= 0.5;
+  }
+  else
+  {
+    itkExceptionMacro(<< "Unknown gradient type!");
+  }
+
+  const double metricValue = this->ComputeLocalUpdate(m_FixedStatistics->GetPixel(index),
+                                                      movingSums,
+                                                      static_cast<double>(pixelCounter),
+                                                      static_cast<double>(fixedImage->GetPixel(index)),
+                                                      static_cast<double>(warpedImage->GetPixel(index)),
+                                                      gradient.GetDataPointer(),
+                                                      update);
+
+  // Update the global data (metric etc.)
+  auto * globalData = (GlobalDataStruct *)gd;
+  if (globalData)
+  {
+    globalData->m_NumberOfPixelsProcessed += 1;
+    globalData->m_SumOfMetricValues += metricValue;
+    globalData->m_SumOfSquaredChange += update.GetSquaredNorm();
+  }
+
+  return update;
+}
+
+/*
+ * Compute the update of one pixel from the local statistics
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+double
+VariationalRegistrationNCCFunction<TFixedImage, TMovingImage, TDisplacementField>::ComputeLocalUpdate(
+  const FixedStatisticsPixelType & fixedStatistics,
+  const double *                   movingSums,
+  double                           pixelCounter,
+  double                           fixedValue,
+  double                           warpedValue,
+  const double *                   gradient,
+  PixelType &                      update) const
+{
+  const double fixedMean = fixedStatistics[0];
+  const double SumFF = fixedStatistics[1];
+  const double sm = movingSums[0];
+  const double smm = movingSums[1];
+  const double sfm = movingSums[2];
+
+  const double movingMean = sm / pixelCounter;
+
+  // Compute Sum_i (m-meanM)^2, Sum_i (f-meanF)(m-meanM); Sum_i (f-meanF)^2 is precomputed
+  // Sum_i (m-meanM)^2 = Sum_i m*m - 2* meanM*Sum_i m + Sum_i meanM*meanM
+  // Sum_i (f-meanF)(m-meanM) = Sum_i f*m - meanF*Sum_i m   (as Sum_i f = N*meanF)
   const double SumMM = smm - 2 * movingMean * sm + pixelCounter * movingMean * movingMean;
-  const double SumFM = sfm - fixedMean * sm - movingMean * sf + pixelCounter * movingMean * fixedMean;
+  const double SumFM = sfm - fixedMean * sm;
 
   // Compute cross correlation and derivative only for non-homogeneous regions
   // cross correlation, if one region is homogeneous is here defined as 1
   double localCrossCorrelation = 1.0;
 
+  update.Fill(0.0);
+
   // check for homogeneous region
   const double SumFFMultSumMM = SumFF * SumMM;
-  // if(SumFF != 0.0 && SumMM != 0.0)
   if (SumFFMultSumMM > 1.e-5)
   {
     // compute local cross correlation
     localCrossCorrelation = SumFM * SumFM / SumFFMultSumMM;
 
-    // Get grayvalues for fixed and warped images
-    const auto warpedValue = static_cast<double>(warpedImage->GetPixel(index));
-    const auto fixedValue = static_cast<double>(fixedImage->GetPixel(index));
-
     const double centerWarpedValue = warpedValue - movingMean;
     const double centerFixedValue = fixedValue - fixedMean;
 
-    typename GradientCalculatorType::OutputType gradient;
+    // Compute the derivative of LCC as given in Hermosillo et al., IJCV 50(3), 2002
+    // and Avants et al., Med Image Anal 12(1), 2008 (except Jacobian term):
+    //
+    //       2* Sum_i (f-meanF)(m-meanM)        (             Sum_i (f-meanF)(m-meanM)          )
+    //    -------------------------------------*( (m-meanM) - ------------------------*(f-meanF)) * gradient f
+    //    Sum_i (f-meanF)^2 * Sum_i (m-meanM)^2 (             Sum_i (f-meanF)^2                 )
+    //
+    const double preComputeFactor =
+      (2.0 * SumFM / SumFFMultSumMM) * (centerWarpedValue - SumFM / SumFF * centerFixedValue);
 
-    // Compute the gradient of either fixed or warped moving image or as the mean of both (symmetric)
-    if (m_GradientType == GRADIENT_TYPE_WARPED)
+    for (unsigned int dim = 0; dim < ImageDimension; dim++)
     {
-      gradient = m_WarpedImageGradientCalculator->EvaluateAtIndex(index);
+      update[dim] = (-1) * preComputeFactor * gradient[dim];
     }
-    else if (m_GradientType == GRADIENT_TYPE_FIXED)
+  }
+
+  // use 1 - CC to get a decreasing metric value
+  return 1.0 - localCrossCorrelation;
+}
+
+/*
+ * Compute updates for a line of pixels
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationNCCFunction<TFixedImage, TMovingImage, TDisplacementField>::ComputeUpdateScanline(
+  const IndexType & index,
+  SizeValueType     length,
+  PixelType *       update,
+  void *            gd)
+{
+  using FixedPixelType = typename FixedImageType::PixelType;
+  using MaskPixelType = typename MaskImageType::PixelType;
+  using RegionType = typename FixedImageType::RegionType;
+
+  // We compute the CC on the fixed and warped moving image
+  // VariationalRegistrationFunction::WarpMovingImage() has to be called before
+  const FixedImageType * fixedImage = this->GetFixedImage();
+  const FixedImageType * warpedImage = this->GetWarpedImage();
+  const MaskImageType *  mask = this->GetMaskImage();
+  const RadiusType       radius = this->GetRadius();
+
+  //
+  // Compute the bounds of all neighborhoods of the line. As in
+  // ComputeUpdate(), neighborhoods are restricted to the image region.
+  //
+  const RegionType & imageRegion = fixedImage->GetBufferedRegion();
+  IndexType          lowerIndex;
+  IndexType          upperIndex;
+  for (unsigned int d = 0; d < ImageDimension; d++)
+  {
+    const IndexValueType imageLower = imageRegion.GetIndex(d);
+    const IndexValueType imageUpper = imageLower + static_cast<IndexValueType>(imageRegion.GetSize(d)) - 1;
+    const IndexValueType lineUpper = (d == 0) ? index[0] + static_cast<IndexValueType>(length) - 1 : index[d];
+
+    lowerIndex[d] = std::max(index[d] - static_cast<IndexValueType>(radius[d]), imageLower);
+    upperIndex[d] = std::min(lineUpper + static_cast<IndexValueType>(radius[d]), imageUpper);
+  }
+
+  //
+  // Sum up m, m*m and f*m of all neighborhood lines in columns along the
+  // first dimension. The local sums of each pixel are then computed by adding
+  // up the 2*radius+1 columns of its neighborhood. The fixed image statistics
+  // are precomputed.
+  //
+  const SizeValueType numberOfColumns = upperIndex[0] - lowerIndex[0] + 1;
+  std::vector<double> columnSums(3 * numberOfColumns, 0.0);
+  double *            columnSumM = columnSums.data();
+  double *            columnSumMM = columnSumM + numberOfColumns;
+  double *            columnSumFM = columnSumMM + numberOfColumns;
+  SizeValueType       numberOfLines = 0;
+
+  IndexType lineIndex = lowerIndex;
+  while (true)
+  {
+    const FixedPixelType * fixedLine = fixedImage->GetBufferPointer() + fixedImage->ComputeOffset(lineIndex);
+    const FixedPixelType * warpedLine = warpedImage->GetBufferPointer() + warpedImage->ComputeOffset(lineIndex);
+    for (SizeValueType c = 0; c < numberOfColumns; c++)
     {
-      gradient = m_FixedImageGradientCalculator->EvaluateAtIndex(index);
+      const auto fixedNeighValue = static_cast<double>(fixedLine[c]);
+      const auto movingNeighValue = static_cast<double>(warpedLine[c]);
+
+      columnSumM[c] += movingNeighValue;
+      columnSumMM[c] += movingNeighValue * movingNeighValue;
+      columnSumFM[c] += fixedNeighValue * movingNeighValue;
     }
-    else if (m_GradientType == GRADIENT_TYPE_SYMMETRIC)
+    numberOfLines++;
+
+    // Go to the next line of the neighborhood
+    unsigned int d = 1;
+    for (; d < ImageDimension; d++)
     {
-      gradient = 0.5 * (m_WarpedImageGradientCalculator->EvaluateAtIndex(index) +
-                        m_FixedImageGradientCalculator->EvaluateAtIndex(index));
+      if (lineIndex[d] < upperIndex[d])
+      {
+        lineIndex[d]++;
+        break;
+      }
+      lineIndex[d] = lowerIndex[d];
     }
-    else
+    if (d == ImageDimension)
     {
-      itkExceptionMacro(<< "Unknown gradient type!");
+      break;
     }
+  }
 
-    // compute the gradient magnitude
-    // const double gradientMagnitude = gradient.GetSquaredNorm();
+  // Get raw pointers to the current line of all buffers
+  const FixedPixelType *           fixedLine = fixedImage->GetBufferPointer() + fixedImage->ComputeOffset(index);
+  const FixedPixelType *           warpedLine = warpedImage->GetBufferPointer() + warpedImage->ComputeOffset(index);
+  const FixedStatisticsPixelType * statisticsLine =
+    m_FixedStatistics->GetBufferPointer() + m_FixedStatistics->ComputeOffset(index);
+  const MaskPixelType * maskLine = mask ? mask->GetBufferPointer() + mask->ComputeOffset(index) : nullptr;
+  const MaskPixelType   maskThreshold = this->GetMaskBackgroundThreshold();
+
+  // Select the gradient; the symmetric gradient is the mean of both gradients.
+  const GradientImageType * gradientImage = nullptr;
+  const GradientImageType * secondGradientImage = nullptr;
+  double                    gradientScale = 1.0;
+  if (m_GradientType == GRADIENT_TYPE_WARPED)
+  {
+    gradientImage = this->GetWarpedImageGradient();
+  }
+  else if (m_GradientType == GRADIENT_TYPE_FIXED)
+  {
+    gradientImage = this->GetFixedImageGradient();
+  }
+  else if (m_GradientType == GRADIENT_TYPE_SYMMETRIC)
+  {
+    gradientImage = this->GetFixedImageGradient();
+    secondGradientImage = this->GetWarpedImageGradient();
+    gradientScale = 0.5;
+  }
+  else
+  {
+    itkExceptionMacro(<< "Unknown gradient type!");
+  }
+  const GradientPixelType * gradientLine = gradientImage->GetBufferPointer() + gradientImage->ComputeOffset(index);
+  const GradientPixelType * secondGradientLine =
+    secondGradientImage ? secondGradientImage->GetBufferPointer() + secondGradientImage->ComputeOffset(index)
+                        : nullptr;
 
-    // Compute the derivative of LCC as given in Hermosillo et al., IJCV 50(3), 2002
-    // and Avants et al., Med Image Anal 12(1), 2008 (except Jacobian term):
-    //
-    //       2* Sum_i (f-meanF)(m-meanM)        (             Sum_i (f-meanF)(m-meanM)          )
-    //    -------------------------------------*( (m-meanM) - ------------------------*(f-meanF)) * gradient f
-    //    Sum_i (f-meanF)^2 * Sum_i (m-meanM)^2 (             Sum_i (f-meanF)^2                 )
-    //
-    const double preComputeFactor =
-      (2.0 * SumFM / SumFFMultSumMM) * (centerWarpedValue - SumFM / SumFF * centerFixedValue);
+  double        sumOfMetricValues = 0.0;
+  SizeValueType numberOfPixelsProcessed = 0;
+  double        sumOfSquaredChange = 0.0;
+
+  const auto radius0 = static_cast<IndexValueType>(radius[0]);
+  for (SizeValueType i = 0; i < length; i++)
+  {
+    // initialize update value to compute with zero
+    update[i].Fill(0.0);
+
+    // Check if pixel lies inside mask
+    if (maskLine && maskLine[i] <= maskThreshold)
+    {
+      continue;
+    }
+
+    // Add up the columns of the neighborhood
+    const IndexValueType x = index[0] + static_cast<IndexValueType>(i);
+    const SizeValueType  firstColumn = std::max(x - radius0, lowerIndex[0]) - lowerIndex[0];
+    const SizeValueType  lastColumn = std::min(x + radius0, upperIndex[0]) - lowerIndex[0];
 
+    double movingSums[3] = { 0.0, 0.0, 0.0 };
+    for (SizeValueType c = firstColumn; c <= lastColumn; c++)
+    {
+      movingSums[0] += columnSumM[c];
+      movingSums[1] += columnSumMM[c];
+      movingSums[2] += columnSumFM[c];
+    }
+    const auto pixelCounter = static_cast<double>(numberOfLines * (lastColumn - firstColumn + 1));
+
+    double gradient[ImageDimension];
     for (unsigned int dim = 0; dim < ImageDimension; dim++)
     {
-      update[dim] = (-1) * preComputeFactor * gradient[dim];
+      gradient[dim] = gradientLine[i][dim];
+      if (secondGradientLine)
+      {
+        gradient[dim] += secondGradientLine[i][dim];
+      }
+      gradient[dim] *= gradientScale;
     }
+
+    sumOfMetricValues += this->ComputeLocalUpdate(statisticsLine[i],
+                                                  movingSums,
+                                                  pixelCounter,
+                                                  static_cast<double>(fixedLine[i]),
+                                                  static_cast<double>(warpedLine[i]),
+                                                  gradient,
+                                                  update[i]);
+    numberOfPixelsProcessed++;
+    sumOfSquaredChange += update[i].GetSquaredNorm();
   }
 
   // Update the global data (metric etc.)
   auto * globalData = (GlobalDataStruct *)gd;
   if (globalData)
   {
-    globalData->m_NumberOfPixelsProcessed += 1;
-    // use 1 - CC to get a decreasing metric value
-    globalData->m_SumOfMetricValues += 1.0 - localCrossCorrelation;
-    globalData->m_SumOfSquaredChange += update.GetSquaredNorm();
+    globalData->m_NumberOfPixelsProcessed += numberOfPixelsProcessed;
+    globalData->m_SumOfMetricValues += sumOfMetricValues;
+    globalData->m_SumOfSquaredChange += sumOfSquaredChange;
   }
-
-  return update;
 }
 
 } // end namespace itk
@@ -80,6 +80,48 @@ public:
   /** Set whether the image spacing should be considered or not */
   itkBooleanMacro(UseImageSpacing);
 
+  /** Returns whether the regularizer supports UseIncrementalUpdate. */
+  virtual bool
+  SupportsIncrementalUpdate() const
+  {
+    return false;
+  }
+
+  /** Set/Get whether the regularizer keeps the last regularized field. If
+   * on, the input has to be the last output plus an increment; only the
+   * increment is processed. It is added to the kept field, which is
+   * regularized again (see RegularizeIncrement). Ignored if
+   * SupportsIncrementalUpdate() is false. Default is off. */
+  itkSetMacro(UseIncrementalUpdate, bool);
+  itkGetConstMacro(UseIncrementalUpdate, bool);
+  itkBooleanMacro(UseIncrementalUpdate);
+
+  /** Set/Get whether the increment is regularized before it is added to the
+   * kept field with UseIncrementalUpdate, i.e. whether the update and the
+   * field are smoothed in one call as with SmoothUpdateField and
+   * SmoothDisplacementField of VariationalRegistrationFilter. If off, the
+   * increment is only regularized with the field as with
+   * SmoothDisplacementField alone. Default is on. */
+  itkSetMacro(RegularizeIncrement, bool);
+  itkGetConstMacro(RegularizeIncrement, bool);
+  itkBooleanMacro(RegularizeIncrement);
+
+  /** Set/Get a field that is contained in the increment, multiplied with
+   * UnregularizedIncrementScale, but is not regularized before it is added
+   * to the kept field even with RegularizeIncrement on. It is only used with
+   * UseIncrementalUpdate and RegularizeIncrement. Default is none. */
+  itkSetConstObjectMacro(UnregularizedIncrement, DisplacementFieldType);
+  itkGetConstObjectMacro(UnregularizedIncrement, DisplacementFieldType);
+
+  /** Set/Get the factor of the UnregularizedIncrement. Default is 1. */
+  itkSetMacro(UnregularizedIncrementScale, double);
+  itkGetConstMacro(UnregularizedIncrementScale, double);
+
+  /** Discard the kept field, so the next input is regularized completely. */
+  virtual void
+  ResetIncrementalUpdate()
+  {}
+
 protected:
   VariationalRegistrationRegularizer();
   ~VariationalRegistrationRegularizer() override = default;
@@ -95,6 +137,15 @@ protected:
 private:
   /** A boolean that indicates, if image spacing is considered. */
   bool m_UseImageSpacing;
+
+  /** Keep the last regularized field. */
+  bool m_UseIncrementalUpdate;
+
+  /** Regularize the increment before it is added to the kept field, except
+   * for the unregularized increment. */
+  bool                          m_RegularizeIncrement;
+  DisplacementFieldConstPointer m_UnregularizedIncrement;
+  double                        m_UnregularizedIncrementScale;
 };
 
 } // namespace itk
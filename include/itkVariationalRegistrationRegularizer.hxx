@@ -33,6 +33,9 @@ VariationalRegistrationRegularizer<TDisplacementField>::VariationalRegistrationR
 {
   // Initialize default values.
   m_UseImageSpacing = true;
+  m_UseIncrementalUpdate = false;
+  m_RegularizeIncrement = true;
+  m_UnregularizedIncrementScale = 1.0;
 }
 
 /*
@@ -46,6 +49,14 @@ VariationalRegistrationRegularizer<TDisplacementField>::PrintSelf(std::ostream &
 
   os << indent << "UseImageSpacing: ";
   os << m_UseImageSpacing << std::endl;
+  os << indent << "UseIncrementalUpdate: ";
+  os << m_UseIncrementalUpdate << std::endl;
+  os << indent << "RegularizeIncrement: ";
+  os << m_RegularizeIncrement << std::endl;
+  os << indent << "UnregularizedIncrement: ";
+  os << m_UnregularizedIncrement.GetPointer() << std::endl;
+  os << indent << "UnregularizedIncrementScale: ";
+  os << m_UnregularizedIncrementScale << std::endl;
 }
 
 } // end namespace itk
@@ -20,6 +20,10 @@
 
 #include "itkVariationalRegistrationSSDFunction.h"
 #include "itkMath.h"
+#include "itkVariationalRegistrationForceKernels.h"
+
+#include <algorithm>
+#include <type_traits>
 
 namespace itk
 {
@@ -40,10 +44,10 @@ VariationalRegistrationSSDFunction<TFixedImage, TMovingImage, TDisplacementField
   m_IntensityDifferenceThreshold = 0.001;
 
   m_Normalizer = 1.0;
-  m_FixedImageGradientCalculator = GradientCalculatorType::New();
-  m_WarpedImageGradientCalculator = GradientCalculatorType::New();
 
   m_GradientType = GRADIENT_TYPE_WARPED;
+
+  m_UseVectorizedForces = true;
 }
 
 /**
@@ -68,9 +72,17 @@ VariationalRegistrationSSDFunction<TFixedImage, TMovingImage, TDisplacementField
   }
   m_Normalizer /= static_cast<double>(ImageDimension);
 
-  // setup gradient calculator
-  m_WarpedImageGradientCalculator->SetInputImage(this->GetWarpedImage());
-  m_FixedImageGradientCalculator->SetInputImage(this->GetFixedImage());
+  // compute warped image gradient
+  if (m_GradientType != GRADIENT_TYPE_FIXED)
+  {
+    this->ComputeWarpedImageGradient();
+  }
+
+  // update fixed image gradient; this is only computed once per level
+  if (m_GradientType != GRADIENT_TYPE_WARPED)
+  {
+    this->UpdateFixedImageGradient();
+  }
 }
 
 /**
@@ -110,22 +122,22 @@ VariationalRegistrationSSDFunction<TFixedImage, TMovingImage, TDisplacementField
   }
   else
   {
-    typename GradientCalculatorType::OutputType gradient;
+    CovariantVector<double, ImageDimension> gradient;
 
     // Compute the gradient of either fixed or moving image
     if (m_GradientType == GRADIENT_TYPE_WARPED)
     {
-      gradient = m_WarpedImageGradientCalculator->EvaluateAtIndex(index);
+      gradient = this->GetWarpedImageGradient()->GetPixel(index);
     }
     else if (m_GradientType == GRADIENT_TYPE_FIXED)
     {
-      gradient = m_FixedImageGradientCalculator->EvaluateAtIndex(index);
+      gradient = this->GetFixedImageGradient()->GetPixel(index);
     }
     else if (m_GradientType == GRADIENT_TYPE_SYMMETRIC)
     {
       // Does not have to be divided by 2, normalization is done afterwards
-      gradient = m_WarpedImageGradientCalculator->EvaluateAtIndex(index) +
-                 m_FixedImageGradientCalculator->EvaluateAtIndex(index);
+      gradient = this->GetFixedImageGradient()->GetPixel(index);
+      gradient += this->GetWarpedImageGradient()->GetPixel(index);
     }
     else
     {
@@ -150,6 +162,153 @@ VariationalRegistrationSSDFunction<TFixedImage, TMovingImage, TDisplacementField
   return update;
 }
 
+/**
+ * Compute updates for a line of pixels
+ */
+template <typename TFixedImage, typename TMovingImage, typename TDisplacementField>
+void
+VariationalRegistrationSSDFunction<TFixedImage, TMovingImage, TDisplacementField>::ComputeUpdateScanline(
+  const IndexType & index,
+  SizeValueType     length,
+  PixelType *       update,
+  void *            gd)
+{
+  using FixedPixelType = typename FixedImageType::PixelType;
+  using MaskPixelType = typename MaskImageType::PixelType;
+
+  // VariationalRegistrationFunction::WarpMovingImage() has to be called before
+  const FixedImageType * fixedImage = this->GetFixedImage();
+  const FixedImageType * warpedImage = this->GetWarpedImage();
+  const MaskImageType *  mask = this->GetMaskImage();
+
+  // Get raw pointers to the current line of all buffers
+  const FixedPixelType * fixedLine = fixedImage->GetBufferPointer() + fixedImage->ComputeOffset(index);
+  const FixedPixelType * warpedLine = warpedImage->GetBufferPointer() + warpedImage->ComputeOffset(index);
+  const MaskPixelType *  maskLine = mask ? mask->GetBufferPointer() + mask->ComputeOffset(index) : nullptr;
+  const MaskPixelType    maskThreshold = this->GetMaskBackgroundThreshold();
+
+  // Select the gradient; the symmetric gradient is the sum of both gradients.
+  // Does not have to be divided by 2, normalization is done afterwards
+  const GradientImageType * gradientImage = nullptr;
+  const GradientImageType * secondGradientImage = nullptr;
+  if (m_GradientType == GRADIENT_TYPE_WARPED)
+  {
+    gradientImage = this->GetWarpedImageGradient();
+  }
+  else if (m_GradientType == GRADIENT_TYPE_FIXED)
+  {
+    gradientImage = this->GetFixedImageGradient();
+  }
+  else if (m_GradientType == GRADIENT_TYPE_SYMMETRIC)
+  {
+    gradientImage = this->GetFixedImageGradient();
+    secondGradientImage = this->GetWarpedImageGradient();
+  }
+  else
+  {
+    itkExceptionMacro(<< "Unknown gradient type!");
+  }
+  const GradientPixelType * gradientLine = gradientImage->GetBufferPointer() + gradientImage->ComputeOffset(index);
+  const GradientPixelType * secondGradientLine =
+    secondGradientImage ? secondGradientImage->GetBufferPointer() + secondGradientImage->ComputeOffset(index)
+                        : nullptr;
+
+  double        sumOfMetricValues = 0.0;
+  SizeValueType numberOfPixelsProcessed = 0;
+  double        sumOfSquaredChange = 0.0;
+
+  // The single precision row kernels need float gradient and update vectors
+  using GradientValueType = typename GradientPixelType::ValueType;
+  using UpdateValueType = typename PixelType::ValueType;
+  const bool useKernel = m_UseVectorizedForces && std::is_same<GradientValueType, float>::value &&
+                         std::is_same<UpdateValueType, float>::value &&
+                         sizeof(GradientPixelType) == ImageDimension * sizeof(float) &&
+                         sizeof(PixelType) == ImageDimension * sizeof(float);
+  const VariationalRegistrationForceKernels::SSDKernelType<ImageDimension> kernel =
+    useKernel ? VariationalRegistrationForceKernels::GetSSDKernel<ImageDimension>() : nullptr;
+  if (kernel)
+  {
+    // The kernel works on the interleaved gradient and update buffers; the
+    // intensities and the mask are converted in chunks
+    constexpr SizeValueType chunkLength = VariationalRegistrationForceKernels::ChunkLength;
+    float                   fixedChunk[chunkLength];
+    float                   warpedChunk[chunkLength];
+    unsigned char           insideChunk[chunkLength];
+    for (SizeValueType start = 0; start < length; start += chunkLength)
+    {
+      const SizeValueType n = std::min(chunkLength, length - start);
+      if (maskLine)
+      {
+        numberOfPixelsProcessed +=
+          VariationalRegistrationForceKernels::GetInsideFlags(maskLine + start, maskThreshold, n, insideChunk);
+      }
+      else
+      {
+        numberOfPixelsProcessed += n;
+      }
+
+      kernel(n,
+             VariationalRegistrationForceKernels::GetFloatRow(fixedLine + start, n, fixedChunk),
+             VariationalRegistrationForceKernels::GetFloatRow(warpedLine + start, n, warpedChunk),
+             reinterpret_cast<const float *>(gradientLine + start),
+             secondGradientLine ? reinterpret_cast<const float *>(secondGradientLine + start) : nullptr,
+             maskLine ? insideChunk : nullptr,
+             reinterpret_cast<float *>(update + start),
+             m_IntensityDifferenceThreshold,
+             sumOfMetricValues,
+             sumOfSquaredChange);
+    }
+  }
+  else
+  {
+    // The forces are computed in double precision directly on the
+    // interleaved buffers; the operations are the same as in ComputeUpdate().
+    for (SizeValueType p = 0; p < length; p++)
+    {
+      // Check if pixel lies inside mask
+      if (maskLine && maskLine[p] <= maskThreshold)
+      {
+        update[p] = m_ZeroUpdateReturn;
+        continue;
+      }
+
+      // Calculate speed value
+      const double speedValue = static_cast<double>(fixedLine[p]) - static_cast<double>(warpedLine[p]);
+
+      // Zero update if intensities match
+      if (itk::Math::abs(speedValue) < m_IntensityDifferenceThreshold)
+      {
+        update[p] = m_ZeroUpdateReturn;
+      }
+      else
+      {
+        for (unsigned int j = 0; j < ImageDimension; j++)
+        {
+          double gradient = gradientLine[p][j];
+          if (secondGradientLine)
+          {
+            gradient += secondGradientLine[p][j];
+          }
+          update[p][j] = static_cast<typename PixelType::ValueType>(speedValue * gradient);
+        }
+      }
+
+      numberOfPixelsProcessed++;
+      sumOfMetricValues += itk::Math::sqr(speedValue);
+      sumOfSquaredChange += update[p].GetSquaredNorm();
+    }
+  }
+
+  // Update the global data (metric etc.)
+  auto * globalData = (GlobalDataStruct *)gd;
+  if (globalData)
+  {
+    globalData->m_NumberOfPixelsProcessed += numberOfPixelsProcessed;
+    globalData->m_SumOfMetricValues += sumOfMetricValues;
+    globalData->m_SumOfSquaredChange += sumOfSquaredChange;
+  }
+}
+
 /**
  * Standard "PrintSelf" method.
  */
@@ -160,10 +319,6 @@ VariationalRegistrationSSDFunction<TFixedImage, TMovingImage, TDisplacementField
 {
   Superclass::PrintSelf(os, indent);
 
-  os << indent << "FixedImageGradientCalculator: ";
-  os << m_FixedImageGradientCalculator.GetPointer() << std::endl;
-  os << indent << "WarpedImageGradientCalculator: ";
-  os << m_WarpedImageGradientCalculator.GetPointer() << std::endl;
   os << indent << "GradientType: ";
   os << m_GradientType << std::endl;
 
@@ -171,6 +326,8 @@ VariationalRegistrationSSDFunction<TFixedImage, TMovingImage, TDisplacementField
   os << m_IntensityDifferenceThreshold << std::endl;
   os << indent << "Normalizer: ";
   os << m_Normalizer << std::endl;
+  os << indent << "UseVectorizedForces: ";
+  os << m_UseVectorizedForces << std::endl;
 }
 
 } // end namespace itk
@@ -177,6 +177,15 @@ protected:
   /** The type of region used for multithreading */
   using ThreadRegionType = typename UpdateBufferType::RegionType;
 
+  /** The backward update is not smoothed with SmoothUpdateField, so it is the
+   * unsmoothed part of the increment, with the factor -dt/2. */
+  const UpdateBufferType *
+  GetUnsmoothedIncrement(const TimeStepType & dt, double & scale) override
+  {
+    scale = -0.5 * dt;
+    return m_BackwardUpdateBuffer;
+  }
+
   /** Threaded version of ApplyUpdate that adds forward and backward fields  */
   void
   ThreadedApplyUpdate(const TimeStepType &     dt,
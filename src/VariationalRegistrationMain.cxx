@@ -70,14 +70,15 @@ extern "C"
 #include "itkVariationalRegistrationSSDFunction.h"
 #include "itkVariationalRegistrationNCCFunction.h"
 #include "itkVariationalRegistrationFastNCCFunction.h"
+#include "itkVariationalRegistrationGaussianNCCFunction.h"
+#include "itkVariationalRegistrationMIFunction.h"
 
 #include "itkVariationalRegistrationRegularizer.h"
 #include "itkVariationalRegistrationGaussianRegularizer.h"
 #include "itkVariationalRegistrationDiffusionRegularizer.h"
-#if defined(ITK_USE_FFTWD) || defined(ITK_USE_FFTWF)
-#  include "itkVariationalRegistrationElasticRegularizer.h"
-#  include "itkVariationalRegistrationCurvatureRegularizer.h"
-#endif
+#include "itkVariationalRegistrationElasticRegularizer.h"
+#include "itkVariationalRegistrationCurvatureRegularizer.h"
+#include "itkVariationalRegistrationMultigridRegularizer.h"
 
 #include "itkVariationalRegistrationStopCriterion.h"
 #include "itkVariationalRegistrationLogger.h"
@@ -145,24 +146,56 @@ PrintHelp()
   std::cout << "                               diffeomorphic registration (search space 1 or 2)." << std::endl;
   std::cout << std::endl;
   std::cout << "  Parameters for regularizer:" << std::endl;
-  std::cout << "    -r 0|1|2|3               Select regularizer." << std::endl;
+  std::cout << "    -r 0|1|2|3|4             Select regularizer." << std::endl;
   std::cout << "                               0: Gaussian smoother." << std::endl;
   std::cout << "                               1: Diffusive regularizer (default)." << std::endl;
   std::cout << "                               2: Elastic regularizer." << std::endl;
   std::cout << "                               3: Curvature regularizer." << std::endl;
-  std::cout << "    -a <alpha>               Alpha for the regularization (only diffusive or curvature)." << std::endl;
+  std::cout << "                               4: Multigrid regularizer." << std::endl;
+  std::cout << "    -o 0|1|2                 Select operator (only multigrid)." << std::endl;
+  std::cout << "                               0: Diffusive (default)." << std::endl;
+  std::cout << "                               1: Elastic." << std::endl;
+  std::cout << "                               2: Curvature." << std::endl;
+  std::cout << "    -a <alpha>               Alpha for the regularization (only diffusive, curvature or multigrid)."
+            << std::endl;
   std::cout << "    -v <variance>            Variance for the regularization (only gaussian)." << std::endl;
-  std::cout << "    -m <mu>                  Mu for the regularization (only elastic)." << std::endl;
-  std::cout << "    -b <lambda>              Lambda for the regularization (only elasic)." << std::endl;
+  std::cout << "    -c 0|1                   Select Gaussian filter (only gaussian)." << std::endl;
+  std::cout << "                               0: Truncated Gaussian kernel (default)." << std::endl;
+  std::cout << "                               1: Recursive Gaussian filter." << std::endl;
+  std::cout << "    -m <mu>                  Mu for the regularization (only elastic or multigrid)." << std::endl;
+  std::cout << "    -b <lambda>              Lambda for the regularization (only elasic or multigrid)." << std::endl;
+  std::cout << "    -w <wisdom file>         FFTW wisdom file (only elastic or curvature with FFTW)." << std::endl;
+  std::cout << "    -y 0|1|2                 Select FFTW planner effort (only elastic or curvature)." << std::endl;
+  std::cout << "                               0: Estimate." << std::endl;
+  std::cout << "                               1: Measure (default)." << std::endl;
+  std::cout << "                               2: Patient." << std::endl;
+  std::cout << "    -z 0|1                   Pad FFTs to sizes with small prime factors (only elastic or curvature)."
+            << std::endl;
+  std::cout << "                               0: No padding." << std::endl;
+  std::cout << "                               1: Padding." << std::endl;
+  std::cout << "                               Default: Padding for the bundled mixed radix backend only." << std::endl;
+  std::cout << "    -j 0|1                   Select FFT backend (only elastic or curvature)." << std::endl;
+  std::cout << "                               0: FFTW if available, bundled otherwise (default)." << std::endl;
+  std::cout << "                               1: Bundled mixed radix FFT." << std::endl;
   std::cout << std::endl;
   std::cout << "  Parameters for registration function:" << std::endl;
-  std::cout << "    -f 0|1|2                 Select force term." << std::endl;
+  std::cout << "    -f 0|1|2|3|4             Select force term." << std::endl;
   std::cout << "                               0: Demon forces (default)." << std::endl;
   std::cout << "                               1: Sum of Squared Differences." << std::endl;
   std::cout << "                               2: Normalized Cross Correlation." << std::endl;
-  std::cout << "                               3: Normalized Mutual Information (NYI)." << std::endl;
+  std::cout << "                               3: Mutual Information." << std::endl;
+  std::cout << "                               4: Normalized Cross Correlation with Gaussian window." << std::endl;
   std::cout << "    -q <radius>              Radius of neighborhood size for Normalized Cross Correlation."
             << std::endl;
+  std::cout << "    -G <sigma>               Standard deviation of the Gaussian window in pixels (only force term 4,"
+            << std::endl;
+  std::cout << "                               default 2)." << std::endl;
+  std::cout << "    -B 0|1|2                 Select boundary condition for Normalized Cross Correlation." << std::endl;
+  std::cout << "                               0: Crop neighborhoods at the image boundary (default)." << std::endl;
+  std::cout << "                               1: Mirror the images at the boundary." << std::endl;
+  std::cout << "                               2: Clamp the images at the boundary." << std::endl;
+  std::cout << "    -k <bins>                Number of histogram bins for Mutual Information (default 32)."
+            << std::endl;
   std::cout << "    -d 0|1|2                 Select image domain for force calculation." << std::endl;
   std::cout << "                               0: Warped image forces (default)." << std::endl;
   std::cout << "                               1: Fixed image forces." << std::endl;
@@ -224,6 +257,7 @@ main(int argc, char * argv[])
   char * warpedImageFilename = nullptr;
   char * initialFieldFilename = nullptr;
   char * logFilename = nullptr;
+  char * fftWisdomFilename = nullptr;
 
   // Registration parameters
   int    numberOfIterations = 400;
@@ -237,10 +271,18 @@ main(int argc, char * argv[])
   int   regularizerType = 1; // Diffusive
   float regulAlpha = 0.5;
   float regulVar = 0.5;
+  bool  useRecursiveGaussian = false;
+  int   multigridOperator = 0; // Diffusive
   float regulMu = 0.5;
   float regulLambda = 0.5;
+  int   fftPlannerEffort = 1; // Measure
+  int   fftPadding = -1;      // Default of the FFT backend
+  int   fftBackend = 0;       // Default backend
 
-  int nccRadius = 2;
+  int    nccRadius = 2;
+  int    nccBoundaryCondition = 0; // Crop
+  double nccSigma = 2.0;
+  int    miBins = 32;
 
   // Force parameters
   int forceType = 0;   // Demon
@@ -256,7 +298,8 @@ main(int argc, char * argv[])
   bool bWrite3DDisplacementField = false;
 
   // Reading parameters
-  while ((c = getopt(argc, argv, "F:R:M:T:S:I:D:O:V:W:L:i:n:l:t:s:u:e:r:a:v:m:b:f:d:p:g:h:q:x?3")) != -1)
+  const char * options = "F:R:M:T:S:I:D:O:V:W:L:B:G:i:n:l:t:s:u:e:r:o:a:v:c:m:b:w:y:z:j:f:d:p:g:h:q:k:x?3";
+  while ((c = getopt(argc, argv, options)) != -1)
   {
     switch (c)
     {
@@ -362,12 +405,36 @@ main(int argc, char * argv[])
         {
           std::cout << "  Regularizer:                     Curvature" << std::endl;
         }
+        else if (regularizerType == 4)
+        {
+          std::cout << "  Regularizer:                     Multigrid" << std::endl;
+        }
         else
         {
           ExceptionMacro("Regularizer space unknown!");
           return EXIT_FAILURE;
         }
         break;
+      case 'o':
+        multigridOperator = std::stoi(optarg);
+        if (multigridOperator == 0)
+        {
+          std::cout << "  Multigrid operator:              Diffusive" << std::endl;
+        }
+        else if (multigridOperator == 1)
+        {
+          std::cout << "  Multigrid operator:              Elastic" << std::endl;
+        }
+        else if (multigridOperator == 2)
+        {
+          std::cout << "  Multigrid operator:              Curvature" << std::endl;
+        }
+        else
+        {
+          ExceptionMacro("Multigrid operator unknown!");
+          return EXIT_FAILURE;
+        }
+        break;
       case 'a':
         regulAlpha = std::stod(optarg);
         std::cout << "  Regularization alpha:            " << regulAlpha << std::endl;
@@ -376,6 +443,19 @@ main(int argc, char * argv[])
         regulVar = std::stod(optarg);
         std::cout << "  Regularization variance:         " << regulVar << std::endl;
         break;
+      case 'c':
+        intVal = std::stoi(optarg);
+        if (intVal == 0)
+        {
+          std::cout << "  Gaussian filter:                 Truncated kernel" << std::endl;
+          useRecursiveGaussian = false;
+        }
+        else
+        {
+          std::cout << "  Gaussian filter:                 Recursive" << std::endl;
+          useRecursiveGaussian = true;
+        }
+        break;
       case 'm':
         regulMu = std::stod(optarg);
         std::cout << "  Regularization mu:               " << regulMu << std::endl;
@@ -384,6 +464,59 @@ main(int argc, char * argv[])
         regulLambda = std::stod(optarg);
         std::cout << "  Regularization lambda:           " << regulLambda << std::endl;
         break;
+      case 'w':
+        fftWisdomFilename = optarg;
+        std::cout << "  FFTW wisdom file:                " << fftWisdomFilename << std::endl;
+        break;
+      case 'y':
+        fftPlannerEffort = std::stoi(optarg);
+        if (fftPlannerEffort == 0)
+        {
+          std::cout << "  FFTW planner effort:             Estimate" << std::endl;
+        }
+        else if (fftPlannerEffort == 1)
+        {
+          std::cout << "  FFTW planner effort:             Measure" << std::endl;
+        }
+        else if (fftPlannerEffort == 2)
+        {
+          std::cout << "  FFTW planner effort:             Patient" << std::endl;
+        }
+        else
+        {
+          ExceptionMacro("FFTW planner effort unknown!");
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'z':
+        intVal = std::stoi(optarg);
+        if (intVal == 0)
+        {
+          std::cout << "  FFT padding:                     false" << std::endl;
+          fftPadding = 0;
+        }
+        else
+        {
+          std::cout << "  FFT padding:                     true" << std::endl;
+          fftPadding = 1;
+        }
+        break;
+      case 'j':
+        fftBackend = std::stoi(optarg);
+        if (fftBackend == 0)
+        {
+          std::cout << "  FFT backend:                     Default" << std::endl;
+        }
+        else if (fftBackend == 1)
+        {
+          std::cout << "  FFT backend:                     Bundled mixed radix" << std::endl;
+        }
+        else
+        {
+          ExceptionMacro("FFT backend unknown!");
+          return EXIT_FAILURE;
+        }
+        break;
       case 'f':
         forceType = std::stoi(optarg);
         if (forceType == 0)
@@ -398,6 +531,14 @@ main(int argc, char * argv[])
         {
           std::cout << "  Force type:                      NCC" << std::endl;
         }
+        else if (forceType == 3)
+        {
+          std::cout << "  Force type:                      MI" << std::endl;
+        }
+        else if (forceType == 4)
+        {
+          std::cout << "  Force type:                      Gaussian NCC" << std::endl;
+        }
         else
         {
           ExceptionMacro("Force type unknown!");
@@ -465,6 +606,34 @@ main(int argc, char * argv[])
         nccRadius = std::stoi(optarg);
         std::cout << "  Radius size for NCC:             " << nccRadius << std::endl;
         break;
+      case 'G':
+        nccSigma = std::stod(optarg);
+        std::cout << "  Gaussian window sigma for NCC:   " << nccSigma << std::endl;
+        break;
+      case 'B':
+        nccBoundaryCondition = std::stoi(optarg);
+        if (nccBoundaryCondition == 0)
+        {
+          std::cout << "  NCC boundary condition:          Crop" << std::endl;
+        }
+        else if (nccBoundaryCondition == 1)
+        {
+          std::cout << "  NCC boundary condition:          Mirror" << std::endl;
+        }
+        else if (nccBoundaryCondition == 2)
+        {
+          std::cout << "  NCC boundary condition:          Clamp" << std::endl;
+        }
+        else
+        {
+          ExceptionMacro("NCC boundary condition unknown!");
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'k':
+        miBins = std::stoi(optarg);
+        std::cout << "  Histogram bins for MI:           " << miBins << std::endl;
+        break;
       case 'x':
         std::cout << "  Use debug mode:                  true" << std::endl;
         useDebugMode = true;
@@ -636,6 +805,9 @@ main(int argc, char * argv[])
   using DemonsFunctionType = VariationalRegistrationDemonsFunction<ImageType, ImageType, DisplacementFieldType>;
   using SSDFunctionType = VariationalRegistrationSSDFunction<ImageType, ImageType, DisplacementFieldType>;
   using NCCFunctionType = VariationalRegistrationFastNCCFunction<ImageType, ImageType, DisplacementFieldType>;
+  using MIFunctionType = VariationalRegistrationMIFunction<ImageType, ImageType, DisplacementFieldType>;
+  using GaussianNCCFunctionType =
+    VariationalRegistrationGaussianNCCFunction<ImageType, ImageType, DisplacementFieldType>;
 
   FunctionType::Pointer function;
   switch (forceType)
@@ -688,6 +860,19 @@ main(int argc, char * argv[])
       }
       nccFunction->SetRadius(r);
 
+      switch (nccBoundaryCondition)
+      {
+        case 0:
+          nccFunction->SetBoundaryConditionToCrop();
+          break;
+        case 1:
+          nccFunction->SetBoundaryConditionToMirror();
+          break;
+        case 2:
+          nccFunction->SetBoundaryConditionToClamp();
+          break;
+      }
+
       switch (forceDomain)
       {
         case 0:
@@ -703,6 +888,46 @@ main(int argc, char * argv[])
       function = nccFunction;
     }
     break;
+    case 3:
+    {
+      MIFunctionType::Pointer miFunction = MIFunctionType::New();
+      miFunction->SetNumberOfHistogramBins(miBins);
+
+      switch (forceDomain)
+      {
+        case 0:
+          miFunction->SetGradientTypeToWarpedMovingImage();
+          break;
+        case 1:
+          miFunction->SetGradientTypeToFixedImage();
+          break;
+        case 2:
+          miFunction->SetGradientTypeToSymmetric();
+          break;
+      }
+      function = miFunction;
+    }
+    break;
+    case 4:
+    {
+      GaussianNCCFunctionType::Pointer gaussianNCCFunction = GaussianNCCFunctionType::New();
+      gaussianNCCFunction->SetStandardDeviations(nccSigma);
+
+      switch (forceDomain)
+      {
+        case 0:
+          gaussianNCCFunction->SetGradientTypeToWarpedMovingImage();
+          break;
+        case 1:
+          gaussianNCCFunction->SetGradientTypeToFixedImage();
+          break;
+        case 2:
+          gaussianNCCFunction->SetGradientTypeToSymmetric();
+          break;
+      }
+      function = gaussianNCCFunction;
+    }
+    break;
   }
   // function->SetMovingImageWarper( warper );
   function->SetTimeStep(timestep);
@@ -714,10 +939,23 @@ main(int argc, char * argv[])
   using RegularizerType = VariationalRegistrationRegularizer<DisplacementFieldType>;
   using GaussianRegularizerType = VariationalRegistrationGaussianRegularizer<DisplacementFieldType>;
   using DiffusionRegularizerType = VariationalRegistrationDiffusionRegularizer<DisplacementFieldType>;
-#if defined(ITK_USE_FFTWD) || defined(ITK_USE_FFTWF)
   using ElasticRegularizerType = VariationalRegistrationElasticRegularizer<DisplacementFieldType>;
   using CurvatureRegularizerType = VariationalRegistrationCurvatureRegularizer<DisplacementFieldType>;
-#endif
+  using FFTBackendType = ElasticRegularizerType::FFTBackendType;
+  using MixedRadixFFTBackendType =
+    VariationalRegistrationMixedRadixFFTBackend<ElasticRegularizerType::RealTypeFFT, DIMENSION>;
+
+  // Planner flag of the FFT based regularizers
+  unsigned int fftPlanRigor = FFTBackendType::PlanMeasure;
+  if (fftPlannerEffort == 0)
+  {
+    fftPlanRigor = FFTBackendType::PlanEstimate;
+  }
+  else if (fftPlannerEffort == 2)
+  {
+    fftPlanRigor = FFTBackendType::PlanPatient;
+  }
+  using MultigridRegularizerType = VariationalRegistrationMultigridRegularizer<DisplacementFieldType>;
 
   RegularizerType::Pointer regularizer;
   switch (regularizerType)
@@ -726,6 +964,7 @@ main(int argc, char * argv[])
     {
       GaussianRegularizerType::Pointer gaussRegularizer = GaussianRegularizerType::New();
       gaussRegularizer->SetStandardDeviations(std::sqrt(regulVar));
+      gaussRegularizer->SetUseRecursiveGaussian(useRecursiveGaussian);
       regularizer = gaussRegularizer;
     }
     break;
@@ -738,25 +977,66 @@ main(int argc, char * argv[])
     break;
     case 2:
     {
-#if defined(ITK_USE_FFTWD) || defined(ITK_USE_FFTWF)
       ElasticRegularizerType::Pointer elasticRegularizer = ElasticRegularizerType::New();
       elasticRegularizer->SetMu(regulMu);
       elasticRegularizer->SetLambda(regulLambda);
+      elasticRegularizer->SetPlanRigor(fftPlanRigor);
+      if (fftWisdomFilename != nullptr)
+      {
+        elasticRegularizer->SetWisdomFileName(fftWisdomFilename);
+      }
+      if (fftBackend == 1)
+      {
+        elasticRegularizer->SetFFTBackend(MixedRadixFFTBackendType::New());
+      }
+      // Keep the padding default of the backend unless -z is given
+      if (fftPadding >= 0)
+      {
+        elasticRegularizer->SetUsePadding(fftPadding != 0);
+      }
       regularizer = elasticRegularizer;
-#else
-      ExceptionMacro(<< "ITK has to be built with ITK_USE_FFTWD set ON for elastic regularisation!");
-#endif
     }
     break;
     case 3:
     {
-#if defined(ITK_USE_FFTWD) || defined(ITK_USE_FFTWF)
       CurvatureRegularizerType::Pointer curvatureRegularizer = CurvatureRegularizerType::New();
       curvatureRegularizer->SetAlpha(regulAlpha);
+      curvatureRegularizer->SetPlanRigor(fftPlanRigor);
+      if (fftWisdomFilename != nullptr)
+      {
+        curvatureRegularizer->SetWisdomFileName(fftWisdomFilename);
+      }
+      if (fftBackend == 1)
+      {
+        curvatureRegularizer->SetFFTBackend(MixedRadixFFTBackendType::New());
+      }
+      // Keep the padding default of the backend unless -z is given
+      if (fftPadding >= 0)
+      {
+        curvatureRegularizer->SetUsePadding(fftPadding != 0);
+      }
       regularizer = curvatureRegularizer;
-#else
-      ExceptionMacro(<< "ITK has to be built with ITK_USE_FFTWD set ON for elastic regularisation!");
-#endif
+    }
+    break;
+    case 4:
+    {
+      MultigridRegularizerType::Pointer multigridRegularizer = MultigridRegularizerType::New();
+      if (multigridOperator == 1)
+      {
+        multigridRegularizer->SetOperatorToElastic();
+      }
+      else if (multigridOperator == 2)
+      {
+        multigridRegularizer->SetOperatorToCurvature();
+      }
+      else
+      {
+        multigridRegularizer->SetOperatorToDiffusion();
+      }
+      multigridRegularizer->SetAlpha(regulAlpha);
+      multigridRegularizer->SetMu(regulMu);
+      multigridRegularizer->SetLambda(regulLambda);
+      regularizer = multigridRegularizer;
     }
     break;
   }
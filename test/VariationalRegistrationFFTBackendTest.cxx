@@ -0,0 +1,295 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkVariationalRegistrationFFTUtilities.h"
+#include "itkMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+// Position of a linear index in an image of the given size (dimension 0
+// varies fastest).
+template <unsigned int VDimension>
+itk::Size<VDimension>
+LinearIndexToPosition(itk::SizeValueType index, const itk::Size<VDimension> & size)
+{
+  itk::Size<VDimension> position;
+  for (unsigned int d = 0; d < VDimension; ++d)
+  {
+    position[d] = index % size[d];
+    index /= size[d];
+  }
+  return position;
+}
+
+// Deterministic test values in [-1, 1].
+std::vector<double>
+GenerateValues(itk::SizeValueType numberOfValues)
+{
+  std::vector<double> values(numberOfValues);
+  for (itk::SizeValueType i = 0; i < numberOfValues; ++i)
+  {
+    values[i] = std::sin(1.3 * static_cast<double>(i) + 0.7) * std::cos(0.37 * static_cast<double>(i * i));
+  }
+  return values;
+}
+
+// Naive real-to-complex DFT of one image; the spectrum has the size
+// [n_0/2+1, n_1, ..., n_d].
+template <unsigned int VDimension>
+std::vector<std::complex<double>>
+NaiveRealToComplex(const double * real, const itk::Size<VDimension> & size)
+{
+  itk::Size<VDimension> complexSize = size;
+  complexSize[0] = size[0] / 2 + 1;
+
+  std::vector<std::complex<double>> spectrum(complexSize.CalculateProductOfElements());
+  for (itk::SizeValueType k = 0; k < spectrum.size(); ++k)
+  {
+    const itk::Size<VDimension> frequency = LinearIndexToPosition<VDimension>(k, complexSize);
+    std::complex<double>        sum = 0.0;
+    for (itk::SizeValueType i = 0; i < size.CalculateProductOfElements(); ++i)
+    {
+      const itk::Size<VDimension> position = LinearIndexToPosition<VDimension>(i, size);
+      double                      phase = 0.0;
+      for (unsigned int d = 0; d < VDimension; ++d)
+      {
+        phase += static_cast<double>((frequency[d] * position[d]) % size[d]) / size[d];
+      }
+      sum += real[i] * std::polar(1.0, -2.0 * itk::Math::pi * phase);
+    }
+    spectrum[k] = sum;
+  }
+  return spectrum;
+}
+
+// Naive multidimensional DCT-III (forward = true, FFTW_REDFT01) or DCT-II
+// (forward = false, FFTW_REDFT10).
+template <unsigned int VDimension>
+std::vector<double>
+NaiveCosine(const std::vector<double> & input, const itk::Size<VDimension> & size, bool forward)
+{
+  std::vector<double> output(input.size());
+  for (itk::SizeValueType k = 0; k < output.size(); ++k)
+  {
+    const itk::Size<VDimension> frequency = LinearIndexToPosition<VDimension>(k, size);
+    double                      sum = 0.0;
+    for (itk::SizeValueType j = 0; j < input.size(); ++j)
+    {
+      const itk::Size<VDimension> position = LinearIndexToPosition<VDimension>(j, size);
+      double                      factor = 1.0;
+      for (unsigned int d = 0; d < VDimension; ++d)
+      {
+        const double n = static_cast<double>(size[d]);
+        if (forward)
+        {
+          const double weight = (position[d] == 0) ? 1.0 : 2.0;
+          factor *= weight * std::cos(itk::Math::pi * position[d] * (frequency[d] + 0.5) / n);
+        }
+        else
+        {
+          factor *= 2.0 * std::cos(itk::Math::pi * (position[d] + 0.5) * frequency[d] / n);
+        }
+      }
+      sum += factor * input[j];
+    }
+    output[k] = sum;
+  }
+  return output;
+}
+
+// Compare the transforms of a backend with the naive transforms for one size.
+// The errors are relative to the largest magnitude of the expected result.
+template <unsigned int VDimension>
+bool
+TestBackendSize(itk::VariationalRegistrationFFTBackend<double, VDimension> * backend,
+                const itk::Size<VDimension> &                                size)
+{
+  constexpr double       tolerance = 1e-10;
+  constexpr unsigned int numberOfImages = 2;
+
+  const itk::SizeValueType numberOfPixels = size.CalculateProductOfElements();
+  const itk::SizeValueType numberOfFrequencies = (size[0] / 2 + 1) * (numberOfPixels / size[0]);
+
+  std::cout << "  Size " << size << std::flush;
+
+  // Real-to-complex FFT of several images and its inverse
+  const std::vector<double>         values = GenerateValues(numberOfImages * numberOfPixels);
+  std::vector<double>               real(values);
+  std::vector<std::complex<double>> complex(numberOfImages * numberOfFrequencies);
+  if (!backend->PlanRealToComplex(size, numberOfImages, real.data(), complex.data()))
+  {
+    std::cout << ": planning the real-to-complex FFT failed." << std::endl;
+    return false;
+  }
+  real = values;
+  backend->ExecuteRealToComplex();
+
+  double forwardError = 0.0;
+  double forwardMaximum = 0.0;
+  for (unsigned int n = 0; n < numberOfImages; ++n)
+  {
+    const std::vector<std::complex<double>> expected =
+      NaiveRealToComplex<VDimension>(values.data() + n * numberOfPixels, size);
+    for (itk::SizeValueType k = 0; k < numberOfFrequencies; ++k)
+    {
+      forwardError = std::max(forwardError, std::abs(complex[n * numberOfFrequencies + k] - expected[k]));
+      forwardMaximum = std::max(forwardMaximum, std::abs(expected[k]));
+    }
+  }
+  forwardError /= forwardMaximum;
+
+  // The inverse of the unnormalized transforms scales by the number of pixels
+  backend->ExecuteComplexToReal();
+  double inverseError = 0.0;
+  for (itk::SizeValueType i = 0; i < values.size(); ++i)
+  {
+    inverseError = std::max(inverseError, std::abs(real[i] / numberOfPixels - values[i]));
+  }
+
+  // DCT-III and DCT-II
+  const std::vector<double> cosineValues(values.begin(), values.begin() + numberOfPixels);
+  std::vector<double>       spatial(numberOfPixels);
+  std::vector<double>       frequency(numberOfPixels);
+  if (!backend->PlanCosine(size, spatial.data(), frequency.data()))
+  {
+    std::cout << ": planning the DCTs failed." << std::endl;
+    return false;
+  }
+
+  spatial = cosineValues;
+  backend->ExecuteForwardCosine();
+  std::vector<double> expected = NaiveCosine<VDimension>(cosineValues, size, true);
+
+  double forwardCosineError = 0.0;
+  double forwardCosineMaximum = 0.0;
+  for (itk::SizeValueType i = 0; i < numberOfPixels; ++i)
+  {
+    forwardCosineError = std::max(forwardCosineError, std::abs(frequency[i] - expected[i]));
+    forwardCosineMaximum = std::max(forwardCosineMaximum, std::abs(expected[i]));
+  }
+  forwardCosineError /= forwardCosineMaximum;
+
+  frequency = cosineValues;
+  backend->ExecuteBackwardCosine();
+  expected = NaiveCosine<VDimension>(cosineValues, size, false);
+
+  double backwardCosineError = 0.0;
+  double backwardCosineMaximum = 0.0;
+  for (itk::SizeValueType i = 0; i < numberOfPixels; ++i)
+  {
+    backwardCosineError = std::max(backwardCosineError, std::abs(spatial[i] - expected[i]));
+    backwardCosineMaximum = std::max(backwardCosineMaximum, std::abs(expected[i]));
+  }
+  backwardCosineError /= backwardCosineMaximum;
+
+  std::cout << ": R2C " << forwardError << "  C2R " << inverseError << "  DCT-III " << forwardCosineError
+            << "  DCT-II " << backwardCosineError << std::endl;
+
+  return forwardError <= tolerance && inverseError <= tolerance && forwardCosineError <= tolerance &&
+         backwardCosineError <= tolerance;
+}
+
+// Compare the transforms of a backend with the naive transforms for sizes
+// with power of two, odd and prime extents.
+template <unsigned int VDimension>
+bool
+TestBackend(itk::VariationalRegistrationFFTBackend<double, VDimension> * backend,
+            const std::vector<itk::Size<VDimension>> &                   sizes)
+{
+  std::cout << backend->GetNameOfClass() << ", dimension " << VDimension << std::endl;
+
+  // Several work units, so the lines are distributed
+  backend->SetNumberOfWorkUnits(3);
+  backend->SetPlanRigor(itk::VariationalRegistrationFFTBackend<double, VDimension>::PlanEstimate);
+
+  bool passed = true;
+  for (const auto & size : sizes)
+  {
+    passed = TestBackendSize<VDimension>(backend, size) && passed;
+  }
+  return passed;
+}
+} // namespace
+
+int
+VariationalRegistrationFFTBackendTest(int, char *[])
+{
+  using Size2DType = itk::Size<2>;
+  using Size3DType = itk::Size<3>;
+
+  // Power of two, odd and prime sizes; the prime sizes use the generic pass
+  // of the mixed radix backend.
+  const std::vector<Size2DType> sizes2D = { { { 16, 8 } }, { { 9, 15 } },  { { 7, 13 } },
+                                            { { 1, 11 } }, { { 12, 17 } }, { { 25, 6 } } };
+  const std::vector<Size3DType> sizes3D = { { { 4, 8, 2 } }, { { 5, 3, 9 } }, { { 7, 6, 11 } } };
+
+  bool passed = true;
+
+  //--------------------------------------------------------
+  std::cout << "Test bundled mixed radix backend" << std::endl;
+
+  using MixedRadix2DType = itk::VariationalRegistrationMixedRadixFFTBackend<double, 2>;
+  using MixedRadix3DType = itk::VariationalRegistrationMixedRadixFFTBackend<double, 3>;
+
+  MixedRadix2DType::Pointer mixedRadix2D = MixedRadix2DType::New();
+  MixedRadix3DType::Pointer mixedRadix3D = MixedRadix3DType::New();
+  passed = TestBackend<2>(mixedRadix2D, sizes2D) && passed;
+  passed = TestBackend<3>(mixedRadix3D, sizes3D) && passed;
+
+  if (!mixedRadix2D->GetDefaultUsePadding())
+  {
+    std::cout << "Test failed - the mixed radix backend does not pad by default." << std::endl;
+    passed = false;
+  }
+
+  //--------------------------------------------------------
+#if defined(ITK_USE_FFTWD)
+  std::cout << "Test FFTW backend" << std::endl;
+
+  using FFTW2DType = itk::VariationalRegistrationFFTWBackend<double, 2>;
+  using FFTW3DType = itk::VariationalRegistrationFFTWBackend<double, 3>;
+
+  FFTW2DType::Pointer fftw2D = FFTW2DType::New();
+  FFTW3DType::Pointer fftw3D = FFTW3DType::New();
+  passed = TestBackend<2>(fftw2D, sizes2D) && passed;
+  passed = TestBackend<3>(fftw3D, sizes3D) && passed;
+
+  if (fftw2D->GetDefaultUsePadding())
+  {
+    std::cout << "Test failed - the FFTW backend pads by default." << std::endl;
+    passed = false;
+  }
+#else
+  std::cout << "ITK is built without FFTW for double precision; FFTW backend not tested." << std::endl;
+#endif
+
+  if (!passed)
+  {
+    std::cout << "Test failed - the transforms differ from the naive transforms." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
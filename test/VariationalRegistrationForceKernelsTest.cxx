@@ -0,0 +1,489 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkVariationalRegistrationForceKernels.h"
+#include "itkVariationalRegistrationFilter.h"
+#include "itkVariationalRegistrationDemonsFunction.h"
+#include "itkVariationalRegistrationSSDFunction.h"
+
+#include "itkImageRegionIteratorWithIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+namespace Kernels = itk::VariationalRegistrationForceKernels;
+
+// Deterministic test value in [-1, 1].
+double
+TestValue(itk::SizeValueType i, double frequency, double phase)
+{
+  return std::sin(frequency * static_cast<double>(i) + phase) * std::cos(0.37 * static_cast<double>(i * i));
+}
+
+// One image row in the layout of the kernels.
+struct RowType
+{
+  std::vector<float>         m_Fixed;
+  std::vector<float>         m_Warped;
+  std::vector<float>         m_Gradient;
+  std::vector<float>         m_SecondGradient;
+  std::vector<unsigned char> m_Inside;
+};
+
+// Generate a row with matching intensities (every 7th pixel), vanishing
+// gradients (every 11th pixel) and pixels outside the mask (every 5th pixel).
+template <unsigned int VDimension>
+RowType
+GenerateRow(itk::SizeValueType length)
+{
+  RowType row;
+  row.m_Gradient.resize(length * VDimension);
+  row.m_SecondGradient.resize(length * VDimension);
+  for (itk::SizeValueType i = 0; i < length; i++)
+  {
+    row.m_Fixed.push_back(static_cast<float>(1000.0 * TestValue(i, 1.3, 0.7)));
+    if (i % 7 == 0)
+    {
+      row.m_Warped.push_back(row.m_Fixed[i]);
+    }
+    else if (i % 11 == 0)
+    {
+      row.m_Warped.push_back(row.m_Fixed[i] + 0.05f);
+    }
+    else
+    {
+      row.m_Warped.push_back(static_cast<float>(row.m_Fixed[i] + 50.0 * TestValue(i, 0.9, 0.1)));
+    }
+    for (unsigned int j = 0; j < VDimension; j++)
+    {
+      const bool vanishing = (i % 11 == 0);
+      row.m_Gradient[i * VDimension + j] = vanishing ? 0.0f : static_cast<float>(20.0 * TestValue(i, 0.5 + j, 0.3));
+      row.m_SecondGradient[i * VDimension + j] =
+        vanishing ? 0.0f : static_cast<float>(20.0 * TestValue(i, 0.8 + j, 1.1));
+    }
+    row.m_Inside.push_back(i % 5 != 3);
+  }
+  return row;
+}
+
+// Parameters of one kernel call.
+struct ParametersType
+{
+  bool   m_Demons;
+  bool   m_UseSecondGradient;
+  bool   m_UseInside;
+  double m_Normalizer;
+  double m_IntensityDifferenceThreshold;
+  double m_DenominatorThreshold;
+};
+
+// Double precision forces of the registration functions (see
+// ComputeUpdateScanline()). Pixels whose speed or denominator lies close to a
+// threshold are flagged, as single precision may decide differently there.
+template <unsigned int VDimension>
+void
+ComputeReferenceForces(const RowType &        row,
+                       itk::SizeValueType     offset,
+                       itk::SizeValueType     length,
+                       const ParametersType & parameters,
+                       std::vector<double> &  update,
+                       std::vector<bool> &    nearThreshold,
+                       double &               sumOfMetricValues,
+                       double &               sumOfSquaredChange)
+{
+  update.assign(length * VDimension, 0.0);
+  nearThreshold.assign(length, false);
+  sumOfMetricValues = 0.0;
+  sumOfSquaredChange = 0.0;
+
+  for (itk::SizeValueType p = 0; p < length; p++)
+  {
+    const itk::SizeValueType i = offset + p;
+    if (parameters.m_UseInside && !row.m_Inside[i])
+    {
+      continue;
+    }
+
+    const double speedValue = static_cast<double>(row.m_Fixed[i]) - static_cast<double>(row.m_Warped[i]);
+    double       gradient[VDimension];
+    double       gradientSquaredMagnitude = 0.0;
+    for (unsigned int j = 0; j < VDimension; j++)
+    {
+      gradient[j] = row.m_Gradient[i * VDimension + j];
+      if (parameters.m_UseSecondGradient)
+      {
+        gradient[j] += row.m_SecondGradient[i * VDimension + j];
+      }
+      gradientSquaredMagnitude += gradient[j] * gradient[j];
+    }
+    const double denominator = speedValue * speedValue / parameters.m_Normalizer + gradientSquaredMagnitude;
+
+    const double speedDistance = std::abs(std::abs(speedValue) - parameters.m_IntensityDifferenceThreshold);
+    const double denominatorDistance = std::abs(denominator - parameters.m_DenominatorThreshold);
+    nearThreshold[p] = (speedDistance <= 1e-4 * (std::abs(speedValue) + 1.0)) ||
+                       (parameters.m_Demons && denominatorDistance <= 1e-4 * (denominator + 1e-6));
+
+    const bool active = !(std::abs(speedValue) < parameters.m_IntensityDifferenceThreshold) &&
+                        !(parameters.m_Demons && denominator < parameters.m_DenominatorThreshold);
+    if (active)
+    {
+      for (unsigned int j = 0; j < VDimension; j++)
+      {
+        const double u = parameters.m_Demons ? speedValue * gradient[j] / denominator : speedValue * gradient[j];
+        update[p * VDimension + j] = u;
+        sumOfSquaredChange += u * u;
+      }
+    }
+    sumOfMetricValues += speedValue * speedValue;
+  }
+}
+
+// Run a Demons or SSD kernel on the row from the given offset.
+template <unsigned int VDimension>
+void
+RunKernel(Kernels::DemonsKernelType<VDimension> demonsKernel,
+          Kernels::SSDKernelType<VDimension>    ssdKernel,
+          const RowType &                       row,
+          itk::SizeValueType                    offset,
+          itk::SizeValueType                    length,
+          const ParametersType &                parameters,
+          std::vector<float> &                  update,
+          double &                              sumOfMetricValues,
+          double &                              sumOfSquaredChange)
+{
+  update.assign(length * VDimension + 1, -1.0f);
+  sumOfMetricValues = 0.0;
+  sumOfSquaredChange = 0.0;
+
+  const float *         fixed = row.m_Fixed.data() + offset;
+  const float *         warped = row.m_Warped.data() + offset;
+  const float *         gradient = row.m_Gradient.data() + offset * VDimension;
+  const float *         secondGradient =
+    parameters.m_UseSecondGradient ? row.m_SecondGradient.data() + offset * VDimension : nullptr;
+  const unsigned char * inside = parameters.m_UseInside ? row.m_Inside.data() + offset : nullptr;
+
+  if (parameters.m_Demons)
+  {
+    demonsKernel(length,
+                 fixed,
+                 warped,
+                 gradient,
+                 secondGradient,
+                 inside,
+                 update.data(),
+                 parameters.m_Normalizer,
+                 parameters.m_IntensityDifferenceThreshold,
+                 parameters.m_DenominatorThreshold,
+                 sumOfMetricValues,
+                 sumOfSquaredChange);
+  }
+  else
+  {
+    ssdKernel(length,
+              fixed,
+              warped,
+              gradient,
+              secondGradient,
+              inside,
+              update.data(),
+              parameters.m_IntensityDifferenceThreshold,
+              sumOfMetricValues,
+              sumOfSquaredChange);
+  }
+}
+
+// Compare a pair of kernels with the double precision forces for all row
+// lengths up to three vectors of 16 pixels, a long row, unaligned rows and
+// all combinations of mask, symmetric gradient and thresholds.
+template <unsigned int VDimension>
+bool
+TestKernels(const char *                          name,
+            Kernels::DemonsKernelType<VDimension> demonsKernel,
+            Kernels::SSDKernelType<VDimension>    ssdKernel)
+{
+  constexpr double tolerance = 1e-5;
+
+  std::vector<itk::SizeValueType> lengths;
+  for (itk::SizeValueType length = 0; length <= 48; length++)
+  {
+    lengths.push_back(length);
+  }
+  lengths.push_back(1000);
+
+  const RowType row = GenerateRow<VDimension>(1001);
+
+  double maximumError = 0.0;
+  double maximumSumError = 0.0;
+  bool   passed = true;
+  for (const bool demons : { true, false })
+  {
+    for (const bool useSecondGradient : { false, true })
+    {
+      for (const bool useInside : { false, true })
+      {
+        // The second threshold pair makes the denominator threshold reject
+        // the pixels with vanishing gradient
+        for (const bool largeDenominatorThreshold : { false, true })
+        {
+          const ParametersType parameters = { demons,
+                                              useSecondGradient,
+                                              useInside,
+                                              largeDenominatorThreshold ? 1.0 : 0.75,
+                                              largeDenominatorThreshold ? 0.0 : 0.001,
+                                              largeDenominatorThreshold ? 1e-2 : 1e-9 };
+          for (const itk::SizeValueType length : lengths)
+          {
+            for (const itk::SizeValueType offset : { 0, 1 })
+            {
+              std::vector<double> reference;
+              std::vector<bool>   nearThreshold;
+              double              referenceMetric;
+              double              referenceChange;
+              ComputeReferenceForces<VDimension>(
+                row, offset, length, parameters, reference, nearThreshold, referenceMetric, referenceChange);
+
+              std::vector<float> update;
+              double             metric;
+              double             change;
+              RunKernel<VDimension>(demonsKernel, ssdKernel, row, offset, length, parameters, update, metric, change);
+
+              bool skipped = false;
+              for (itk::SizeValueType p = 0; p < length; p++)
+              {
+                if (nearThreshold[p])
+                {
+                  skipped = true;
+                  continue;
+                }
+                double norm = 0.0;
+                for (unsigned int j = 0; j < VDimension; j++)
+                {
+                  norm += reference[p * VDimension + j] * reference[p * VDimension + j];
+                }
+                norm = std::sqrt(norm);
+                for (unsigned int j = 0; j < VDimension; j++)
+                {
+                  const double error = std::abs(update[p * VDimension + j] - reference[p * VDimension + j]);
+                  maximumError = std::max(maximumError, error / (norm + 1e-30));
+                  if (error > tolerance * norm)
+                  {
+                    passed = false;
+                  }
+                }
+              }
+
+              // The kernel must not write behind the row
+              if (update[length * VDimension] != -1.0f)
+              {
+                std::cout << "  " << name << ": length " << length << " writes behind the row." << std::endl;
+                passed = false;
+              }
+
+              if (!skipped)
+              {
+                const double metricError = std::abs(metric - referenceMetric) / (referenceMetric + 1e-30);
+                const double changeError = std::abs(change - referenceChange) / (referenceChange + 1e-30);
+                maximumSumError = std::max(maximumSumError, std::max(metricError, changeError));
+                if (metricError > tolerance || changeError > tolerance)
+                {
+                  passed = false;
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  std::cout << "  " << name << ", dimension " << VDimension << ": maximum relative update error " << maximumError
+            << ", maximum relative sum error " << maximumSumError << std::endl;
+  return passed;
+}
+
+// Test the scalar kernels and the vector kernels supported by the CPU.
+template <unsigned int VDimension>
+bool
+TestAllKernels()
+{
+  bool passed = TestKernels<VDimension>(
+    "Scalar", Kernels::DemonsKernelScalar<VDimension>, Kernels::SSDKernelScalar<VDimension>);
+
+  const Kernels::InstructionSetType instructionSets[] = { Kernels::InstructionSetType::AVX2,
+                                                          Kernels::InstructionSetType::AVX512 };
+  const char *                      names[] = { "AVX2", "AVX-512" };
+  for (unsigned int k = 0; k < 2; k++)
+  {
+    const Kernels::DemonsKernelType<VDimension> demonsKernel = Kernels::GetDemonsKernel<VDimension>(instructionSets[k]);
+    const Kernels::SSDKernelType<VDimension>    ssdKernel = Kernels::GetSSDKernel<VDimension>(instructionSets[k]);
+    if (instructionSets[k] > Kernels::GetInstructionSet() || !demonsKernel || !ssdKernel)
+    {
+      std::cout << "  " << names[k] << " kernels not available." << std::endl;
+      continue;
+    }
+    passed = TestKernels<VDimension>(names[k], demonsKernel, ssdKernel) && passed;
+  }
+  return passed;
+}
+
+// Fill an image with a smooth ellipsoid.
+template <typename TImage>
+void
+FillWithEllipsoid(TImage * image, const double * center, const double * radius)
+{
+  for (itk::ImageRegionIteratorWithIndex<TImage> it(image, image->GetBufferedRegion()); !it.IsAtEnd(); ++it)
+  {
+    double distance = 0;
+    for (unsigned int j = 0; j < TImage::ImageDimension; j++)
+    {
+      distance += itk::Math::sqr((it.GetIndex()[j] - center[j]) / radius[j]);
+    }
+    it.Set(static_cast<typename TImage::PixelType>(100.0 / (1.0 + std::exp(8.0 * (std::sqrt(distance) - 1.0)))));
+  }
+}
+
+// Register two ellipsoids with a Demons or an SSD function (symmetric
+// gradient, mask) and compare the fields computed with and without the vector
+// kernels.
+template <unsigned int VDimension, typename TFunction>
+bool
+TestFunction(const char * name, const itk::Size<VDimension> & size, double timeStep)
+{
+  using ImageType = itk::Image<short, VDimension>;
+  using FieldType = itk::Image<itk::Vector<float, VDimension>, VDimension>;
+  using RegistrationFilterType = itk::VariationalRegistrationFilter<ImageType, ImageType, FieldType>;
+  using MaskImageType = typename RegistrationFilterType::MaskImageType;
+
+  typename ImageType::RegionType region;
+  region.SetSize(size);
+
+  auto fixed = ImageType::New();
+  fixed->SetRegions(region);
+  fixed->Allocate();
+  auto moving = ImageType::New();
+  moving->SetRegions(region);
+  moving->Allocate();
+  auto mask = MaskImageType::New();
+  mask->SetRegions(region);
+  mask->Allocate();
+
+  double fixedCenter[VDimension];
+  double fixedRadius[VDimension];
+  double movingCenter[VDimension];
+  double movingRadius[VDimension];
+  for (unsigned int d = 0; d < VDimension; d++)
+  {
+    fixedCenter[d] = 0.5 * size[d] - 1.0;
+    fixedRadius[d] = 0.3 * size[d] + d;
+    movingCenter[d] = 0.5 * size[d] + 1.5;
+    movingRadius[d] = 0.28 * size[d];
+  }
+  FillWithEllipsoid<ImageType>(fixed, fixedCenter, fixedRadius);
+  FillWithEllipsoid<ImageType>(moving, movingCenter, movingRadius);
+
+  // Mask out a slab at the border of the image
+  for (itk::ImageRegionIteratorWithIndex<MaskImageType> it(mask, region); !it.IsAtEnd(); ++it)
+  {
+    it.Set(it.GetIndex()[VDimension - 1] < 3 ? 0 : 1);
+  }
+
+  typename FieldType::Pointer fields[2];
+  for (unsigned int k = 0; k < 2; k++)
+  {
+    auto function = TFunction::New();
+    function->SetGradientTypeToSymmetric();
+    function->SetTimeStep(timeStep);
+    function->SetUseVectorizedForces(k == 0);
+
+    auto regFilter = RegistrationFilterType::New();
+    regFilter->SetDifferenceFunction(function);
+    regFilter->SetFixedImage(fixed);
+    regFilter->SetMovingImage(moving);
+    regFilter->SetMaskImage(mask);
+    regFilter->SetNumberOfIterations(10);
+    regFilter->Update();
+
+    fields[k] = regFilter->GetOutput();
+    fields[k]->DisconnectPipeline();
+  }
+
+  // The fields only differ by rounding errors, which are relative to the
+  // displacements
+  double maximumDisplacement = 0.0;
+  double maximumDifference = 0.0;
+  using IteratorType = itk::ImageRegionConstIterator<FieldType>;
+  for (IteratorType it0(fields[0], region), it1(fields[1], region); !it0.IsAtEnd(); ++it0, ++it1)
+  {
+    for (unsigned int c = 0; c < VDimension; c++)
+    {
+      maximumDisplacement = std::max(maximumDisplacement, std::abs(static_cast<double>(it1.Get()[c])));
+      maximumDifference =
+        std::max(maximumDifference, std::abs(static_cast<double>(it0.Get()[c]) - static_cast<double>(it1.Get()[c])));
+    }
+  }
+  std::cout << "  " << name << ", dimension " << VDimension << ": maximum displacement " << maximumDisplacement
+            << ", maximum difference " << maximumDifference << std::endl;
+
+  return maximumDisplacement >= 0.1 && maximumDifference <= 1e-3 * maximumDisplacement;
+}
+} // namespace
+
+int
+VariationalRegistrationForceKernelsTest(int, char *[])
+{
+  bool passed = true;
+
+  //--------------------------------------------------------
+  std::cout << "Compare the kernels with the double precision forces" << std::endl;
+
+  passed = TestAllKernels<2>() && passed;
+  passed = TestAllKernels<3>() && passed;
+
+  //--------------------------------------------------------
+  std::cout << "Compare registrations with and without the vector kernels" << std::endl;
+
+  using Image2DType = itk::Image<short, 2>;
+  using Image3DType = itk::Image<short, 3>;
+  using Field2DType = itk::Image<itk::Vector<float, 2>, 2>;
+  using Field3DType = itk::Image<itk::Vector<float, 3>, 3>;
+  using Demons2DType = itk::VariationalRegistrationDemonsFunction<Image2DType, Image2DType, Field2DType>;
+  using Demons3DType = itk::VariationalRegistrationDemonsFunction<Image3DType, Image3DType, Field3DType>;
+  using SSD2DType = itk::VariationalRegistrationSSDFunction<Image2DType, Image2DType, Field2DType>;
+  using SSD3DType = itk::VariationalRegistrationSSDFunction<Image3DType, Image3DType, Field3DType>;
+
+  // Row lengths that are not multiples of the vector widths
+  const itk::Size<2> size2D = { { 61, 54 } };
+  const itk::Size<3> size3D = { { 27, 22, 20 } };
+  passed = TestFunction<2, Demons2DType>("Demons", size2D, 1.0) && passed;
+  passed = TestFunction<3, Demons3DType>("Demons", size3D, 1.0) && passed;
+  passed = TestFunction<2, SSD2DType>("SSD", size2D, 1e-4) && passed;
+  passed = TestFunction<3, SSD3DType>("SSD", size3D, 1e-4) && passed;
+
+  if (!passed)
+  {
+    std::cout << "Test failed - the vector kernels differ from the double precision forces." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,376 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkVariationalRegistrationFilter.h"
+#include "itkVariationalRegistrationGaussianNCCFunction.h"
+#include "itkVariationalRegistrationDiffusionRegularizer.h"
+#include "itkContinuousBorderWarpImageFilter.h"
+
+#include "itkNearestNeighborInterpolateImageFunction.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+// Fill an image with a circle.
+template <typename TImage>
+void
+FillWithCircle(TImage *                   image,
+               const double *             center,
+               double                     radius,
+               typename TImage::PixelType foregnd,
+               typename TImage::PixelType backgnd)
+{
+  const double r2 = itk::Math::sqr(radius);
+  for (itk::ImageRegionIteratorWithIndex<TImage> it(image, image->GetBufferedRegion()); !it.IsAtEnd(); ++it)
+  {
+    const typename TImage::IndexType index = it.GetIndex();
+    double                           distance = 0;
+    for (unsigned int j = 0; j < TImage::ImageDimension; j++)
+    {
+      distance += itk::Math::sqr(static_cast<double>(index[j]) - center[j]);
+    }
+    it.Set(distance <= r2 ? foregnd : backgnd);
+  }
+}
+
+// Count the pixels that differ in two images.
+template <typename TImage>
+unsigned int
+CountDifferentPixels(const TImage * image1, const TImage * image2)
+{
+  itk::ImageRegionConstIterator<TImage> it1(image1, image1->GetBufferedRegion());
+  itk::ImageRegionConstIterator<TImage> it2(image2, image1->GetBufferedRegion());
+
+  unsigned int numPixelsDifferent = 0;
+  for (; !it1.IsAtEnd(); ++it1, ++it2)
+  {
+    if (it1.Get() != it2.Get())
+    {
+      numPixelsDifferent++;
+    }
+  }
+  return numPixelsDifferent;
+}
+
+using FloatImageType = itk::Image<float, 2>;
+using FloatFieldType = itk::Image<itk::Vector<float, 2>, 2>;
+
+// Mean of 1 - CC with Gaussian weighted local sums computed by brute force,
+// and the update of the fixed image gradient type. The images are extended
+// with their boundary values, the sampled Gaussian weights are normalized
+// and the sums are scaled with the window size of the function. The update
+// is only computed where the central differences are defined.
+double
+BruteForceGaussianNCC(const FloatImageType * fixed,
+                      const FloatImageType * moving,
+                      const double *         sigma,
+                      FloatFieldType *       update)
+{
+  const FloatImageType::SizeType size = fixed->GetBufferedRegion().GetSize();
+  const double                   pixelCounter = 2.0 * itk::Math::pi * sigma[0] * sigma[1];
+
+  int                 radius[2];
+  std::vector<double> weights[2];
+  for (unsigned int d = 0; d < 2; d++)
+  {
+    radius[d] = static_cast<int>(std::ceil(8.0 * sigma[d]));
+    double sum = 0.0;
+    for (int k = -radius[d]; k <= radius[d]; k++)
+    {
+      weights[d].push_back(std::exp(-0.5 * k * k / (sigma[d] * sigma[d])));
+      sum += weights[d].back();
+    }
+    for (double & weight : weights[d])
+    {
+      weight /= sum;
+    }
+  }
+
+  // Value of an image at an index that is clamped to the image
+  const auto valueAt = [&size](const FloatImageType * image, itk::Index<2> index) {
+    for (unsigned int d = 0; d < 2; d++)
+    {
+      index[d] = std::min<itk::IndexValueType>(std::max<itk::IndexValueType>(index[d], 0), size[d] - 1);
+    }
+    return static_cast<double>(image->GetPixel(index));
+  };
+
+  double sumOfMetricValues = 0.0;
+  for (itk::ImageRegionIteratorWithIndex<FloatFieldType> it(update, update->GetBufferedRegion()); !it.IsAtEnd(); ++it)
+  {
+    const itk::Index<2> index = it.GetIndex();
+
+    double meanF = 0.0;
+    double meanM = 0.0;
+    for (int j = -radius[1]; j <= radius[1]; j++)
+    {
+      for (int i = -radius[0]; i <= radius[0]; i++)
+      {
+        const itk::Index<2> neighbor = { { index[0] + i, index[1] + j } };
+        const double        weight = weights[0][i + radius[0]] * weights[1][j + radius[1]];
+        meanF += weight * valueAt(fixed, neighbor);
+        meanM += weight * valueAt(moving, neighbor);
+      }
+    }
+
+    double sumFF = 0.0;
+    double sumMM = 0.0;
+    double sumFM = 0.0;
+    for (int j = -radius[1]; j <= radius[1]; j++)
+    {
+      for (int i = -radius[0]; i <= radius[0]; i++)
+      {
+        const itk::Index<2> neighbor = { { index[0] + i, index[1] + j } };
+        const double        weight = pixelCounter * weights[0][i + radius[0]] * weights[1][j + radius[1]];
+        const double        f = valueAt(fixed, neighbor) - meanF;
+        const double        m = valueAt(moving, neighbor) - meanM;
+        sumFF += weight * f * f;
+        sumMM += weight * m * m;
+        sumFM += weight * f * m;
+      }
+    }
+
+    const double crossCorrelation = sumFM * sumFM / (sumFF * sumMM);
+    sumOfMetricValues += 1.0 - crossCorrelation;
+
+    const double factor = (2.0 * sumFM / (sumFF * sumMM)) *
+                          ((valueAt(moving, index) - meanM) - sumFM / sumFF * (valueAt(fixed, index) - meanF));
+    FloatFieldType::PixelType value;
+    for (unsigned int d = 0; d < 2; d++)
+    {
+      itk::Index<2> next = index;
+      itk::Index<2> previous = index;
+      next[d]++;
+      previous[d]--;
+      value[d] = static_cast<float>(-factor * 0.5 * (valueAt(fixed, next) - valueAt(fixed, previous)));
+    }
+    it.Set(value);
+  }
+  return sumOfMetricValues / static_cast<double>(size[0] * size[1]);
+}
+
+// Compare the Gaussian NCC metric and update of one iteration with the
+// brute-force computation on a small image. The recursive filters are
+// third order approximations of the Gaussian; with the standard deviations
+// of the test, the metric differs by about 0.3 percent and the updates by
+// about 13 percent in the L2 norm.
+bool
+TestBruteForce()
+{
+  const double sigma[2] = { 1.5, 2.0 };
+
+  FloatImageType::RegionType region;
+  region.SetSize(0, 24);
+  region.SetSize(1, 20);
+
+  FloatImageType::Pointer fixed = FloatImageType::New();
+  fixed->SetRegions(region);
+  fixed->Allocate();
+
+  FloatImageType::Pointer moving = FloatImageType::New();
+  moving->SetRegions(region);
+  moving->Allocate();
+
+  // Smooth images with a nonlinear intensity relation and a local shift
+  const auto intensity = [](double x, double y) {
+    return 100.0 + 40.0 * std::sin(0.45 * x + 0.2) * std::cos(0.3 * y) + 0.2 * x * y;
+  };
+  for (itk::ImageRegionIteratorWithIndex<FloatImageType> it(fixed, region); !it.IsAtEnd(); ++it)
+  {
+    const double x = it.GetIndex()[0];
+    const double y = it.GetIndex()[1];
+    it.Set(static_cast<float>(intensity(x, y)));
+    moving->SetPixel(it.GetIndex(),
+                     static_cast<float>(0.01 * itk::Math::sqr(intensity(x + 0.7, y - 0.4)) + 5.0 * std::sin(0.9 * x)));
+  }
+
+  using FunctionType = itk::VariationalRegistrationGaussianNCCFunction<FloatImageType, FloatImageType, FloatFieldType>;
+  FunctionType::Pointer function = FunctionType::New();
+  function->SetGradientTypeToFixedImage();
+  function->SetTimeStep(1.0);
+  FunctionType::StandardDeviationsType standardDeviations;
+  standardDeviations[0] = sigma[0];
+  standardDeviations[1] = sigma[1];
+  function->SetStandardDeviations(standardDeviations);
+
+  // One iteration without regularization; the output is the update
+  using RegistrationFilterType = itk::VariationalRegistrationFilter<FloatImageType, FloatImageType, FloatFieldType>;
+  RegistrationFilterType::Pointer regFilter = RegistrationFilterType::New();
+  regFilter->SetDifferenceFunction(function);
+  regFilter->SetRegularizer(itk::VariationalRegistrationDiffusionRegularizer<FloatFieldType>::New());
+  regFilter->SetFixedImage(fixed);
+  regFilter->SetMovingImage(moving);
+  regFilter->SetNumberOfIterations(1);
+  regFilter->SmoothDisplacementFieldOff();
+  regFilter->SmoothUpdateFieldOff();
+  regFilter->Update();
+
+  FloatFieldType::Pointer expectedUpdate = FloatFieldType::New();
+  expectedUpdate->SetRegions(region);
+  expectedUpdate->Allocate();
+  const double expectedMetric = BruteForceGaussianNCC(fixed, moving, sigma, expectedUpdate);
+
+  double squaredDifference = 0.0;
+  double squaredNorm = 0.0;
+  for (itk::ImageRegionConstIteratorWithIndex<FloatFieldType> it(expectedUpdate, region); !it.IsAtEnd(); ++it)
+  {
+    const itk::Index<2> index = it.GetIndex();
+    bool                boundary = false;
+    for (unsigned int d = 0; d < 2; d++)
+    {
+      boundary = boundary || index[d] == 0 || index[d] + 1 == static_cast<itk::IndexValueType>(region.GetSize(d));
+    }
+    if (boundary)
+    {
+      continue;
+    }
+    squaredDifference += (regFilter->GetOutput()->GetPixel(index) - it.Get()).GetSquaredNorm();
+    squaredNorm += it.Get().GetSquaredNorm();
+  }
+
+  const double metricError = std::abs(function->GetMetric() - expectedMetric) / expectedMetric;
+  const double updateError = std::sqrt(squaredDifference / squaredNorm);
+  std::cout << "Metric " << function->GetMetric() << ", brute force " << expectedMetric << ", relative error "
+            << metricError << "; relative L2 error of the update " << updateError << std::endl;
+
+  return metricError < 0.02 && updateError < 0.25;
+}
+} // namespace
+
+int
+VariationalRegistrationGaussianNCCFunctionTest(int, char *[])
+{
+  constexpr unsigned int ImageDimension = 2;
+  using PixelType = unsigned char;
+  using ImageType = itk::Image<PixelType, ImageDimension>;
+  using VectorType = itk::Vector<float, ImageDimension>;
+  using FieldType = itk::Image<VectorType, ImageDimension>;
+
+  //--------------------------------------------------------
+  std::cout << "Generate input images" << std::endl;
+
+  ImageType::RegionType region;
+  region.SetSize(0, 128);
+  region.SetSize(1, 128);
+
+  ImageType::Pointer moving = ImageType::New();
+  moving->SetRegions(region);
+  moving->Allocate();
+
+  ImageType::Pointer fixed = ImageType::New();
+  fixed->SetRegions(region);
+  fixed->Allocate();
+
+  const PixelType fgnd = 250;
+  const PixelType bgnd = 15;
+
+  const double movingCenter[ImageDimension] = { 64, 64 };
+  FillWithCircle<ImageType>(moving, movingCenter, 30, fgnd, bgnd);
+
+  const double fixedCenter[ImageDimension] = { 62, 64 };
+  FillWithCircle<ImageType>(fixed, fixedCenter, 32, fgnd, bgnd);
+
+  const unsigned int numPixelsDifferentBefore = CountDifferentPixels<ImageType>(fixed, moving);
+  std::cout << "Number of pixels different before registration: " << numPixelsDifferentBefore << std::endl;
+
+  //-------------------------------------------------------------
+  std::cout << "Test invalid standard deviation" << std::endl;
+
+  using FunctionType = itk::VariationalRegistrationGaussianNCCFunction<ImageType, ImageType, FieldType>;
+  FunctionType::Pointer function = FunctionType::New();
+  function->SetGradientTypeToSymmetric();
+  function->SetTimeStep(40.0);
+  function->SetStandardDeviations(0.25);
+
+  using RegularizerType = itk::VariationalRegistrationDiffusionRegularizer<FieldType>;
+  RegularizerType::Pointer regularizer = RegularizerType::New();
+  regularizer->SetAlpha(1.5);
+
+  using RegistrationFilterType = itk::VariationalRegistrationFilter<ImageType, ImageType, FieldType>;
+  RegistrationFilterType::Pointer regFilter = RegistrationFilterType::New();
+  regFilter->SetDifferenceFunction(function);
+  regFilter->SetRegularizer(regularizer);
+  regFilter->SetFixedImage(fixed);
+  regFilter->SetMovingImage(moving);
+  regFilter->SetNumberOfIterations(100);
+
+  bool passed = false;
+  try
+  {
+    regFilter->Update();
+  }
+  catch (itk::ExceptionObject & err)
+  {
+    std::cout << "Caught expected error." << std::endl;
+    std::cout << err << std::endl;
+    passed = true;
+  }
+
+  if (!passed)
+  {
+    std::cout << "Test failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  //-------------------------------------------------------------
+  std::cout << "Run registration and warp moving" << std::endl;
+
+  function->SetStandardDeviations(2.0);
+  regFilter->Modified();
+  regFilter->Update();
+
+  using WarperType = itk::ContinuousBorderWarpImageFilter<ImageType, ImageType, FieldType>;
+  using InterpolatorType = itk::NearestNeighborInterpolateImageFunction<ImageType, WarperType::CoordRepType>;
+  WarperType::Pointer warper = WarperType::New();
+  warper->SetInput(moving);
+  warper->SetDisplacementField(regFilter->GetOutput());
+  warper->SetInterpolator(InterpolatorType::New());
+  warper->SetOutputParametersFromImage(fixed);
+  warper->SetEdgePaddingValue(bgnd);
+  warper->Update();
+
+  // ---------------------------------------------------------
+  std::cout << "Compare warped moving and fixed." << std::endl;
+
+  const unsigned int numPixelsDifferent = CountDifferentPixels<ImageType>(fixed, warper->GetOutput());
+  std::cout << "Number of pixels different: " << numPixelsDifferent << std::endl;
+
+  if (2 * numPixelsDifferent > numPixelsDifferentBefore)
+  {
+    std::cout << "Test failed - too many pixels different." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  //-------------------------------------------------------------
+  std::cout << "Compare with brute-force Gaussian weighted NCC" << std::endl;
+
+  if (!TestBruteForce())
+  {
+    std::cout << "Test failed - the Gaussian weighted sums differ from the brute-force sums." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  function->Print(std::cout);
+
+  std::cout << "Test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,244 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkVariationalRegistrationFilter.h"
+#include "itkVariationalDiffeomorphicRegistrationFilter.h"
+#include "itkVariationalSymmetricDiffeomorphicRegistrationFilter.h"
+#include "itkVariationalRegistrationDemonsFunction.h"
+#include "itkVariationalRegistrationElasticRegularizer.h"
+#include "itkVariationalRegistrationCurvatureRegularizer.h"
+
+#include "itkImageRegionIteratorWithIndex.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+constexpr unsigned int ImageDimension = 2;
+using ImageType = itk::Image<float, ImageDimension>;
+using VectorType = itk::Vector<float, ImageDimension>;
+using FieldType = itk::Image<VectorType, ImageDimension>;
+using RegularizerType = itk::VariationalRegistrationRegularizer<FieldType>;
+using RegistrationFilterType = itk::VariationalRegistrationFilter<ImageType, ImageType, FieldType>;
+
+// Registration filters with a different ApplyUpdate()
+enum class FilterKind
+{
+  Plain,
+  Diffeomorphic,
+  SymmetricDiffeomorphic
+};
+
+const char *
+GetFilterName(FilterKind kind)
+{
+  switch (kind)
+  {
+    case FilterKind::Diffeomorphic:
+      return "Diffeomorphic";
+    case FilterKind::SymmetricDiffeomorphic:
+      return "SymmetricDiffeomorphic";
+    default:
+      return "Plain";
+  }
+}
+
+// Fill an image with a smooth ellipse.
+void
+FillWithEllipse(ImageType * image, const double * center, const double * radius)
+{
+  for (itk::ImageRegionIteratorWithIndex<ImageType> it(image, image->GetBufferedRegion()); !it.IsAtEnd(); ++it)
+  {
+    double distance = 0;
+    for (unsigned int j = 0; j < ImageDimension; j++)
+    {
+      distance += itk::Math::sqr((it.GetIndex()[j] - center[j]) / radius[j]);
+    }
+    it.Set(static_cast<float>(200.0 / (1.0 + std::exp(8.0 * (std::sqrt(distance) - 1.0)))));
+  }
+}
+
+// Maximum absolute difference of the components of two fields.
+double
+MaximumDifference(const FieldType * field1, const FieldType * field2)
+{
+  itk::ImageRegionConstIterator<FieldType> it1(field1, field1->GetBufferedRegion());
+  itk::ImageRegionConstIterator<FieldType> it2(field2, field1->GetBufferedRegion());
+
+  double maximum = 0.0;
+  for (; !it1.IsAtEnd(); ++it1, ++it2)
+  {
+    for (unsigned int c = 0; c < ImageDimension; c++)
+    {
+      maximum = std::max(maximum, std::abs(static_cast<double>(it1.Get()[c]) - it2.Get()[c]));
+    }
+  }
+  return maximum;
+}
+
+// Maximum absolute component of a field.
+double
+MaximumComponent(const FieldType * field)
+{
+  double maximum = 0.0;
+  for (itk::ImageRegionConstIterator<FieldType> it(field, field->GetBufferedRegion()); !it.IsAtEnd(); ++it)
+  {
+    for (unsigned int c = 0; c < ImageDimension; c++)
+    {
+      maximum = std::max(maximum, std::abs(static_cast<double>(it.Get()[c])));
+    }
+  }
+  return maximum;
+}
+
+// Register the images with a demons function and return the filter.
+RegistrationFilterType::Pointer
+Register(const ImageType * fixed,
+         const ImageType * moving,
+         RegularizerType * regularizer,
+         FilterKind        kind,
+         bool              smoothUpdateField,
+         bool              useIncrementalRegularization)
+{
+  using FunctionType = itk::VariationalRegistrationDemonsFunction<ImageType, ImageType, FieldType>;
+  FunctionType::Pointer function = FunctionType::New();
+  function->SetGradientTypeToFixedImage();
+  function->SetTimeStep(1.0);
+
+  RegistrationFilterType::Pointer regFilter;
+  switch (kind)
+  {
+    case FilterKind::Diffeomorphic:
+      regFilter = itk::VariationalDiffeomorphicRegistrationFilter<ImageType, ImageType, FieldType>::New();
+      break;
+    case FilterKind::SymmetricDiffeomorphic:
+      regFilter = itk::VariationalSymmetricDiffeomorphicRegistrationFilter<ImageType, ImageType, FieldType>::New();
+      break;
+    default:
+      regFilter = RegistrationFilterType::New();
+      break;
+  }
+  regFilter->SetDifferenceFunction(function);
+  regFilter->SetRegularizer(regularizer);
+  regFilter->SetFixedImage(fixed);
+  regFilter->SetMovingImage(moving);
+  regFilter->SetNumberOfIterations(40);
+  regFilter->SetSmoothDisplacementField(true);
+  regFilter->SetSmoothUpdateField(smoothUpdateField);
+  regFilter->SetUseIncrementalRegularization(useIncrementalRegularization);
+  regFilter->Update();
+  return regFilter;
+}
+
+// Compare the incremental and the direct regularization for one regularizer
+// with each filter, with and without SmoothUpdateField. The output (the
+// velocity field of the diffeomorphic filters) and the displacement field are
+// compared.
+bool
+TestRegularizer(const ImageType * fixed, const ImageType * moving, RegularizerType * regularizer)
+{
+  std::cout << regularizer->GetNameOfClass() << std::endl;
+
+  bool passed = true;
+  for (const FilterKind kind : { FilterKind::Plain, FilterKind::Diffeomorphic, FilterKind::SymmetricDiffeomorphic })
+  {
+    for (const bool smoothUpdateField : { true, false })
+    {
+      RegistrationFilterType::Pointer direct = Register(fixed, moving, regularizer, kind, smoothUpdateField, false);
+      RegistrationFilterType::Pointer incremental = Register(fixed, moving, regularizer, kind, smoothUpdateField, true);
+
+      // The fields only differ by rounding errors, which are relative to the
+      // displacements
+      const double maximumDisplacement = MaximumComponent(direct->GetDisplacementField());
+      const double outputDifference = MaximumDifference(direct->GetOutput(), incremental->GetOutput());
+      const double displacementDifference =
+        MaximumDifference(direct->GetDisplacementField(), incremental->GetDisplacementField());
+      std::cout << "  " << GetFilterName(kind) << ", SmoothUpdateField " << smoothUpdateField
+                << ": maximum displacement " << maximumDisplacement << ", maximum difference " << outputDifference
+                << " (output), " << displacementDifference << " (displacement)" << std::endl;
+
+      if (maximumDisplacement < 0.1 || outputDifference > 1e-3 * maximumDisplacement ||
+          displacementDifference > 1e-3 * maximumDisplacement)
+      {
+        passed = false;
+      }
+    }
+  }
+  return passed;
+}
+} // namespace
+
+int
+VariationalRegistrationIncrementalRegularizationTest(int, char *[])
+{
+  //--------------------------------------------------------
+  std::cout << "Generate input images" << std::endl;
+
+  // Sizes with odd and prime factors
+  ImageType::RegionType region;
+  region.SetSize(0, 60);
+  region.SetSize(1, 54);
+
+  ImageType::Pointer fixed = ImageType::New();
+  fixed->SetRegions(region);
+  fixed->Allocate();
+
+  ImageType::Pointer moving = ImageType::New();
+  moving->SetRegions(region);
+  moving->Allocate();
+
+  const double fixedCenter[ImageDimension] = { 28, 27 };
+  const double fixedRadius[ImageDimension] = { 16, 13 };
+  FillWithEllipse(fixed, fixedCenter, fixedRadius);
+
+  const double movingCenter[ImageDimension] = { 31, 26 };
+  const double movingRadius[ImageDimension] = { 14, 14 };
+  FillWithEllipse(moving, movingCenter, movingRadius);
+
+  //--------------------------------------------------------
+  std::cout << "Compare incremental and direct regularization" << std::endl;
+
+  // Without padding, the incremental regularization only differs from the
+  // direct regularization by rounding errors
+  bool passed = true;
+
+  using ElasticRegularizerType = itk::VariationalRegistrationElasticRegularizer<FieldType>;
+  ElasticRegularizerType::Pointer elasticRegularizer = ElasticRegularizerType::New();
+  elasticRegularizer->SetMu(0.5);
+  elasticRegularizer->SetLambda(0.5);
+  elasticRegularizer->SetPlanRigor(ElasticRegularizerType::FFTBackendType::PlanEstimate);
+  elasticRegularizer->UsePaddingOff();
+  passed = TestRegularizer(fixed, moving, elasticRegularizer) && passed;
+
+  using CurvatureRegularizerType = itk::VariationalRegistrationCurvatureRegularizer<FieldType>;
+  CurvatureRegularizerType::Pointer curvatureRegularizer = CurvatureRegularizerType::New();
+  curvatureRegularizer->SetAlpha(0.5);
+  curvatureRegularizer->SetPlanRigor(CurvatureRegularizerType::FFTBackendType::PlanEstimate);
+  curvatureRegularizer->UsePaddingOff();
+  passed = TestRegularizer(fixed, moving, curvatureRegularizer) && passed;
+
+  if (!passed)
+  {
+    std::cout << "Test failed - incremental and direct regularization differ." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,404 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkVariationalRegistrationFilter.h"
+#include "itkVariationalRegistrationMIFunction.h"
+#include "itkVariationalRegistrationDiffusionRegularizer.h"
+#include "itkContinuousBorderWarpImageFilter.h"
+
+#include "itkNearestNeighborInterpolateImageFunction.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+// Fill an image with a circle.
+template <typename TImage>
+void
+FillWithCircle(TImage *                   image,
+               const double *             center,
+               double                     radius,
+               typename TImage::PixelType foregnd,
+               typename TImage::PixelType backgnd)
+{
+  const double r2 = itk::Math::sqr(radius);
+  for (itk::ImageRegionIteratorWithIndex<TImage> it(image, image->GetBufferedRegion()); !it.IsAtEnd(); ++it)
+  {
+    const typename TImage::IndexType index = it.GetIndex();
+    double                           distance = 0;
+    for (unsigned int j = 0; j < TImage::ImageDimension; j++)
+    {
+      distance += itk::Math::sqr(static_cast<double>(index[j]) - center[j]);
+    }
+    it.Set(distance <= r2 ? foregnd : backgnd);
+  }
+}
+
+// Count the pixels that differ in two images.
+template <typename TImage>
+unsigned int
+CountDifferentPixels(const TImage * image1, const TImage * image2)
+{
+  itk::ImageRegionConstIterator<TImage> it1(image1, image1->GetBufferedRegion());
+  itk::ImageRegionConstIterator<TImage> it2(image2, image1->GetBufferedRegion());
+
+  unsigned int numPixelsDifferent = 0;
+  for (; !it1.IsAtEnd(); ++it1, ++it2)
+  {
+    if (it1.Get() != it2.Get())
+    {
+      numPixelsDifferent++;
+    }
+  }
+  return numPixelsDifferent;
+}
+
+// Intensity range of an image in the joint histogram; the range is mapped to
+// the bins between two padding bins at each end.
+struct HistogramAxis
+{
+  double minimum;
+  double binWidth;
+};
+
+HistogramAxis
+ComputeHistogramAxis(const std::vector<double> & values, unsigned int numberOfBins)
+{
+  const auto range = std::minmax_element(values.begin(), values.end());
+  return { *range.first, (*range.second - *range.first) / static_cast<double>(numberOfBins - 4) };
+}
+
+// Cubic B-spline.
+double
+CubicBSpline(double x)
+{
+  const double absX = std::abs(x);
+  if (absX < 1.0)
+  {
+    return (4.0 - 6.0 * absX * absX + 3.0 * absX * absX * absX) / 6.0;
+  }
+  return (absX < 2.0) ? (2.0 - absX) * (2.0 - absX) * (2.0 - absX) / 6.0 : 0.0;
+}
+
+// Mutual information computed directly from the joint histogram, with a zero
+// order Parzen window for the fixed and a cubic B-spline Parzen window for
+// the moving intensities.
+double
+ComputeMutualInformation(const std::vector<double> & fixed,
+                         const std::vector<double> & moving,
+                         const HistogramAxis &       fixedAxis,
+                         const HistogramAxis &       movingAxis,
+                         unsigned int                numberOfBins)
+{
+  std::vector<double> joint(numberOfBins * numberOfBins, 0.0);
+  for (std::size_t k = 0; k < fixed.size(); k++)
+  {
+    const double fixedPosition = (fixed[k] - fixedAxis.minimum) / fixedAxis.binWidth + 2.0;
+    const auto   fixedBin = std::min(static_cast<unsigned int>(std::max(fixedPosition, 2.0)), numberOfBins - 3);
+    const double movingPosition =
+      std::min(std::max((moving[k] - movingAxis.minimum) / movingAxis.binWidth + 2.0, 2.0), numberOfBins - 2.0);
+    for (unsigned int j = 0; j < numberOfBins; j++)
+    {
+      joint[fixedBin * numberOfBins + j] += CubicBSpline(j - movingPosition) / fixed.size();
+    }
+  }
+
+  std::vector<double> fixedMarginal(numberOfBins, 0.0);
+  std::vector<double> movingMarginal(numberOfBins, 0.0);
+  for (unsigned int i = 0; i < numberOfBins; i++)
+  {
+    for (unsigned int j = 0; j < numberOfBins; j++)
+    {
+      fixedMarginal[i] += joint[i * numberOfBins + j];
+      movingMarginal[j] += joint[i * numberOfBins + j];
+    }
+  }
+
+  double mutualInformation = 0.0;
+  for (unsigned int i = 0; i < numberOfBins; i++)
+  {
+    for (unsigned int j = 0; j < numberOfBins; j++)
+    {
+      const double p = joint[i * numberOfBins + j];
+      if (p > 0.0)
+      {
+        mutualInformation += p * std::log(p / (fixedMarginal[i] * movingMarginal[j]));
+      }
+    }
+  }
+  return mutualInformation;
+}
+
+// Compare the metric and the forces of one iteration with the mutual
+// information computed directly from the joint histogram of a small image.
+// The metric is the negative mutual information, and the forces are the
+// derivative of the mutual information with respect to the warped image
+// intensities times the number of pixels and the fixed image gradient.
+bool
+TestMutualInformation()
+{
+  using FloatImageType = itk::Image<float, 2>;
+  using FloatFieldType = itk::Image<itk::Vector<float, 2>, 2>;
+  constexpr unsigned int numberOfBins = 16;
+
+  FloatImageType::RegionType region;
+  region.SetSize(0, 24);
+  region.SetSize(1, 20);
+
+  FloatImageType::Pointer fixed = FloatImageType::New();
+  fixed->SetRegions(region);
+  fixed->Allocate();
+
+  FloatImageType::Pointer moving = FloatImageType::New();
+  moving->SetRegions(region);
+  moving->Allocate();
+
+  // Smooth images with a nonlinear intensity relation and a local shift
+  const auto intensity = [](double x, double y) {
+    return 100.0 + 40.0 * std::sin(0.45 * x + 0.2) * std::cos(0.3 * y) + 0.2 * x * y;
+  };
+  for (itk::ImageRegionIteratorWithIndex<FloatImageType> it(fixed, region); !it.IsAtEnd(); ++it)
+  {
+    const double x = it.GetIndex()[0];
+    const double y = it.GetIndex()[1];
+    it.Set(static_cast<float>(intensity(x, y)));
+    moving->SetPixel(it.GetIndex(),
+                     static_cast<float>(0.01 * itk::Math::sqr(intensity(x + 0.7, y - 0.4)) + 5.0 * std::sin(0.9 * x)));
+  }
+
+  using FunctionType = itk::VariationalRegistrationMIFunction<FloatImageType, FloatImageType, FloatFieldType>;
+  FunctionType::Pointer function = FunctionType::New();
+  function->SetGradientTypeToFixedImage();
+  function->SetNumberOfHistogramBins(numberOfBins);
+  function->SetTimeStep(1.0);
+
+  // One iteration without regularization; the output is the update
+  using RegistrationFilterType = itk::VariationalRegistrationFilter<FloatImageType, FloatImageType, FloatFieldType>;
+  RegistrationFilterType::Pointer regFilter = RegistrationFilterType::New();
+  regFilter->SetDifferenceFunction(function);
+  regFilter->SetRegularizer(itk::VariationalRegistrationDiffusionRegularizer<FloatFieldType>::New());
+  regFilter->SetFixedImage(fixed);
+  regFilter->SetMovingImage(moving);
+  regFilter->SetNumberOfIterations(1);
+  regFilter->SetNumberOfWorkUnits(3);
+  regFilter->SmoothDisplacementFieldOff();
+  regFilter->SmoothUpdateFieldOff();
+  regFilter->Update();
+
+  const itk::SizeValueType  numberOfPixels = region.GetNumberOfPixels();
+  const std::vector<double> fixedValues(fixed->GetBufferPointer(), fixed->GetBufferPointer() + numberOfPixels);
+  std::vector<double>       movingValues(moving->GetBufferPointer(), moving->GetBufferPointer() + numberOfPixels);
+  const HistogramAxis       fixedAxis = ComputeHistogramAxis(fixedValues, numberOfBins);
+  const HistogramAxis       movingAxis = ComputeHistogramAxis(movingValues, numberOfBins);
+
+  const double mutualInformation =
+    ComputeMutualInformation(fixedValues, movingValues, fixedAxis, movingAxis, numberOfBins);
+  const double metricError = std::abs(function->GetMetric() + mutualInformation);
+  std::cout << "Metric " << function->GetMetric() << ", mutual information " << mutualInformation << std::endl;
+
+  // Central difference derivatives of the mutual information in the interior;
+  // the Parzen window positions of the minimum and maximum intensities are
+  // clamped, so these pixels are skipped.
+  constexpr double epsilon = 1e-3;
+  const double     movingMaximum = movingAxis.minimum + (numberOfBins - 4) * movingAxis.binWidth;
+  double           maximumDerivative = 0.0;
+  double           derivativeError = 0.0;
+  for (itk::ImageRegionConstIteratorWithIndex<FloatImageType> it(fixed, region); !it.IsAtEnd(); ++it)
+  {
+    const FloatImageType::IndexType index = it.GetIndex();
+    const double                    movingValue = moving->GetPixel(index);
+
+    bool skip = movingValue - movingAxis.minimum < epsilon || movingMaximum - movingValue < epsilon;
+
+    double       gradient[2];
+    unsigned int largest = 0;
+    for (unsigned int d = 0; d < 2; d++)
+    {
+      FloatImageType::IndexType next = index;
+      FloatImageType::IndexType previous = index;
+      next[d]++;
+      previous[d]--;
+      skip = skip || index[d] == 0 || next[d] == static_cast<itk::IndexValueType>(region.GetSize(d));
+      if (!skip)
+      {
+        gradient[d] = 0.5 * (fixed->GetPixel(next) - fixed->GetPixel(previous));
+        largest = (std::abs(gradient[d]) > std::abs(gradient[largest])) ? d : largest;
+      }
+    }
+    if (skip || std::abs(gradient[largest]) < 1.0)
+    {
+      continue;
+    }
+
+    const itk::OffsetValueType offset = fixed->ComputeOffset(index);
+    movingValues[offset] = movingValue + epsilon;
+    const double forward = ComputeMutualInformation(fixedValues, movingValues, fixedAxis, movingAxis, numberOfBins);
+    movingValues[offset] = movingValue - epsilon;
+    const double backward = ComputeMutualInformation(fixedValues, movingValues, fixedAxis, movingAxis, numberOfBins);
+    movingValues[offset] = movingValue;
+
+    const double expected = numberOfPixels * (forward - backward) / (2.0 * epsilon);
+    const double derivative = regFilter->GetOutput()->GetPixel(index)[largest] / gradient[largest];
+    maximumDerivative = std::max(maximumDerivative, std::abs(expected));
+    derivativeError = std::max(derivativeError, std::abs(derivative - expected));
+  }
+  std::cout << "Maximum derivative " << maximumDerivative << ", maximum error of the forces " << derivativeError
+            << std::endl;
+
+  return metricError < 1e-8 && maximumDerivative > 0.0 && derivativeError < 1e-4 * maximumDerivative;
+}
+} // namespace
+
+int
+VariationalRegistrationMIFunctionTest(int, char *[])
+{
+  constexpr unsigned int ImageDimension = 2;
+  using PixelType = unsigned char;
+  using ImageType = itk::Image<PixelType, ImageDimension>;
+  using VectorType = itk::Vector<float, ImageDimension>;
+  using FieldType = itk::Image<VectorType, ImageDimension>;
+
+  //--------------------------------------------------------
+  std::cout << "Generate input images" << std::endl;
+
+  ImageType::RegionType region;
+  region.SetSize(0, 128);
+  region.SetSize(1, 128);
+
+  ImageType::Pointer moving = ImageType::New();
+  moving->SetRegions(region);
+  moving->Allocate();
+
+  ImageType::Pointer fixed = ImageType::New();
+  fixed->SetRegions(region);
+  fixed->Allocate();
+
+  const PixelType fgnd = 250;
+  const PixelType bgnd = 15;
+
+  const double movingCenter[ImageDimension] = { 64, 64 };
+  FillWithCircle<ImageType>(moving, movingCenter, 30, fgnd, bgnd);
+
+  const double fixedCenter[ImageDimension] = { 62, 64 };
+  FillWithCircle<ImageType>(fixed, fixedCenter, 32, fgnd, bgnd);
+
+  const unsigned int numPixelsDifferentBefore = CountDifferentPixels<ImageType>(fixed, moving);
+  std::cout << "Number of pixels different before registration: " << numPixelsDifferentBefore << std::endl;
+
+  //-------------------------------------------------------------
+  std::cout << "Run registration and warp moving" << std::endl;
+
+  using FunctionType = itk::VariationalRegistrationMIFunction<ImageType, ImageType, FieldType>;
+  FunctionType::Pointer function = FunctionType::New();
+  function->SetGradientTypeToSymmetric();
+  function->SetNumberOfHistogramBins(16);
+  function->SetTimeStep(0.05);
+
+  using RegularizerType = itk::VariationalRegistrationDiffusionRegularizer<FieldType>;
+  RegularizerType::Pointer regularizer = RegularizerType::New();
+  regularizer->SetAlpha(1.5);
+
+  using RegistrationFilterType = itk::VariationalRegistrationFilter<ImageType, ImageType, FieldType>;
+  RegistrationFilterType::Pointer regFilter = RegistrationFilterType::New();
+  regFilter->SetDifferenceFunction(function);
+  regFilter->SetRegularizer(regularizer);
+  regFilter->SetFixedImage(fixed);
+  regFilter->SetMovingImage(moving);
+  regFilter->SetNumberOfIterations(100);
+  regFilter->SetNumberOfWorkUnits(4);
+  regFilter->Update();
+
+  FieldType::Pointer field = regFilter->GetOutput();
+  field->DisconnectPipeline();
+
+  using WarperType = itk::ContinuousBorderWarpImageFilter<ImageType, ImageType, FieldType>;
+  using InterpolatorType = itk::NearestNeighborInterpolateImageFunction<ImageType, WarperType::CoordRepType>;
+  WarperType::Pointer warper = WarperType::New();
+  warper->SetInput(moving);
+  warper->SetDisplacementField(field);
+  warper->SetInterpolator(InterpolatorType::New());
+  warper->SetOutputParametersFromImage(fixed);
+  warper->SetEdgePaddingValue(bgnd);
+  warper->Update();
+
+  // ---------------------------------------------------------
+  std::cout << "Compare warped moving and fixed." << std::endl;
+
+  const unsigned int numPixelsDifferent = CountDifferentPixels<ImageType>(fixed, warper->GetOutput());
+  std::cout << "Number of pixels different: " << numPixelsDifferent << std::endl;
+
+  if (2 * numPixelsDifferent > numPixelsDifferentBefore)
+  {
+    std::cout << "Test failed - too many pixels different." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // ---------------------------------------------------------
+  std::cout << "Test that a second run with the same function gives the same result." << std::endl;
+
+  // The histograms of the work units are kept between the iterations and
+  // have to be cleared for each iteration.
+  regFilter->Modified();
+  regFilter->Update();
+
+  itk::ImageRegionConstIterator<FieldType> fieldIt(field, region);
+  itk::ImageRegionConstIterator<FieldType> secondFieldIt(regFilter->GetOutput(), region);
+  for (; !fieldIt.IsAtEnd(); ++fieldIt, ++secondFieldIt)
+  {
+    if (fieldIt.Get() != secondFieldIt.Get())
+    {
+      std::cout << "Test failed - displacement fields differ at " << fieldIt.GetIndex() << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // ---------------------------------------------------------
+  std::cout << "Test a different number of work units." << std::endl;
+
+  regFilter->SetNumberOfWorkUnits(1);
+  regFilter->Update();
+
+  warper->SetDisplacementField(regFilter->GetOutput());
+  warper->Update();
+
+  const unsigned int numPixelsDifferentSingleThreaded = CountDifferentPixels<ImageType>(fixed, warper->GetOutput());
+  std::cout << "Number of pixels different: " << numPixelsDifferentSingleThreaded << std::endl;
+
+  if (2 * numPixelsDifferentSingleThreaded > numPixelsDifferentBefore)
+  {
+    std::cout << "Test failed - too many pixels different." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // ---------------------------------------------------------
+  std::cout << "Compare with the directly computed mutual information." << std::endl;
+
+  if (!TestMutualInformation())
+  {
+    std::cout << "Test failed - metric or forces differ from the mutual information." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  function->Print(std::cout);
+
+  std::cout << "Test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,265 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkVariationalRegistrationMultigridRegularizer.h"
+#include "itkVariationalRegistrationDiffusionRegularizer.h"
+#include "itkVariationalRegistrationCurvatureRegularizer.h"
+
+#include "itkImageRegionIteratorWithIndex.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Maximum absolute difference of the components of two fields.
+template <typename TField>
+double
+MaximumDifference(const TField * field1, const TField * field2)
+{
+  itk::ImageRegionConstIterator<TField> it1(field1, field1->GetBufferedRegion());
+  itk::ImageRegionConstIterator<TField> it2(field2, field1->GetBufferedRegion());
+
+  double maximum = 0.0;
+  for (; !it1.IsAtEnd(); ++it1, ++it2)
+  {
+    for (unsigned int c = 0; c < TField::ImageDimension; c++)
+    {
+      maximum = std::max(maximum, std::abs(static_cast<double>(it1.Get()[c]) - it2.Get()[c]));
+    }
+  }
+  return maximum;
+}
+
+// Compare the multigrid curvature regularization of a 3D field to the
+// curvature regularizer.
+bool
+TestCurvature3D()
+{
+  constexpr unsigned int ImageDimension = 3;
+  using VectorType = itk::Vector<float, ImageDimension>;
+  using FieldType = itk::Image<VectorType, ImageDimension>;
+
+  constexpr itk::SizeValueType size = 32;
+
+  FieldType::RegionType region;
+  region.SetSize(0, size);
+  region.SetSize(1, size);
+  region.SetSize(2, size);
+
+  FieldType::Pointer field = FieldType::New();
+  field->SetRegions(region);
+  field->Allocate();
+
+  // A Gaussian bump and slowly varying waves
+  double maximumInput = 0.0;
+  for (itk::ImageRegionIteratorWithIndex<FieldType> it(field, region); !it.IsAtEnd(); ++it)
+  {
+    const double x = it.GetIndex()[0];
+    const double y = it.GetIndex()[1];
+    const double z = it.GetIndex()[2];
+    const double bump =
+      std::exp(-(itk::Math::sqr(x - 12.8) + itk::Math::sqr(y - 19.2) + itk::Math::sqr(z - 14.4)) / 128.0);
+
+    VectorType value;
+    value[0] = 2.0 * bump + 0.5 * std::cos(itk::Math::pi * x / size);
+    value[1] = -bump * std::sin(itk::Math::pi * y / size);
+    value[2] = bump * std::cos(itk::Math::pi * z / size);
+    it.Set(value);
+
+    for (unsigned int c = 0; c < ImageDimension; c++)
+    {
+      maximumInput = std::max(maximumInput, std::abs(static_cast<double>(value[c])));
+    }
+  }
+
+  using MultigridRegularizerType = itk::VariationalRegistrationMultigridRegularizer<FieldType>;
+  MultigridRegularizerType::Pointer multigrid = MultigridRegularizerType::New();
+  multigrid->SetOperatorToCurvature();
+  multigrid->SetAlpha(1.0);
+  multigrid->InPlaceOff();
+  multigrid->SetInput(field);
+  multigrid->Update();
+
+  using CurvatureRegularizerType = itk::VariationalRegistrationCurvatureRegularizer<FieldType>;
+  CurvatureRegularizerType::Pointer curvature = CurvatureRegularizerType::New();
+  curvature->SetAlpha(1.0);
+  curvature->InPlaceOff();
+  curvature->SetInput(field);
+  curvature->Update();
+
+  // The eigenvalues of the curvature regularizer are shifted by one
+  // frequency, which matters more on this smaller grid than in 2D. The
+  // measured difference is 1.4% of the maximum input.
+  const double difference = MaximumDifference<FieldType>(multigrid->GetOutput(), curvature->GetOutput());
+  std::cout << "Cycles: " << multigrid->GetElapsedCycles() << "  Maximum difference: " << difference << std::endl;
+  return difference <= 0.03 * maximumInput;
+}
+} // namespace
+
+int
+VariationalRegistrationMultigridRegularizerTest(int, char *[])
+{
+  constexpr unsigned int ImageDimension = 2;
+  using VectorType = itk::Vector<float, ImageDimension>;
+  using FieldType = itk::Image<VectorType, ImageDimension>;
+
+  //--------------------------------------------------------
+  std::cout << "Generate smooth input field" << std::endl;
+
+  constexpr itk::SizeValueType size = 64;
+
+  FieldType::RegionType region;
+  region.SetSize(0, size);
+  region.SetSize(1, size);
+
+  FieldType::Pointer field = FieldType::New();
+  field->SetRegions(region);
+  field->Allocate();
+
+  // A Gaussian bump and slowly varying waves
+  double maximumInput = 0.0;
+  for (itk::ImageRegionIteratorWithIndex<FieldType> it(field, region); !it.IsAtEnd(); ++it)
+  {
+    const double x = it.GetIndex()[0];
+    const double y = it.GetIndex()[1];
+    const double bump = std::exp(-(itk::Math::sqr(x - 24.0) + itk::Math::sqr(y - 36.0)) / 128.0);
+
+    VectorType value;
+    value[0] = 2.0 * bump + 0.5 * std::cos(itk::Math::pi * x / size);
+    value[1] = -bump * std::sin(itk::Math::pi * y / size);
+    it.Set(value);
+
+    maximumInput = std::max(maximumInput, std::abs(static_cast<double>(value[0])));
+    maximumInput = std::max(maximumInput, std::abs(static_cast<double>(value[1])));
+  }
+
+  // The multigrid regularizer solves the systems without operator splitting
+  // (diffusion) and with the eigenvalues of the Neumann boundary conditions
+  // (curvature), so the results only agree within a tolerance. The measured
+  // differences are 0.12% (diffusion) and 0.25% (curvature) of the maximum
+  // input.
+  const double tolerance = 0.01 * maximumInput;
+  const double alpha = 1.0;
+
+  using MultigridRegularizerType = itk::VariationalRegistrationMultigridRegularizer<FieldType>;
+
+  //--------------------------------------------------------
+  std::cout << "Compare diffusive regularization" << std::endl;
+
+  MultigridRegularizerType::Pointer multigrid = MultigridRegularizerType::New();
+  multigrid->SetOperatorToDiffusion();
+  multigrid->SetAlpha(alpha);
+  multigrid->InPlaceOff();
+  multigrid->SetInput(field);
+  multigrid->Update();
+
+  using DiffusionRegularizerType = itk::VariationalRegistrationDiffusionRegularizer<FieldType>;
+  DiffusionRegularizerType::Pointer diffusion = DiffusionRegularizerType::New();
+  diffusion->SetAlpha(alpha);
+  diffusion->InPlaceOff();
+  diffusion->SetInput(field);
+  diffusion->Update();
+
+  double difference = MaximumDifference<FieldType>(multigrid->GetOutput(), diffusion->GetOutput());
+  std::cout << "Cycles: " << multigrid->GetElapsedCycles() << "  Maximum difference: " << difference << std::endl;
+  if (difference > tolerance)
+  {
+    std::cout << "Test failed - multigrid and diffusion regularizer differ." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  //--------------------------------------------------------
+  std::cout << "Test warm start" << std::endl;
+
+  // The solution of the last call already satisfies the tolerance
+  multigrid->Modified();
+  multigrid->Update();
+  std::cout << "Cycles: " << multigrid->GetElapsedCycles() << std::endl;
+  if (multigrid->GetElapsedCycles() != 0)
+  {
+    std::cout << "Test failed - warm start needs further cycles." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The registration filter alternately regularizes the update field and the
+  // displacement field, so the solutions of both inputs are kept.
+  FieldType::Pointer otherField = FieldType::New();
+  otherField->SetRegions(region);
+  otherField->Allocate();
+  for (itk::ImageRegionIteratorWithIndex<FieldType> it(otherField, region); !it.IsAtEnd(); ++it)
+  {
+    const VectorType value = field->GetPixel(it.GetIndex());
+    VectorType       otherValue;
+    otherValue[0] = value[1];
+    otherValue[1] = -value[0];
+    it.Set(otherValue);
+  }
+
+  multigrid->SetInput(otherField);
+  multigrid->Update();
+  const unsigned int otherCycles = multigrid->GetElapsedCycles();
+  multigrid->SetInput(field);
+  multigrid->Update();
+  const unsigned int firstRepeatCycles = multigrid->GetElapsedCycles();
+  multigrid->SetInput(otherField);
+  multigrid->Update();
+  std::cout << "Cycles of alternating inputs: " << otherCycles << ", " << firstRepeatCycles << ", "
+            << multigrid->GetElapsedCycles() << std::endl;
+  if (otherCycles == 0 || firstRepeatCycles != 0 || multigrid->GetElapsedCycles() != 0)
+  {
+    std::cout << "Test failed - warm start of alternating inputs needs further cycles." << std::endl;
+    return EXIT_FAILURE;
+  }
+  multigrid->SetInput(field);
+
+  //--------------------------------------------------------
+  std::cout << "Compare curvature regularization" << std::endl;
+
+  multigrid->SetOperatorToCurvature();
+  multigrid->Update();
+
+  using CurvatureRegularizerType = itk::VariationalRegistrationCurvatureRegularizer<FieldType>;
+  CurvatureRegularizerType::Pointer curvature = CurvatureRegularizerType::New();
+  curvature->SetAlpha(alpha);
+  curvature->InPlaceOff();
+  curvature->SetInput(field);
+  curvature->Update();
+
+  difference = MaximumDifference<FieldType>(multigrid->GetOutput(), curvature->GetOutput());
+  std::cout << "Cycles: " << multigrid->GetElapsedCycles() << "  Maximum difference: " << difference << std::endl;
+  if (difference > tolerance)
+  {
+    std::cout << "Test failed - multigrid and curvature regularizer differ." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  //--------------------------------------------------------
+  std::cout << "Compare curvature regularization in 3D" << std::endl;
+
+  if (!TestCurvature3D())
+  {
+    std::cout << "Test failed - multigrid and curvature regularizer differ in 3D." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  multigrid->Print(std::cout);
+
+  std::cout << "Test passed" << std::endl;
+  return EXIT_SUCCESS;
+}